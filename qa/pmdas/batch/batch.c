@@ -0,0 +1,237 @@
+/*
+ * batch PMDA ... the same values from a batch fetch callback and from
+ * a per-instance fetch callback, for QA
+ *
+ * Copyright (c) 2026 Red Hat.  All Rights Reserved.
+ */
+
+#include <pcp/pmapi.h>
+#include <pcp/impl.h>
+#include <pcp/pmda.h>
+#include "domain.h"
+
+#define NUMINST	10
+
+static pmdaInstid insts[NUMINST] = {
+    { 0, "i0" }, { 1, "i1" }, { 2, "i2" }, { 3, "i3" }, { 4, "i4" },
+    { 5, "i5" }, { 6, "i6" }, { 7, "i7" }, { 8, "i8" }, { 9, "i9" }
+};
+
+static pmdaIndom indoms[] = {
+    { 0, NUMINST, insts }
+};
+
+static pmdaMetric metrics[] = {
+/* u32 */
+    { NULL,
+      { PMDA_PMID(0,0), PM_TYPE_U32, 0, PM_SEM_INSTANT,
+        PMDA_PMUNITS(0, 0, 0, 0, 0, 0) } },
+/* u64 */
+    { NULL,
+      { PMDA_PMID(0,1), PM_TYPE_U64, 0, PM_SEM_INSTANT,
+        PMDA_PMUNITS(0, 0, 0, 0, 0, 0) } },
+/* float */
+    { NULL,
+      { PMDA_PMID(0,2), PM_TYPE_FLOAT, 0, PM_SEM_INSTANT,
+        PMDA_PMUNITS(0, 0, 0, 0, 0, 0) } },
+/* double */
+    { NULL,
+      { PMDA_PMID(0,3), PM_TYPE_DOUBLE, PM_INDOM_NULL, PM_SEM_INSTANT,
+        PMDA_PMUNITS(0, 0, 0, 0, 0, 0) } },
+/* string */
+    { NULL,
+      { PMDA_PMID(0,4), PM_TYPE_STRING, 0, PM_SEM_DISCRETE,
+        PMDA_PMUNITS(0, 0, 0, 0, 0, 0) } },
+/* dynstring */
+    { NULL,
+      { PMDA_PMID(0,5), PM_TYPE_STRING, 0, PM_SEM_DISCRETE,
+        PMDA_PMUNITS(0, 0, 0, 0, 0, 0) } },
+/* aggregate */
+    { NULL,
+      { PMDA_PMID(0,6), PM_TYPE_AGGREGATE, 0, PM_SEM_DISCRETE,
+        PMDA_PMUNITS(0, 0, 0, 0, 0, 0) } },
+/* dynaggregate */
+    { NULL,
+      { PMDA_PMID(0,7), PM_TYPE_AGGREGATE, 0, PM_SEM_DISCRETE,
+        PMDA_PMUNITS(0, 0, 0, 0, 0, 0) } },
+/* staticaggregate */
+    { NULL,
+      { PMDA_PMID(0,8), PM_TYPE_AGGREGATE_STATIC, 0, PM_SEM_DISCRETE,
+        PMDA_PMUNITS(0, 0, 0, 0, 0, 0) } },
+/* bigstring */
+    { NULL,
+      { PMDA_PMID(0,9), PM_TYPE_STRING, PM_INDOM_NULL, PM_SEM_DISCRETE,
+        PMDA_PMUNITS(0, 0, 0, 0, 0, 0) } },
+/* sparse */
+    { NULL,
+      { PMDA_PMID(0,10), PM_TYPE_U32, 0, PM_SEM_INSTANT,
+        PMDA_PMUNITS(0, 0, 0, 0, 0, 0) } },
+/* novalues */
+    { NULL,
+      { PMDA_PMID(0,11), PM_TYPE_U32, 0, PM_SEM_INSTANT,
+        PMDA_PMUNITS(0, 0, 0, 0, 0, 0) } },
+/* insterr */
+    { NULL,
+      { PMDA_PMID(0,12), PM_TYPE_32, 0, PM_SEM_INSTANT,
+        PMDA_PMUNITS(0, 0, 0, 0, 0, 0) } },
+/* lasterr */
+    { NULL,
+      { PMDA_PMID(0,13), PM_TYPE_32, 0, PM_SEM_INSTANT,
+        PMDA_PMUNITS(0, 0, 0, 0, 0, 0) } },
+/* fail */
+    { NULL,
+      { PMDA_PMID(0,14), PM_TYPE_U32, 0, PM_SEM_INSTANT,
+        PMDA_PMUNITS(0, 0, 0, 0, 0, 0) } },
+};
+
+static pmValueBlock	*aggr[NUMINST];
+static char		bigstring[512];
+
+/*
+ * callback provided to pmdaFetch, and used for each instance by the
+ * batch fetch callback
+ */
+static int
+batch_fetchCallBack(pmdaMetric *mdesc, unsigned int inst, pmAtomValue *atom)
+{
+    __pmID_int		*idp = (__pmID_int *)&(mdesc->m_desc.pmid);
+    char		buf[32];
+
+    if (idp->cluster != 0)
+	return PM_ERR_PMID;
+    if (mdesc->m_desc.indom == PM_INDOM_NULL) {
+	if (inst != PM_IN_NULL)
+	    return PM_ERR_INST;
+    }
+    else if (inst >= NUMINST)
+	return PM_ERR_INST;
+
+    switch (idp->item) {
+	case 0:		/* u32 */
+	    atom->ul = 10 * inst + 1;
+	    break;
+	case 1:		/* u64 */
+	    atom->ull = ((__uint64_t)1 << 40) + inst;
+	    break;
+	case 2:		/* float */
+	    atom->f = inst / 4.0;
+	    break;
+	case 3:		/* double */
+	    atom->d = 3.25;
+	    break;
+	case 4:		/* string */
+	    atom->cp = insts[inst].i_name;
+	    break;
+	case 5:		/* dynstring */
+	    snprintf(buf, sizeof(buf), "dynamic string %u", inst);
+	    if ((atom->cp = strdup(buf)) == NULL)
+		return -oserror();
+	    return PMDA_FETCH_DYNAMIC;
+	case 6:		/* aggregate */
+	    atom->vbp = aggr[inst];
+	    break;
+	case 7:		/* dynaggregate */
+	    if ((atom->vbp = (pmValueBlock *)malloc(aggr[inst]->vlen)) == NULL)
+		return -oserror();
+	    memcpy(atom->vbp, aggr[inst], aggr[inst]->vlen);
+	    return PMDA_FETCH_DYNAMIC;
+	case 8:		/* staticaggregate */
+	    atom->vbp = aggr[inst];
+	    break;
+	case 9:		/* bigstring */
+	    atom->cp = bigstring;
+	    break;
+	case 10:	/* sparse */
+	    if (inst % 2)
+		return PMDA_FETCH_NOVALUES;
+	    atom->ul = inst;
+	    break;
+	case 11:	/* novalues */
+	    return PMDA_FETCH_NOVALUES;
+	case 12:	/* insterr */
+	    if (inst == 3)
+		return PM_ERR_VALUE;
+	    if (inst == 6)
+		return PM_ERR_AGAIN;
+	    atom->l = -(int)inst;
+	    break;
+	case 13:	/* lasterr ... no values, and the last instance has none */
+	    if (inst == 9)
+		return PMDA_FETCH_NOVALUES;
+	    return PM_ERR_AGAIN;
+	case 14:	/* fail */
+	    return PM_ERR_AGAIN;
+	default:
+	    return PM_ERR_PMID;
+    }
+    return PMDA_FETCH_STATIC;
+}
+
+/*
+ * callback provided to pmdaFetch for batch_init
+ */
+static int
+batch_fetchBatchCallBack(pmdaMetric *mdesc, pmdaFetchBatch *batch)
+{
+    __pmID_int		*idp = (__pmID_int *)&(mdesc->m_desc.pmid);
+    pmAtomValue		atom;
+    int			i;
+    int			sts;
+
+    if (idp->cluster == 0 && idp->item == 14)	/* fail */
+	return PM_ERR_AGAIN;
+    for (i = 0; i < batch->numinst; i++) {
+	sts = batch_fetchCallBack(mdesc, batch->instlist[i], &atom);
+	if (sts == PM_ERR_PMID)
+	    return sts;
+	pmdaFetchBatchValue(batch, i, sts, &atom);
+    }
+    return 0;
+}
+
+static void
+setup(pmdaInterface *dp, char *name)
+{
+    int		i;
+
+    pmdaDSO(dp, PMDA_INTERFACE_7, name, NULL);
+    if (dp->status != 0)
+	return;
+
+    pmdaSetFetchCallBack(dp, batch_fetchCallBack);
+    pmdaInit(dp, indoms, sizeof(indoms)/sizeof(indoms[0]),
+		metrics, sizeof(metrics)/sizeof(metrics[0]));
+
+    /* a different length for each instance, odd and even */
+    for (i = 0; i < NUMINST; i++) {
+	if (aggr[i] != NULL)
+	    continue;
+	aggr[i] = (pmValueBlock *)malloc(PM_VAL_HDR_SIZE + i + 1);
+	if (aggr[i] == NULL) {
+	    fprintf(stderr, "%s: malloc failed: %s\n", name, pmErrStr(-errno));
+	    exit(1);
+	}
+	aggr[i]->vtype = PM_TYPE_AGGREGATE;
+	aggr[i]->vlen = PM_VAL_HDR_SIZE + i + 1;
+	memset(aggr[i]->vbuf, 'a' + i, i + 1);
+    }
+    for (i = 0; i < sizeof(bigstring) - 1; i++)
+	bigstring[i] = 'A' + i % 26;
+}
+
+/* Initialise the DSO agent, values from the batch fetch callback */
+void
+batch_init(pmdaInterface *dp)
+{
+    setup(dp, "batch DSO");
+    if (dp->status != 0)
+	return;
+    pmdaSetFetchBatchCallBack(dp, batch_fetchBatchCallBack);
+}
+
+/* Initialise the DSO agent, values from the per-instance fetch callback */
+void
+perinst_init(pmdaInterface *dp)
+{
+    setup(dp, "perinst DSO");
+}
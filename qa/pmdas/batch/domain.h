@@ -0,0 +1,2 @@
+/* reuse the QA BROKEN domain id */
+#define BATCH 249
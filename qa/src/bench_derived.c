@@ -0,0 +1,268 @@
+/*
+ * Copyright (c) 2026 Red Hat.
+ *
+ * Micro-benchmark for derived metric evaluation ... the compiled
+ * vector evaluator against the recursive tree walk (selected with
+ * PCP_DERIVED_NOCOMPILE), over synthetic pmResults with many instances
+ * for the operand metrics.  Operand descriptors come from an archive
+ * with kernel.percpu.cpu.* metrics, e.g. archives/20041125.
+ */
+
+#include <pcp/pmapi.h>
+#include <pcp/impl.h>
+
+static char	*exprs[][2] = {
+    { "bench.busy",	"kernel.percpu.cpu.user + kernel.percpu.cpu.sys" },
+    { "bench.frac",	"rate(kernel.percpu.cpu.user) / (rate(kernel.percpu.cpu.user) + rate(kernel.percpu.cpu.idle))" },
+    { "bench.util",	"100 * (rate(kernel.percpu.cpu.user) + rate(kernel.percpu.cpu.sys))" },
+    { "bench.delta",	"delta(kernel.percpu.cpu.idle)" },
+    { "bench.sum",	"sum(kernel.percpu.cpu.user)" },
+    { "bench.avg",	"avg(kernel.percpu.cpu.sys)" },
+    { "bench.max",	"max(kernel.percpu.cpu.idle)" },
+    { "bench.min",	"min(kernel.percpu.cpu.idle)" },
+    { "bench.count",	"count(kernel.percpu.cpu.user)" },
+};
+#define NEXPR (sizeof(exprs) / sizeof(exprs[0]))
+
+static int	ninst = 4096;
+static int	nloop = 500;
+
+/*
+ * fabricate the result PMCD would return for list[], with ninst
+ * instances of each non-derived metric, as counters that advance by a
+ * different amount per instance
+ */
+static pmResult *
+fake_result(int n, pmID *list, int iter)
+{
+    pmResult	*rp;
+    pmValueSet	*vsp;
+    int		i;
+    int		j;
+
+    rp = (pmResult *)malloc(sizeof(pmResult) + (n - 1) * sizeof(pmValueSet *));
+    if (rp == NULL) {
+	fprintf(stderr, "fake_result: malloc failed\n");
+	exit(1);
+    }
+    rp->timestamp.tv_sec = 1000000000 + iter;
+    rp->timestamp.tv_usec = 0;
+    rp->numpmid = n;
+    for (i = 0; i < n; i++) {
+	if (IS_DERIVED(list[i])) {
+	    vsp = (pmValueSet *)malloc(sizeof(pmValueSet));
+	    vsp->numval = PM_ERR_PMID;
+	}
+	else {
+	    vsp = (pmValueSet *)malloc(sizeof(pmValueSet) + (ninst - 1) * sizeof(pmValue));
+	    if (vsp == NULL) {
+		fprintf(stderr, "fake_result: malloc failed\n");
+		exit(1);
+	    }
+	    vsp->numval = ninst;
+	    vsp->valfmt = PM_VAL_INSITU;
+	    for (j = 0; j < ninst; j++) {
+		vsp->vlist[j].inst = j;
+		vsp->vlist[j].value.lval = (iter + 1) * (((j + i) % 13) + 1) * 10;
+	    }
+	}
+	vsp->pmid = list[i];
+	rp->vset[i] = vsp;
+    }
+    return rp;
+}
+
+/*
+ * run nloop fetches through the derived metric post-processing and
+ * return the evaluation time in seconds; the last result is kept
+ */
+static double
+run(char *archive, pmID *pmids, pmResult **last)
+{
+    __pmContext		*ctxp;
+    pmID		*newlist;
+    pmResult		*rp;
+    struct timeval	start;
+    struct timeval	end;
+    double		elapsed = 0;
+    char		*names[NEXPR];
+    int			ctx;
+    int			n;
+    int			i;
+    int			sts;
+
+    if ((ctx = pmNewContext(PM_CONTEXT_ARCHIVE, archive)) < 0) {
+	fprintf(stderr, "pmNewContext(%s): %s\n", archive, pmErrStr(ctx));
+	exit(1);
+    }
+    for (i = 0; i < NEXPR; i++)
+	names[i] = exprs[i][0];
+    if ((sts = pmLookupName(NEXPR, names, pmids)) < 0) {
+	fprintf(stderr, "pmLookupName: %s\n", pmErrStr(sts));
+	exit(1);
+    }
+    if ((ctxp = __pmHandleToPtr(ctx)) == NULL) {
+	fprintf(stderr, "__pmHandleToPtr(%d) failed\n", ctx);
+	exit(1);
+    }
+    PM_UNLOCK(ctxp->c_lock);
+
+    *last = NULL;
+    for (i = 0; i < nloop; i++) {
+	newlist = NULL;
+	n = __pmPrepareFetch(ctxp, NEXPR, pmids, &newlist);
+	if (n <= 0) {
+	    fprintf(stderr, "__pmPrepareFetch: no derived metrics?\n");
+	    exit(1);
+	}
+	rp = fake_result(n, newlist != NULL ? newlist : pmids, i);
+	if (newlist != NULL)
+	    free(newlist);
+	__pmtimevalNow(&start);
+	__pmFinishResult(ctxp, n, &rp);
+	__pmtimevalNow(&end);
+	elapsed += __pmtimevalSub(&end, &start);
+	if (*last != NULL)
+	    pmFreeResult(*last);
+	*last = rp;
+    }
+    pmDestroyContext(ctx);
+    return elapsed;
+}
+
+/* compare the values from the two evaluators, bit for bit */
+static int
+compare(pmResult *a, pmResult *b)
+{
+    pmValueSet	*va;
+    pmValueSet	*vb;
+    int		bad = 0;
+    int		i;
+    int		j;
+    int		len;
+
+    for (i = 0; i < a->numpmid; i++) {
+	va = a->vset[i];
+	vb = b->vset[i];
+	if (va->numval != vb->numval) {
+	    printf("%s: numval %d vs %d\n", exprs[i][0], va->numval, vb->numval);
+	    bad++;
+	    continue;
+	}
+	if (va->numval > 0 && va->valfmt != vb->valfmt) {
+	    printf("%s: valfmt %d vs %d\n", exprs[i][0], va->valfmt, vb->valfmt);
+	    bad++;
+	    continue;
+	}
+	for (j = 0; j < va->numval; j++) {
+	    if (va->vlist[j].inst != vb->vlist[j].inst) {
+		printf("%s[%d]: inst %d vs %d\n", exprs[i][0], j,
+			va->vlist[j].inst, vb->vlist[j].inst);
+		bad++;
+		break;
+	    }
+	    if (va->valfmt == PM_VAL_INSITU) {
+		if (va->vlist[j].value.lval == vb->vlist[j].value.lval)
+		    continue;
+	    }
+	    else {
+		len = va->vlist[j].value.pval->vlen;
+		if (len == vb->vlist[j].value.pval->vlen &&
+		    memcmp(va->vlist[j].value.pval, vb->vlist[j].value.pval, len) == 0)
+		    continue;
+	    }
+	    printf("%s[%d]: values differ\n", exprs[i][0], j);
+	    bad++;
+	    break;
+	}
+    }
+    return bad;
+}
+
+int
+main(int argc, char **argv)
+{
+    int		c;
+    int		i;
+    int		sts;
+    int		errflag = 0;
+    char	*errmsg;
+    char	*archive = "archives/20041125";
+    pmID	pmids[NEXPR];
+    pmResult	*tree;
+    pmResult	*vector;
+    double	t_tree;
+    double	t_vector;
+
+    __pmSetProgname(argv[0]);
+
+    while ((c = getopt(argc, argv, "a:D:i:n:")) != EOF) {
+	switch (c) {
+
+	case 'a':	/* archive for the operand metadata */
+	    archive = optarg;
+	    break;
+
+	case 'D':	/* debug flag */
+	    sts = __pmParseDebug(optarg);
+	    if (sts < 0) {
+		fprintf(stderr, "%s: unrecognized debug flag specification (%s)\n",
+		    pmProgname, optarg);
+		errflag++;
+	    }
+	    else
+		pmDebug |= sts;
+	    break;
+
+	case 'i':	/* instances per operand */
+	    ninst = atoi(optarg);
+	    if (ninst < 1) {
+		fprintf(stderr, "%s: -i requires a positive count\n", pmProgname);
+		errflag++;
+	    }
+	    break;
+
+	case 'n':	/* fetches per evaluator */
+	    nloop = atoi(optarg);
+	    if (nloop < 1) {
+		fprintf(stderr, "%s: -n requires a positive count\n", pmProgname);
+		errflag++;
+	    }
+	    break;
+
+	case '?':
+	default:
+	    errflag++;
+	    break;
+	}
+    }
+
+    if (errflag || optind != argc) {
+	fprintf(stderr, "Usage: %s [-D debug] [-a archive] [-i instances] [-n fetches]\n", pmProgname);
+	exit(1);
+    }
+
+    for (i = 0; i < NEXPR; i++) {
+	if ((errmsg = pmRegisterDerived(exprs[i][0], exprs[i][1])) != NULL) {
+	    fprintf(stderr, "pmRegisterDerived(%s): %s\n", exprs[i][0], errmsg);
+	    exit(1);
+	}
+    }
+
+    setenv("PCP_DERIVED_NOCOMPILE", "1", 1);
+    t_tree = run(archive, pmids, &tree);
+    unsetenv("PCP_DERIVED_NOCOMPILE");
+    t_vector = run(archive, pmids, &vector);
+
+    printf("%d derived metrics, %d instances, %d fetches\n", (int)NEXPR, ninst, nloop);
+    printf("tree walk: %10.1f usec/fetch\n", 1e6 * t_tree / nloop);
+    printf("compiled:  %10.1f usec/fetch (%.2fx)\n", 1e6 * t_vector / nloop,
+	    t_vector > 0 ? t_tree / t_vector : 0);
+
+    if (compare(tree, vector) == 0)
+	printf("values match\n");
+    pmFreeResult(tree);
+    pmFreeResult(vector);
+
+    exit(0);
+}
@@ -0,0 +1,135 @@
+/*
+ * Delay, a PMDA that takes its time over each fetch, and counts the
+ * fetches it has been sent ... used for pmcd and pmie QA
+ *
+ * Copyright (c) 2026 Red Hat.  All Rights Reserved.
+ */
+
+#include <pcp/pmapi.h>
+#include <pcp/impl.h>
+#include <pcp/pmda.h>
+#include <ctype.h>
+
+static pmdaMetric metrics[] = {
+/* fetches */
+    { NULL,
+      { PMDA_PMID(0,0), PM_TYPE_U32, PM_INDOM_NULL, PM_SEM_COUNTER,
+        PMDA_PMUNITS(0, 0, 1, 0, 0, PM_COUNT_ONE) } },
+/* msec */
+    { NULL,
+      { PMDA_PMID(0,1), PM_TYPE_U32, PM_INDOM_NULL, PM_SEM_DISCRETE,
+        PMDA_PMUNITS(0, 1, 0, 0, PM_TIME_MSEC, 0) } },
+};
+
+static unsigned int	fetches;	/* fetch requests seen */
+static unsigned int	msec;		/* delay before each fetch reply */
+
+static void
+usage(void)
+{
+    fprintf(stderr, "Usage: %s [options] [msec] [auth]\n\n", pmProgname);
+    fputs("Options:\n"
+	  "  -D N       set pmDebug debugging flag to N\n"
+	  "  -d domain  use domain (numeric) for metrics domain of PMDA\n"
+	  "  -l logfile write log into logfile rather than using default log name\n"
+	  "\n"
+	  "Each fetch is answered after msec milliseconds (default 0),\n"
+	  "and with auth pmcd is asked for client credentials.\n",
+	  stderr);
+    exit(1);
+}
+
+static int
+delay_fetchCallBack(pmdaMetric *mdesc, unsigned int inst, pmAtomValue *atom)
+{
+    __pmID_int		*idp = (__pmID_int *)&(mdesc->m_desc.pmid);
+
+    if (idp->cluster != 0)
+	return PM_ERR_PMID;
+    if (inst != PM_IN_NULL)
+	return PM_ERR_INST;
+    switch (idp->item) {
+	case 0:		/* fetches */
+	    atom->ul = fetches;
+	    break;
+	case 1:		/* msec */
+	    atom->ul = msec;
+	    break;
+	default:
+	    return PM_ERR_PMID;
+    }
+    return PMDA_FETCH_STATIC;
+}
+
+static int
+delay_fetch(int numpmid, pmID pmidlist[], pmResult **resp, pmdaExt *pmda)
+{
+    struct timespec	delay;
+
+    fetches++;
+    if (msec > 0) {
+	delay.tv_sec = msec / 1000;
+	delay.tv_nsec = (msec % 1000) * 1000000;
+	nanosleep(&delay, NULL);
+    }
+    return pmdaFetch(numpmid, pmidlist, resp, pmda);
+}
+
+static int
+delay_store(pmResult *result, pmdaExt *pmda)
+{
+    pmValueSet		*vsp;
+    __pmID_int		*idp;
+    int			i;
+
+    for (i = 0; i < result->numpmid; i++) {
+	vsp = result->vset[i];
+	idp = (__pmID_int *)&vsp->pmid;
+	if (idp->cluster != 0 || idp->item != 1)
+	    return PM_ERR_PERMISSION;
+	if (vsp->numval != 1 || vsp->valfmt != PM_VAL_INSITU)
+	    return PM_ERR_BADSTORE;
+	msec = vsp->vlist[0].value.lval;
+    }
+    return 0;
+}
+
+int
+main(int argc, char **argv)
+{
+    int			err = 0;
+    pmdaInterface	desc = { 0 };
+
+    __pmSetProgname(argv[0]);
+
+    pmdaDaemon(&desc, PMDA_INTERFACE_6, pmProgname, desc.domain, "delay_pmda.log", NULL);
+    if (desc.status != 0) {
+	fprintf(stderr, "pmdaDaemon() failed!\n");
+	exit(1);
+    }
+
+    if (pmdaGetOpt(argc, argv, "D:d:l:", &desc, &err) != EOF)
+	err++;
+    if (err)
+	usage();
+
+    for (; optind < argc; optind++) {
+	if (strcmp(argv[optind], "auth") == 0)
+	    desc.comm.flags |= PDU_FLAG_AUTH;
+	else if (isdigit((int)argv[optind][0]))
+	    msec = atoi(argv[optind]);
+	else
+	    usage();
+    }
+
+    desc.version.six.fetch = delay_fetch;
+    desc.version.six.store = delay_store;
+    pmdaSetFetchCallBack(&desc, delay_fetchCallBack);
+
+    pmdaOpenLog(&desc);
+    pmdaInit(&desc, NULL, 0, metrics, sizeof(metrics)/sizeof(metrics[0]));
+    pmdaConnect(&desc);
+    pmdaMain(&desc);
+
+    exit(0);
+}
@@ -0,0 +1,506 @@
+/*
+ * Copyright (c) 2026 Red Hat.  All Rights Reserved.
+ *
+ * Replay a trace of __pmHash* operations recorded by hashtrace.so
+ * against the libpcp hash tables and against open addressed tables,
+ * reporting the time for each and checking that every search finds
+ * the same nodes, e.g.
+ *	bzcat hashtrace-pmlogger.bz2 | hashbench
+ * hashtrace-pmlogger.bz2 is from pmlogger sampling linux PMDA metrics,
+ * hashtrace-archive.bz2 from pmdumplog -a opening the resulting archive.
+ *
+ * Searches walk hp->next over the nodes with the same key, as
+ * pmlogger does, so the libpcp tables pay for their chain walks.
+ */
+
+#include <pcp/pmapi.h>
+#include <pcp/impl.h>
+
+typedef struct {
+    char		op;
+    int			table;
+    unsigned int	key;
+    long		data;
+} hashop_t;
+
+static hashop_t	*ops;
+static int	nops;
+static int	ntables;
+
+/*
+ * Open addressing with linear probing, as an alternative to the
+ * chained libpcp tables.  Each slot holds a key inline and the chain
+ * of nodes added with that key, most recent first.  Nodes come from
+ * arenas with a free list, so there is no malloc per add, and the
+ * nodes are released by oa_clear().  Deleting the last node for a key
+ * leaves a tombstone, reclaimed when the table is rehashed.
+ *
+ * libpcp cannot use this, as __pmHashCtl (embedded in __pmLogCtl) is
+ * part of the ABI, callers walk and free the chains of hash[] directly,
+ * and the order of a walk shows up in the output of tools like pmdumplog.
+ */
+typedef struct {
+    unsigned int	key;
+    int			used;		/* != 0 once filled, see tombstones */
+    __pmHashNode	*node;		/* NULL if empty or a tombstone */
+} oa_slot;
+
+typedef struct oa_arena {
+    struct oa_arena	*next;
+    int			nnodes;
+    __pmHashNode	node[1];
+} oa_arena;
+
+typedef struct {
+    int			nodes;
+    int			hsize;		/* power of 2, 0 if none yet */
+    int			used;		/* slots in use, including tombstones */
+    oa_slot		*slots;
+    oa_arena		*arena;
+    __pmHashNode	*freelist;
+} oa_ctl;
+
+#define OA_MIN_SLOTS	16
+#define OA_MAX_ARENA	1024
+
+/* spread keys like pmIDs that differ only in the high bits */
+static inline unsigned int
+oa_hash(unsigned int key, int hsize)
+{
+    key *= 2654435761U;
+    key ^= key >> 16;
+    return key & (hsize - 1);
+}
+
+/* rehash with at most half of the slots live, and no tombstones */
+static int
+oa_resize(oa_ctl *hcp)
+{
+    oa_slot		*sp;
+    int			live = 0;
+    int			size;
+    int			i;
+    unsigned int	k;
+
+    for (i = 0; i < hcp->hsize; i++) {
+	if (hcp->slots[i].node != NULL)
+	    live++;
+    }
+    for (size = OA_MIN_SLOTS; size < 2 * (live + 1); size *= 2)
+	;
+    if ((sp = (oa_slot *)calloc(size, sizeof(oa_slot))) == NULL)
+	return -oserror();
+    for (i = 0; i < hcp->hsize; i++) {
+	if (hcp->slots[i].node == NULL)
+	    continue;
+	for (k = oa_hash(hcp->slots[i].key, size); sp[k].used; k = (k + 1) & (size - 1))
+	    ;
+	sp[k] = hcp->slots[i];
+    }
+    free(hcp->slots);
+    hcp->slots = sp;
+    hcp->used = live;
+    hcp->hsize = size;
+    return 0;
+}
+
+static __pmHashNode *
+oa_node_alloc(oa_ctl *hcp)
+{
+    oa_arena		*ap;
+    __pmHashNode	*hp;
+    int			n;
+    int			i;
+
+    if (hcp->freelist == NULL) {
+	n = hcp->arena == NULL ? 8 : hcp->arena->nnodes * 2;
+	if (n > OA_MAX_ARENA)
+	    n = OA_MAX_ARENA;
+	ap = (oa_arena *)malloc(sizeof(oa_arena) + (n - 1) * sizeof(__pmHashNode));
+	if (ap == NULL)
+	    return NULL;
+	ap->nnodes = n;
+	ap->next = hcp->arena;
+	hcp->arena = ap;
+	for (i = n - 1; i >= 0; i--) {
+	    ap->node[i].next = hcp->freelist;
+	    hcp->freelist = &ap->node[i];
+	}
+    }
+    hp = hcp->freelist;
+    hcp->freelist = hp->next;
+    return hp;
+}
+
+/* slot holding key, or NULL */
+static inline oa_slot *
+oa_slot_search(unsigned int key, oa_ctl *hcp)
+{
+    oa_slot		*sp;
+    unsigned int	k;
+
+    if (hcp->hsize == 0)
+	return NULL;
+
+    for (k = oa_hash(key, hcp->hsize); ; k = (k + 1) & (hcp->hsize - 1)) {
+	sp = &hcp->slots[k];
+	if (!sp->used)
+	    return NULL;
+	if (sp->node != NULL && sp->key == key)
+	    return sp;
+    }
+}
+
+static __pmHashNode *
+oa_search(unsigned int key, oa_ctl *hcp)
+{
+    oa_slot	*sp;
+
+    if ((sp = oa_slot_search(key, hcp)) == NULL)
+	return NULL;
+    return sp->node;
+}
+
+static int
+oa_add(unsigned int key, void *data, oa_ctl *hcp)
+{
+    oa_slot		*sp;
+    oa_slot		*free_sp = NULL;
+    __pmHashNode	*hp;
+    unsigned int	k;
+    int			sts;
+
+    /* keep at least a quarter of the slots empty */
+    if (hcp->hsize == 0 || 4 * (hcp->used + 1) > 3 * hcp->hsize) {
+	if ((sts = oa_resize(hcp)) < 0)
+	    return sts;
+    }
+
+    for (k = oa_hash(key, hcp->hsize); ; k = (k + 1) & (hcp->hsize - 1)) {
+	sp = &hcp->slots[k];
+	if (!sp->used)
+	    break;
+	if (sp->node == NULL) {
+	    /* tombstone, reuse the first one unless key is further on */
+	    if (free_sp == NULL)
+		free_sp = sp;
+	}
+	else if (sp->key == key)
+	    break;
+    }
+
+    if ((hp = oa_node_alloc(hcp)) == NULL)
+	return -oserror();
+    hp->key = key;
+    hp->data = data;
+
+    if (sp->node == NULL) {
+	if (free_sp != NULL)
+	    sp = free_sp;
+	else
+	    hcp->used++;
+	sp->key = key;
+	sp->used = 1;
+	hp->next = NULL;
+    }
+    else
+	hp->next = sp->node;
+    sp->node = hp;
+    hcp->nodes++;
+
+    return 1;
+}
+
+static int
+oa_del(unsigned int key, void *data, oa_ctl *hcp)
+{
+    oa_slot		*sp;
+    __pmHashNode	**hpp;
+    __pmHashNode	*hp;
+
+    if ((sp = oa_slot_search(key, hcp)) == NULL)
+	return 0;
+
+    for (hpp = &sp->node; (hp = *hpp) != NULL; hpp = &hp->next) {
+	if (hp->data == data) {
+	    /* if this empties the slot, it becomes a tombstone */
+	    *hpp = hp->next;
+	    hp->next = hcp->freelist;
+	    hcp->freelist = hp;
+	    hcp->nodes--;
+	    return 1;
+	}
+    }
+    return 0;
+}
+
+static int
+oa_walk(oa_ctl *hcp)
+{
+    __pmHashNode	*hp;
+    int			i;
+    int			n = 0;
+
+    for (i = 0; i < hcp->hsize; i++) {
+	for (hp = hcp->slots[i].node; hp != NULL; hp = hp->next)
+	    n++;
+    }
+    return n;
+}
+
+static void
+oa_clear(oa_ctl *hcp)
+{
+    oa_arena	*ap;
+
+    while ((ap = hcp->arena) != NULL) {
+	hcp->arena = ap->next;
+	free(ap);
+    }
+    free(hcp->slots);
+    memset(hcp, 0, sizeof(*hcp));
+}
+
+static void
+load(FILE *f)
+{
+    char	line[128];
+    hashop_t	*op;
+    int		n;
+    int		size = 0;
+
+    while (fgets(line, sizeof(line), f) != NULL) {
+	if (nops == size) {
+	    size = size ? 2 * size : 4096;
+	    if ((ops = (hashop_t *)realloc(ops, size * sizeof(hashop_t))) == NULL) {
+		fprintf(stderr, "%s: out of memory for %d operations\n", pmProgname, size);
+		exit(1);
+	    }
+	}
+	op = &ops[nops];
+	op->key = 0;
+	op->data = 0;
+	n = sscanf(line, "%c %d %u %ld", &op->op, &op->table, &op->key, &op->data);
+	if (n < 2 || strchr("asdwc", op->op) == NULL || op->table < 0) {
+	    fprintf(stderr, "%s: bad trace line %d: %s", pmProgname, nops + 1, line);
+	    exit(1);
+	}
+	if (op->table >= ntables)
+	    ntables = op->table + 1;
+	nops++;
+    }
+}
+
+/*
+ * Both implementations are called through one of these, so neither
+ * gains from inlining into the replay loop.
+ */
+typedef struct {
+    const char		*name;
+    size_t		ctlsize;
+    __pmHashNode	*(*search)(unsigned int, void *);
+    int			(*add)(unsigned int, void *, void *);
+    int			(*del)(unsigned int, void *, void *);
+    int			(*walk)(void *);
+    void		(*clear)(void *);
+} hashimpl_t;
+
+static int
+libpcp_walk(__pmHashCtl *hcp)
+{
+    __pmHashNode	*hp;
+    int			n = 0;
+
+    for (hp = __pmHashWalk(hcp, PM_HASH_WALK_START);
+	 hp != NULL;
+	 hp = __pmHashWalk(hcp, PM_HASH_WALK_NEXT))
+	n++;
+    return n;
+}
+
+/* __pmHashClear() leaves the nodes to the caller */
+static void
+libpcp_clear(__pmHashCtl *hcp)
+{
+    __pmHashNode	*hp;
+    __pmHashNode	*tp;
+    int			i;
+
+    for (i = 0; i < hcp->hsize; i++) {
+	for (hp = hcp->hash[i]; hp != NULL; ) {
+	    tp = hp;
+	    hp = hp->next;
+	    free(tp);
+	}
+    }
+    __pmHashClear(hcp);
+    __pmHashInit(hcp);
+}
+
+static hashimpl_t impls[] = {
+    { "libpcp", sizeof(__pmHashCtl),
+      (__pmHashNode *(*)(unsigned int, void *))__pmHashSearch,
+      (int (*)(unsigned int, void *, void *))__pmHashAdd,
+      (int (*)(unsigned int, void *, void *))__pmHashDel,
+      (int (*)(void *))libpcp_walk,
+      (void (*)(void *))libpcp_clear },
+    { "open", sizeof(oa_ctl),
+      (__pmHashNode *(*)(unsigned int, void *))oa_search,
+      (int (*)(unsigned int, void *, void *))oa_add,
+      (int (*)(unsigned int, void *, void *))oa_del,
+      (int (*)(void *))oa_walk,
+      (void (*)(void *))oa_clear },
+};
+#define NIMPL (sizeof(impls) / sizeof(impls[0]))
+
+/*
+ * Replay the trace, returning the elapsed time.  For a search, found[]
+ * holds the data of the first node found and the number of nodes with
+ * that key, and for a walk the number of nodes visited.
+ */
+static double
+replay(hashimpl_t *ip, long *found)
+{
+    char		*tab;
+    __pmHashNode	*hp;
+    hashop_t		*op;
+    struct timeval	start, end;
+    long		n;
+    int			i;
+
+    tab = (char *)calloc(ntables, ip->ctlsize);
+#define TAB(i) ((void *)(tab + (i) * ip->ctlsize))
+    __pmtimevalNow(&start);
+    for (i = 0, op = ops; i < nops; i++, op++) {
+	switch (op->op) {
+	    case 'a':
+		ip->add(op->key, (void *)op->data, TAB(op->table));
+		break;
+	    case 's':
+		n = 0;
+		for (hp = ip->search(op->key, TAB(op->table)); hp != NULL; hp = hp->next) {
+		    if (hp->key != op->key)
+			continue;
+		    if (n == 0)
+			found[i] = (long)hp->data << 16;
+		    n++;
+		}
+		found[i] += n;
+		break;
+	    case 'd':
+		ip->del(op->key, (void *)op->data, TAB(op->table));
+		break;
+	    case 'w':
+		found[i] = ip->walk(TAB(op->table));
+		break;
+	    case 'c':
+		ip->clear(TAB(op->table));
+		break;
+	}
+    }
+    for (i = 0; i < ntables; i++)
+	ip->clear(TAB(i));
+    __pmtimevalNow(&end);
+#undef TAB
+    free(tab);
+    return __pmtimevalSub(&end, &start);
+}
+
+int
+main(int argc, char **argv)
+{
+    int		c;
+    int		i;
+    int		j;
+    int		sts;
+    int		errflag = 0;
+    int		loops = 20;
+    int		bad = 0;
+    int		nsearch = 0;
+    long	*found[NIMPL];
+    double	best[NIMPL];
+    double	t;
+    FILE	*f = stdin;
+
+    __pmSetProgname(argv[0]);
+
+    while ((c = getopt(argc, argv, "D:n:")) != EOF) {
+	switch (c) {
+
+	case 'D':	/* debug flag */
+	    sts = __pmParseDebug(optarg);
+	    if (sts < 0) {
+		fprintf(stderr, "%s: unrecognized debug flag specification (%s)\n",
+		    pmProgname, optarg);
+		errflag++;
+	    }
+	    else
+		pmDebug |= sts;
+	    break;
+
+	case 'n':	/* replays of the trace */
+	    loops = atoi(optarg);
+	    if (loops < 1) {
+		fprintf(stderr, "%s: -n requires a positive count\n", pmProgname);
+		errflag++;
+	    }
+	    break;
+
+	case '?':
+	default:
+	    errflag++;
+	    break;
+	}
+    }
+
+    if (errflag || optind < argc - 1) {
+	fprintf(stderr, "Usage: %s [-D debug] [-n loops] [trace]\n", pmProgname);
+	exit(1);
+    }
+    if (optind == argc - 1 && (f = fopen(argv[optind], "r")) == NULL) {
+	fprintf(stderr, "%s: cannot open %s: %s\n", pmProgname, argv[optind], osstrerror());
+	exit(1);
+    }
+    load(f);
+
+    for (j = 0; j < NIMPL; j++) {
+	if ((found[j] = (long *)calloc(nops, sizeof(long))) == NULL) {
+	    fprintf(stderr, "%s: out of memory\n", pmProgname);
+	    exit(1);
+	}
+    }
+
+    /*
+     * alternate, so neither implementation gets all the warm caches,
+     * and keep the best time for each as the least disturbed
+     */
+    for (i = 0; i < loops; i++) {
+	for (j = 0; j < NIMPL; j++) {
+	    memset(found[j], 0, nops * sizeof(long));
+	    t = replay(&impls[j], found[j]);
+	    if (i == 0 || t < best[j])
+		best[j] = t;
+	}
+    }
+
+    for (i = 0; i < nops; i++) {
+	if (ops[i].op == 's')
+	    nsearch++;
+	if (found[0][i] != found[1][i]) {
+	    if (bad++ < 10)
+		printf("op %d: '%c' table %d key %u: %s %ld, %s %ld\n",
+			i + 1, ops[i].op, ops[i].table, ops[i].key,
+			impls[0].name, found[0][i], impls[1].name, found[1][i]);
+	}
+    }
+
+    printf("%d operations (%d searches) on %d tables, best of %d replays\n",
+	    nops, nsearch, ntables, loops);
+    printf("%-8s %8.1f nsec/op\n", impls[0].name, 1e9 * best[0] / nops);
+    printf("%-8s %8.1f nsec/op (%.2fx)\n", impls[1].name, 1e9 * best[1] / nops,
+	    best[1] > 0 ? best[0] / best[1] : 0);
+    if (bad == 0)
+	printf("results match\n");
+
+    exit(0);
+}
@@ -0,0 +1,187 @@
+/*
+ * Copyright (c) 2026 Red Hat.  All Rights Reserved.
+ *
+ * LD_PRELOAD shim that records the __pmHash* calls a PCP tool makes,
+ * for replay by hashbench, e.g.
+ *	PCP_HASHTRACE=out LD_PRELOAD=./hashtrace.so pmlogger ...
+ *
+ * One line per call, tables and data pointers numbered in order of
+ * first appearance:
+ *	a table key data	__pmHashAdd
+ *	s table key		__pmHashSearch
+ *	d table key data	__pmHashDel, or a delete from __pmHashWalkCB
+ *	w table			__pmHashWalk START or __pmHashWalkCB
+ *	c table			__pmHashClear
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <pcp/pmapi.h>
+#include <pcp/impl.h>
+#include <dlfcn.h>
+
+static FILE	*out;
+
+static const void	**tables;
+static int		ntables;
+
+typedef struct {
+    const void	*ptr;
+    int		id;
+} datamap_t;
+static datamap_t	*datamap;	/* open addressing, by ptr */
+static int		szdatamap;
+static int		ndata;
+
+static void
+setup(void)
+{
+    char	*p;
+
+    if (out != NULL)
+	return;
+    if ((p = getenv("PCP_HASHTRACE")) == NULL || (out = fopen(p, "w")) == NULL)
+	out = stderr;
+}
+
+static int
+table_id(const void *hcp)
+{
+    int		i;
+
+    for (i = 0; i < ntables; i++) {
+	if (tables[i] == hcp)
+	    return i;
+    }
+    tables = realloc(tables, (ntables + 1) * sizeof(tables[0]));
+    tables[ntables] = hcp;
+    return ntables++;
+}
+
+static unsigned int
+data_slot(const void *ptr, int size)
+{
+    return ((unsigned long)ptr >> 4) * 2654435761U & (size - 1);
+}
+
+static int
+data_id(const void *ptr)
+{
+    datamap_t	*old;
+    int		oldsize;
+    int		i;
+    unsigned int	k;
+
+    if (ptr == NULL)
+	return 0;
+    if (2 * (ndata + 1) > szdatamap) {
+	old = datamap;
+	oldsize = szdatamap;
+	szdatamap = szdatamap ? 2 * szdatamap : 1024;
+	datamap = calloc(szdatamap, sizeof(datamap[0]));
+	for (i = 0; i < oldsize; i++) {
+	    if (old[i].ptr == NULL)
+		continue;
+	    for (k = data_slot(old[i].ptr, szdatamap); datamap[k].ptr != NULL; k = (k + 1) & (szdatamap - 1))
+		;
+	    datamap[k] = old[i];
+	}
+	free(old);
+    }
+    for (k = data_slot(ptr, szdatamap); datamap[k].ptr != NULL; k = (k + 1) & (szdatamap - 1)) {
+	if (datamap[k].ptr == ptr)
+	    return datamap[k].id;
+    }
+    datamap[k].ptr = ptr;
+    datamap[k].id = ++ndata;
+    return ndata;
+}
+
+int
+__pmHashAdd(unsigned int key, void *data, __pmHashCtl *hcp)
+{
+    static int (*real)(unsigned int, void *, __pmHashCtl *);
+
+    if (real == NULL)
+	real = dlsym(RTLD_NEXT, "__pmHashAdd");
+    setup();
+    fprintf(out, "a %d %u %d\n", table_id(hcp), key, data_id(data));
+    return real(key, data, hcp);
+}
+
+__pmHashNode *
+__pmHashSearch(unsigned int key, __pmHashCtl *hcp)
+{
+    static __pmHashNode *(*real)(unsigned int, __pmHashCtl *);
+
+    if (real == NULL)
+	real = dlsym(RTLD_NEXT, "__pmHashSearch");
+    setup();
+    fprintf(out, "s %d %u\n", table_id(hcp), key);
+    return real(key, hcp);
+}
+
+int
+__pmHashDel(unsigned int key, void *data, __pmHashCtl *hcp)
+{
+    static int (*real)(unsigned int, void *, __pmHashCtl *);
+
+    if (real == NULL)
+	real = dlsym(RTLD_NEXT, "__pmHashDel");
+    setup();
+    fprintf(out, "d %d %u %d\n", table_id(hcp), key, data_id(data));
+    return real(key, data, hcp);
+}
+
+void
+__pmHashClear(__pmHashCtl *hcp)
+{
+    static void (*real)(__pmHashCtl *);
+
+    if (real == NULL)
+	real = dlsym(RTLD_NEXT, "__pmHashClear");
+    setup();
+    fprintf(out, "c %d\n", table_id(hcp));
+    real(hcp);
+}
+
+__pmHashNode *
+__pmHashWalk(__pmHashCtl *hcp, __pmHashWalkState state)
+{
+    static __pmHashNode *(*real)(__pmHashCtl *, __pmHashWalkState);
+
+    if (real == NULL)
+	real = dlsym(RTLD_NEXT, "__pmHashWalk");
+    setup();
+    if (state == PM_HASH_WALK_START)
+	fprintf(out, "w %d\n", table_id(hcp));
+    return real(hcp, state);
+}
+
+static __pmHashWalkCallback	walk_cb;
+static int			walk_table;
+
+static __pmHashWalkState
+walk_wrapper(const __pmHashNode *hp, void *cdata)
+{
+    __pmHashWalkState	state = walk_cb(hp, cdata);
+
+    if (state == PM_HASH_WALK_DELETE_NEXT || state == PM_HASH_WALK_DELETE_STOP)
+	fprintf(out, "d %d %u %d\n", walk_table, hp->key, data_id(hp->data));
+    return state;
+}
+
+void
+__pmHashWalkCB(__pmHashWalkCallback cb, void *cdata, const __pmHashCtl *hcp)
+{
+    static void (*real)(__pmHashWalkCallback, void *, const __pmHashCtl *);
+
+    if (real == NULL)
+	real = dlsym(RTLD_NEXT, "__pmHashWalkCB");
+    setup();
+    walk_cb = cb;
+    walk_table = table_id(hcp);
+    fprintf(out, "w %d\n", walk_table);
+    real(walk_wrapper, cdata, hcp);
+}
@@ -0,0 +1,193 @@
+/*
+ * Copyright (c) 2026 Red Hat.  All Rights Reserved.
+ */
+
+/*
+ * Replay an archive in interpolated mode forwards, backwards and then
+ * forwards again over the same interval, reporting the interpolation
+ * read cache counters from __pmGetInterpCacheStats() for each pass,
+ * and checking the two forward passes return the same values
+ */
+
+#include <pcp/pmapi.h>
+#include <pcp/impl.h>
+
+static int	numpmid;
+static pmID	*pmidlist;
+
+/* one pass of samples fetches, delta apart, starting at start */
+static pmResult **
+replay(const char *name, struct timeval *start, int delta, int samples)
+{
+    pmResult			**rlist;
+    __pmInterpCacheStats	stats;
+    int				i;
+    int				sts;
+
+    if ((rlist = (pmResult **)calloc(samples, sizeof(pmResult *))) == NULL) {
+	__pmNoMem("interpcache.rlist", samples * sizeof(pmResult *), PM_FATAL_ERR);
+	/* NOTREACHED */
+    }
+    if ((sts = pmSetMode(PM_MODE_INTERP, start, delta)) < 0) {
+	fprintf(stderr, "%s: pmSetMode: %s\n", pmProgname, pmErrStr(sts));
+	exit(1);
+    }
+    __pmResetInterpCacheStats();
+    for (i = 0; i < samples; i++) {
+	if ((sts = pmFetch(numpmid, pmidlist, &rlist[i])) < 0) {
+	    fprintf(stderr, "%s: %s pmFetch %d: %s\n",
+		    pmProgname, name, i, pmErrStr(sts));
+	    exit(1);
+	}
+    }
+    __pmGetInterpCacheStats(&stats);
+
+    printf("%s: %d fetches\n", name, samples);
+    printf("    records read: %ld forwards, %ld backwards\n",
+	    stats.nr_forw, stats.nr_back);
+    printf("    from the cache: %ld forwards, %ld backwards\n",
+	    stats.nr_cache_forw, stats.nr_cache_back);
+    printf("    read ahead: %ld, evicted: %ld\n",
+	    stats.nr_prefetch, stats.nr_evict);
+    return rlist;
+}
+
+static int
+same_values(const pmResult *a, const pmResult *b)
+{
+    int		i;
+    int		j;
+
+    if (a->numpmid != b->numpmid)
+	return 0;
+    for (i = 0; i < a->numpmid; i++) {
+	if (a->vset[i]->numval != b->vset[i]->numval)
+	    return 0;
+	for (j = 0; j < a->vset[i]->numval; j++) {
+	    if (a->vset[i]->vlist[j].inst != b->vset[i]->vlist[j].inst ||
+		(a->vset[i]->valfmt == PM_VAL_INSITU &&
+		 a->vset[i]->vlist[j].value.lval != b->vset[i]->vlist[j].value.lval) ||
+		(a->vset[i]->valfmt != PM_VAL_INSITU &&
+		 memcmp(a->vset[i]->vlist[j].value.pval,
+			b->vset[i]->vlist[j].value.pval,
+			a->vset[i]->vlist[j].value.pval->vlen) != 0))
+		return 0;
+	}
+    }
+    return 1;
+}
+
+int
+main(int argc, char **argv)
+{
+    int		c;
+    int		i;
+    int		sts;
+    int		errflag = 0;
+    int		samples = 100;
+    int		delta = 10000;
+    char	*endnum;
+    pmLogLabel	label;
+    struct timeval start;
+    struct timeval end;
+    pmResult	**first;
+    pmResult	**back;
+    pmResult	**again;
+    int		differ = 0;
+    static char	*usage = "[-D N] [-s samples] [-t msec] archive metric ...";
+
+    __pmSetProgname(argv[0]);
+
+    while ((c = getopt(argc, argv, "D:s:t:")) != EOF) {
+	switch (c) {
+
+	case 'D':	/* debug flag */
+	    sts = __pmParseDebug(optarg);
+	    if (sts < 0) {
+		fprintf(stderr, "%s: unrecognized debug flag specification (%s)\n",
+		    pmProgname, optarg);
+		errflag++;
+	    }
+	    else
+		pmDebug |= sts;
+	    break;
+
+	case 's':	/* samples */
+	    samples = (int)strtol(optarg, &endnum, 10);
+	    if (*endnum != '\0' || samples <= 0) {
+		fprintf(stderr, "%s: -s requires a positive number\n", pmProgname);
+		errflag++;
+	    }
+	    break;
+
+	case 't':	/* delta, in msec */
+	    delta = (int)strtol(optarg, &endnum, 10);
+	    if (*endnum != '\0' || delta <= 0) {
+		fprintf(stderr, "%s: -t requires a positive number of msec\n", pmProgname);
+		errflag++;
+	    }
+	    break;
+
+	case '?':
+	default:
+	    errflag++;
+	    break;
+	}
+    }
+
+    if (errflag || optind >= argc - 1) {
+	fprintf(stderr, "Usage: %s %s\n", pmProgname, usage);
+	exit(1);
+    }
+
+    if ((sts = pmNewContext(PM_CONTEXT_ARCHIVE, argv[optind])) < 0) {
+	fprintf(stderr, "%s: pmNewContext(%s): %s\n",
+		pmProgname, argv[optind], pmErrStr(sts));
+	exit(1);
+    }
+    optind++;
+
+    numpmid = argc - optind;
+    if ((pmidlist = (pmID *)malloc(numpmid * sizeof(pmID))) == NULL) {
+	__pmNoMem("interpcache.pmidlist", numpmid * sizeof(pmID), PM_FATAL_ERR);
+	/* NOTREACHED */
+    }
+    if ((sts = pmLookupName(numpmid, &argv[optind], pmidlist)) < 0) {
+	fprintf(stderr, "%s: pmLookupName: %s\n", pmProgname, pmErrStr(sts));
+	exit(1);
+    }
+
+    if ((sts = pmGetArchiveLabel(&label)) < 0) {
+	fprintf(stderr, "%s: pmGetArchiveLabel: %s\n", pmProgname, pmErrStr(sts));
+	exit(1);
+    }
+    start = label.ll_start;
+    end = start;
+    end.tv_sec += (samples - 1) * (delta / 1000);
+    end.tv_usec += (samples - 1) * (delta % 1000) * 1000;
+    end.tv_sec += end.tv_usec / 1000000;
+    end.tv_usec %= 1000000;
+
+    first = replay("forwards", &start, delta, samples);
+    back = replay("backwards", &end, -delta, samples);
+    again = replay("forwards again", &start, delta, samples);
+
+    for (i = 0; i < samples; i++) {
+	if (!same_values(first[i], again[i]) ||
+	    !same_values(first[i], back[samples - 1 - i])) {
+	    printf("sample %d: values differ\n", i);
+	    differ++;
+	}
+	pmFreeResult(first[i]);
+	pmFreeResult(back[samples - 1 - i]);
+	pmFreeResult(again[i]);
+    }
+    if (differ == 0)
+	printf("the same values in all three passes\n");
+
+    free(first);
+    free(back);
+    free(again);
+    free(pmidlist);
+    exit(0);
+}
@@ -0,0 +1,156 @@
+/*
+ * Hold many connections to pmcd (or pmproxy) at once, more than would
+ * fit in an fd_set, and fetch over all of them ... used for pmcd and
+ * pmproxy QA
+ *
+ * Copyright (c) 2026 Red Hat.  All Rights Reserved.
+ */
+
+#include <pcp/pmapi.h>
+#include <pcp/impl.h>
+
+static int
+fetch(int ctx, pmID pmid, unsigned int *value)
+{
+    pmResult	*rp;
+    int		sts;
+
+    if ((sts = pmUseContext(ctx)) < 0)
+	return sts;
+    if ((sts = pmFetch(1, &pmid, &rp)) < 0)
+	return sts;
+    if ((sts = rp->vset[0]->numval) > 0)
+	*value = rp->vset[0]->vlist[0].value.lval;
+    else if (sts == 0)
+	sts = PM_ERR_VALUE;
+    pmFreeResult(rp);
+    return sts;
+}
+
+int
+main(int argc, char **argv)
+{
+    int		c;
+    int		sts;
+    int		errflag = 0;
+    char	*host = "local:";
+    int		count = 2 * FD_SETSIZE;
+    int		*ctx;
+    int		fd;
+    int		i;
+    int		good;
+    char	*name;
+    char	*endnum;
+    pmID	pmid;
+    unsigned int	value = 0;
+
+    __pmSetProgname(argv[0]);
+
+    while ((c = getopt(argc, argv, "D:h:n:?")) != EOF) {
+	switch (c) {
+
+	case 'D':	/* debug flag */
+	    sts = __pmParseDebug(optarg);
+	    if (sts < 0) {
+		fprintf(stderr, "%s: unrecognized debug flag specification (%s)\n",
+		    pmProgname, optarg);
+		errflag++;
+	    }
+	    else
+		pmDebug |= sts;
+	    break;
+
+	case 'h':	/* contact PMCD on this hostname */
+	    host = optarg;
+	    break;
+
+	case 'n':	/* number of connections */
+	    count = (int)strtol(optarg, &endnum, 10);
+	    if (*endnum != '\0' || count < 2) {
+		fprintf(stderr, "%s: -n requires a number >= 2\n", pmProgname);
+		errflag++;
+	    }
+	    break;
+
+	case '?':
+	default:
+	    errflag++;
+	    break;
+	}
+    }
+
+    if (errflag || optind != argc - 1) {
+	fprintf(stderr,
+"Usage: %s [options] metric\n\
+\n\
+Options:\n\
+  -D debug	set debug flags\n\
+  -h host	connect to PMCD on host (default local:)\n\
+  -n count	number of connections (default %d)\n\
+\n\
+metric is a singular metric with a 32-bit counter value, such as a\n\
+count of fetches seen by an agent.\n",
+		pmProgname, 2 * FD_SETSIZE);
+	exit(1);
+    }
+    name = argv[optind];
+
+    if ((ctx = (int *)malloc(count * sizeof(int))) == NULL) {
+	__pmNoMem("manyconn.ctx", count * sizeof(int), PM_FATAL_ERR);
+	/* NOTREACHED */
+    }
+
+    /* exclusive contexts, so each one has its own connection */
+    for (i = 0; i < count; i++) {
+	ctx[i] = pmNewContext(PM_CONTEXT_HOST | PM_CTXFLAG_EXCLUSIVE, host);
+	if (ctx[i] < 0) {
+	    fprintf(stderr, "%s: context %d: pmNewContext(%s): %s\n",
+		    pmProgname, i, host, pmErrStr(ctx[i]));
+	    exit(1);
+	}
+    }
+    if ((fd = open("/dev/null", O_RDONLY)) < 0) {
+	perror("open(/dev/null)");
+	exit(1);
+    }
+    printf("%d connections, next fd %s FD_SETSIZE\n",
+	    count, fd > FD_SETSIZE ? "beyond" : "within");
+    close(fd);
+
+    if ((sts = pmLookupName(1, &name, &pmid)) < 0) {
+	fprintf(stderr, "%s: pmLookupName(%s): %s\n",
+		pmProgname, name, pmErrStr(sts));
+	exit(1);
+    }
+
+    /* newest first, so the highest descriptors are served first */
+    good = 0;
+    for (i = count - 1; i >= 0; i--) {
+	if ((sts = fetch(ctx[i], pmid, &value)) < 0)
+	    fprintf(stderr, "%s: context %d: pmFetch: %s\n",
+		    pmProgname, i, pmErrStr(sts));
+	else
+	    good++;
+    }
+    printf("fetched over %d of %d connections\n", good, count);
+
+    /* close every second connection, the rest are still served */
+    for (i = 0; i < count; i += 2)
+	pmDestroyContext(ctx[i]);
+    good = 0;
+    for (i = 1; i < count; i += 2) {
+	if ((sts = fetch(ctx[i], pmid, &value)) < 0)
+	    fprintf(stderr, "%s: context %d: pmFetch: %s\n",
+		    pmProgname, i, pmErrStr(sts));
+	else
+	    good++;
+    }
+    printf("fetched over %d of %d remaining connections\n", good, count / 2);
+    printf("%s %u\n", name, value);
+
+    for (i = 1; i < count; i += 2)
+	pmDestroyContext(ctx[i]);
+    free(ctx);
+
+    exit(0);
+}
@@ -0,0 +1,262 @@
+/*
+ * Copyright (c) 2026 Red Hat.
+ *
+ * Multi-threaded archive fetch scaling ... each thread opens its own
+ * archive context and replays it, fetching every metric, and the
+ * results are checked against those from a single threaded pass over
+ * the same archive.  The number of results and the checksum of the
+ * values from the single threaded pass are reported for each thread.
+ *
+ * Usage: multithread11 [-v] [-i iterations] archive ...
+ *
+ * There is one thread per archive.  Contexts for the same archive name
+ * share one __pmLogCtl, which is not safe to use from several threads
+ * at once, so to measure scaling use copies of an archive, and with -v
+ * the elapsed time for each phase is reported on stderr, e.g.
+ *	for i in 1 2 3 4; do pmlogextract foo /tmp/foo$i; done
+ *	multithread11 -v -i 5 /tmp/foo1 /tmp/foo2 /tmp/foo3 /tmp/foo4
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <pcp/pmapi.h>
+#include <pcp/impl.h>
+#include <pthread.h>
+
+typedef struct work {
+    const char		*archive;
+    int			iter;
+    struct work		*ref;		/* expected results, if any */
+    int			fetches;	/* results, for all iterations */
+    double		sum;		/* checksum of values, last iteration */
+    int			bad;		/* iterations that differ from ref */
+    int			sts;		/* first error, if any */
+} work_t;
+
+typedef struct {
+    char	**names;
+    int		numnames;
+} names_t;
+
+static void
+dometric(const char *name, void *arg)
+{
+    names_t	*np = (names_t *)arg;
+
+    np->names = (char **)realloc(np->names, (np->numnames+1) * sizeof(char *));
+    if (np->names == NULL) {
+	fprintf(stderr, "dometric: realloc failed\n");
+	exit(1);
+    }
+    if ((np->names[np->numnames] = strdup(name)) == NULL) {
+	fprintf(stderr, "dometric: strdup failed\n");
+	exit(1);
+    }
+    np->numnames++;
+}
+
+static double
+checksum(pmResult *rp)
+{
+    pmValueSet	*vsp;
+    double	sum = rp->timestamp.tv_sec + rp->timestamp.tv_usec / 1000000.0;
+    int		i, j, k;
+
+    for (i = 0; i < rp->numpmid; i++) {
+	vsp = rp->vset[i];
+	sum += vsp->numval;
+	for (j = 0; j < vsp->numval; j++) {
+	    sum += vsp->vlist[j].inst;
+	    if (vsp->valfmt == PM_VAL_INSITU)
+		sum += vsp->vlist[j].value.lval;
+	    else {
+		pmValueBlock	*vbp = vsp->vlist[j].value.pval;
+		for (k = 0; k < vbp->vlen - PM_VAL_HDR_SIZE; k++)
+		    sum += (unsigned char)vbp->vbuf[k];
+	    }
+	}
+    }
+    return sum;
+}
+
+static void *
+replay(void *arg)
+{
+    work_t	*wp = (work_t *)arg;
+    names_t	n = { NULL, 0 };
+    pmID	*pmids = NULL;
+    pmLogLabel	label;
+    pmResult	*rp;
+    int		ctx;
+    int		fetches;
+    int		i;
+    int		sts;
+
+    if ((ctx = pmNewContext(PM_CONTEXT_ARCHIVE, wp->archive)) < 0) {
+	wp->sts = ctx;
+	return NULL;
+    }
+    if ((sts = pmTraversePMNS_r("", dometric, &n)) < 0 ||
+	(sts = pmGetArchiveLabel(&label)) < 0)
+	goto done;
+    if ((pmids = (pmID *)malloc(n.numnames * sizeof(pmID))) == NULL) {
+	sts = -oserror();
+	goto done;
+    }
+    if ((sts = pmLookupName(n.numnames, n.names, pmids)) < 0)
+	goto done;
+
+    for (i = 0; i < wp->iter; i++) {
+	if ((sts = pmSetMode(PM_MODE_FORW, &label.ll_start, 0)) < 0)
+	    goto done;
+	fetches = 0;
+	wp->sum = 0;
+	while ((sts = pmFetch(n.numnames, pmids, &rp)) >= 0) {
+	    fetches++;
+	    wp->sum += checksum(rp);
+	    pmFreeResult(rp);
+	}
+	if (sts != PM_ERR_EOL)
+	    goto done;
+	wp->fetches += fetches;
+	if (wp->ref != NULL &&
+	    (fetches != wp->ref->fetches || wp->sum != wp->ref->sum))
+	    wp->bad++;
+    }
+    sts = 0;
+
+done:
+    wp->sts = sts;
+    for (i = 0; i < n.numnames; i++)
+	free(n.names[i]);
+    free(n.names);
+    free(pmids);
+    pmDestroyContext(ctx);
+    return NULL;
+}
+
+static double
+elapsed(struct timeval *start)
+{
+    struct timeval	now;
+
+    gettimeofday(&now, NULL);
+    return __pmtimevalSub(&now, start);
+}
+
+int
+main(int argc, char **argv)
+{
+    int			c;
+    int			errflag = 0;
+    int			verbose = 0;
+    int			iter = 1;
+    int			nthreads;
+    int			fetches;
+    int			i;
+    int			sts;
+    work_t		*ref;
+    work_t		*work;
+    pthread_t		*tids;
+    struct timeval	start;
+    char		*endnum;
+
+    __pmSetProgname(argv[0]);
+
+    while ((c = getopt(argc, argv, "D:i:v")) != EOF) {
+	switch (c) {
+	case 'D':
+	    sts = __pmParseDebug(optarg);
+	    if (sts < 0) {
+		fprintf(stderr, "%s: unrecognized debug flag specification (%s)\n",
+		    pmProgname, optarg);
+		errflag++;
+	    }
+	    else
+		pmDebug |= sts;
+	    break;
+	case 'i':
+	    iter = (int)strtol(optarg, &endnum, 10);
+	    if (*endnum != '\0' || iter < 1) {
+		fprintf(stderr, "%s: -i requires a positive numeric argument\n", pmProgname);
+		errflag++;
+	    }
+	    break;
+	case 'v':
+	    verbose++;
+	    break;
+	case '?':
+	default:
+	    errflag++;
+	    break;
+	}
+    }
+    nthreads = argc - optind;
+    if (errflag || nthreads < 1) {
+	fprintf(stderr, "Usage: %s [-v] [-D debug] [-i iterations] archive ...\n", pmProgname);
+	exit(1);
+    }
+
+    ref = (work_t *)calloc(nthreads, sizeof(work_t));
+    work = (work_t *)calloc(nthreads, sizeof(work_t));
+    tids = (pthread_t *)malloc(nthreads * sizeof(pthread_t));
+    if (ref == NULL || work == NULL || tids == NULL) {
+	fprintf(stderr, "%s: out of memory\n", pmProgname);
+	exit(1);
+    }
+
+    /* single threaded, one pass over each archive, for reference */
+    gettimeofday(&start, NULL);
+    for (i = 0; i < nthreads; i++) {
+	ref[i].archive = argv[optind + i];
+	ref[i].iter = 1;
+	replay(&ref[i]);
+	if (ref[i].sts < 0) {
+	    fprintf(stderr, "%s: %s: %s\n", pmProgname, ref[i].archive, pmErrStr(ref[i].sts));
+	    exit(1);
+	}
+    }
+    if (verbose)
+	fprintf(stderr, "reference: %d archives in %.3f sec\n", nthreads, elapsed(&start));
+
+    gettimeofday(&start, NULL);
+    for (i = 0; i < nthreads; i++) {
+	work[i].archive = argv[optind + i];
+	work[i].iter = iter;
+	work[i].ref = &ref[i];
+	if ((sts = pthread_create(&tids[i], NULL, replay, &work[i])) != 0) {
+	    fprintf(stderr, "%s: pthread_create: %s\n", pmProgname, pmErrStr(-sts));
+	    exit(1);
+	}
+    }
+    fetches = 0;
+    for (i = 0; i < nthreads; i++) {
+	pthread_join(tids[i], NULL);
+	fetches += work[i].fetches;
+    }
+    if (verbose) {
+	double	t = elapsed(&start);
+	fprintf(stderr, "%d threads: %d fetches in %.3f sec, %.0f fetches/sec\n",
+	    nthreads, fetches, t, t > 0 ? fetches / t : 0);
+    }
+
+    sts = 0;
+    for (i = 0; i < nthreads; i++) {
+	printf("thread %d: %d results, checksum %.3f: ",
+	    i, ref[i].fetches, ref[i].sum);
+	if (work[i].sts < 0) {
+	    printf("%s\n", pmErrStr(work[i].sts));
+	    sts = 1;
+	}
+	else if (work[i].bad) {
+	    printf("%d of %d replays differ\n", work[i].bad, iter);
+	    sts = 1;
+	}
+	else
+	    printf("ok\n");
+    }
+
+    exit(sts);
+}
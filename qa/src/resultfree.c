@@ -0,0 +1,167 @@
+/*
+ * Copyright (c) 2026 Red Hat.  All Rights Reserved.
+ */
+
+/*
+ * Check how a pmResult from pmFetch is allocated ... the pmResult
+ * itself is malloc'd, so both pmFreeResult() and the older idiom
+ * of __pmFreeResultValues() followed by free() release it, and no
+ * PDU buffers are left pinned either way
+ */
+
+#include <pcp/pmapi.h>
+#include <pcp/impl.h>
+
+int
+main(int argc, char **argv)
+{
+    int		c;
+    int		i;
+    int		ctx;
+    int		sts;
+    int		errflag = 0;
+    int		contype = PM_CONTEXT_HOST;
+    char	*host = "local:";
+    char	*archive = NULL;
+    char	*namespace = PM_NS_DEFAULT;
+    int		niter = 100;
+    int		numpmid;
+    pmID	*pmidlist;
+    pmResult	*rp;
+    pmLogLabel	label;
+    int		inpdubuf = 0;
+    int		before, after, dummy;
+    static char	*usage = "[-D N] [-L] [-h host] [-a archive] [-n namespace] [-i iterations] metric ...";
+
+    __pmSetProgname(argv[0]);
+
+    while ((c = getopt(argc, argv, "a:D:h:i:Ln:")) != EOF) {
+	switch (c) {
+
+	case 'a':	/* archive */
+	    archive = optarg;
+	    contype = PM_CONTEXT_ARCHIVE;
+	    break;
+
+	case 'D':	/* debug flag */
+	    sts = __pmParseDebug(optarg);
+	    if (sts < 0) {
+		fprintf(stderr, "%s: unrecognized debug flag specification (%s)\n",
+		    pmProgname, optarg);
+		errflag++;
+	    }
+	    else
+		pmDebug |= sts;
+	    break;
+
+	case 'h':	/* host */
+	    host = optarg;
+	    contype = PM_CONTEXT_HOST;
+	    break;
+
+	case 'i':	/* iterations */
+	    niter = atoi(optarg);
+	    break;
+
+	case 'L': 	/* local */
+	    contype = PM_CONTEXT_LOCAL;
+	    break;
+
+	case 'n':	/* alternative name space file */
+	    namespace = optarg;
+	    break;
+
+	case '?':
+	default:
+	    errflag++;
+	    break;
+	}
+    }
+
+    if (errflag || optind >= argc) {
+	fprintf(stderr, "Usage: %s %s\n", pmProgname, usage);
+	exit(1);
+    }
+
+    if (namespace != PM_NS_DEFAULT) {
+	if ((sts = pmLoadASCIINameSpace(namespace, 1)) < 0) {
+	    fprintf(stderr, "%s: Cannot load namespace from \"%s\": %s\n",
+		    pmProgname, namespace, pmErrStr(sts));
+	    exit(1);
+	}
+    }
+
+    if (contype == PM_CONTEXT_ARCHIVE)
+	sts = pmNewContext(contype, archive);
+    else if (contype == PM_CONTEXT_LOCAL)
+	sts = pmNewContext(contype, NULL);
+    else
+	sts = pmNewContext(contype, host);
+    if ((ctx = sts) < 0) {
+	fprintf(stderr, "%s: pmNewContext: %s\n", pmProgname, pmErrStr(sts));
+	exit(1);
+    }
+
+    numpmid = argc - optind;
+    if ((pmidlist = (pmID *)malloc(numpmid * sizeof(pmID))) == NULL) {
+	__pmNoMem("resultfree.pmidlist", numpmid * sizeof(pmID), PM_FATAL_ERR);
+	/* NOTREACHED */
+    }
+    /* unknown names are fetched as PM_ID_NULL, an error value set */
+    if ((sts = pmLookupName(numpmid, &argv[optind], pmidlist)) < 0) {
+	fprintf(stderr, "%s: pmLookupName: %s\n", pmProgname, pmErrStr(sts));
+	exit(1);
+    }
+
+    for (i = 0; i < niter; i++) {
+	if (i == 1)
+	    /* after the first fetch has set up the context */
+	    __pmCountPDUBuf(0, &before, &dummy);
+	if ((sts = pmFetch(numpmid, pmidlist, &rp)) < 0) {
+	    if (sts == PM_ERR_EOL && contype == PM_CONTEXT_ARCHIVE) {
+		/* start over at the beginning of the archive */
+		if ((sts = pmGetArchiveLabel(&label)) < 0 ||
+		    (sts = pmSetMode(PM_MODE_FORW, &label.ll_start, 0)) < 0) {
+		    fprintf(stderr, "%s: pmSetMode: %s\n", pmProgname, pmErrStr(sts));
+		    exit(1);
+		}
+		i--;
+		continue;
+	    }
+	    fprintf(stderr, "%s: pmFetch: %s\n", pmProgname, pmErrStr(sts));
+	    exit(1);
+	}
+	if (i == 0) {
+	    int		j;
+
+	    for (j = 0; j < rp->numpmid; j++) {
+		if (rp->vset[j]->numval < 0)
+		    printf("%s: %s\n", argv[optind+j], pmErrStr(rp->vset[j]->numval));
+		else
+		    printf("%s: %d values\n", argv[optind+j], rp->vset[j]->numval);
+	    }
+	}
+	/* would unpin the buffer, were the pmResult itself in one */
+	if (__pmUnpinPDUBuf((void *)rp)) {
+	    inpdubuf++;
+	    continue;
+	}
+	if (i % 2 == 0)
+	    pmFreeResult(rp);
+	else {
+	    __pmFreeResultValues(rp);
+	    free(rp);
+	}
+    }
+    __pmCountPDUBuf(0, &after, &dummy);
+
+    printf("%d fetches, %d pmResults in a PDU buffer\n", niter, inpdubuf);
+    if (after != before)
+	printf("PDU buffers pinned: %d before, %d after\n", before, after);
+    else
+	printf("no PDU buffers left pinned\n");
+
+    pmDestroyContext(ctx);
+    free(pmidlist);
+    exit(0);
+}
@@ -94,7 +94,7 @@ opendso(char *dso, char *init, int domain)
 	    }
 	    else {
 		if (dispatch.comm.pmda_interface < PMDA_INTERFACE_2 ||
-		    dispatch.comm.pmda_interface > PMDA_INTERFACE_LATEST) {
+		    dispatch.comm.pmda_interface > PMDA_INTERFACE_7) {
 
 		    printf("Error: Unsupported PMDA interface version %d returned by DSO \"%s\"\n",
 			   dispatch.comm.pmda_interface, dso);
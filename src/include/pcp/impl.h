@@ -252,6 +252,7 @@ typedef struct __pmnsTree {
 
 /* used by pmnsmerge... */
 PCP_CALL extern __pmnsTree *__pmExportPMNS(void); 
+PCP_CALL extern int __pmWriteBinaryPMNS(FILE *, __pmnsTree *);
 
 /* for PMNS in archives */
 PCP_CALL extern int __pmNewPMNS(__pmnsTree **);
@@ -417,8 +418,8 @@ typedef struct {
     int		l_state;	/* (when writing) log state */
     __pmHashCtl	l_hashpmid;	/* PMID hashed access */
     __pmHashCtl	l_hashindom;	/* instance domain hashed access */
-    __pmHashCtl	l_hashrange;	/* ptr to first and last value in log for */
-				/* each metric */
+    __pmHashCtl	l_hashrange;	/* libpcp private state for this log, */
+				/* see __pmLogPrivate() */
     int		l_minvol;	/* (when reading) lowest known volume no. */
     int		l_maxvol;	/* (when reading) highest known volume no. */
     int		l_numseen;	/* (when reading) size of l_seen */
@@ -442,6 +443,13 @@ typedef struct {
 #define PM_LOG_STATE_NEW	0
 #define PM_LOG_STATE_INIT	1
 
+/*
+ * Label version for archives with version 2 records and delta encoded
+ * data volumes, see logdelta.c ... this is not a PMAPI archive version
+ * and is deliberately outside their numbering
+ */
+#define PM_LOG_VERS02_DELTA	0x82
+
 /*
  * Return the argument if it's a valid filename else return NULL
  * (note: this function could be replaced with a call to access(),
@@ -578,6 +586,7 @@ typedef struct {
     int			pc_timeout;	/* set if connect times out */
     int			pc_tout_sec;	/* timeout for __pmGetPDU */
     time_t		pc_again;	/* time to try again */
+    int			pc_pending;	/* __pmFetchSend() reply outstanding */
 } __pmPMCDCtl;
 
 PCP_CALL extern int __pmConnectPMCD(pmHostSpec *, int, int, __pmHashCtl *);
@@ -636,6 +645,19 @@ PCP_CALL extern void __pmFD_COPY(__pmFdSet *, const __pmFdSet *);
 PCP_CALL extern int __pmSelectRead(int, __pmFdSet *, struct timeval *);
 PCP_CALL extern int __pmSelectWrite(int, __pmFdSet *, struct timeval *);
 
+/*
+ * Readiness sets without the FD_SETSIZE limit of __pmFdSet, for daemons
+ * with many client connections
+ */
+typedef struct __pmPollSet __pmPollSet;
+PCP_CALL extern __pmPollSet *__pmPollSetCreate(void);
+PCP_CALL extern void __pmPollSetDestroy(__pmPollSet *);
+PCP_CALL extern int __pmPollSetAdd(__pmPollSet *, int);
+PCP_CALL extern int __pmPollSetDel(__pmPollSet *, int);
+PCP_CALL extern int __pmPollSetWait(__pmPollSet *, struct timeval *);
+PCP_CALL extern int __pmPollSetReady(__pmPollSet *, int);
+PCP_CALL extern int __pmPollFds(int, const int *, int *, int, struct timeval *);
+
 PCP_CALL extern __pmSockAddr *__pmSockAddrAlloc(void);
 PCP_CALL extern void	     __pmSockAddrFree(__pmSockAddr *);
 PCP_CALL extern size_t	     __pmSockAddrSize(void);
@@ -730,7 +752,7 @@ typedef struct {
     void		*ac_want;	/* used in interp.c */
     void		*ac_unbound;	/* used in interp.c */
     void		*ac_cache;	/* used in interp.c */
-    int			ac_cache_idx;	/* used in interp.c */
+    int			ac_cache_idx;	/* unused, kept for ABI */
     /*
      * These were added to the ABI in order to support multiple archives
      * in a single context. In order to maintain ABI compatibility they must
@@ -786,6 +808,14 @@ PCP_CALL extern int __pmPrepareFetch(__pmContext *, int, const pmID *, pmID **);
 PCP_CALL extern int __pmFinishResult(__pmContext *, int, pmResult **);
 PCP_CALL extern int __pmFetchLocal(__pmContext *, int, pmID *, pmResult **);
 
+/*
+ * pmFetch in two halves for host contexts, so fetches from several
+ * pmcds can be outstanding at once.
+ */
+PCP_CALL extern int __pmFetchSend(int, int, pmID *);
+PCP_CALL extern int __pmFetchRecv(int, pmResult **);
+PCP_CALL extern int __pmFetchCancel(int);
+
 /* Archive context helper. */
 int __pmFindOrOpenArchive(__pmContext *, const char *, int);
 
@@ -1095,6 +1125,7 @@ PCP_CALL extern int __pmLogCreate(const char *, const char *, int, __pmLogCtl *)
 #define PMLOGREAD_NEXT		0
 #define PMLOGREAD_TO_EOF	1
 PCP_CALL extern int __pmLogRead(__pmLogCtl *, int, FILE *, pmResult **, int);
+PCP_CALL extern int __pmLogReadFilter(__pmLogCtl *, int, FILE *, pmResult **, int, int, pmID *);
 PCP_CALL extern int __pmLogWriteLabel(FILE *, const __pmLogLabel *);
 PCP_CALL extern int __pmLogOpen(const char *, __pmContext *);
 PCP_CALL extern int __pmLogLoadLabel(__pmLogCtl *, const char *);
@@ -1122,12 +1153,34 @@ PCP_CALL extern int __pmLogNameInDom(__pmLogCtl *, pmInDom, __pmTimeval *, int,
 
 PCP_CALL extern int __pmLogPutResult(__pmLogCtl *, __pmPDU *);
 PCP_CALL extern int __pmLogPutResult2(__pmLogCtl *, __pmPDU *);
+PCP_CALL extern int __pmLogBatchStart(__pmLogCtl *, size_t, const struct timeval *);
+PCP_CALL extern int __pmLogBatchFlush(__pmLogCtl *);
+PCP_CALL extern int __pmLogBatchStop(__pmLogCtl *);
+PCP_CALL extern size_t __pmLogWrite(const __pmLogCtl *, FILE *, const void *, size_t);
+PCP_CALL extern off_t __pmLogTell(const __pmLogCtl *, FILE *);
+PCP_CALL extern int __pmLogSeek(const __pmLogCtl *, FILE *, off_t);
 PCP_CALL extern int __pmLogFetch(__pmContext *, int, pmID *, pmResult **);
+PCP_CALL extern int __pmFetchArchiveFilter(int, pmID *, pmResult **);
 PCP_CALL extern int __pmLogFetchInterp(__pmContext *, int, pmID *, pmResult **);
 PCP_CALL extern void __pmLogSetTime(__pmContext *);
 PCP_CALL extern void __pmLogResetInterp(__pmContext *);
 PCP_CALL extern void __pmFreeInterpData(__pmContext *);
 
+/*
+ * diagnostics for the archive read cache used by __pmLogFetchInterp,
+ * accumulated across all contexts
+ */
+typedef struct {
+    long	nr_forw;	/* records read forwards on a cache miss */
+    long	nr_back;	/* records read backwards on a cache miss */
+    long	nr_cache_forw;	/* forwards reads satisfied from the cache */
+    long	nr_cache_back;	/* backwards reads satisfied from the cache */
+    long	nr_prefetch;	/* records read ahead into the cache */
+    long	nr_evict;	/* records dropped to stay within size bound */
+} __pmInterpCacheStats;
+PCP_CALL extern void __pmGetInterpCacheStats(__pmInterpCacheStats *);
+PCP_CALL extern void __pmResetInterpCacheStats(void);
+
 PCP_CALL extern int __pmLogChangeVol(__pmLogCtl *, int);
 PCP_CALL extern int __pmLogChkLabel(__pmLogCtl *, FILE *, __pmLogLabel *, int);
 PCP_CALL extern int __pmGetArchiveLabel(__pmLogCtl *, pmLogLabel *);
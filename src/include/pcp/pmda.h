@@ -30,6 +30,7 @@ extern "C" {
 #define PMDA_INTERFACE_5	5	/* client context in pmda and */
 					/* 4-state return from fetch callback */
 #define PMDA_INTERFACE_6	6	/* client security attributes in pmda */
+#define PMDA_INTERFACE_7	7	/* batch fetch callback */
 #define PMDA_INTERFACE_LATEST	6
 
 /*
@@ -75,6 +76,14 @@ typedef int (*pmdaFetchCallBack)(pmdaMetric *, unsigned int, pmAtomValue *);
 #define PMDA_FETCH_STATIC	1
 #define PMDA_FETCH_DYNAMIC	2	/* free avp->vp after __pmStuffValue */
 
+/*
+ * Type of function call back used by pmdaFetch for PMDA_INTERFACE_7 or
+ * later, once per metric for all of the instances in the profile (see
+ * struct pmdaFetchBatch below).
+ */
+typedef struct pmdaFetchBatch pmdaFetchBatch;
+typedef int (*pmdaFetchBatchCallBack)(pmdaMetric *, pmdaFetchBatch *);
+
 /*
  * Type of function call back used by pmdaMain to clean up a pmResult structure
  * after a fetch.
@@ -150,6 +159,8 @@ typedef struct pmdaExt {
     /* added for PMDA_INTERFACE_5 */
     int		e_context;	/* client context id from pmcd */
     pmdaEndContextCallBack	e_endCallBack;	/* callback after client context closed */
+    /* added for PMDA_INTERFACE_7 */
+    pmdaFetchBatchCallBack	e_fetchBatchCallBack; /* callback to assign all values of a metric */
 } pmdaExt;
 
 #define PMDA_EXT_FLAG_DIRECT	0x01	/* direct mapped PMID metric table */
@@ -158,6 +169,17 @@ typedef struct pmdaExt {
 #define PMDA_EXT_CONNECTED	0x08	/* pmdaConnect() done */
 #define PMDA_EXT_NOTREADY	0x10	/* pmcd connection marked NOTREADY */
 
+/*
+ * The instances passed to a pmdaFetchBatchCallBack, in profile order.
+ * Values are returned with pmdaFetchBatchValue(), which copies them
+ * straight away, so the same buffer may be used for each value.
+ */
+struct pmdaFetchBatch {
+    int			numinst;	/* number of instances in instlist */
+    unsigned int	*instlist;	/* PM_IN_NULL for singular metrics */
+    pmdaExt		*ext;		/* used internally within libpcp_pmda */
+};
+
 /*
  * Optionally restrict symbol visibility for DSO PMDAs
  *
@@ -239,8 +261,9 @@ typedef struct pmdaInterface {
 	} four, five;
 
 /*
- * Interface Version 6 (client context security attributes in PMDA).
- * PMDA_INTERFACE_6
+ * Interface Version 6 (client context security attributes in PMDA) and
+ * Version 7 (batch fetch callback in pmdaExt).
+ * PMDA_INTERFACE_6, PMDA_INTERFACE_7
  */
 	struct {
 	    pmdaExt *ext;
@@ -254,7 +277,7 @@ typedef struct pmdaInterface {
 	    int     (*name)(pmID, char ***, pmdaExt *);
 	    int     (*children)(const char *, int, char ***, int **, pmdaExt *);
 	    int     (*attribute)(int, int, const char *, int, pmdaExt *);
-	} six;
+	} six, seven;
 
     } version;
 
@@ -403,6 +426,12 @@ typedef struct pmdaOptions {
  *      pmAtom structure with a metrics value. This must be set if pmdaFetch is
  *      used as the fetch callback.
  *
+ * pmdaSetFetchBatchCallBack
+ *      For PMDA_INTERFACE_7 or later, allows an application specific routine
+ *      to be specified for returning the values of all instances of a metric
+ *      in one call, with pmdaFetchBatchValue.  If set, pmdaFetch uses it in
+ *      preference to the fetch callback.
+ *
  * pmdaSetCheckCallBack
  *      Allows an application specific routine to be called upon receipt of any
  *      PDU. For all PDUs except PDU_PROFILE, a result less than zero
@@ -435,6 +464,7 @@ PMDA_CALL extern void pmdaMain(pmdaInterface *);
 
 PMDA_CALL extern void pmdaSetResultCallBack(pmdaInterface *, pmdaResultCallBack);
 PMDA_CALL extern void pmdaSetFetchCallBack(pmdaInterface *, pmdaFetchCallBack);
+PMDA_CALL extern void pmdaSetFetchBatchCallBack(pmdaInterface *, pmdaFetchBatchCallBack);
 PMDA_CALL extern void pmdaSetCheckCallBack(pmdaInterface *, pmdaCheckCallBack);
 PMDA_CALL extern void pmdaSetDoneCallBack(pmdaInterface *, pmdaDoneCallBack);
 PMDA_CALL extern void pmdaSetEndContextCallBack(pmdaInterface *, pmdaEndContextCallBack);
@@ -449,7 +479,12 @@ PMDA_CALL extern void pmdaSetEndContextCallBack(pmdaInterface *, pmdaEndContextC
  *
  * pmdaFetch
  *	Resize the pmResult and call e_callback in the pmdaExt structure
- *	for each metric instance required by the profile.
+ *	for each metric instance required by the profile, or if set, the
+ *	e_fetchBatchCallBack once for each metric.
+ *
+ * pmdaFetchBatchValue
+ *	Called from a batch fetch callback to return the value for one of
+ *	the instances, with the same status codes as a fetch callback.
  *
  * pmdaInstance
  *	Return description of instances and instance domains.
@@ -487,6 +522,7 @@ PMDA_CALL extern void pmdaSetEndContextCallBack(pmdaInterface *, pmdaEndContextC
 
 PMDA_CALL extern int pmdaProfile(pmdaInProfile *, pmdaExt *);
 PMDA_CALL extern int pmdaFetch(int, pmID *, pmResult **, pmdaExt *);
+PMDA_CALL extern int pmdaFetchBatchValue(pmdaFetchBatch *, int, int, pmAtomValue *);
 PMDA_CALL extern int pmdaInstance(pmInDom, int, char *, pmdaInResult **, pmdaExt *);
 PMDA_CALL extern int pmdaDesc(pmID, pmDesc *, pmdaExt *);
 PMDA_CALL extern int pmdaText(int, int, char **, pmdaExt *);
@@ -24,6 +24,9 @@
 #define SOCKET_INTERNAL
 #include "internal.h"
 
+/* most addresses for one host that __pmAuxConnectPMCDPort tries at once */
+#define MAXCONNFDS	16
+
 /* default connect timeout is 5 seconds */
 static struct timeval	conn_wait = { 5, 0 };
 static int		conn_wait_done;
@@ -847,10 +850,10 @@ __pmAuxConnectPMCDPort(const char *hostname, int pmcd_port)
     __pmHostEnt		*servInfo;
     int			fd;
     int			sts;
-    int			fdFlags[FD_SETSIZE];
-    __pmFdSet		allFds;
-    __pmFdSet		readyFds;
-    int			maxFd;
+    int			fds[MAXCONNFDS];
+    int			fdFlags[MAXCONNFDS];
+    int			ready[MAXCONNFDS];
+    int			nfds;
     void		*enumIx;
     struct timeval	stv;
     struct timeval	*pstv;
@@ -870,17 +873,16 @@ __pmAuxConnectPMCDPort(const char *hostname, int pmcd_port)
     /*
      * We want to respect the connect timeout that has been configured, but we
      * may have more than one address to try. Do this by creating a socket for
-     * each address and then using __pmSelectWrite() to wait for one of them to
+     * each address and then using __pmPollFds() to wait for one of them to
      * respond. That way, the timeout is applied to all of the addresses
-     * simultaneously. First, create the sockets, add them to the fd set
+     * simultaneously. First, create the sockets, add them to the fd list
      * and try to connect.
      */
     __pmConnectTimeout();
-    __pmFD_ZERO(&allFds);
-    maxFd = -1;
+    nfds = 0;
     enumIx = NULL;
     for (myAddr = __pmHostEntGetSockAddr(servInfo, &enumIx);
-	 myAddr != NULL;
+	 myAddr != NULL && nfds < MAXCONNFDS;
 	 myAddr = __pmHostEntGetSockAddr(servInfo, &enumIx)) {
 	/* Create a socket */
 	if (__pmSockAddrIsInet(myAddr))
@@ -899,9 +901,9 @@ __pmAuxConnectPMCDPort(const char *hostname, int pmcd_port)
 	}
 
 	/* Attempt to connect */
-	fdFlags[fd] = __pmConnectTo(fd, myAddr, pmcd_port);
+	fdFlags[nfds] = __pmConnectTo(fd, myAddr, pmcd_port);
 	__pmSockAddrFree(myAddr);
-	if (fdFlags[fd] < 0) {
+	if (fdFlags[nfds] < 0) {
 	    /*
 	     * Mark failure in case we fall out the end of the loop
 	     * and try next address
@@ -910,22 +912,21 @@ __pmAuxConnectPMCDPort(const char *hostname, int pmcd_port)
 	    continue;
 	}
 
-	/* Add it to the fd set. */
-	__pmFD_SET(fd, &allFds);
-	if (fd > maxFd)
-	    maxFd = fd;
+	/* Add it to the fd list. */
+	fds[nfds++] = fd;
     }
+    if (myAddr != NULL)
+	__pmSockAddrFree(myAddr);
     __pmHostEntFree(servInfo);
 
     /* If we were unable to open any sockets, then give up. */
-    if (maxFd == -1)
+    if (nfds == 0)
 	return -ECONNREFUSED;
 
-    /* FNDELAY and we're in progress - wait on select */
-    __pmFD_COPY(&readyFds, &allFds);
+    /* FNDELAY and we're in progress - wait on poll */
     stv = conn_wait;
     pstv = (stv.tv_sec || stv.tv_usec) ? &stv : NULL;
-    rc = __pmSelectWrite(maxFd+1, &readyFds, pstv);
+    rc = __pmPollFds(nfds, fds, ready, 1, pstv);
 
     /* Figure out what happened. */
     if (rc == 0)
@@ -934,18 +935,18 @@ __pmAuxConnectPMCDPort(const char *hostname, int pmcd_port)
 	fd = -neterror();
     else {
 	/*
-	 * Examine the fd set and choose the first successfully connected
+	 * Examine the fd list and choose the first successfully connected
 	 * socket, if any.
 	 * Note that because rc > 0, at least one fd is ready and 'fd' will
 	 * definitely get set. However, initialize it to keep coverity happy.
 	 */
 	fd = -EINVAL;
-	for (i = 0; i <= maxFd; ++i) {
-	    if (__pmFD_ISSET(i, &readyFds)) {
+	for (i = 0; i < nfds; ++i) {
+	    if (ready[i]) {
 		/* Successful connection? */
-		sts = __pmConnectCheckError(i);
+		sts = __pmConnectCheckError(fds[i]);
 		if (sts == 0) {
-		    fd = i;
+		    fd = fds[i];
 		    break;
 		}
 		fd = -sts;
@@ -954,9 +955,9 @@ __pmAuxConnectPMCDPort(const char *hostname, int pmcd_port)
     }
 
     /* Clean up the unused fds. */
-    for (i = 0; i <= maxFd; ++i) {
-	if (i != fd && __pmFD_ISSET(i, &allFds))
-	    __pmCloseSocket(i);
+    for (i = 0; i < nfds; ++i) {
+	if (fds[i] != fd)
+	    __pmCloseSocket(fds[i]);
     }
 
     /* Unsuccessful? */
@@ -968,7 +969,9 @@ __pmAuxConnectPMCDPort(const char *hostname, int pmcd_port)
      * flags and make sure this file descriptor is closed if exec() is
      * called
      */
-    return __pmConnectRestoreFlags(fd, fdFlags[fd]);
+    for (i = 0; fds[i] != fd; ++i)
+	;
+    return __pmConnectRestoreFlags(fd, fdFlags[i]);
 }
 
 /*
@@ -1008,7 +1011,7 @@ __pmAuxConnectPMCDUnixSocket(const char *sock_path)
     int			fdFlags = 0;
     struct timeval	stv;
     struct timeval	*pstv;
-    __pmFdSet		wfds;
+    int			ready;
     int			rc;
 
     __pmConnectTimeout();
@@ -1045,10 +1048,8 @@ __pmAuxConnectPMCDUnixSocket(const char *sock_path)
     /* FNDELAY and we're in progress - wait on select */
     stv = conn_wait;
     pstv = (stv.tv_sec || stv.tv_usec) ? &stv : NULL;
-    __pmFD_ZERO(&wfds);
-    __pmFD_SET(fd, &wfds);
     sts = 0;
-    if ((rc = __pmSelectWrite(fd+1, &wfds, pstv)) == 1) {
+    if ((rc = __pmPollFds(1, &fd, &ready, 1, pstv)) == 1) {
 	sts = __pmConnectCheckError(fd);
     }
     else if (rc == 0) {
@@ -1465,11 +1466,9 @@ __pmRecv(int socket, void *buffer, size_t length, int flags)
 int
 __pmSocketReady(int fd, struct timeval *timeout)
 {
-    __pmFdSet	onefd;
+    int		ready;
 
-    FD_ZERO(&onefd);
-    FD_SET(fd, &onefd);
-    return select(fd+1, &onefd, NULL, NULL, timeout);
+    return __pmPollFds(1, &fd, &ready, 0, timeout);
 }
 
 #endif /* !HAVE_SECURE_SOCKETS */
@@ -430,7 +430,7 @@ __pmConnectLocal(__pmHashCtl *attrs)
 	}
 	else {
 	    if (dp->dispatch.comm.pmda_interface < PMDA_INTERFACE_2 ||
-		dp->dispatch.comm.pmda_interface > PMDA_INTERFACE_LATEST) {
+		dp->dispatch.comm.pmda_interface > PMDA_INTERFACE_7) {
 		pmprintf("__pmConnectLocal: Error: Unknown PMDA interface "
 			 "version %d in \"%s\" DSO\n", 
 			 dp->dispatch.comm.pmda_interface, path);
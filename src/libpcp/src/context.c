@@ -17,8 +17,15 @@
  *
  * curcontext needs to be thread-private
  *
- * contexts[] et al and def_backoff[] et al are protected from changes
- * using the libpcp lock.
+ * def_backoff[] et al are protected from changes using the libpcp lock.
+ *
+ * contexts[] and contexts_len are only changed holding both the libpcp
+ * lock and contexts_lock (in that order), so may be read holding either.
+ * __pmHandleToPtr() and pmUseContext() take just contexts_lock, so
+ * threads working in their own contexts do not queue up behind one
+ * that holds the libpcp lock for a long operation (e.g. pmNewContext()
+ * opening an archive).  contexts_lock is never held while taking
+ * another lock.
  *
  * The actual contexts (__pmContext) are protected by the (recursive)
  * c_lock mutex which is intialized in pmNewContext() and pmDupContext(),
@@ -34,6 +41,11 @@
 
 static __pmContext	**contexts;		/* array of context ptrs */
 static int		contexts_len;		/* number of contexts */
+#ifdef PM_MULTI_THREAD
+static __pmMutex	contexts_lock = PTHREAD_MUTEX_INITIALIZER;
+#else
+static __pmMutex	contexts_lock;
+#endif
 
 #ifdef PM_MULTI_THREAD
 #ifdef HAVE___THREAD
@@ -103,21 +115,25 @@ waitawhile(__pmPMCDCtl *ctl)
 __pmContext *
 __pmHandleToPtr(int handle)
 {
+    __pmContext	*ctxp;
+
     PM_INIT_LOCKS();
-    PM_LOCK(__pmLock_libpcp);
+    PM_LOCK(contexts_lock);
     if (handle < 0 || handle >= contexts_len ||
 	contexts[handle]->c_type == PM_CONTEXT_INIT ||
 	contexts[handle]->c_type == PM_CONTEXT_FREE) {
-	PM_UNLOCK(__pmLock_libpcp);
+	PM_UNLOCK(contexts_lock);
 	return NULL;
     }
-    else {
-	__pmContext	*sts;
-	sts = contexts[handle];
-	PM_UNLOCK(__pmLock_libpcp);
-	PM_LOCK(sts->c_lock);
-	return sts;
+    ctxp = contexts[handle];
+    PM_UNLOCK(contexts_lock);
+    PM_LOCK(ctxp->c_lock);
+    if (ctxp->c_type == PM_CONTEXT_FREE) {
+	/* destroyed while we waited for c_lock */
+	PM_UNLOCK(ctxp->c_lock);
+	return NULL;
     }
+    return ctxp;
 }
 
 int
@@ -125,14 +141,14 @@ __pmPtrToHandle(__pmContext *ctxp)
 {
     int		i;
     PM_INIT_LOCKS();
-    PM_LOCK(__pmLock_libpcp);
+    PM_LOCK(contexts_lock);
     for (i = 0; i < contexts_len; i++) {
 	if (ctxp == contexts[i]) {
-	    PM_UNLOCK(__pmLock_libpcp);
+	    PM_UNLOCK(contexts_lock);
 	    return i;
 	}
     }
-    PM_UNLOCK(__pmLock_libpcp);
+    PM_UNLOCK(contexts_lock);
     return PM_CONTEXT_UNDEF;
 }
 
@@ -230,12 +246,12 @@ int
 pmWhichContext(void)
 {
     /*
-     * return curcontext, provided it is defined
+     * return curcontext, provided it is defined ... it is thread-private,
+     * so no lock is needed
      */
     int		sts;
 
     PM_INIT_LOCKS();
-    PM_LOCK(__pmLock_libpcp);
     if (PM_TPD(curcontext) > PM_CONTEXT_UNDEF)
 	sts = PM_TPD(curcontext);
     else
@@ -246,7 +262,6 @@ pmWhichContext(void)
 	fprintf(stderr, "pmWhichContext() -> %d, cur=%d\n",
 	    sts, PM_TPD(curcontext));
 #endif
-    PM_UNLOCK(__pmLock_libpcp);
     return sts;
 }
 
@@ -547,9 +562,10 @@ __pmFindOrOpenArchive(__pmContext *ctxp, const char *name, int multi_arch)
 	if ((lcp = (__pmLogCtl *)malloc(sizeof(*lcp))) == NULL)
 	    __pmNoMem("__pmFindOrOpenArchive", sizeof(*lcp), PM_FATAL_ERR);
 	lcp->l_pmns = NULL;
-	lcp->l_hashpmid.nodes = lcp->l_hashpmid.hsize = 0;
-	lcp->l_hashindom.nodes = lcp->l_hashindom.hsize = 0;
+	__pmHashInit(&lcp->l_hashpmid);
+	__pmHashInit(&lcp->l_hashindom);
 	lcp->l_multi = multi_arch;
+	__pmHashInit(&lcp->l_hashrange);
 	acp->ac_log = lcp;
     }
     sts = __pmLogOpen(name, ctxp);
@@ -854,8 +870,7 @@ initarchive(__pmContext	*ctxp, const char *name)
     acp->ac_offset = sizeof(__pmLogLabel) + 2*sizeof(int);
     acp->ac_vol = acp->ac_log->l_curvol;
     acp->ac_serial = 0;		/* not serial access, yet */
-    acp->ac_pmid_hc.nodes = 0;	/* empty hash list */
-    acp->ac_pmid_hc.hsize = 0;
+    __pmHashInit(&acp->ac_pmid_hc);	/* empty hash list */
     acp->ac_end = 0.0;
     acp->ac_want = NULL;
     acp->ac_unbound = NULL;
@@ -895,6 +910,17 @@ initarchive(__pmContext	*ctxp, const char *name)
     return sts;
 }
 
+/*
+ * Install ctxp in contexts[handle], caller holds the libpcp lock.
+ */
+static void
+setcontext(int handle, __pmContext *ctxp)
+{
+    PM_LOCK(contexts_lock);
+    contexts[handle] = ctxp;
+    PM_UNLOCK(contexts_lock);
+}
+
 int
 pmNewContext(int type, const char *name)
 {
@@ -922,21 +948,24 @@ pmNewContext(int type, const char *name)
 	if (contexts[i]->c_type == PM_CONTEXT_FREE) {
 	    PM_TPD(curcontext) = i;
 	    new = contexts[i];
-	    contexts[i] = &being_initialized;
+	    setcontext(i, &being_initialized);
 	    goto INIT_CONTEXT;
 	}
     }
 
     /* Create a new one */
+    PM_LOCK(contexts_lock);
     if (contexts == NULL)
 	list = (__pmContext **)malloc(sizeof(__pmContext *));
     else
 	list = (__pmContext **)realloc((void *)contexts, (1+contexts_len) * sizeof(__pmContext *));
     if (list == NULL) {
 	sts = -oserror();
+	PM_UNLOCK(contexts_lock);
 	goto FAILED_LOCKED;
     }
     contexts = list;
+    PM_UNLOCK(contexts_lock);
     /*
      * NB: it is harmless (not a leak) if contexts[] is realloc'd a
      * little larger, and then the last slot is not initialized (since
@@ -951,10 +980,11 @@ pmNewContext(int type, const char *name)
 	goto FAILED_LOCKED;
     }
 
-    contexts = list;
     PM_TPD(curcontext) = contexts_len;
+    PM_LOCK(contexts_lock);
     contexts[contexts_len] = &being_initialized;
     contexts_len++;
+    PM_UNLOCK(contexts_lock);
 
     /*
      * We do not need to hold __pmLock_libpcp just for filling of the
@@ -1143,7 +1173,7 @@ INIT_CONTEXT:
     /* Take libpcp lock to update contexts[] with this fully operational
        battle station ^W context. */
     PM_LOCK(__pmLock_libpcp);
-    contexts[PM_TPD(curcontext)] = new;
+    setcontext(PM_TPD(curcontext), new);
     PM_UNLOCK(__pmLock_libpcp);
 
     /* return the handle to the new (current) context */
@@ -1178,7 +1208,7 @@ FAILED_LOCKED:
         /* We could memset-0 the struct, but this is not really
            necessary.  That's the first thing we'll do in INIT_CONTEXT. */
         new->c_type = PM_CONTEXT_FREE;
-        contexts[PM_TPD(curcontext)] = new;
+        setcontext(PM_TPD(curcontext), new);
     }
     PM_TPD(curcontext) = old_curcontext;
 #ifdef PCP_DEBUG
@@ -1379,8 +1409,7 @@ pmDupContext(void)
 	 * __pmFreeInterpData() to trash our hash list and read cache.
 	 * Start with an empty hash list and read cache for the dup'd context.
 	 */
-	newcon->c_archctl->ac_pmid_hc.nodes = 0;
-	newcon->c_archctl->ac_pmid_hc.hsize = 0;
+	__pmHashInit(&newcon->c_archctl->ac_pmid_hc);
 	newcon->c_archctl->ac_cache = NULL;
 
 	/*
@@ -1447,17 +1476,18 @@ int
 pmUseContext(int handle)
 {
     PM_INIT_LOCKS();
-    PM_LOCK(__pmLock_libpcp);
+    PM_LOCK(contexts_lock);
     if (handle < 0 || handle >= contexts_len ||
 	contexts[handle]->c_type == PM_CONTEXT_FREE ||
         contexts[handle]->c_type == PM_CONTEXT_INIT) {
+	    PM_UNLOCK(contexts_lock);
 #ifdef PCP_DEBUG
 	    if (pmDebug & DBG_TRACE_CONTEXT)
 		fprintf(stderr, "pmUseContext(%d) -> %d\n", handle, PM_ERR_NOCONTEXT);
 #endif
-	    PM_UNLOCK(__pmLock_libpcp);
 	    return PM_ERR_NOCONTEXT;
     }
+    PM_UNLOCK(contexts_lock);
 
 #ifdef PCP_DEBUG
     if (pmDebug & DBG_TRACE_CONTEXT)
@@ -1465,7 +1495,6 @@ pmUseContext(int handle)
 #endif
     PM_TPD(curcontext) = handle;
 
-    PM_UNLOCK(__pmLock_libpcp);
     return 0;
 }
 
@@ -1606,9 +1635,9 @@ __pmDumpContext(FILE *f, int context, pmInDom indom)
 		    fprintf(f, " mode=%s", _mode[con->c_mode & __PM_MODE_MASK]);
 		    fprintf(f, " profile=%s tifd=%d mdfd=%d mfd=%d\nrefcnt=%d vol=%d",
 			    con->c_sent ? "SENT" : "NOT_SENT",
-			    con->c_archctl->ac_log->l_tifp == NULL ? -1 : fileno(con->c_archctl->ac_log->l_tifp),
-			    fileno(con->c_archctl->ac_log->l_mdfp),
-			    fileno(con->c_archctl->ac_log->l_mfp),
+			    con->c_archctl->ac_log->l_tifp == NULL ? -1 : __pmLogFileno(con->c_archctl->ac_log, con->c_archctl->ac_log->l_tifp),
+			    __pmLogFileno(con->c_archctl->ac_log, con->c_archctl->ac_log->l_mdfp),
+			    __pmLogFileno(con->c_archctl->ac_log, con->c_archctl->ac_log->l_mfp),
 			    con->c_archctl->ac_log->l_refcnt,
 			    con->c_archctl->ac_log->l_curvol);
 		    fprintf(f, " offset=%ld (vol=%d) serial=%d",
@@ -1717,6 +1746,8 @@ __pmCloseChannelbyContext(__pmContext *ctxp, int expect, int recv)
 	}
 	__pmCloseSocket(ctxp->c_pmcd->pc_fd);
 	ctxp->c_pmcd->pc_fd = -1;
+	/* no reply is coming now */
+	ctxp->c_pmcd->pc_pending = 0;
     }
 }
 
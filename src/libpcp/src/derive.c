@@ -1560,6 +1560,8 @@ registerderived(const char *name, const char *expr, int isanon)
     pmid.item = registered.nmetric;
     registered.mlist[registered.nmetric-1].pmid = *((pmID *)&pmid);
     registered.mlist[registered.nmetric-1].expr = np;
+    registered.mlist[registered.nmetric-1].nstep = 0;
+    registered.mlist[registered.nmetric-1].step = NULL;
 
 #ifdef PCP_DEBUG
     if (pmDebug & DBG_TRACE_DERIVE) {
@@ -2107,6 +2109,8 @@ __dmopencontext(__pmContext *ctxp)
     }
     ctxp->c_dm = (void *)cp;
     cp->nmetric = registered.nmetric;
+    cp->szvbuf = 0;
+    cp->vbuf = NULL;
     if ((cp->mlist = (dm_t *)malloc(cp->nmetric*sizeof(dm_t))) == NULL) {
 	PM_UNLOCK(registered.mutex);
 	__pmNoMem("pmNewContext: derived metrics (mlist)", cp->nmetric*sizeof(dm_t), PM_FATAL_ERR);
@@ -2117,6 +2121,8 @@ __dmopencontext(__pmContext *ctxp)
 	cp->mlist[i].name = registered.mlist[i].name;
 	cp->mlist[i].pmid = registered.mlist[i].pmid;
 	cp->mlist[i].anon = registered.mlist[i].anon;
+	cp->mlist[i].nstep = 0;
+	cp->mlist[i].step = NULL;
 	assert(registered.mlist[i].expr != NULL);
 	if (!registered.mlist[i].anon) {
 	    /*
@@ -2154,6 +2160,7 @@ __dmopencontext(__pmContext *ctxp)
 		cp->mlist[i].expr->desc.pmid = cp->mlist[i].pmid;
 	    }
 	}
+	__dmcompile(&cp->mlist[i]);
 #ifdef PCP_DEBUG
 	if ((pmDebug & DBG_TRACE_DERIVE) && cp->mlist[i].expr != NULL) {
 	    fprintf(stderr, "__dmopencontext: bind metric[%d] %s\n", i, registered.mlist[i].name);
@@ -2181,8 +2188,10 @@ __dmclosecontext(__pmContext *ctxp)
     if (cp == NULL) return;
     for (i = 0; i < cp->nmetric; i++) {
 	free_expr(cp->mlist[i].expr); 
+	free(cp->mlist[i].step);
     }
     free(cp->mlist);
+    free(cp->vbuf);
     free(cp);
     ctxp->c_dm = NULL;
 }
@@ -52,6 +52,8 @@ typedef struct {		/* one derived metric */
     int		anon;		/* 1 for anonymous derived metrics */
     pmID	pmid;
     node_t	*expr;		/* NULL => invalid, e.g. dup or missing operands */
+    int		nstep;		/* length of step[] */
+    node_t	**step;		/* compiled expr, NULL => walk the tree */
 } dm_t;
 
 /*
@@ -65,6 +67,8 @@ typedef struct {
     dm_t		*mlist;
     int			fetch_has_dm;	/* ==1 if pmResult rewrite needed */
     int			numpmid;	/* from pmFetch before rewrite */
+    int			szvbuf;		/* length of vbuf[] */
+    double		*vbuf;		/* scratch for compiled exprs */
 } ctl_t;
 
 /* lexical types */
@@ -99,5 +103,6 @@ extern int __dmdesc(__pmContext *, pmID, pmDesc *) _PCP_HIDDEN;
 extern int __dmprefetch(__pmContext *, int, const pmID *, pmID **) _PCP_HIDDEN;
 extern void __dmpostfetch(__pmContext *, pmResult **) _PCP_HIDDEN;
 extern void __dmdumpexpr(node_t *, int) _PCP_HIDDEN;
+extern void __dmcompile(dm_t *) _PCP_HIDDEN;
 
 #endif	/* _DERIVE_H */
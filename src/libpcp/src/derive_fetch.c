@@ -467,29 +467,41 @@ bin_op(int type, int op, pmAtomValue a, int ltype, int lmul, int ldiv, pmAtomVal
 
 
 /*
- * Walk an expression tree, filling in operand values from the
- * pmResult at the leaf nodes and propagating the computed values
- * towards the root node of the tree.
+ * One-trip initialization for rate(time counter) -> time utilization,
+ * the factor to scale the operand from counter units into seconds
+ */
+static double
+rate_time_scale(node_t *np)
+{
+    int		i;
+
+    if (np->info->time_scale < 0) {
+	np->info->time_scale = 1;
+	if (np->left->desc.units.scaleTime > PM_TIME_SEC) {
+	    for (i = PM_TIME_SEC; i < np->left->desc.units.scaleTime; i++)
+		np->info->time_scale *= 60;
+	}
+	else {
+	    for (i = np->left->desc.units.scaleTime; i < PM_TIME_SEC; i++)
+		np->info->time_scale /= 1000;
+	}
+    }
+    return np->info->time_scale;
+}
+
+/*
+ * Compute the values for one node of an expression tree, from the
+ * pmResult for leaf nodes, else from the values already computed for
+ * the operand nodes.
  */
 static int
-eval_expr(node_t *np, pmResult *rp, int level)
+eval_node(node_t *np, pmResult *rp)
 {
-    int		sts;
     int		i;
     int		j;
     int		k;
     size_t	need;
 
-    assert(np != NULL);
-    if (np->left != NULL) {
-	sts = eval_expr(np->left, rp, level+1);
-	if (sts < 0) return sts;
-    }
-    if (np->right != NULL) {
-	sts = eval_expr(np->right, rp, level+1);
-	if (sts < 0) return sts;
-    }
-
     /* mostly, np->left is not NULL ... */
     assert (np->type == L_NUMBER || np->type == L_NAME || np->left != NULL);
 
@@ -626,26 +638,7 @@ eval_expr(node_t *np, pmResult *rp, int level)
 		     */
 		    if (np->left->desc.units.dimTime == 1) {
 			/* scale rate(time counter) -> time utilization */
-			if (np->info->time_scale < 0) {
-			    /*
-			     * one trip initialization for time utilization
-			     * scaling factor (to scale metric from counter
-			     * units into seconds)
-			     */
-			    int		i;
-			    np->info->time_scale = 1;
-			    if (np->left->desc.units.scaleTime > PM_TIME_SEC) {
-
-				for (i = PM_TIME_SEC; i < np->left->desc.units.scaleTime; i++)
-
-				    np->info->time_scale *= 60;
-			    }
-			    else {
-				for (i = np->left->desc.units.scaleTime; i < PM_TIME_SEC; i++)
-				    np->info->time_scale /= 1000;
-			    }
-			}
-			np->info->ivlist[k].value.d *= np->info->time_scale;
+			np->info->ivlist[k].value.d *= rate_time_scale(np);
 		    }
 		}
 		k++;
@@ -1065,6 +1058,463 @@ eval_expr(node_t *np, pmResult *rp, int level)
     /*NOTREACHED*/
 }
 
+/*
+ * Walk an expression tree, filling in operand values from the
+ * pmResult at the leaf nodes and propagating the computed values
+ * towards the root node of the tree.
+ */
+static int
+eval_expr(node_t *np, pmResult *rp, int level)
+{
+    int		sts;
+
+    assert(np != NULL);
+    if (np->left != NULL) {
+	sts = eval_expr(np->left, rp, level+1);
+	if (sts < 0) return sts;
+    }
+    if (np->right != NULL) {
+	sts = eval_expr(np->right, rp, level+1);
+	if (sts < 0) return sts;
+    }
+    return eval_node(np, rp);
+}
+
+/*
+ * Compiled expressions.
+ *
+ * __dmcompile() flattens a bound expression tree into its nodes in
+ * evaluation (post) order, so each fetch is a loop over the operators
+ * rather than a recursive walk of the tree.  The arithmetic operators,
+ * delta(), rate() and the aggregates are applied to the whole vector
+ * of instance values at once when the operands line up (the common
+ * case of operands over the same instance domain, fetched with the
+ * same profile), with double results computed over contiguous arrays
+ * the compiler can vectorize.  Anything else falls back to eval_node()
+ * one value at a time, and the results are the same either way.
+ *
+ * PCP_DERIVED_NOCOMPILE in the environment at pmNewContext() selects
+ * the tree walk instead, for QA and benchmarks.
+ */
+
+static int
+count_nodes(node_t *np)
+{
+    if (np == NULL)
+	return 0;
+    return 1 + count_nodes(np->left) + count_nodes(np->right);
+}
+
+static void
+order_nodes(node_t *np, node_t **step, int *nstep)
+{
+    if (np == NULL)
+	return;
+    order_nodes(np->left, step, nstep);
+    order_nodes(np->right, step, nstep);
+    step[(*nstep)++] = np;
+}
+
+void
+__dmcompile(dm_t *dp)
+{
+    int		n;
+
+    dp->nstep = 0;
+    dp->step = NULL;
+    if (dp->expr == NULL || getenv("PCP_DERIVED_NOCOMPILE") != NULL)
+	return;
+    n = count_nodes(dp->expr);
+    if ((dp->step = (node_t **)malloc(n * sizeof(node_t *))) == NULL)
+	/* not fatal, the tree walk works just as well */
+	return;
+    order_nodes(dp->expr, dp->step, &dp->nstep);
+}
+
+/* scratch for two vectors of n doubles */
+static double *
+vec_scratch(ctl_t *cp, int n)
+{
+    if (2 * n > cp->szvbuf) {
+	free(cp->vbuf);
+	if ((cp->vbuf = (double *)malloc(2 * n * sizeof(double))) == NULL) {
+	    __pmNoMem("vec_scratch", 2 * n * sizeof(double), PM_FATAL_ERR);
+	    /*NOTREACHED*/
+	}
+	cp->szvbuf = 2 * n;
+    }
+    return cp->vbuf;
+}
+
+static int
+vec_numeric(int type)
+{
+    return type == PM_TYPE_32 || type == PM_TYPE_U32 ||
+	   type == PM_TYPE_64 || type == PM_TYPE_U64 ||
+	   type == PM_TYPE_FLOAT || type == PM_TYPE_DOUBLE;
+}
+
+static void
+vec_alloc(node_t *np, int n)
+{
+    if ((np->info->ivlist = (val_t *)malloc(n*sizeof(val_t))) == NULL) {
+	__pmNoMem("eval_prog: ivlist", n*sizeof(val_t), PM_FATAL_ERR);
+	/*NOTREACHED*/
+    }
+}
+
+/*
+ * Values of the operand np as doubles with units scaling applied, as
+ * bin_op() does for a PM_TYPE_DOUBLE result ... stride is 0 for a
+ * singular operand that applies to every instance.
+ */
+static void
+vec_double(node_t *np, int n, int stride, double *out)
+{
+    val_t	*vp = np->info->ivlist;
+    double	mul = np->info->mul_scale;
+    double	div = np->info->div_scale;
+    int		k;
+
+    switch (np->desc.type) {
+	case PM_TYPE_32:
+	    for (k = 0; k < n; k++)
+		out[k] = vp[k*stride].value.l;
+	    break;
+	case PM_TYPE_U32:
+	    for (k = 0; k < n; k++)
+		out[k] = vp[k*stride].value.ul;
+	    break;
+	case PM_TYPE_64:
+	    for (k = 0; k < n; k++)
+		out[k] = vp[k*stride].value.ll;
+	    break;
+	case PM_TYPE_U64:
+	    for (k = 0; k < n; k++)
+		out[k] = vp[k*stride].value.ull;
+	    break;
+	case PM_TYPE_FLOAT:
+	    for (k = 0; k < n; k++)
+		out[k] = vp[k*stride].value.f;
+	    break;
+	case PM_TYPE_DOUBLE:
+	    for (k = 0; k < n; k++)
+		out[k] = vp[k*stride].value.d;
+	    break;
+    }
+    if (mul != 1 || div != 1) {
+	for (k = 0; k < n; k++)
+	    out[k] = (out[k] / div) * mul;
+    }
+}
+
+/* same type operands and result, no promotion needed */
+#define VEC_BINOP(t) \
+    switch (np->type) { \
+	case L_PLUS: \
+	    for (k = 0; k < n; k++) \
+		iv[k].value.t = lv[k*ls].value.t + rv[k*rs].value.t; \
+	    break; \
+	case L_MINUS: \
+	    for (k = 0; k < n; k++) \
+		iv[k].value.t = lv[k*ls].value.t - rv[k*rs].value.t; \
+	    break; \
+	case L_STAR: \
+	    for (k = 0; k < n; k++) \
+		iv[k].value.t = lv[k*ls].value.t * rv[k*rs].value.t; \
+	    break; \
+    }
+
+static int
+vec_binop(ctl_t *cp, node_t *np)
+{
+    node_t	*lp = np->left;
+    node_t	*rp = np->right;
+    val_t	*lv, *rv, *iv;
+    double	*a, *b;
+    int		ls, rs;
+    int		n, k;
+
+    ls = lp->desc.indom == PM_INDOM_NULL ? 0 : 1;
+    rs = rp->desc.indom == PM_INDOM_NULL ? 0 : 1;
+    if (ls && rs) {
+	/* operand instances must be in the same order */
+	if (lp->info->numval != rp->info->numval)
+	    return eval_node(np, NULL);
+	for (k = 0; k < lp->info->numval; k++) {
+	    if (lp->info->ivlist[k].inst != rp->info->ivlist[k].inst)
+		return eval_node(np, NULL);
+	}
+    }
+
+    free_ivlist(np);
+    if (lp->info->numval == 0 || rp->info->numval == 0) {
+	np->info->numval = 0;
+	return 0;
+    }
+    n = ls ? lp->info->numval : rp->info->numval;
+    vec_alloc(np, n);
+    lv = lp->info->ivlist;
+    rv = rp->info->ivlist;
+    iv = np->info->ivlist;
+    for (k = 0; k < n; k++)
+	iv[k].inst = ls ? lv[k].inst : rv[k*rs].inst;
+
+    if (np->desc.type == PM_TYPE_DOUBLE) {
+	a = vec_scratch(cp, n);
+	b = &a[n];
+	vec_double(lp, n, ls, a);
+	vec_double(rp, n, rs, b);
+	switch (np->type) {
+	    case L_PLUS:
+		for (k = 0; k < n; k++)
+		    a[k] = a[k] + b[k];
+		break;
+	    case L_MINUS:
+		for (k = 0; k < n; k++)
+		    a[k] = a[k] - b[k];
+		break;
+	    case L_STAR:
+		for (k = 0; k < n; k++)
+		    a[k] = a[k] * b[k];
+		break;
+	    case L_SLASH:
+		for (k = 0; k < n; k++)
+		    a[k] = a[k] == 0 ? 0 : a[k] / b[k];
+		break;
+	}
+	for (k = 0; k < n; k++)
+	    iv[k].value.d = a[k];
+    }
+    else if (lp->desc.type == np->desc.type && rp->desc.type == np->desc.type) {
+	switch (np->desc.type) {
+	    case PM_TYPE_32:
+		VEC_BINOP(l);
+		break;
+	    case PM_TYPE_U32:
+		VEC_BINOP(ul);
+		break;
+	    case PM_TYPE_64:
+		VEC_BINOP(ll);
+		break;
+	    case PM_TYPE_U64:
+		VEC_BINOP(ull);
+		break;
+	    case PM_TYPE_FLOAT:
+		VEC_BINOP(f);
+		break;
+	}
+    }
+    else {
+	for (k = 0; k < n; k++)
+	    iv[k].value = bin_op(np->desc.type, np->type,
+			   lv[k*ls].value, lp->desc.type, lp->info->mul_scale, lp->info->div_scale,
+			   rv[k*rs].value, rp->desc.type, rp->info->mul_scale, rp->info->div_scale);
+    }
+    np->info->numval = n;
+    return n;
+}
+
+#define VEC_DELTA(t) \
+    for (k = 0; k < n; k++) \
+	iv[k].value.t = cv[k].value.t - pv[k].value.t
+
+#define VEC_RATE(t) \
+    for (k = 0; k < n; k++) \
+	iv[k].value.d = (double)(cv[k].value.t - pv[k].value.t)
+
+static int
+vec_delta(node_t *np, pmResult *rp)
+{
+    node_t		*lp = np->left;
+    val_t		*cv = lp->info->ivlist;
+    val_t		*pv = lp->info->last_ivlist;
+    val_t		*iv;
+    struct timeval	stampdiff;
+    double		dt;
+    double		scale;
+    int			n = lp->info->numval;
+    int			k;
+
+    /* this and the last values must have the same instances in order */
+    if (n <= 0 || n != lp->info->last_numval || !vec_numeric(lp->desc.type))
+	return eval_node(np, rp);
+    for (k = 0; k < n; k++) {
+	if (cv[k].inst != pv[k].inst)
+	    return eval_node(np, rp);
+    }
+
+    np->info->last_stamp = np->info->stamp;
+    np->info->stamp = rp->timestamp;
+    free_ivlist(np);
+    vec_alloc(np, n);
+    iv = np->info->ivlist;
+    for (k = 0; k < n; k++)
+	iv[k].inst = cv[k].inst;
+
+    if (np->type == L_DELTA) {
+	switch (lp->desc.type) {
+	    case PM_TYPE_32:
+		VEC_DELTA(l);
+		break;
+	    case PM_TYPE_U32:
+		VEC_DELTA(ul);
+		break;
+	    case PM_TYPE_64:
+		VEC_DELTA(ll);
+		break;
+	    case PM_TYPE_U64:
+		VEC_DELTA(ull);
+		break;
+	    case PM_TYPE_FLOAT:
+		VEC_DELTA(f);
+		break;
+	    case PM_TYPE_DOUBLE:
+		VEC_DELTA(d);
+		break;
+	}
+    }
+    else {
+	switch (lp->desc.type) {
+	    case PM_TYPE_32:
+		VEC_RATE(l);
+		break;
+	    case PM_TYPE_U32:
+		VEC_RATE(ul);
+		break;
+	    case PM_TYPE_64:
+		VEC_RATE(ll);
+		break;
+	    case PM_TYPE_U64:
+		VEC_RATE(ull);
+		break;
+	    case PM_TYPE_FLOAT:
+		VEC_RATE(f);
+		break;
+	    case PM_TYPE_DOUBLE:
+		VEC_RATE(d);
+		break;
+	}
+	stampdiff = np->info->stamp;
+	__pmtimevalDec(&stampdiff, &np->info->last_stamp);
+	dt = __pmtimevalToReal(&stampdiff);
+	for (k = 0; k < n; k++)
+	    iv[k].value.d /= dt;
+	if (lp->desc.units.dimTime == 1) {
+	    scale = rate_time_scale(np);
+	    for (k = 0; k < n; k++)
+		iv[k].value.d *= scale;
+	}
+    }
+    np->info->numval = n;
+    return n;
+}
+
+#define VEC_SUM(t) \
+    for (k = 0; k < n; k++) \
+	res->t += lv[k].value.t
+
+#define VEC_AVG(t) \
+    for (k = 0; k < n; k++) \
+	res->f += (float)lv[k].value.t / n
+
+#define VEC_MAX(t) \
+    if (n > 0) { \
+	res->t = lv[0].value.t; \
+	for (k = 1; k < n; k++) \
+	    if (res->t < lv[k].value.t) \
+		res->t = lv[k].value.t; \
+    }
+
+#define VEC_MIN(t) \
+    if (n > 0) { \
+	res->t = lv[0].value.t; \
+	for (k = 1; k < n; k++) \
+	    if (res->t > lv[k].value.t) \
+		res->t = lv[k].value.t; \
+    }
+
+/* one loop per aggregate and type, rather than a switch per value */
+#define VEC_AGGR(OP, type) \
+    switch (type) { \
+	case PM_TYPE_32: OP(l); break; \
+	case PM_TYPE_U32: OP(ul); break; \
+	case PM_TYPE_64: OP(ll); break; \
+	case PM_TYPE_U64: OP(ull); break; \
+	case PM_TYPE_FLOAT: OP(f); break; \
+	case PM_TYPE_DOUBLE: OP(d); break; \
+    }
+
+static int
+vec_aggr(node_t *np, pmResult *rp)
+{
+    val_t	*lv = np->left->info->ivlist;
+    pmAtomValue	*res;
+    int		n = np->left->info->numval;
+    int		k;
+
+    if (np->type == L_COUNT || np->info->ivlist == NULL ||
+	!vec_numeric(np->type == L_AVG ? np->left->desc.type : np->desc.type))
+	return eval_node(np, rp);
+
+    np->info->numval = 1;
+    res = &np->info->ivlist[0].value;
+    switch (np->type) {
+	case L_AVG:
+	    res->f = 0;
+	    VEC_AGGR(VEC_AVG, np->left->desc.type);
+	    break;
+	case L_SUM:
+	    memset(res, 0, sizeof(*res));
+	    VEC_AGGR(VEC_SUM, np->desc.type);
+	    break;
+	case L_MAX:
+	    VEC_AGGR(VEC_MAX, np->desc.type);
+	    break;
+	case L_MIN:
+	    VEC_AGGR(VEC_MIN, np->desc.type);
+	    break;
+    }
+    return np->info->numval;
+}
+
+/* Evaluate a compiled expression, returns as for eval_expr() */
+static int
+eval_prog(ctl_t *cp, dm_t *dp, pmResult *rp)
+{
+    node_t	*np;
+    int		sts = 0;
+    int		s;
+
+    for (s = 0; s < dp->nstep; s++) {
+	np = dp->step[s];
+	switch (np->type) {
+	    case L_PLUS:
+	    case L_MINUS:
+	    case L_STAR:
+	    case L_SLASH:
+		sts = vec_binop(cp, np);
+		break;
+	    case L_DELTA:
+	    case L_RATE:
+		sts = vec_delta(np, rp);
+		break;
+	    case L_AVG:
+	    case L_SUM:
+	    case L_MAX:
+	    case L_MIN:
+		sts = vec_aggr(np, rp);
+		break;
+	    default:
+		sts = eval_node(np, rp);
+		break;
+	}
+	if (sts < 0)
+	    return sts;
+    }
+    return sts;
+}
+
 /*
  * Algorithm here is complicated by trying to re-write the pmResult.
  *
@@ -1143,7 +1593,10 @@ __dmpostfetch(__pmContext *ctxp, pmResult **result)
 			    valfmt = PM_VAL_INSITU;
 			else
 			    valfmt = PM_VAL_DPTR;
-			numval = eval_expr(cp->mlist[m].expr, rp, 1);
+			if (cp->mlist[m].step != NULL)
+			    numval = eval_prog(cp, &cp->mlist[m], rp);
+			else
+			    numval = eval_expr(cp->mlist[m].expr, rp, 1);
 #ifdef PCP_DEBUG
     if ((pmDebug & DBG_TRACE_DERIVE) && (pmDebug & DBG_TRACE_APPL2)) {
 	int	k;
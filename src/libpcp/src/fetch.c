@@ -190,8 +190,157 @@ done:
     return n;
 }
 
+/*
+ * pmFetch() for a host context in two halves, so that a client with
+ * contexts for many pmcds can have a fetch outstanding on each of them
+ * at once, and collect the results as they arrive rather than paying
+ * for the round-trips one after another.
+ *
+ * Contexts for the same host may share a pmcd connection (see
+ * pc_refcnt), and replies on a connection are not matched to the
+ * request, so at most one fetch may be outstanding per connection.
+ * While it is, no context using that connection may be used for
+ * anything else until __pmFetchRecv() or __pmFetchCancel() is called
+ * for the context that sent it.  If another fetch is already
+ * outstanding on the connection, PM_ERR_AGAIN is returned and nothing
+ * is sent.
+ *
+ * Returns the descriptor that becomes readable when the reply arrives.
+ */
+int
+__pmFetchSend(int ctxid, int numpmid, pmID pmidlist[])
+{
+    __pmContext	*ctxp;
+    int		n;
+    int		newcnt;
+    pmID	*newlist = NULL;
+
+    if (numpmid < 1)
+	return PM_ERR_TOOSMALL;
+    if ((ctxp = __pmHandleToPtr(ctxid)) == NULL)
+	return PM_ERR_NOCONTEXT;
+    if (ctxp->c_type != PM_CONTEXT_HOST) {
+	PM_UNLOCK(ctxp->c_lock);
+	return PM_ERR_NOTHOST;
+    }
+
+    /* for derived metrics, may need to rewrite the pmidlist */
+    newcnt = __pmPrepareFetch(ctxp, numpmid, pmidlist, &newlist);
+    if (newcnt > numpmid) {
+	numpmid = newcnt;
+	pmidlist = newlist;
+    }
+
+    PM_LOCK(ctxp->c_pmcd->pc_lock);
+    if (ctxp->c_pmcd->pc_pending)
+	n = PM_ERR_AGAIN;
+    else if ((n = request_fetch(ctxid, ctxp, numpmid, pmidlist)) >= 0) {
+	ctxp->c_pmcd->pc_pending = 1;
+	n = ctxp->c_pmcd->pc_fd;
+    }
+    PM_UNLOCK(ctxp->c_pmcd->pc_lock);
+    if (newlist != NULL)
+	free(newlist);
+    PM_UNLOCK(ctxp->c_lock);
+    return n;
+}
+
+/*
+ * Second half of __pmFetchSend() ... returns as for pmFetch().  This
+ * blocks until the reply arrives (up to the usual request timeout),
+ * so call it once the descriptor is readable.
+ */
+int
+__pmFetchRecv(int ctxid, pmResult **result)
+{
+    __pmContext	*ctxp;
+    __pmPDU	*pb;
+    int		pinpdu;
+    int		changed = 0;
+    int		n;
+
+    if ((ctxp = __pmHandleToPtr(ctxid)) == NULL)
+	return PM_ERR_NOCONTEXT;
+    if (ctxp->c_type != PM_CONTEXT_HOST) {
+	PM_UNLOCK(ctxp->c_lock);
+	return PM_ERR_NOTHOST;
+    }
+
+    /* as for pmFetch(), unlock pc_lock before decoding the result */
+    PM_LOCK(ctxp->c_pmcd->pc_lock);
+    ctxp->c_pmcd->pc_pending = 0;
+    do {
+PM_FAULT_POINT("libpcp/" __FILE__ ":2", PM_FAULT_TIMEOUT);
+	pinpdu = n = __pmGetPDU(ctxp->c_pmcd->pc_fd, ANY_SIZE,
+				ctxp->c_pmcd->pc_tout_sec, &pb);
+	if (n == PDU_RESULT) {
+	    PM_UNLOCK(ctxp->c_pmcd->pc_lock);
+	    n = __pmDecodeResult(pb, result);
+	}
+	else if (n == PDU_ERROR) {
+	    __pmDecodeError(pb, &n);
+	    if (n > 0)
+		/* PMCD state change protocol */
+		changed = n;
+	    else
+		PM_UNLOCK(ctxp->c_pmcd->pc_lock);
+	}
+	else {
+	    __pmCloseChannelbyContext(ctxp, PDU_RESULT, n);
+	    PM_UNLOCK(ctxp->c_pmcd->pc_lock);
+	    if (n != PM_ERR_TIMEOUT)
+		n = PM_ERR_IPC;
+	}
+	if (pinpdu > 0)
+	    __pmUnpinPDUBuf(pb);
+    } while (n > 0);
+
+    if (n == 0) {
+	n |= changed;
+	/* a result was decoded, process derived metrics, if any */
+	__pmFinishResult(ctxp, n, result);
+    }
+    PM_UNLOCK(ctxp->c_lock);
+    return n;
+}
+
+/*
+ * Give up on a fetch sent with __pmFetchSend() whose reply has not
+ * arrived in time ... as for a pmFetch() timeout, the connection to
+ * pmcd is closed and pmReconnectContext() is needed to use it again.
+ */
+int
+__pmFetchCancel(int ctxid)
+{
+    __pmContext	*ctxp;
+
+    if ((ctxp = __pmHandleToPtr(ctxid)) == NULL)
+	return PM_ERR_NOCONTEXT;
+    if (ctxp->c_type != PM_CONTEXT_HOST) {
+	PM_UNLOCK(ctxp->c_lock);
+	return PM_ERR_NOTHOST;
+    }
+    PM_LOCK(ctxp->c_pmcd->pc_lock);
+    __pmCloseChannelbyContext(ctxp, PDU_RESULT, PM_ERR_TIMEOUT);
+    PM_UNLOCK(ctxp->c_pmcd->pc_lock);
+    PM_UNLOCK(ctxp->c_lock);
+    return PM_ERR_TIMEOUT;
+}
+
 int
 pmFetchArchive(pmResult **result)
+{
+    return __pmFetchArchiveFilter(0, NULL, result);
+}
+
+/*
+ * pmFetchArchive(), but if nfilter > 0 only the pmValueSets for the
+ * metrics in filter[] (sorted in ascending order) are decoded and
+ * returned, and records with none of them are skipped ... <mark>
+ * records are always returned
+ */
+int
+__pmFetchArchiveFilter(int nfilter, pmID *filter, pmResult **result)
 {
     int		n;
     __pmContext	*ctxp;
@@ -210,7 +359,7 @@ pmFetchArchive(pmResult **result)
 		n = PM_ERR_MODE;
 	    else {
 		/* assume PM_CONTEXT_ARCHIVE and BACK or FORW */
-		n = __pmLogFetch(ctxp, 0, NULL, result);
+		n = __pmLogFetchFilter(ctxp, 0, NULL, nfilter, filter, result);
 		if (n >= 0) {
 		    ctxp->c_origin.tv_sec = (__int32_t)(*result)->timestamp.tv_sec;
 		    ctxp->c_origin.tv_usec = (__int32_t)(*result)->timestamp.tv_usec;
@@ -19,6 +19,9 @@
 #include "pmda.h"
 #include "internal.h"
 
+/* keep pmValueSets and pmValueBlocks in the result suitably aligned */
+#define ARENA_ALIGN(n)	(((n) + sizeof(__int64_t) - 1) & ~(sizeof(__int64_t) - 1))
+
 /*
  * Called with valid context locked ...
  */
@@ -27,15 +30,26 @@ __pmFetchLocal(__pmContext *ctxp, int numpmid, pmID pmidlist[], pmResult **resul
 {
     int		sts;
     int		ctx;
+    int		i;
     int		j;
     int		k;
     int		n;
+    int		ndone = 0;
     pmResult	*ans;
     pmResult	*tmp_ans;
+    pmValueSet	*vsp;
+    pmValueSet	*nvsp;
+    pmValueBlock *vbp;
     __pmDSO	*dp;
-    int		need;
+    char	*base;
+    size_t	hdr;
+    size_t	need;
+    size_t	vsize;
 
     static pmID * splitlist=NULL;
+    static pmValueSet ** vsplist=NULL;	/* value set for each pmidlist[] */
+    static pmValueSet * errlist=NULL;	/* value sets for failed fetches */
+    static pmResult ** donelist=NULL;	/* results from the DSOs */
     static int	splitmax=0;
 
     if (PM_MULTIPLE_THREADS(PM_SCOPE_DSO_PMDA))
@@ -46,47 +60,50 @@ __pmFetchLocal(__pmContext *ctxp, int numpmid, pmID pmidlist[], pmResult **resul
 
     ctx = __pmPtrToHandle(ctxp);
 
-    /*
-     * this is very ugly ... the DSOs have a high-water mark
-     * allocation algorithm for the result skeleton, but the
-     * code that calls us assumes it has freedom to retain
-     * this result structure for as long as it wishes, and
-     * then to call pmFreeResult
-     *
-     * we make another skeleton, selectively copy and return that
-     *
-     * (numpmid - 1) because there's room for one valueSet
-     * in a pmResult
-     */
-    need = (int)sizeof(pmResult) + (numpmid - 1) * (int)sizeof(pmValueSet *);
-    if ((ans = (pmResult *)malloc(need)) == NULL)
-	return -oserror();
-
     /*
      * Check if we have enough space to accomodate "best" case scenario -
      * all pmids are from the same domain
      */
     if (splitmax < numpmid) {
-	splitmax = numpmid;
-	pmID *tmp_list = (pmID *)realloc(splitlist, sizeof(pmID)*splitmax);
-	if (tmp_list == NULL) {
+	pmID *tmp_list = (pmID *)realloc(splitlist, sizeof(pmID)*numpmid);
+	pmValueSet **tmp_vsplist = NULL;
+	pmValueSet *tmp_errlist = NULL;
+	pmResult **tmp_donelist = NULL;
+	if (tmp_list != NULL) {
+	    splitlist = tmp_list;
+	    tmp_vsplist = (pmValueSet **)realloc(vsplist, sizeof(pmValueSet *)*numpmid);
+	}
+	if (tmp_vsplist != NULL) {
+	    vsplist = tmp_vsplist;
+	    tmp_errlist = (pmValueSet *)realloc(errlist, sizeof(pmValueSet)*numpmid);
+	}
+	if (tmp_errlist != NULL) {
+	    errlist = tmp_errlist;
+	    tmp_donelist = (pmResult **)realloc(donelist, sizeof(pmResult *)*numpmid);
+	}
+	if (tmp_donelist == NULL) {
 	    free(splitlist);
+	    free(vsplist);
+	    free(errlist);
+	    free(donelist);
+	    splitlist = NULL;
+	    vsplist = NULL;
+	    errlist = NULL;
+	    donelist = NULL;
 	    splitmax = 0;
-	    free(ans);
 	    return -oserror();
 	}
-	splitlist = tmp_list;
+	donelist = tmp_donelist;
+	splitmax = numpmid;
     }
 
-    ans->numpmid = numpmid;
-    __pmtimevalNow(&ans->timestamp);
     for (j = 0; j < numpmid; j++)
-	ans->vset[j] = NULL;
+	vsplist[j] = NULL;
 
     for (j = 0; j < numpmid; j++) {
 	int cnt;
 
-	if (ans->vset[j] != NULL)
+	if (vsplist[j] != NULL)
 	    /* picked up in a previous fetch */
 	    continue;
 
@@ -130,29 +147,20 @@ __pmFetchLocal(__pmContext *ctxp, int numpmid, pmID pmidlist[], pmResult **resul
 		dp->dispatch.version.four.ext->e_context = ctx;
 	    sts = dp->dispatch.version.any.fetch(cnt, splitlist, &tmp_ans,
 						dp->dispatch.version.any.ext);
+	    if (sts >= 0)
+		donelist[ndone++] = tmp_ans;
 	}
 
-	/* Copy results back
-	 *
-	 * Note: We DO NOT have to free tmp_ans since DSO PMDA would
-	 *		ALWAYS return a pointer to the static area.
-	 */
+	/* Note where the results are */
 	for (n = 0, k = j; k < numpmid && n < cnt; k++) {
 	    if (pmidlist[k] == splitlist[n]) {
 		if (sts < 0) {
-		    ans->vset[k] = (pmValueSet *)malloc(sizeof(pmValueSet));
-		    if (ans->vset[k] == NULL) {
-			/* cleanup all partial allocations for ans->vset[] */
-			for (k--; k >=0; k--)
-			    free(ans->vset[k]);
-			free(ans);
-			return -oserror();
-		    }
-		    ans->vset[k]->numval = sts;
-		    ans->vset[k]->pmid = pmidlist[k];
+		    errlist[k].pmid = pmidlist[k];
+		    errlist[k].numval = sts;
+		    vsplist[k] = &errlist[k];
 		}
 		else {
-		    ans->vset[k] = tmp_ans->vset[n];
+		    vsplist[k] = tmp_ans->vset[n];
 		}
 #ifdef PCP_DEBUG
 		if (pmDebug & DBG_TRACE_FETCH) {
@@ -160,17 +168,89 @@ __pmFetchLocal(__pmContext *ctxp, int numpmid, pmID pmidlist[], pmResult **resul
 		    char	errmsg[PM_MAXERRMSGLEN];
 		    fprintf(stderr, "__pmFetchLocal: [%d] PMID=%s nval=",
 			    k, pmIDStr_r(pmidlist[k], strbuf, sizeof(strbuf)));
-		    if (ans->vset[k]->numval < 0)
+		    if (vsplist[k]->numval < 0)
 			fprintf(stderr, "%s\n",
-				pmErrStr_r(ans->vset[k]->numval, errmsg, sizeof(errmsg)));
+				pmErrStr_r(vsplist[k]->numval, errmsg, sizeof(errmsg)));
 		    else
-			fprintf(stderr, "%d\n", ans->vset[k]->numval);
+			fprintf(stderr, "%d\n", vsplist[k]->numval);
 		}
 #endif
 		n++;
 	    }
 	}
     }
+
+    /*
+     * The DSOs have a high-water mark allocation algorithm for the
+     * result skeleton, but the code that calls us assumes it has
+     * freedom to retain this result structure for as long as it
+     * wishes, and then to call pmFreeResult.  Nor can pmValueSets
+     * from several DSOs (or from an error) be combined in one result,
+     * as some may be in a pinned PDU buffer (refer to the notes in
+     * freeresult.c).
+     *
+     * So make another skeleton, copy the pmValueSets and pmValueBlocks
+     * into one pinned PDU buffer, released by __pmFreeResultValues()
+     * (and so pmFreeResult()) in one go, and release the DSOs'
+     * pmValueSets here.
+     *
+     * (numpmid - 1) because there's room for one valueSet in a pmResult
+     */
+    hdr = sizeof(pmResult) + (numpmid - 1) * sizeof(pmValueSet *);
+    need = 0;
+    for (j = 0; j < numpmid; j++) {
+	vsp = vsplist[j];
+	if (vsp->numval <= 0) {
+	    need += ARENA_ALIGN(sizeof(pmValueSet) - sizeof(pmValue));
+	    continue;
+	}
+	need += ARENA_ALIGN(sizeof(pmValueSet) + (vsp->numval - 1) * sizeof(pmValue));
+	if (vsp->valfmt == PM_VAL_INSITU)
+	    continue;
+	for (i = 0; i < vsp->numval; i++)
+	    need += ARENA_ALIGN(vsp->vlist[i].value.pval->vlen);
+    }
+
+    ans = NULL;
+    if (need > INT_MAX)
+	sts = PM_ERR_TOOBIG;
+    else if ((ans = (pmResult *)malloc(hdr)) == NULL)
+	sts = -oserror();
+    else if ((base = (char *)__pmFindPDUBuf((int)need)) == NULL) {
+	sts = -oserror();
+	free(ans);
+    }
+    else {
+	ans->numpmid = numpmid;
+	__pmtimevalNow(&ans->timestamp);
+	need = 0;
+	for (j = 0; j < numpmid; j++) {
+	    vsp = vsplist[j];
+	    nvsp = ans->vset[j] = (pmValueSet *)&base[need];
+	    if (vsp->numval <= 0)
+		vsize = sizeof(pmValueSet) - sizeof(pmValue);
+	    else
+		vsize = sizeof(pmValueSet) + (vsp->numval - 1) * sizeof(pmValue);
+	    memcpy((void *)nvsp, (void *)vsp, vsize);
+	    need += ARENA_ALIGN(vsize);
+	    if (vsp->numval <= 0 || vsp->valfmt == PM_VAL_INSITU)
+		continue;
+	    nvsp->valfmt = PM_VAL_SPTR;
+	    for (i = 0; i < vsp->numval; i++) {
+		vbp = vsp->vlist[i].value.pval;
+		memcpy((void *)&base[need], (void *)vbp, vbp->vlen);
+		nvsp->vlist[i].value.pval = (pmValueBlock *)&base[need];
+		need += ARENA_ALIGN(vbp->vlen);
+	    }
+	}
+	sts = 0;
+    }
+
+    for (j = 0; j < ndone; j++)
+	__pmFreeResultValues(donelist[j]);
+    if (sts < 0)
+	return sts;
+
     *result = ans;
 
     return 0;
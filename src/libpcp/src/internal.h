@@ -272,4 +272,27 @@ extern int __pmAddPorts(const char *, int **, int) _PCP_HIDDEN;
 extern void __pmCloseChannelbyContext(__pmContext *, int, int ) _PCP_HIDDEN;
 extern void __pmCloseChannelbyFd(int, int, int ) _PCP_HIDDEN;
 
+/* archive volumes, possibly decompressed in-process or mapped */
+struct stat;
+extern FILE *__pmLogFopenXz(const char *) _PCP_HIDDEN;
+extern int __pmLogFileno(const __pmLogCtl *, FILE *) _PCP_HIDDEN;
+extern int __pmLogFstat(const __pmLogCtl *, FILE *, struct stat *) _PCP_HIDDEN;
+extern FILE *__pmLogFopen(__pmLogCtl *, const char *) _PCP_HIDDEN;
+extern int __pmLogMapFileno(const __pmLogCtl *, FILE *) _PCP_HIDDEN;
+extern const char *__pmLogMapAddr(const __pmLogCtl *, FILE *, long, size_t) _PCP_HIDDEN;
+
+/* libpcp state for an archive, in l_hashrange of its __pmLogCtl */
+#define PM_LOG_PRIV_BATCH	1	/* group commit, see logbatch.c */
+#define PM_LOG_PRIV_MAP		2	/* each mapped stream, see logmap.c */
+#define PM_LOG_PRIV_DELTA	3	/* keyframes, see logdelta.c */
+extern void *__pmLogPrivate(const __pmLogCtl *, unsigned int) _PCP_HIDDEN;
+extern void __pmLogFreePrivate(__pmLogCtl *) _PCP_HIDDEN;
+
+/* delta encoded records, for PM_LOG_VERS02_DELTA archives */
+extern int __pmLogEncodeDelta(__pmLogCtl *, __pmPDU *, __pmPDU **) _PCP_HIDDEN;
+extern int __pmLogDecodeDelta(__pmLogCtl *, FILE *, long, __pmPDU **) _PCP_HIDDEN;
+extern void __pmLogDeltaFree(__pmLogCtl *) _PCP_HIDDEN;
+
+extern int __pmLogFetchFilter(__pmContext *, int, pmID *, int, pmID *, pmResult **) _PCP_HIDDEN;
+
 #endif /* _LIBPCP_INTERNAL_H */
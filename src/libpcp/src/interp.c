@@ -14,9 +14,13 @@
  *
  * Thread-safe notes:
  *
- * nr[] and nr_cache[] are diagnostic counters that are maintained with
- * non-atomic updates ... we've decided that it is acceptable for their
- * values to be subject to possible (but unlikely) missed updates
+ * nr[], nr_cache[], nr_prefetch and nr_evict are diagnostic counters
+ * that are maintained with non-atomic updates ... we've decided that it
+ * is acceptable for their values to be subject to possible (but unlikely)
+ * missed updates
+ *
+ * cache_maxsize and cache_prefetch are set once, under the
+ * __pmLock_libpcp mutex, and only read thereafter
  */
 
 /*
@@ -101,18 +105,45 @@ typedef struct pmidcntl {		/* metric control */
     struct instcntl	*first;		/* first metric-instace control */
 } pmidcntl_t;
 
-typedef struct {
+typedef struct cache {
+    struct cache *hnext;	/* hash chain, by vol and head_posn */
+    struct cache *tnext;	/* hash chain, by vol and tail_posn */
+    struct cache *prev;		/* LRU list, most recently used first */
+    struct cache *next;
     pmResult	*rp;		/* cached pmResult from __pmLogRead */
     int		sts;		/* from __pmLogRead */
-    char	*l_name;	/* log name */
+    const char	*l_name;	/* log name, shared via cache_ctl_t */
     int		vol;		/* log volume */
     long	head_posn;	/* posn in file before forwards __pmLogRead */
     long	tail_posn;	/* posn in file after forwards __pmLogRead */
     int		mode;		/* PM_MODE_FORW or PM_MODE_BACK */
-    int		used;		/* used count for LFU replacement */
+    size_t	size;		/* approx bytes held by this entry */
 } cache_t;
 
-#define NUMCACHE 4
+#define CACHE_HSIZE	1024		/* hash buckets, head and tail each */
+#define CACHE_MINENT	4		/* keep this many, no matter the size */
+#define CACHE_MAXSIZE	(4*1024*1024)	/* default bytes per context */
+
+#define CACHE_HASH(vol, posn) \
+	((unsigned long)((posn) ^ ((long)(vol) << 20)) % CACHE_HSIZE)
+
+/*
+ * per-context read cache, hung off ac_cache ... entries are found
+ * by (archive, volume, offset) via the head[] and tail[] hash chains,
+ * and are dropped least recently used first once the total size
+ * exceeds cache_maxsize
+ */
+typedef struct {
+    cache_t	*head[CACHE_HSIZE];
+    cache_t	*tail[CACHE_HSIZE];
+    cache_t	*first;		/* most recently used */
+    cache_t	*last;		/* least recently used */
+    int		nent;
+    size_t	size;		/* sum of size over all entries */
+    pmResult	*uncached;	/* last result we could not cache */
+    int		nname;
+    char	**name;		/* archive names, l_name for entries */
+} cache_ctl_t;
 
 /*
  * diagnostic counters ... indexed by PM_MODE_FORW (2) and
@@ -120,6 +151,285 @@ typedef struct {
  */
 static long	nr_cache[PM_MODE_BACK+1];
 static long	nr[PM_MODE_BACK+1];
+static long	nr_prefetch;
+static long	nr_evict;
+
+/*
+ * cache tuning, from the environment on first use
+ */
+static size_t	cache_maxsize;
+static int	cache_prefetch = -1;
+
+static void
+cache_init(void)
+{
+    char	*p;
+    char	*end;
+    long	val;
+
+    PM_INIT_LOCKS();
+    PM_LOCK(__pmLock_libpcp);
+    if (cache_prefetch == -1) {
+	/* PCP_INTERP_CACHE_SIZE bytes, with optional K or M suffix */
+	cache_maxsize = CACHE_MAXSIZE;
+	if ((p = getenv("PCP_INTERP_CACHE_SIZE")) != NULL) {
+	    val = strtol(p, &end, 10);
+	    if (*end == 'k' || *end == 'K') {
+		val *= 1024;
+		end++;
+	    }
+	    else if (*end == 'm' || *end == 'M') {
+		val *= 1024*1024;
+		end++;
+	    }
+	    if (end != p && *end == '\0' && val >= 0)
+		cache_maxsize = val;
+	}
+	/* PCP_INTERP_PREFETCH records to read ahead after a cache miss */
+	val = 0;
+	if ((p = getenv("PCP_INTERP_PREFETCH")) != NULL) {
+	    val = strtol(p, &end, 10);
+	    if (end == p || *end != '\0' || val < 0)
+		val = 0;
+	}
+	cache_prefetch = (int)val;
+    }
+    PM_UNLOCK(__pmLock_libpcp);
+}
+
+void
+__pmGetInterpCacheStats(__pmInterpCacheStats *sp)
+{
+    sp->nr_forw = nr[PM_MODE_FORW];
+    sp->nr_back = nr[PM_MODE_BACK];
+    sp->nr_cache_forw = nr_cache[PM_MODE_FORW];
+    sp->nr_cache_back = nr_cache[PM_MODE_BACK];
+    sp->nr_prefetch = nr_prefetch;
+    sp->nr_evict = nr_evict;
+}
+
+void
+__pmResetInterpCacheStats(void)
+{
+    nr_cache[PM_MODE_FORW] = nr[PM_MODE_FORW] = 0;
+    nr_cache[PM_MODE_BACK] = nr[PM_MODE_BACK] = 0;
+    nr_prefetch = nr_evict = 0;
+}
+
+/*
+ * archive names are shared by all entries from the same archive,
+ * so entries can be matched by pointer rather than strcmp()
+ */
+static const char *
+cache_name(cache_ctl_t *ccp, const char *l_name)
+{
+    char	**name;
+    int		i;
+
+    for (i = 0; i < ccp->nname; i++) {
+	if (strcmp(ccp->name[i], l_name) == 0)
+	    return ccp->name[i];
+    }
+    name = (char **)realloc(ccp->name, (ccp->nname+1) * sizeof(char *));
+    if (name == NULL) {
+	__pmNoMem("__pmLogFetchInterp.name",
+		  (ccp->nname+1) * sizeof(char *), PM_FATAL_ERR);
+    }
+    ccp->name = name;
+    if ((name[ccp->nname] = strdup(l_name)) == NULL) {
+	__pmNoMem("__pmLogFetchInterp.l_name",
+		  strlen(l_name) + 1, PM_FATAL_ERR);
+    }
+    return name[ccp->nname++];
+}
+
+static cache_t *
+cache_lookup(cache_ctl_t *ccp, const char *l_name, int vol, int mode, long posn)
+{
+    cache_t	*cp;
+
+    if (mode == PM_MODE_FORW) {
+	for (cp = ccp->head[CACHE_HASH(vol, posn)]; cp != NULL; cp = cp->hnext) {
+	    if (cp->head_posn == posn && cp->vol == vol && cp->l_name == l_name)
+		return cp;
+	}
+    }
+    else {
+	for (cp = ccp->tail[CACHE_HASH(vol, posn)]; cp != NULL; cp = cp->tnext) {
+	    if (cp->tail_posn == posn && cp->vol == vol && cp->l_name == l_name)
+		return cp;
+	}
+    }
+    return NULL;
+}
+
+/*
+ * approximate memory held by a cached record ... the values
+ * are decoded in place in a (pinned) PDU buffer of about the
+ * same size as the record in the archive
+ */
+static size_t
+cache_size(cache_t *cp)
+{
+    size_t	size;
+    int		i;
+
+    size = sizeof(cache_t) + sizeof(pmResult) + (cp->tail_posn - cp->head_posn);
+    for (i = 0; i < cp->rp->numpmid; i++) {
+	size += sizeof(pmValueSet *) + sizeof(pmValueSet) +
+		cp->rp->vset[i]->numval * sizeof(pmValue);
+    }
+    return size;
+}
+
+static void
+cache_unlink(cache_ctl_t *ccp, cache_t *cp)
+{
+    cache_t	**cpp;
+
+    for (cpp = &ccp->head[CACHE_HASH(cp->vol, cp->head_posn)]; *cpp != cp; cpp = &(*cpp)->hnext)
+	;
+    *cpp = cp->hnext;
+    for (cpp = &ccp->tail[CACHE_HASH(cp->vol, cp->tail_posn)]; *cpp != cp; cpp = &(*cpp)->tnext)
+	;
+    *cpp = cp->tnext;
+    if (cp->prev != NULL)
+	cp->prev->next = cp->next;
+    else
+	ccp->first = cp->next;
+    if (cp->next != NULL)
+	cp->next->prev = cp->prev;
+    else
+	ccp->last = cp->prev;
+    ccp->nent--;
+    ccp->size -= cp->size;
+}
+
+static void
+cache_insert(cache_ctl_t *ccp, cache_t *cp)
+{
+    unsigned long	h;
+
+    h = CACHE_HASH(cp->vol, cp->head_posn);
+    cp->hnext = ccp->head[h];
+    ccp->head[h] = cp;
+    h = CACHE_HASH(cp->vol, cp->tail_posn);
+    cp->tnext = ccp->tail[h];
+    ccp->tail[h] = cp;
+    cp->prev = NULL;
+    cp->next = ccp->first;
+    if (ccp->first != NULL)
+	ccp->first->prev = cp;
+    else
+	ccp->last = cp;
+    ccp->first = cp;
+    ccp->nent++;
+    ccp->size += cp->size;
+}
+
+/*
+ * move to the front of the LRU list
+ */
+static void
+cache_touch(cache_ctl_t *ccp, cache_t *cp)
+{
+    if (ccp->first == cp)
+	return;
+    cp->prev->next = cp->next;
+    if (cp->next != NULL)
+	cp->next->prev = cp->prev;
+    else
+	ccp->last = cp->prev;
+    cp->prev = NULL;
+    cp->next = ccp->first;
+    ccp->first->prev = cp;
+    ccp->first = cp;
+}
+
+/*
+ * drop least recently used entries until we fit, but never keep
+ * (our caller is still using it) and never below CACHE_MINENT
+ */
+static void
+cache_trim(cache_ctl_t *ccp, cache_t *keep)
+{
+    cache_t	*cp;
+
+    while (ccp->size > cache_maxsize && ccp->nent > CACHE_MINENT &&
+	   ccp->last != keep) {
+	cp = ccp->last;
+	cache_unlink(ccp, cp);
+	pmFreeResult(cp->rp);
+	free(cp);
+	nr_evict++;
+    }
+}
+
+/*
+ * fill in the key and size for a record just read by __pmLogRead
+ * that started at posn
+ */
+static void
+cache_fill(__pmArchCtl *acp, cache_t *cp, const char *l_name, int mode, long posn)
+{
+    cp->mode = mode;
+    cp->vol = acp->ac_vol;
+    cp->l_name = l_name;
+    if (mode == PM_MODE_FORW) {
+	cp->head_posn = posn;
+	cp->tail_posn = ftell(acp->ac_log->l_mfp);
+	assert(cp->tail_posn >= 0);
+    }
+    else {
+	cp->tail_posn = posn;
+	cp->head_posn = ftell(acp->ac_log->l_mfp);
+	assert(cp->head_posn >= 0);
+    }
+    cp->size = cache_size(cp);
+}
+
+/*
+ * read up to cache_prefetch more records in the replay direction,
+ * stopping at the end of the current volume or at a record that
+ * is already cached, then put the stream back where it was
+ */
+static void
+cache_readahead(__pmArchCtl *acp, cache_ctl_t *ccp, const char *l_name, int mode, cache_t *keep)
+{
+    __pmLogCtl	*lcp = acp->ac_log;
+    cache_t	*cp;
+    long	save;
+    long	posn;
+    int		i;
+
+    save = posn = ftell(lcp->l_mfp);
+    assert(save >= 0);
+    for (i = 0; i < cache_prefetch; i++) {
+	if (cache_lookup(ccp, l_name, acp->ac_vol, mode, posn) != NULL)
+	    break;
+	if ((cp = (cache_t *)calloc(1, sizeof(cache_t))) == NULL)
+	    break;
+	/* passing l_mfp as peekf stops __pmLogRead changing volume */
+	cp->sts = __pmLogRead(lcp, mode, lcp->l_mfp, &cp->rp, PMLOGREAD_NEXT);
+	if (cp->sts < 0) {
+	    free(cp);
+	    break;
+	}
+	cache_fill(acp, cp, l_name, mode, posn);
+	cache_insert(ccp, cp);
+	cache_trim(ccp, keep);
+	nr_prefetch++;
+	posn = ftell(lcp->l_mfp);
+	assert(posn >= 0);
+    }
+    fseek(lcp->l_mfp, save, SEEK_SET);
+    cache_touch(ccp, keep);
+#ifdef PCP_DEBUG
+    if ((pmDebug & DBG_TRACE_LOG) && (pmDebug & DBG_TRACE_DESPERATE))
+	fprintf(stderr, "cache_read: prefetch %d records, %d entries %ld bytes\n",
+	    i, ccp->nent, (long)ccp->size);
+#endif
+}
 
 /*
  * called with the context lock held
@@ -129,8 +439,8 @@ cache_read(__pmArchCtl *acp, int mode, pmResult **rp)
 {
     long	posn;
     cache_t	*cp;
-    cache_t	*lfup;
-    cache_t	*cache;
+    cache_ctl_t	*ccp;
+    const char	*l_name;
     char	*save_curlog_name;
     int		sts;
     int		save_curvol;
@@ -156,13 +466,19 @@ cache_read(__pmArchCtl *acp, int mode, pmResult **rp)
 
     if (acp->ac_cache == NULL) {
 	/* cache initialization */
-	acp->ac_cache = cache = (cache_t *)calloc(NUMCACHE, sizeof(cache_t));
-	if (!cache)
+	cache_init();
+	acp->ac_cache = ccp = (cache_ctl_t *)calloc(1, sizeof(cache_ctl_t));
+	if (!ccp)
 	    return -ENOMEM;
-	acp->ac_cache_idx = 0;
     }
     else
-	cache = acp->ac_cache;
+	ccp = (cache_ctl_t *)acp->ac_cache;
+
+    /* caller is done with the result from last time */
+    if (ccp->uncached != NULL) {
+	pmFreeResult(ccp->uncached);
+	ccp->uncached = NULL;
+    }
 
 #ifdef PCP_DEBUG
     if ((pmDebug & DBG_TRACE_LOG) && (pmDebug & DBG_TRACE_DESPERATE)) {
@@ -175,46 +491,39 @@ cache_read(__pmArchCtl *acp, int mode, pmResult **rp)
     }
 #endif
 
-    acp->ac_cache_idx = (acp->ac_cache_idx + 1) % NUMCACHE;
-    lfup = &cache[acp->ac_cache_idx];
-    for (cp = cache; cp < &cache[NUMCACHE]; cp++) {
-	if (cp->l_name != NULL && strcmp(cp->l_name, acp->ac_log->l_name) == 0 &&
-	    cp->vol == acp->ac_vol &&
-	    ((mode == PM_MODE_FORW && cp->head_posn == posn) ||
-	     (mode == PM_MODE_BACK && cp->tail_posn == posn)) &&
-	    cp->rp != NULL) {
-	    *rp = cp->rp;
-	    cp->used++;
-	    if (mode == PM_MODE_FORW)
-		fseek(acp->ac_log->l_mfp, cp->tail_posn, SEEK_SET);
-	    else
-		fseek(acp->ac_log->l_mfp, cp->head_posn, SEEK_SET);
+    l_name = cache_name(ccp, acp->ac_log->l_name);
+    if ((cp = cache_lookup(ccp, l_name, acp->ac_vol, mode, posn)) != NULL) {
+	*rp = cp->rp;
+	cache_touch(ccp, cp);
+	if (mode == PM_MODE_FORW)
+	    fseek(acp->ac_log->l_mfp, cp->tail_posn, SEEK_SET);
+	else
+	    fseek(acp->ac_log->l_mfp, cp->head_posn, SEEK_SET);
+	nr_cache[mode]++;
 #ifdef PCP_DEBUG
-	    if ((pmDebug & DBG_TRACE_LOG) && (pmDebug & DBG_TRACE_DESPERATE)) {
-		__pmTimeval	tmp;
-		double		t_this;
-		tmp.tv_sec = (__int32_t)cp->rp->timestamp.tv_sec;
-		tmp.tv_usec = (__int32_t)cp->rp->timestamp.tv_usec;
-		t_this = __pmTimevalSub(&tmp, __pmLogStartTime(acp));
-		fprintf(stderr, "hit cache[%d] t=%.6f\n",
-		    (int)(cp - cache), t_this);
-		nr_cache[mode]++;
-	    }
-#endif
-	    acp->ac_mark_done = 0;
-	    sts = cp->sts;
-	    return sts;
+	if ((pmDebug & DBG_TRACE_LOG) && (pmDebug & DBG_TRACE_DESPERATE)) {
+	    __pmTimeval	tmp;
+	    double		t_this;
+	    tmp.tv_sec = (__int32_t)cp->rp->timestamp.tv_sec;
+	    tmp.tv_usec = (__int32_t)cp->rp->timestamp.tv_usec;
+	    t_this = __pmTimevalSub(&tmp, __pmLogStartTime(acp));
+	    fprintf(stderr, "hit cache vol=%d head=%ld t=%.6f\n",
+		cp->vol, (long)cp->head_posn, t_this);
 	}
+#endif
+	acp->ac_mark_done = 0;
+	return cp->sts;
     }
 
 #ifdef PCP_DEBUG
     if ((pmDebug & DBG_TRACE_LOG) && (pmDebug & DBG_TRACE_DESPERATE))
 	fprintf(stderr, "miss\n");
-    nr[mode]++;
 #endif
+    nr[mode]++;
 
-    if (lfup->rp != NULL)
-	pmFreeResult(lfup->rp);
+    if ((cp = (cache_t *)calloc(1, sizeof(cache_t))) == NULL) {
+	__pmNoMem("__pmLogFetchInterp.cache", sizeof(cache_t), PM_FATAL_ERR);
+    }
 
     /*
      * We need to know when we cross archive or volume boundaries.
@@ -227,10 +536,11 @@ cache_read(__pmArchCtl *acp, int mode, pmResult **rp)
     }
     save_curvol = acp->ac_log->l_curvol;
 
-    lfup->sts = __pmLogRead(acp->ac_log, mode, NULL, &lfup->rp, PMLOGREAD_NEXT);
-    if (lfup->sts < 0)
-	lfup->rp = NULL;
-    *rp = lfup->rp;
+    cp->sts = __pmLogRead(acp->ac_log, mode, NULL, &cp->rp, PMLOGREAD_NEXT);
+    if (cp->sts < 0)
+	cp->rp = NULL;
+    *rp = cp->rp;
+    sts = cp->sts;
 
     archive_changed = strcmp(save_curlog_name, acp->ac_log->l_name) != 0;
     free(save_curlog_name);
@@ -242,58 +552,36 @@ cache_read(__pmArchCtl *acp, int mode, pmResult **rp)
      * ... don't cache
      */
     if (posn == 0 || save_curvol != acp->ac_log->l_curvol || archive_changed ||
-	acp->ac_mark_done) {
-	if (lfup->l_name) {
-	    free(lfup->l_name);
-	    lfup->l_name = NULL;
-	}
+	acp->ac_mark_done || sts < 0) {
+	ccp->uncached = cp->rp;
+	free(cp);
 #ifdef PCP_DEBUG
 	if ((pmDebug & DBG_TRACE_LOG) && (pmDebug & DBG_TRACE_DESPERATE))
-	    fprintf(stderr, "cache_read: reload vol switch, mark cache[%d] unused\n",
-		(int)(lfup - cache));
+	    fprintf(stderr, "cache_read: reload vol switch, not cached\n");
 #endif
     }
     else {
-	lfup->mode = mode;
-	lfup->vol = acp->ac_vol;
-	lfup->used = 1;
-	/* Try to avoid excessive copying/freeing of the archive name. */
-	if (lfup->l_name != NULL && strcmp(lfup->l_name, acp->ac_log->l_name) != 0) {
-	    free(lfup->l_name);
-	    lfup->l_name = NULL;
-	}
-	if (lfup->l_name == NULL) {
-	    if ((lfup->l_name = strdup(acp->ac_log->l_name)) == NULL) {
-		__pmNoMem("__pmLogFetchInterp.l_name",
-			  strlen(acp->ac_log->l_name) + 1, PM_FATAL_ERR);
-	    }
-	}
-	if (mode == PM_MODE_FORW) {
-	    lfup->head_posn = posn;
-	    lfup->tail_posn = ftell(acp->ac_log->l_mfp);
-	    assert(lfup->tail_posn >= 0);
-	}
-	else {
-	    lfup->tail_posn = posn;
-	    lfup->head_posn = ftell(acp->ac_log->l_mfp);
-	    assert(lfup->head_posn >= 0);
-	}
+	cache_fill(acp, cp, l_name, mode, posn);
+	cache_insert(ccp, cp);
+	cache_trim(ccp, cp);
 #ifdef PCP_DEBUG
 	if ((pmDebug & DBG_TRACE_LOG) && (pmDebug & DBG_TRACE_DESPERATE)) {
-	    fprintf(stderr, "cache_read: reload cache[%d] vol=%d (curvol=%d) head=%ld tail=%ld ",
-		(int)(lfup - cache), lfup->vol, acp->ac_log->l_curvol,
-		(long)lfup->head_posn, (long)lfup->tail_posn);
-	    if (lfup->sts == 0)
-		fprintf(stderr, "sts=%d\n", lfup->sts);
+	    fprintf(stderr, "cache_read: reload cache vol=%d (curvol=%d) head=%ld tail=%ld ",
+		cp->vol, acp->ac_log->l_curvol,
+		(long)cp->head_posn, (long)cp->tail_posn);
+	    if (sts == 0)
+		fprintf(stderr, "sts=%d\n", sts);
 	    else {
 		char	errmsg[PM_MAXERRMSGLEN];
-		fprintf(stderr, "sts=%s\n", pmErrStr_r(lfup->sts, errmsg, sizeof(errmsg)));
+		fprintf(stderr, "sts=%s\n", pmErrStr_r(sts, errmsg, sizeof(errmsg)));
 	    }
 	}
 #endif
+	if (cache_prefetch > 0)
+	    cache_readahead(acp, ccp, l_name, mode, cp);
     }
 
-    return lfup->sts;
+    return sts;
 }
 
 void
@@ -705,6 +993,9 @@ __pmLogFetchInterp(__pmContext *ctxp, int numpmid, pmID pmidlist[], pmResult **r
     static int	dowrap = -1;
     __pmTimeval	tmp;
     struct timeval delta_tv;
+#ifdef PCP_DEBUG
+    __pmInterpCacheStats	start;
+#endif
 
     PM_INIT_LOCKS();
     PM_LOCK(__pmLock_libpcp);
@@ -727,8 +1018,7 @@ __pmLogFetchInterp(__pmContext *ctxp, int numpmid, pmID pmidlist[], pmResult **r
 	    t_req, ctxp->c_archctl->ac_log->l_curvol,
 	    (long)ctxp->c_archctl->ac_offset, ctxp->c_archctl->ac_vol,
 	    ctxp->c_archctl->ac_serial);
-	nr_cache[PM_MODE_FORW] = nr[PM_MODE_FORW] = 0;
-	nr_cache[PM_MODE_BACK] = nr[PM_MODE_BACK] = 0;
+	__pmGetInterpCacheStats(&start);
     }
 #endif
 
@@ -1719,13 +2009,13 @@ all_done:
 #ifdef PCP_DEBUG
     if (pmDebug & DBG_TRACE_INTERP) {
 	fprintf(stderr, "__pmLogFetchInterp: log reads: forward %ld",
-	    nr[PM_MODE_FORW]);
-	if (nr_cache[PM_MODE_FORW])
-	    fprintf(stderr, " (+%ld cached)", nr_cache[PM_MODE_FORW]);
+	    nr[PM_MODE_FORW] - start.nr_forw);
+	if (nr_cache[PM_MODE_FORW] > start.nr_cache_forw)
+	    fprintf(stderr, " (+%ld cached)", nr_cache[PM_MODE_FORW] - start.nr_cache_forw);
 	fprintf(stderr, " backwards %ld",
-	    nr[PM_MODE_BACK]);
-	if (nr_cache[PM_MODE_BACK])
-	    fprintf(stderr, " (+%ld cached)", nr_cache[PM_MODE_BACK]);
+	    nr[PM_MODE_BACK] - start.nr_back);
+	if (nr_cache[PM_MODE_BACK] > start.nr_cache_back)
+	    fprintf(stderr, " (+%ld cached)", nr_cache[PM_MODE_BACK] - start.nr_cache_back);
 	fprintf(stderr, "\n");
     }
 #endif
@@ -1859,37 +2149,42 @@ __pmFreeInterpData(__pmContext *ctxp)
 		    free(last_hp->data);
 		free(last_hp);
 	    }
-	    free(hcp->hash);
-	    /* just being paranoid here */
-	    hcp->hash = NULL;
-	    hcp->hsize = 0;
 	}
+	free(hcp->hash);
+	/* just being paranoid here */
+	hcp->hash = NULL;
+	hcp->hsize = 0;
     }
 
     if (ctxp->c_archctl->ac_cache != NULL) {
 	/* read cache allocated, work to be done */
-	cache_t		*cache = (cache_t *)ctxp->c_archctl->ac_cache;
+	cache_ctl_t	*ccp = (cache_ctl_t *)ctxp->c_archctl->ac_cache;
 	cache_t		*cp;
+	int		i;
 
-	for (cp = cache; cp < &cache[NUMCACHE]; cp++) {
+	while ((cp = ccp->first) != NULL) {
 #ifdef PCP_DEBUG
 	    if ((pmDebug & DBG_TRACE_LOG) && (pmDebug & DBG_TRACE_INTERP)) {
 		fprintf(stderr, "read cache entry "
 			PRINTF_P_PFX "%p: l_name=%s rp="
 			PRINTF_P_PFX "%p\n",
-			cp, cp->l_name ? cp->l_name : "(none)",
-			cp->rp);
+			cp, cp->l_name, cp->rp);
 	    }
 #endif
-	    if (cp->l_name != NULL) {
-		free(cp->l_name);
-		cp->l_name = NULL;
-	    }
-	    if (cp->rp != NULL) {
-		pmFreeResult(cp->rp);
-		cp->rp = NULL;
-	    }
-	    cp->used = 0;
+	    cache_unlink(ccp, cp);
+	    pmFreeResult(cp->rp);
+	    free(cp);
+	}
+	if (ccp->uncached != NULL) {
+	    pmFreeResult(ccp->uncached);
+	    ccp->uncached = NULL;
+	}
+	for (i = 0; i < ccp->nname; i++)
+	    free(ccp->name[i]);
+	if (ccp->name != NULL) {
+	    free(ccp->name);
+	    ccp->name = NULL;
 	}
+	ccp->nname = 0;
     }
 }
@@ -70,57 +70,63 @@ SetupDebug(void)
     }
 }
 
-void
-__pmInitLocks(void)
+/*
+ * One trip for all threads run-time initialization.  PM_INIT_LOCKS()
+ * is called on entry to most of the PMAPI, so after the first call this
+ * must not take a lock of its own.
+ */
+static void
+initlocks_once(void)
 {
-    static pthread_mutex_t	init = PTHREAD_MUTEX_INITIALIZER;
-    static int			done = 0;
+#if !defined(PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP) || !defined(HAVE___THREAD)
     int				psts;
     char			errmsg[PM_MAXERRMSGLEN];
-    if ((psts = pthread_mutex_lock(&init)) != 0) {
+#endif
+
+    SetupDebug();
+#ifndef PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP
+    /*
+     * Unable to initialize at compile time, need to do it here.
+     */
+    pthread_mutexattr_t	attr;
+
+    if ((psts = pthread_mutexattr_init(&attr)) != 0) {
 	pmErrStr_r(-psts, errmsg, sizeof(errmsg));
-	fprintf(stderr, "__pmInitLocks: pthread_mutex_lock failed: %s", errmsg);
+	fprintf(stderr, "__pmInitLocks: pthread_mutexattr_init failed: %s", errmsg);
 	exit(4);
     }
-    if (!done) {
-	SetupDebug();
-#ifndef PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP
-	/*
-	 * Unable to initialize at compile time, need to do it here in
-	 * a one trip for all threads run-time initialization.
-	 */
-	pthread_mutexattr_t	attr;
-
-	if ((psts = pthread_mutexattr_init(&attr)) != 0) {
-	    pmErrStr_r(-psts, errmsg, sizeof(errmsg));
-	    fprintf(stderr, "__pmInitLocks: pthread_mutexattr_init failed: %s", errmsg);
-	    exit(4);
-	}
-	if ((psts = pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE)) != 0) {
-	    pmErrStr_r(-psts, errmsg, sizeof(errmsg));
-	    fprintf(stderr, "__pmInitLocks: pthread_mutexattr_settype failed: %s", errmsg);
-	    exit(4);
-	}
-	if ((psts = pthread_mutex_init(&__pmLock_libpcp, &attr)) != 0) {
-	    pmErrStr_r(-psts, errmsg, sizeof(errmsg));
-	    fprintf(stderr, "__pmInitLocks: pthread_mutex_init failed: %s", errmsg);
-	    exit(4);
-	}
-	pthread_mutexattr_destroy(&attr);
+    if ((psts = pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE)) != 0) {
+	pmErrStr_r(-psts, errmsg, sizeof(errmsg));
+	fprintf(stderr, "__pmInitLocks: pthread_mutexattr_settype failed: %s", errmsg);
+	exit(4);
+    }
+    if ((psts = pthread_mutex_init(&__pmLock_libpcp, &attr)) != 0) {
+	pmErrStr_r(-psts, errmsg, sizeof(errmsg));
+	fprintf(stderr, "__pmInitLocks: pthread_mutex_init failed: %s", errmsg);
+	exit(4);
+    }
+    pthread_mutexattr_destroy(&attr);
 #endif
 #ifndef HAVE___THREAD
-	/* first thread here creates the thread private data key */
-	if ((psts = pthread_key_create(&__pmTPDKey, __pmTPD__destroy)) != 0) {
-	    pmErrStr_r(-psts, errmsg, sizeof(errmsg));
-	    fprintf(stderr, "__pmInitLocks: pthread_key_create failed: %s", errmsg);
-	    exit(4);
-	}
-#endif
-	done = 1;
+    /* first thread here creates the thread private data key */
+    if ((psts = pthread_key_create(&__pmTPDKey, __pmTPD__destroy)) != 0) {
+	pmErrStr_r(-psts, errmsg, sizeof(errmsg));
+	fprintf(stderr, "__pmInitLocks: pthread_key_create failed: %s", errmsg);
+	exit(4);
     }
-    if ((psts = pthread_mutex_unlock(&init)) != 0) {
+#endif
+}
+
+void
+__pmInitLocks(void)
+{
+    static pthread_once_t	once = PTHREAD_ONCE_INIT;
+    int				psts;
+    char			errmsg[PM_MAXERRMSGLEN];
+
+    if ((psts = pthread_once(&once, initlocks_once)) != 0) {
 	pmErrStr_r(-psts, errmsg, sizeof(errmsg));
-	fprintf(stderr, "__pmInitLocks: pthread_mutex_unlock failed: %s", errmsg);
+	fprintf(stderr, "__pmInitLocks: pthread_once failed: %s", errmsg);
 	exit(4);
     }
 #ifndef HAVE___THREAD
@@ -0,0 +1,521 @@
+/*
+ * Copyright (c) 2026 Red Hat.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ */
+
+/*
+ * Group commit for archive writes.
+ *
+ * By default every record goes to the archive files with its own
+ * unbuffered fwrite().  After __pmLogBatchStart() records are instead
+ * copied into a staging buffer, and a writer thread takes the buffer
+ * once it holds enough bytes or its oldest record is old enough, while
+ * new records go into a second buffer.  A staged batch is written with
+ * one writev() per file, in the order metadata, data, temporal index.
+ * Every index entry refers to offsets at or before records staged
+ * ahead of it, so whatever prefix of these writes reaches the disk
+ * the index never points past the end of the data or metadata ... the
+ * same guarantee the unbatched writes give.  Records are never split
+ * across writes, other than by a short write from the kernel.
+ *
+ * While records are staged, positions in the archive files are kept
+ * here and the file offsets belong to the writer, so callers use
+ * __pmLogTell() and __pmLogSeek() rather than ftell() and fseek().
+ * After __pmLogBatchFlush() the file offsets are current again and
+ * stdio may be used directly until the next __pmLogWrite().
+ */
+
+#include "pmapi.h"
+#include "impl.h"
+#include "internal.h"
+#ifndef IS_MINGW
+#include <sys/uio.h>
+#endif
+#include <limits.h>
+#include <signal.h>
+
+#ifndef IOV_MAX
+#define IOV_MAX 16
+#endif
+
+/* archive files, in the order a batch is written */
+enum { B_META, B_DATA, B_INDEX, B_NFILES };
+
+typedef struct {
+    int		file;		/* B_META, B_DATA or B_INDEX */
+    int		fd;
+    off_t	offset;		/* in the file */
+    size_t	start;		/* in the staging buffer */
+    size_t	len;
+} logop_t;
+
+typedef struct {
+    char	*buf;
+    size_t	used;
+    size_t	size;
+    logop_t	*ops;
+    int		nops;
+    int		maxops;
+    struct timeval first;	/* when ops[0] was staged */
+} logstage_t;
+
+#ifdef PM_MULTI_THREAD
+struct __pmLogBatch {
+    pthread_mutex_t	lock;
+    pthread_cond_t	kick;		/* for the writer: work, or stop */
+    pthread_cond_t	done;		/* for callers: a batch was written */
+    pthread_t		writer;
+    size_t		threshold;	/* bytes staged before a write */
+    struct timeval	interval;	/* age of oldest record before a write */
+    logstage_t		stage[2];
+    int			filling;	/* stage[] taking new records */
+    int			busy;		/* writer has stage[!filling] */
+    int			flush;		/* write stage[filling] now */
+    int			stop;
+    int			error;		/* first write failure, -errno */
+    int			haspos[B_NFILES];
+    off_t		pos[B_NFILES];	/* if haspos[], else ftell() */
+};
+
+static int
+batch_file(const __pmLogCtl *lcp, FILE *f)
+{
+    if (f == lcp->l_mfp)
+	return B_DATA;
+    if (f == lcp->l_mdfp)
+	return B_META;
+    if (f == lcp->l_tifp)
+	return B_INDEX;
+    return -1;
+}
+
+static int
+writeall(int fd, off_t offset, struct iovec *iov, int n)
+{
+    ssize_t	bytes;
+
+    if (lseek(fd, offset, SEEK_SET) < 0)
+	return -oserror();
+    while (n > 0) {
+	if ((bytes = writev(fd, iov, n)) < 0) {
+	    if (oserror() == EINTR)
+		continue;
+	    return -oserror();
+	}
+	/* short write, carry on after the bytes written */
+	while (n > 0 && (size_t)bytes >= iov->iov_len) {
+	    bytes -= iov->iov_len;
+	    iov++;
+	    n--;
+	}
+	if (n > 0) {
+	    iov->iov_base = (char *)iov->iov_base + bytes;
+	    iov->iov_len -= bytes;
+	}
+    }
+    return 0;
+}
+
+/*
+ * write out a staged batch, one file at a time, coalescing records at
+ * consecutive offsets into one writev()
+ */
+static int
+write_stage(logstage_t *sp)
+{
+    struct iovec	iov[IOV_MAX];
+    logop_t		*op;
+    off_t		offset = 0;
+    off_t		end = 0;
+    int			fd = -1;
+    int			niov;
+    int			nwrites = 0;
+    int			file;
+    int			i;
+    int			sts;
+
+    for (file = 0; file < B_NFILES; file++) {
+	niov = 0;
+	for (i = 0, op = sp->ops; i < sp->nops; i++, op++) {
+	    if (op->file != file)
+		continue;
+	    if (niov > 0 && (op->fd != fd || op->offset != end || niov == IOV_MAX)) {
+		if ((sts = writeall(fd, offset, iov, niov)) < 0)
+		    return sts;
+		nwrites++;
+		niov = 0;
+	    }
+	    if (niov == 0) {
+		fd = op->fd;
+		offset = end = op->offset;
+	    }
+	    iov[niov].iov_base = sp->buf + op->start;
+	    iov[niov].iov_len = op->len;
+	    niov++;
+	    end += op->len;
+	}
+	if (niov > 0) {
+	    if ((sts = writeall(fd, offset, iov, niov)) < 0)
+		return sts;
+	    nwrites++;
+	}
+    }
+
+#ifdef PCP_DEBUG
+    if (pmDebug & DBG_TRACE_LOG)
+	fprintf(stderr, "__pmLogBatch: %d records, %ld bytes in %d writes\n",
+		sp->nops, (long)sp->used, nwrites);
+#endif
+    return 0;
+}
+
+static int
+stage_due(struct __pmLogBatch *bp, struct timespec *deadline)
+{
+    logstage_t		*sp = &bp->stage[bp->filling];
+    struct timeval	due;
+    struct timeval	now;
+
+    if (sp->nops == 0)
+	return 0;
+    if (bp->flush || bp->stop || sp->used >= bp->threshold)
+	return 1;
+    due = sp->first;
+    __pmtimevalInc(&due, &bp->interval);
+    __pmtimevalNow(&now);
+    if (__pmtimevalSub(&due, &now) <= 0)
+	return 1;
+    deadline->tv_sec = due.tv_sec;
+    deadline->tv_nsec = due.tv_usec * 1000;
+    return 0;
+}
+
+static void *
+writer(void *arg)
+{
+    struct __pmLogBatch	*bp = (struct __pmLogBatch *)arg;
+    struct timespec	deadline;
+    logstage_t		*sp;
+    int			sts;
+
+    PM_LOCK(bp->lock);
+    for ( ; ; ) {
+	if (!stage_due(bp, &deadline)) {
+	    if (bp->stop)
+		break;
+	    if (bp->flush) {
+		/* nothing staged, so nothing more to wait for */
+		bp->flush = 0;
+		pthread_cond_broadcast(&bp->done);
+	    }
+	    if (bp->stage[bp->filling].nops > 0)
+		pthread_cond_timedwait(&bp->kick, &bp->lock, &deadline);
+	    else
+		pthread_cond_wait(&bp->kick, &bp->lock);
+	    continue;
+	}
+
+	sp = &bp->stage[bp->filling];
+	bp->filling ^= 1;
+	bp->busy = 1;
+	PM_UNLOCK(bp->lock);
+
+	sts = write_stage(sp);
+
+	PM_LOCK(bp->lock);
+	if (sts < 0 && bp->error == 0) {
+	    char	errmsg[PM_MAXERRMSGLEN];
+	    __pmNotifyErr(LOG_ERR, "archive write failed: %s\n",
+			pmErrStr_r(sts, errmsg, sizeof(errmsg)));
+	    bp->error = sts;
+	}
+	sp->used = 0;
+	sp->nops = 0;
+	bp->busy = 0;
+	pthread_cond_broadcast(&bp->done);
+    }
+    PM_UNLOCK(bp->lock);
+    return NULL;
+}
+
+/*
+ * Stage records for the archive files of lcp, a batch being written
+ * once threshold bytes are staged or the oldest has waited interval.
+ */
+int
+__pmLogBatchStart(__pmLogCtl *lcp, size_t threshold, const struct timeval *interval)
+{
+    struct __pmLogBatch	*bp;
+#ifndef IS_MINGW
+    sigset_t		all;
+    sigset_t		save;
+#endif
+    int			sts;
+
+    if (__pmLogPrivate(lcp, PM_LOG_PRIV_BATCH) != NULL)
+	return 0;
+    if ((bp = (struct __pmLogBatch *)calloc(1, sizeof(*bp))) == NULL)
+	return -oserror();
+    if ((sts = __pmHashAdd(PM_LOG_PRIV_BATCH, (void *)bp, &lcp->l_hashrange)) < 0) {
+	free(bp);
+	return sts;
+    }
+    bp->threshold = threshold;
+    bp->interval = *interval;
+    pthread_mutex_init(&bp->lock, NULL);
+    pthread_cond_init(&bp->kick, NULL);
+    pthread_cond_init(&bp->done, NULL);
+
+#ifndef IS_MINGW
+    /* signals belong to the caller's thread, not the writer */
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &save);
+#endif
+    sts = pthread_create(&bp->writer, NULL, writer, bp);
+#ifndef IS_MINGW
+    pthread_sigmask(SIG_SETMASK, &save, NULL);
+#endif
+    if (sts != 0) {
+	__pmHashDel(PM_LOG_PRIV_BATCH, (void *)bp, &lcp->l_hashrange);
+	pthread_cond_destroy(&bp->done);
+	pthread_cond_destroy(&bp->kick);
+	pthread_mutex_destroy(&bp->lock);
+	free(bp);
+	return -sts;
+    }
+    return 0;
+}
+
+/*
+ * Wait for all staged records to be written, and leave the file
+ * offsets at the positions __pmLogTell() would report.  Returns the
+ * first write error since batching started, if any.
+ */
+int
+__pmLogBatchFlush(__pmLogCtl *lcp)
+{
+    struct __pmLogBatch	*bp = __pmLogPrivate(lcp, PM_LOG_PRIV_BATCH);
+    FILE		*f;
+    int			i;
+
+    if (bp == NULL)
+	return 0;
+
+    PM_LOCK(bp->lock);
+    while (bp->busy || bp->stage[bp->filling].nops > 0) {
+	bp->flush = 1;
+	pthread_cond_signal(&bp->kick);
+	pthread_cond_wait(&bp->done, &bp->lock);
+    }
+    bp->flush = 0;
+    for (i = 0; i < B_NFILES; i++) {
+	if (!bp->haspos[i])
+	    continue;
+	f = i == B_DATA ? lcp->l_mfp : (i == B_META ? lcp->l_mdfp : lcp->l_tifp);
+	fseek(f, bp->pos[i], SEEK_SET);
+	bp->haspos[i] = 0;
+    }
+    PM_UNLOCK(bp->lock);
+    return bp->error;
+}
+
+/*
+ * Flush, then go back to writing each record as it comes.
+ */
+int
+__pmLogBatchStop(__pmLogCtl *lcp)
+{
+    struct __pmLogBatch	*bp = __pmLogPrivate(lcp, PM_LOG_PRIV_BATCH);
+    int			sts;
+    int			i;
+
+    if (bp == NULL)
+	return 0;
+
+    sts = __pmLogBatchFlush(lcp);
+    PM_LOCK(bp->lock);
+    bp->stop = 1;
+    pthread_cond_signal(&bp->kick);
+    PM_UNLOCK(bp->lock);
+    pthread_join(bp->writer, NULL);
+
+    for (i = 0; i < 2; i++) {
+	if (bp->stage[i].buf != NULL)
+	    free(bp->stage[i].buf);
+	if (bp->stage[i].ops != NULL)
+	    free(bp->stage[i].ops);
+    }
+    pthread_cond_destroy(&bp->done);
+    pthread_cond_destroy(&bp->kick);
+    pthread_mutex_destroy(&bp->lock);
+    __pmHashDel(PM_LOG_PRIV_BATCH, (void *)bp, &lcp->l_hashrange);
+    free(bp);
+    return sts;
+}
+
+static int
+stage_record(struct __pmLogBatch *bp, int file, int fd, const void *buf, size_t len)
+{
+    logstage_t	*sp;
+    logop_t	*op;
+    size_t	need;
+
+    /*
+     * keep the writer no more than one batch behind ... beyond that,
+     * wait for it rather than staging without bound
+     */
+    while (bp->busy && bp->stage[bp->filling].used >= 2 * bp->threshold)
+	pthread_cond_wait(&bp->done, &bp->lock);
+
+    sp = &bp->stage[bp->filling];
+    if (sp->used + len > sp->size) {
+	char	*tmp;
+
+	for (need = sp->size ? sp->size : bp->threshold; need < sp->used + len; need *= 2)
+	    ;
+	if ((tmp = (char *)realloc(sp->buf, need)) == NULL)
+	    return -oserror();
+	sp->buf = tmp;
+	sp->size = need;
+    }
+    if (sp->nops == sp->maxops) {
+	logop_t	*tmp;
+
+	need = sp->maxops ? 2 * sp->maxops : 64;
+	if ((tmp = (logop_t *)realloc(sp->ops, need * sizeof(logop_t))) == NULL)
+	    return -oserror();
+	sp->ops = tmp;
+	sp->maxops = need;
+    }
+
+    op = &sp->ops[sp->nops];
+    op->file = file;
+    op->fd = fd;
+    op->offset = bp->pos[file];
+    op->start = sp->used;
+    op->len = len;
+    memcpy(sp->buf + sp->used, buf, len);
+    sp->used += len;
+    if (sp->nops++ == 0) {
+	__pmtimevalNow(&sp->first);
+	/* writer starts the clock on this batch */
+	pthread_cond_signal(&bp->kick);
+    }
+    else if (sp->used >= bp->threshold)
+	pthread_cond_signal(&bp->kick);
+    bp->pos[file] += len;
+    return 0;
+}
+#else
+struct __pmLogBatch {
+    int		unused;
+};
+
+int
+__pmLogBatchStart(__pmLogCtl *lcp, size_t threshold, const struct timeval *interval)
+{
+    return PM_ERR_NYI;
+}
+
+int
+__pmLogBatchFlush(__pmLogCtl *lcp)
+{
+    return 0;
+}
+
+int
+__pmLogBatchStop(__pmLogCtl *lcp)
+{
+    return 0;
+}
+#endif /* PM_MULTI_THREAD */
+
+/*
+ * Write one record to an archive file of lcp, returning the number of
+ * bytes written (or staged) like fwrite(), with oserror() set on failure.
+ */
+size_t
+__pmLogWrite(const __pmLogCtl *lcp, FILE *f, const void *buf, size_t len)
+{
+#ifdef PM_MULTI_THREAD
+    struct __pmLogBatch	*bp = __pmLogPrivate(lcp, PM_LOG_PRIV_BATCH);
+    int			file;
+    int			sts;
+    off_t		pos;
+
+    if (bp != NULL && (file = batch_file(lcp, f)) >= 0) {
+	PM_LOCK(bp->lock);
+	if ((sts = bp->error) == 0) {
+	    if (!bp->haspos[file]) {
+		if ((pos = ftell(f)) < 0)
+		    sts = -oserror();
+		else {
+		    bp->pos[file] = pos;
+		    bp->haspos[file] = 1;
+		}
+	    }
+	    if (sts == 0)
+		sts = stage_record(bp, file, fileno(f), buf, len);
+	}
+	PM_UNLOCK(bp->lock);
+	if (sts < 0) {
+	    setoserror(-sts);
+	    return 0;
+	}
+	return len;
+    }
+    if (bp != NULL)
+	__pmLogBatchFlush((__pmLogCtl *)lcp);
+#endif
+    return fwrite(buf, 1, len, f);
+}
+
+/*
+ * ftell() and fseek(..., SEEK_SET) for the archive files of lcp
+ */
+off_t
+__pmLogTell(const __pmLogCtl *lcp, FILE *f)
+{
+#ifdef PM_MULTI_THREAD
+    struct __pmLogBatch	*bp = __pmLogPrivate(lcp, PM_LOG_PRIV_BATCH);
+    int			file;
+    off_t		pos;
+
+    if (bp != NULL && (file = batch_file(lcp, f)) >= 0) {
+	PM_LOCK(bp->lock);
+	pos = bp->haspos[file] ? bp->pos[file] : ftell(f);
+	PM_UNLOCK(bp->lock);
+	return pos;
+    }
+#endif
+    return ftell(f);
+}
+
+int
+__pmLogSeek(const __pmLogCtl *lcp, FILE *f, off_t offset)
+{
+#ifdef PM_MULTI_THREAD
+    struct __pmLogBatch	*bp = __pmLogPrivate(lcp, PM_LOG_PRIV_BATCH);
+    int			file;
+
+    if (bp != NULL && (file = batch_file(lcp, f)) >= 0) {
+	PM_LOCK(bp->lock);
+	if (bp->haspos[file]) {
+	    bp->pos[file] = offset;
+	    PM_UNLOCK(bp->lock);
+	    return 0;
+	}
+	PM_UNLOCK(bp->lock);
+    }
+#endif
+    return fseek(f, offset, SEEK_SET);
+}
@@ -0,0 +1,437 @@
+/*
+ * Copyright (c) 2026 Red Hat.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ */
+
+#include <sys/stat.h>
+#include "pmapi.h"
+#include "impl.h"
+#include "internal.h"
+#if defined(HAVE_LZMA) && defined(HAVE_FOPENCOOKIE)
+#include <lzma.h>
+
+/*
+ * In-process xz (and legacy lzma) decompression of archive volumes,
+ * presented to the rest of libpcp as a read-only stdio stream, so no
+ * temporary file is needed.
+ *
+ * If the .xz file has a block index (a single stream, as written by
+ * xz(1)), a seek only costs decompressing the part of the one block
+ * it lands in ... so volumes compressed with xz --block-size (see
+ * pmlogger_daily(1)) are randomly accessible.  Otherwise, a backwards
+ * seek means decompressing again from the start of the file.
+ *
+ * Since these streams have no file descriptor of their own,
+ * __pmLogFileno() and __pmLogFstat() stand in for fileno() and fstat()
+ * on archive volumes.
+ */
+typedef struct xzfile {
+    struct xzfile	*next;		/* list of open xz streams */
+    FILE		*fp;		/* stdio stream for this one */
+    int			fd;		/* of the compressed file */
+    lzma_index		*index;		/* block index, NULL if unavailable */
+    lzma_index_iter	iter;		/* current block, if index != NULL */
+    lzma_block		block;		/* its header, used by the decoder */
+    lzma_filter		filters[LZMA_FILTERS_MAX + 1];
+    lzma_stream		strm;
+    int			active;		/* strm is set up for decoding */
+    int			done;		/* at end of current block or stream */
+    int			in_eof;		/* no more compressed input */
+    uint64_t		pos;		/* uncompressed offset of strm output */
+    uint64_t		want;		/* uncompressed offset for next read */
+    int64_t		size;		/* uncompressed size, -1 if unknown */
+    uint8_t		inbuf[BUFSIZ];
+} xzfile_t;
+
+static xzfile_t		*xz_list;	/* guarded by xz_lock */
+#ifdef PM_MULTI_THREAD
+static __pmMutex	xz_lock = PTHREAD_MUTEX_INITIALIZER;
+#else
+static __pmMutex	xz_lock;
+#endif
+
+/*
+ * Read the stream footer, block index and stream header, as xz --list
+ * does, for a file holding a single xz stream.
+ */
+static lzma_index *
+xz_read_index(int fd)
+{
+    lzma_stream_flags	header_flags;
+    lzma_stream_flags	footer_flags;
+    lzma_index		*index = NULL;
+    uint8_t		buf[LZMA_STREAM_HEADER_SIZE];
+    uint8_t		*ibuf;
+    uint64_t		memlimit = UINT64_MAX;
+    size_t		inpos = 0;
+    struct stat		sbuf;
+
+    if (fstat(fd, &sbuf) < 0 || sbuf.st_size < 2 * LZMA_STREAM_HEADER_SIZE)
+	return NULL;
+    if (pread(fd, buf, sizeof(buf), sbuf.st_size - sizeof(buf)) != sizeof(buf))
+	return NULL;
+    if (lzma_stream_footer_decode(&footer_flags, buf) != LZMA_OK)
+	return NULL;
+    if ((off_t)footer_flags.backward_size > sbuf.st_size - 2 * LZMA_STREAM_HEADER_SIZE)
+	return NULL;
+    if ((ibuf = malloc(footer_flags.backward_size)) == NULL)
+	return NULL;
+    if (pread(fd, ibuf, footer_flags.backward_size,
+	      sbuf.st_size - sizeof(buf) - footer_flags.backward_size) !=
+	      (ssize_t)footer_flags.backward_size ||
+	lzma_index_buffer_decode(&index, &memlimit, NULL, ibuf, &inpos,
+				 footer_flags.backward_size) != LZMA_OK) {
+	free(ibuf);
+	return NULL;
+    }
+    free(ibuf);
+
+    /* the index must account for the whole file, i.e. a single stream */
+    if (lzma_index_file_size(index) != (lzma_vli)sbuf.st_size ||
+	pread(fd, buf, sizeof(buf), 0) != sizeof(buf) ||
+	lzma_stream_header_decode(&header_flags, buf) != LZMA_OK ||
+	lzma_stream_flags_compare(&header_flags, &footer_flags) != LZMA_OK ||
+	lzma_index_stream_flags(index, &footer_flags) != LZMA_OK) {
+	lzma_index_end(index, NULL);
+	return NULL;
+    }
+    return index;
+}
+
+/*
+ * Set up to decode the block xz->iter now points at.  The decoder
+ * keeps a pointer to the lzma_block until the end of the block, so
+ * that lives in xz too.
+ */
+static int
+xz_block_start(xzfile_t *xz)
+{
+    lzma_block	*block = &xz->block;
+    uint8_t	hdr[LZMA_BLOCK_HEADER_SIZE_MAX];
+    off_t	offset = (off_t)xz->iter.block.compressed_file_offset;
+    lzma_ret	ret;
+    int		i;
+
+    if (pread(xz->fd, hdr, 1, offset) != 1)
+	return -1;
+    memset(block, 0, sizeof(*block));
+    block->version = 0;
+    block->check = xz->iter.stream.flags->check;
+    block->filters = xz->filters;
+    block->header_size = lzma_block_header_size_decode(hdr[0]);
+    if (pread(xz->fd, hdr, block->header_size, offset) != (ssize_t)block->header_size)
+	return -1;
+    if (lzma_block_header_decode(block, NULL, hdr) != LZMA_OK)
+	return -1;
+    ret = lzma_block_compressed_size(block, xz->iter.block.unpadded_size);
+    if (ret == LZMA_OK)
+	ret = lzma_block_decoder(&xz->strm, block);
+    /* filter options were allocated by lzma_block_header_decode() */
+    for (i = 0; xz->filters[i].id != LZMA_VLI_UNKNOWN; i++) {
+	free(xz->filters[i].options);
+	xz->filters[i].options = NULL;
+    }
+    if (ret != LZMA_OK)
+	return -1;
+    if (lseek(xz->fd, offset + block->header_size, SEEK_SET) < 0)
+	return -1;
+
+    xz->strm.avail_in = 0;
+    xz->active = 1;
+    xz->done = xz->in_eof = 0;
+    xz->pos = xz->iter.block.uncompressed_file_offset;
+    return 0;
+}
+
+/*
+ * Set up to decode the whole file from the start.
+ */
+static int
+xz_stream_start(xzfile_t *xz)
+{
+    if (lseek(xz->fd, 0, SEEK_SET) < 0)
+	return -1;
+    if (lzma_auto_decoder(&xz->strm, UINT64_MAX, LZMA_CONCATENATED) != LZMA_OK)
+	return -1;
+    xz->strm.avail_in = 0;
+    xz->active = 1;
+    xz->done = xz->in_eof = 0;
+    xz->pos = 0;
+    return 0;
+}
+
+/*
+ * Decompress up to len bytes at xz->pos.  Returns the number of
+ * bytes produced, 0 at end of file, or -1 on error.
+ */
+static ssize_t
+xz_decode(xzfile_t *xz, uint8_t *out, size_t len)
+{
+    lzma_ret	ret;
+    ssize_t	bytes;
+
+    xz->strm.next_out = out;
+    xz->strm.avail_out = len;
+    while (xz->strm.avail_out == len) {
+	if (xz->done) {
+	    if (xz->index == NULL ||
+		lzma_index_iter_next(&xz->iter, LZMA_INDEX_ITER_BLOCK))
+		return 0;
+	    if (xz_block_start(xz) < 0)
+		return -1;
+	    xz->strm.next_out = out;
+	    xz->strm.avail_out = len;
+	}
+	if (xz->strm.avail_in == 0 && !xz->in_eof) {
+	    if ((bytes = read(xz->fd, xz->inbuf, sizeof(xz->inbuf))) < 0)
+		return -1;
+	    xz->strm.next_in = xz->inbuf;
+	    xz->strm.avail_in = bytes;
+	    xz->in_eof = (bytes == 0);
+	}
+	ret = lzma_code(&xz->strm, xz->in_eof ? LZMA_FINISH : LZMA_RUN);
+	if (ret == LZMA_STREAM_END)
+	    xz->done = 1;
+	else if (ret != LZMA_OK)
+	    return -1;	/* corrupt or truncated */
+    }
+    bytes = len - xz->strm.avail_out;
+    xz->pos += bytes;
+    return bytes;
+}
+
+static ssize_t
+xz_read(void *cookie, char *buf, size_t size)
+{
+    xzfile_t	*xz = (xzfile_t *)cookie;
+    uint8_t	skip[BUFSIZ];
+    ssize_t	bytes;
+    size_t	n;
+
+    /* get to the block (or stream) holding the wanted offset ... */
+    if (xz->index != NULL) {
+	if (!xz->active || xz->want < xz->pos ||
+	    xz->want >= xz->iter.block.uncompressed_file_offset +
+			xz->iter.block.uncompressed_size) {
+	    if (lzma_index_iter_locate(&xz->iter, xz->want))
+		return 0;	/* beyond the end */
+	    if (xz_block_start(xz) < 0)
+		goto fail;
+	}
+    }
+    else if (!xz->active || xz->want < xz->pos) {
+	if (xz_stream_start(xz) < 0)
+	    goto fail;
+    }
+
+    /* ... then to the wanted offset within it */
+    while (xz->pos < xz->want) {
+	n = xz->want - xz->pos;
+	if (n > sizeof(skip))
+	    n = sizeof(skip);
+	if ((bytes = xz_decode(xz, skip, n)) <= 0) {
+	    if (bytes < 0)
+		goto fail;
+	    return 0;
+	}
+    }
+
+    if ((bytes = xz_decode(xz, (uint8_t *)buf, size)) < 0)
+	goto fail;
+    xz->want += bytes;
+    return bytes;
+
+fail:
+    xz->active = 0;
+    setoserror(EIO);
+    return -1;
+}
+
+static int64_t
+xz_size(xzfile_t *xz)
+{
+    uint8_t	skip[BUFSIZ];
+    ssize_t	bytes;
+
+    if (xz->size >= 0)
+	return xz->size;
+    if (xz->index != NULL)
+	return xz->size = lzma_index_uncompressed_size(xz->index);
+
+    /* no index, so it's the hard way ... but only once */
+    if (!xz->active && xz_stream_start(xz) < 0)
+	return -1;
+    while ((bytes = xz_decode(xz, skip, sizeof(skip))) > 0)
+	;
+    if (bytes < 0) {
+	xz->active = 0;
+	return -1;
+    }
+    return xz->size = xz->pos;
+}
+
+static int
+xz_seek(void *cookie, off64_t *offset, int whence)
+{
+    xzfile_t	*xz = (xzfile_t *)cookie;
+    int64_t	base;
+
+    if (whence == SEEK_SET)
+	base = 0;
+    else if (whence == SEEK_CUR)
+	base = xz->want;
+    else if (whence == SEEK_END) {
+	if ((base = xz_size(xz)) < 0) {
+	    setoserror(EIO);
+	    return -1;
+	}
+    }
+    else {
+	setoserror(EINVAL);
+	return -1;
+    }
+    if (base + *offset < 0) {
+	setoserror(EINVAL);
+	return -1;
+    }
+    xz->want = base + *offset;
+    *offset = xz->want;
+    return 0;
+}
+
+static int
+xz_close(void *cookie)
+{
+    xzfile_t	*xz = (xzfile_t *)cookie;
+    xzfile_t	**xpp;
+
+    PM_INIT_LOCKS();
+    PM_LOCK(xz_lock);
+    for (xpp = &xz_list; *xpp != NULL; xpp = &(*xpp)->next) {
+	if (*xpp == xz) {
+	    *xpp = xz->next;
+	    break;
+	}
+    }
+    PM_UNLOCK(xz_lock);
+
+    lzma_end(&xz->strm);
+    if (xz->index != NULL)
+	lzma_index_end(xz->index, NULL);
+    close(xz->fd);
+    free(xz);
+    return 0;
+}
+
+FILE *
+__pmLogFopenXz(const char *fname)
+{
+    cookie_io_functions_t	io = { xz_read, NULL, xz_seek, xz_close };
+    lzma_stream		init = LZMA_STREAM_INIT;
+    xzfile_t		*xz;
+    int			sts;
+    int			fd;
+
+    if ((fd = open(fname, O_RDONLY)) < 0)
+	return NULL;
+    if ((xz = (xzfile_t *)calloc(1, sizeof(*xz))) == NULL) {
+	close(fd);
+	setoserror(ENOMEM);
+	return NULL;
+    }
+    xz->fd = fd;
+    xz->strm = init;
+    xz->size = -1;
+    xz->filters[0].id = LZMA_VLI_UNKNOWN;
+    if ((xz->index = xz_read_index(fd)) != NULL)
+	lzma_index_iter_init(&xz->iter, xz->index);
+#ifdef PCP_DEBUG
+    if (pmDebug & DBG_TRACE_LOG)
+	fprintf(stderr, "__pmLogOpen: in-process xz decompression of %s, %s\n",
+		fname, xz->index == NULL ? "sequential" : "block index");
+#endif
+
+    if ((xz->fp = fopencookie(xz, "r", io)) == NULL) {
+	sts = oserror();
+	if (xz->index != NULL)
+	    lzma_index_end(xz->index, NULL);
+	free(xz);
+	close(fd);
+	setoserror(sts);
+	return NULL;
+    }
+
+    PM_INIT_LOCKS();
+    PM_LOCK(xz_lock);
+    xz->next = xz_list;
+    xz_list = xz;
+    PM_UNLOCK(xz_lock);
+    return xz->fp;
+}
+
+static xzfile_t *
+xz_lookup(FILE *f)
+{
+    xzfile_t	*xz;
+
+    PM_INIT_LOCKS();
+    PM_LOCK(xz_lock);
+    for (xz = xz_list; xz != NULL; xz = xz->next) {
+	if (xz->fp == f)
+	    break;
+    }
+    PM_UNLOCK(xz_lock);
+    return xz;
+}
+#endif
+
+/*
+ * fileno(3) and fstat(2) for archive volumes, which may be in-process
+ * decompression streams: these are identified by the descriptor of the
+ * compressed file, and report their uncompressed size.  Mapped streams
+ * (see logmap.c) are identified by the descriptor of the mapped file.
+ */
+int
+__pmLogFileno(const __pmLogCtl *lcp, FILE *f)
+{
+    int		fd;
+#if defined(HAVE_LZMA) && defined(HAVE_FOPENCOOKIE)
+    xzfile_t	*xz;
+
+    if ((xz = xz_lookup(f)) != NULL)
+	return xz->fd;
+#endif
+    if ((fd = __pmLogMapFileno(lcp, f)) >= 0)
+	return fd;
+    return fileno(f);
+}
+
+int
+__pmLogFstat(const __pmLogCtl *lcp, FILE *f, struct stat *sbuf)
+{
+#if defined(HAVE_LZMA) && defined(HAVE_FOPENCOOKIE)
+    xzfile_t	*xz;
+    int64_t	size;
+
+    if ((xz = xz_lookup(f)) != NULL) {
+	if (fstat(xz->fd, sbuf) < 0)
+	    return -1;
+	if ((size = xz_size(xz)) < 0) {
+	    setoserror(EIO);
+	    return -1;
+	}
+	sbuf->st_size = size;
+	return 0;
+    }
+#endif
+    return fstat(__pmLogFileno(lcp, f), sbuf);
+}
@@ -0,0 +1,930 @@
+/*
+ * Copyright (c) 2026 Red Hat.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ */
+
+/*
+ * Delta encoded data volumes, for archives with the PM_LOG_VERS02_DELTA
+ * label version.
+ *
+ * Such a data volume holds the same records as version 2, but
+ * most of them are written relative to an earlier "keyframe" record in
+ * the same volume.  Keyframes and <mark> records are version 2 records,
+ * byte for byte.  A delta record is
+ *
+ *	int len | timestamp | int -numpmid | int keyback | bytes ... | int len
+ *
+ * where keyback is the distance in bytes back from the start of this
+ * record to the start of its keyframe, and the bytes (zero padded to a
+ * word boundary) describe each pmValueSet in turn.  Numbers are
+ * unsigned varints, "zigzag" for signed values.
+ *
+ *	0 pmid body	pmID not in the keyframe
+ *	2k+1 values	the same pmID, numval, valfmt and instances as the
+ *			keyframe's k-th pmValueSet
+ *	2k+2 body	the pmID of the keyframe's k-th pmValueSet
+ *
+ * body is zigzag numval, then if numval > 0, valfmt and for each value
+ * an instance (j+1 for the j-th instance of the keyframe pmValueSet, or
+ * 0 and the zigzag instance) and the value.  values is just the value
+ * for each instance, in keyframe order.
+ *
+ * A value is coded against the keyframe's value for the same instance
+ * when there is one with the same valfmt, insitu values as the zigzag
+ * difference, and pmValueBlocks as
+ *	0		identical
+ *	1 zigzag	PM_TYPE_64 or PM_TYPE_U64, the difference
+ *	2 byte xor	PM_TYPE_DOUBLE, the bits xor'd, shifted right byte bytes
+ *	3 hdr bytes	anything, hdr is the vtype/vlen word
+ * Without a keyframe value, insitu values are zigzag and blocks use 3.
+ *
+ * Deltas are taken against the keyframe rather than the previous record
+ * so that any record can be decoded after reading at most one other,
+ * keeping random access through the temporal index and backwards reads
+ * cheap.  pmlogger writes a record per logging group, so keyframes are
+ * kept for each of the last few groups.
+ *
+ * The keyframes for each archive being written or read are kept in the
+ * private state of its __pmLogCtl (see __pmLogPrivate()), so that
+ * structure (which is shared with applications) is unchanged.
+ */
+
+#include "pmapi.h"
+#include "impl.h"
+#include "internal.h"
+
+#define NKEYS		8	/* keyframes kept, when writing or reading */
+#define KEYRECORDS	32	/* delta records written against a keyframe */
+
+/*
+ * Word offsets in a record held in PDU layout, as __pmLogRead() reads
+ * it ... see the ascii art there.
+ */
+#define R_NUMPMID	5
+#define R_VSETS		6	/* first pmValueSet, version 2 record */
+#define R_KEYBACK	6	/* delta record */
+#define R_BYTES		7
+
+#define BLOCK_HDR(w)	((__uint32_t)ntohl(w))
+#define BLOCK_VLEN(h)	((h) & 0xffffff)
+#define BLOCK_VTYPE(h)	((h) >> 24)
+
+typedef struct {
+    int			vol;		/* volume, -1 if not cached */
+    off_t		offset;		/* of the record in the volume */
+    int			nrec;		/* delta records against it */
+    unsigned int	stamp;		/* for replacement */
+    __pmPDU		*rec;		/* the record, PDU layout */
+    int			len;		/* bytes in rec[], as hdr.len */
+    int			size;		/* bytes allocated for rec[] */
+    int			numpmid;
+    int			*vset;		/* word in rec[] of each pmValueSet */
+    int			maxvset;
+} keyframe_t;
+
+typedef struct {
+    unsigned char	*buf;
+    size_t		used;
+    size_t		size;
+    int			err;
+} bytes_t;
+
+typedef struct {
+    const unsigned char	*p;
+    const unsigned char	*end;
+    int			err;
+} reader_t;
+
+typedef struct {
+    __pmPDU		*buf;
+    int			used;
+    int			size;
+} words_t;
+
+typedef struct {
+    keyframe_t		key[NKEYS];
+    unsigned int	clock;
+    int			*vset;		/* writing: index of the new record */
+    int			maxvset;
+    bytes_t		enc;		/* writing: the delta record */
+    words_t		vsets;		/* reading: pmValueSets ... */
+    words_t		blocks;		/* ... and pmValueBlocks */
+} delta_t;
+
+/*
+ * Keyframes for an archive, allocated on first use.  Each archive is
+ * used by one thread at a time, so no lock is needed.
+ */
+static delta_t *
+delta_get(__pmLogCtl *lcp)
+{
+    delta_t	*dp;
+    int		i;
+
+    if ((dp = (delta_t *)__pmLogPrivate(lcp, PM_LOG_PRIV_DELTA)) != NULL)
+	return dp;
+    if ((dp = (delta_t *)calloc(1, sizeof(*dp))) == NULL)
+	return NULL;
+    for (i = 0; i < NKEYS; i++)
+	dp->key[i].vol = -1;
+    if (__pmHashAdd(PM_LOG_PRIV_DELTA, (void *)dp, &lcp->l_hashrange) < 0) {
+	free(dp);
+	return NULL;
+    }
+    return dp;
+}
+
+void
+__pmLogDeltaFree(__pmLogCtl *lcp)
+{
+    delta_t	*dp;
+    int		i;
+
+    if ((dp = (delta_t *)__pmLogPrivate(lcp, PM_LOG_PRIV_DELTA)) == NULL)
+	return;
+    __pmHashDel(PM_LOG_PRIV_DELTA, (void *)dp, &lcp->l_hashrange);
+    for (i = 0; i < NKEYS; i++) {
+	free(dp->key[i].rec);
+	free(dp->key[i].vset);
+    }
+    free(dp->vset);
+    free(dp->enc.buf);
+    free(dp->vsets.buf);
+    free(dp->blocks.buf);
+    free(dp);
+}
+
+static __uint32_t
+zigzag32(__uint32_t v)
+{
+    return (v << 1) ^ (__uint32_t)((__int32_t)v >> 31);
+}
+
+static __uint32_t
+unzigzag32(__uint32_t v)
+{
+    return (v >> 1) ^ -(v & 1);
+}
+
+static __uint64_t
+zigzag64(__uint64_t v)
+{
+    return (v << 1) ^ (__uint64_t)((__int64_t)v >> 63);
+}
+
+static __uint64_t
+unzigzag64(__uint64_t v)
+{
+    return (v >> 1) ^ -(v & 1);
+}
+
+/* 64-bit values in pmValueBlocks are in network byte order */
+static __uint64_t
+get64(const __pmPDU *wp)
+{
+    const unsigned char	*p = (const unsigned char *)wp;
+    __uint64_t		v = 0;
+    int			i;
+
+    for (i = 0; i < 8; i++)
+	v = (v << 8) | p[i];
+    return v;
+}
+
+static void
+put64(__pmPDU *wp, __uint64_t v)
+{
+    unsigned char	*p = (unsigned char *)wp;
+    int			i;
+
+    for (i = 7; i >= 0; i--, v >>= 8)
+	p[i] = v & 0xff;
+}
+
+static unsigned char *
+enc_room(bytes_t *bp, size_t n)
+{
+    unsigned char	*buf;
+    size_t		size;
+
+    if (bp->used + n > bp->size) {
+	size = bp->size ? 2 * bp->size : 4096;
+	while (size < bp->used + n)
+	    size *= 2;
+	if ((buf = (unsigned char *)realloc(bp->buf, size)) == NULL) {
+	    bp->err = 1;
+	    return NULL;
+	}
+	bp->buf = buf;
+	bp->size = size;
+    }
+    return &bp->buf[bp->used];
+}
+
+static void
+enc_byte(bytes_t *bp, unsigned int c)
+{
+    unsigned char	*p;
+
+    if ((p = enc_room(bp, 1)) != NULL) {
+	*p = c;
+	bp->used++;
+    }
+}
+
+static void
+enc_varint(bytes_t *bp, __uint64_t v)
+{
+    unsigned char	*p;
+    int			n = 0;
+
+    if ((p = enc_room(bp, 10)) == NULL)
+	return;
+    while (v >= 0x80) {
+	p[n++] = (v & 0x7f) | 0x80;
+	v >>= 7;
+    }
+    p[n++] = v;
+    bp->used += n;
+}
+
+static void
+enc_bytes(bytes_t *bp, const void *src, size_t n)
+{
+    unsigned char	*p;
+
+    if ((p = enc_room(bp, n)) != NULL) {
+	memcpy(p, src, n);
+	bp->used += n;
+    }
+}
+
+static unsigned int
+dec_byte(reader_t *rp)
+{
+    if (rp->p >= rp->end) {
+	rp->err = 1;
+	return 0;
+    }
+    return *rp->p++;
+}
+
+static __uint64_t
+dec_varint(reader_t *rp)
+{
+    __uint64_t		v = 0;
+    unsigned int	c;
+    int			shift;
+
+    for (shift = 0; shift < 64; shift += 7) {
+	if (rp->p >= rp->end)
+	    break;
+	c = *rp->p++;
+	v |= (__uint64_t)(c & 0x7f) << shift;
+	if ((c & 0x80) == 0)
+	    return v;
+    }
+    rp->err = 1;
+    return 0;
+}
+
+static __pmPDU *
+dec_words(words_t *wp, int n)
+{
+    __pmPDU	*buf;
+    int		size;
+
+    if (wp->used + n > wp->size) {
+	size = wp->size ? 2 * wp->size : 1024;
+	while (size < wp->used + n)
+	    size *= 2;
+	if ((buf = (__pmPDU *)realloc(wp->buf, size * sizeof(__pmPDU))) == NULL)
+	    return NULL;
+	wp->buf = buf;
+	wp->size = size;
+    }
+    wp->used += n;
+    return &wp->buf[wp->used - n];
+}
+
+/*
+ * Find the pmValueSets of the version 2 record rec[] of len bytes,
+ * checking they and their pmValueBlocks lie within it.  Returns
+ * numpmid, with the word offset of each pmValueSet in (*vsetp)[].
+ */
+static int
+index_record(const __pmPDU *rec, int len, int **vsetp, int *maxp)
+{
+    int		nwords = len / (int)sizeof(__pmPDU);
+    int		numpmid;
+    int		numval;
+    int		valfmt;
+    int		w = R_VSETS;
+    int		i;
+    int		j;
+    int		*vset;
+    __uint32_t	off;
+    __uint32_t	hdr;
+
+    if (nwords <= R_NUMPMID)
+	return PM_ERR_LOGREC;
+    numpmid = ntohl(rec[R_NUMPMID]);
+    if (numpmid < 0 || numpmid > nwords)
+	return PM_ERR_LOGREC;
+    if (numpmid > *maxp) {
+	if ((vset = (int *)realloc(*vsetp, numpmid * sizeof(int))) == NULL)
+	    return -oserror();
+	*vsetp = vset;
+	*maxp = numpmid;
+    }
+    for (i = 0; i < numpmid; i++) {
+	if (w + 2 > nwords)
+	    return PM_ERR_LOGREC;
+	(*vsetp)[i] = w;
+	numval = ntohl(rec[w + 1]);
+	w += 2;
+	if (numval <= 0)
+	    continue;
+	if (numval > nwords || w + 1 + 2 * numval > nwords)
+	    return PM_ERR_LOGREC;
+	valfmt = ntohl(rec[w]);
+	if (valfmt != PM_VAL_INSITU && valfmt != PM_VAL_DPTR &&
+	    valfmt != PM_VAL_SPTR)
+	    return PM_ERR_LOGREC;
+	for (j = 0; valfmt != PM_VAL_INSITU && j < numval; j++) {
+	    off = ntohl(rec[w + 2 + 2 * j]);
+	    if (off < R_VSETS || off >= nwords)
+		return PM_ERR_LOGREC;
+	    hdr = BLOCK_HDR(rec[off]);
+	    if (BLOCK_VLEN(hdr) < PM_VAL_HDR_SIZE ||
+		off + PM_PDU_SIZE(BLOCK_VLEN(hdr)) > nwords)
+		return PM_ERR_LOGREC;
+	}
+	w += 1 + 2 * numval;
+    }
+    return numpmid;
+}
+
+static keyframe_t *
+key_slot(delta_t *dp)
+{
+    keyframe_t	*kp = &dp->key[0];
+    int		i;
+
+    for (i = 0; i < NKEYS; i++) {
+	if (dp->key[i].vol < 0)
+	    return &dp->key[i];
+	if (dp->key[i].stamp < kp->stamp)
+	    kp = &dp->key[i];
+    }
+    return kp;
+}
+
+static int
+key_room(keyframe_t *kp, int len)
+{
+    __pmPDU	*rec;
+
+    if (len + (int)sizeof(int) > kp->size) {
+	if ((rec = (__pmPDU *)realloc(kp->rec, len + sizeof(int))) == NULL)
+	    return -oserror();
+	kp->rec = rec;
+	kp->size = len + sizeof(int);
+    }
+    return 0;
+}
+
+/* the keyframe's pmValueSet for pmid, trying hint first */
+static int
+key_pmid(const keyframe_t *kp, __pmPDU pmid, int hint)
+{
+    int		k;
+
+    if (hint < kp->numpmid && kp->rec[kp->vset[hint]] == pmid)
+	return hint;
+    for (k = 0; k < kp->numpmid; k++) {
+	if (kp->rec[kp->vset[k]] == pmid)
+	    return k;
+    }
+    return -1;
+}
+
+/* the instance in the keyframe pmValueSet kvp[], trying hint first */
+static int
+key_inst(const __pmPDU *kvp, __pmPDU inst, int hint)
+{
+    int		numval = ntohl(kvp[1]);
+    int		j;
+
+    if (hint < numval && kvp[3 + 2 * hint] == inst)
+	return hint;
+    for (j = 0; j < numval; j++) {
+	if (kvp[3 + 2 * j] == inst)
+	    return j;
+    }
+    return -1;
+}
+
+static int
+same_instances(const __pmPDU *kvp, const __pmPDU *vp)
+{
+    int		numval = ntohl(vp[1]);
+    int		j;
+
+    if (kvp[1] != vp[1])
+	return 0;
+    if (numval <= 0)
+	return 1;
+    if (kvp[2] != vp[2])
+	return 0;
+    for (j = 0; j < numval; j++) {
+	if (kvp[3 + 2 * j] != vp[3 + 2 * j])
+	    return 0;
+    }
+    return 1;
+}
+
+static void
+enc_value(bytes_t *bp, int valfmt, const __pmPDU *rec, __pmPDU val,
+	const __pmPDU *krec, const __pmPDU *kval)
+{
+    const __pmPDU	*vb;
+    const __pmPDU	*kb;
+    __uint32_t		hdr;
+    __uint64_t		x;
+    int			tz;
+
+    if (valfmt == PM_VAL_INSITU) {
+	__uint32_t	v = ntohl(val);
+	if (kval != NULL)
+	    v -= ntohl(*kval);
+	enc_varint(bp, zigzag32(v));
+	return;
+    }
+
+    vb = &rec[ntohl(val)];
+    hdr = BLOCK_HDR(vb[0]);
+    if (kval != NULL) {
+	kb = &krec[ntohl(*kval)];
+	if (kb[0] == vb[0]) {
+	    if (memcmp(&kb[1], &vb[1], BLOCK_VLEN(hdr) - PM_VAL_HDR_SIZE) == 0) {
+		enc_byte(bp, 0);
+		return;
+	    }
+	    if (BLOCK_VLEN(hdr) == PM_VAL_HDR_SIZE + 8) {
+		if (BLOCK_VTYPE(hdr) == PM_TYPE_64 ||
+		    BLOCK_VTYPE(hdr) == PM_TYPE_U64) {
+		    enc_byte(bp, 1);
+		    enc_varint(bp, zigzag64(get64(&vb[1]) - get64(&kb[1])));
+		    return;
+		}
+		if (BLOCK_VTYPE(hdr) == PM_TYPE_DOUBLE) {
+		    x = get64(&vb[1]) ^ get64(&kb[1]);
+		    for (tz = 0; (x & 0xff) == 0; tz++)
+			x >>= 8;
+		    enc_byte(bp, 2);
+		    enc_byte(bp, tz);
+		    enc_varint(bp, x);
+		    return;
+		}
+	    }
+	}
+    }
+    enc_byte(bp, 3);
+    enc_varint(bp, hdr);
+    enc_bytes(bp, &vb[1], BLOCK_VLEN(hdr) - PM_VAL_HDR_SIZE);
+}
+
+/* append the pmValueSets of rec[], coded against keyframe kp */
+static void
+enc_vsets(delta_t *dp, const keyframe_t *kp, const __pmPDU *rec,
+	int numpmid)
+{
+    bytes_t		*bp = &dp->enc;
+    const __pmPDU	*vp;
+    const __pmPDU	*kvp;
+    int			numval;
+    int			valfmt;
+    int			i;
+    int			j;
+    int			k;
+    int			r;
+    int			hint = 0;
+    int			ihint;
+
+    for (i = 0; i < numpmid; i++) {
+	vp = &rec[dp->vset[i]];
+	numval = ntohl(vp[1]);
+	if ((k = key_pmid(kp, vp[0], hint)) < 0) {
+	    enc_byte(bp, 0);
+	    enc_varint(bp, (__uint32_t)__ntohpmID(vp[0]));
+	    kvp = NULL;
+	}
+	else {
+	    hint = k + 1;
+	    kvp = &kp->rec[kp->vset[k]];
+	    if (same_instances(kvp, vp)) {
+		enc_varint(bp, 2 * (__uint64_t)k + 1);
+		for (j = 0; j < numval; j++)
+		    enc_value(bp, ntohl(vp[2]), rec, vp[4 + 2 * j],
+				kp->rec, &kvp[4 + 2 * j]);
+		continue;
+	    }
+	    enc_varint(bp, 2 * (__uint64_t)k + 2);
+	}
+	enc_varint(bp, zigzag32(numval));
+	if (numval <= 0)
+	    continue;
+	valfmt = ntohl(vp[2]);
+	enc_varint(bp, valfmt);
+	if (kvp != NULL && ntohl(kvp[1]) <= 0)
+	    kvp = NULL;
+	for (j = 0, ihint = 0; j < numval; j++) {
+	    r = kvp == NULL ? -1 : key_inst(kvp, vp[3 + 2 * j], ihint);
+	    if (r < 0) {
+		enc_varint(bp, 0);
+		enc_varint(bp, zigzag32(ntohl(vp[3 + 2 * j])));
+	    }
+	    else {
+		enc_varint(bp, r + 1);
+		ihint = r + 1;
+	    }
+	    enc_value(bp, valfmt, rec, vp[4 + 2 * j], kp->rec,
+			(r >= 0 && kvp[2] == vp[2]) ? &kvp[4 + 2 * r] : NULL);
+	}
+    }
+}
+
+/*
+ * Called with a result PDU (as from __pmEncodeResult) about to be
+ * written to a delta encoded archive.  Returns the size in bytes of the
+ * delta record built for it in *recp, or 0 if the PDU is to be written
+ * as is, becoming a keyframe.
+ */
+int
+__pmLogEncodeDelta(__pmLogCtl *lcp, __pmPDU *pb, __pmPDU **recp)
+{
+    delta_t		*dp;
+    keyframe_t		*kp = NULL;
+    keyframe_t		*tp;
+    off_t		offset;
+    int			numpmid;
+    int			len = ((__pmPDUHdr *)pb)->len;
+    int			sz;
+    int			i;
+
+    if ((dp = delta_get(lcp)) == NULL)
+	return 0;
+    if ((numpmid = index_record(pb, len, &dp->vset, &dp->maxvset)) <= 0)
+	/* <mark> record, or not something we know how to encode */
+	return 0;
+    offset = __pmLogTell(lcp, lcp->l_mfp);
+
+    /*
+     * the latest keyframe for the same logging group, as near as we can
+     * tell ... same first pmID and preferably the same numpmid
+     */
+    for (i = 0; i < NKEYS; i++) {
+	tp = &dp->key[i];
+	if (tp->vol != lcp->l_curvol || tp->offset >= offset ||
+	    tp->rec[R_VSETS] != pb[R_VSETS])
+	    continue;
+	if (kp == NULL ||
+	    (tp->numpmid == numpmid && kp->numpmid != numpmid) ||
+	    ((tp->numpmid == numpmid) == (kp->numpmid == numpmid) &&
+	     tp->stamp > kp->stamp))
+	    kp = tp;
+    }
+
+    if (kp != NULL && kp->nrec < KEYRECORDS &&
+	offset - kp->offset <= 0x7fffffff) {
+	dp->enc.used = 0;
+	dp->enc.err = 0;
+	if (enc_room(&dp->enc, R_BYTES * sizeof(__pmPDU)) != NULL) {
+	    dp->enc.used = (R_BYTES - 2) * sizeof(__pmPDU);
+	    enc_vsets(dp, kp, pb, numpmid);
+	    while (dp->enc.used % sizeof(__pmPDU))
+		enc_byte(&dp->enc, 0);
+	    enc_room(&dp->enc, sizeof(int));
+	}
+	sz = (int)dp->enc.used + (int)sizeof(int);
+	if (!dp->enc.err &&
+	    sz < len - (int)sizeof(__pmPDUHdr) + 2 * (int)sizeof(int)) {
+	    __pmPDU	*rec = (__pmPDU *)dp->enc.buf;
+
+	    rec[0] = htonl(sz);
+	    rec[1] = pb[R_NUMPMID - 2];		/* timestamp */
+	    rec[2] = pb[R_NUMPMID - 1];
+	    rec[3] = htonl(-numpmid);
+	    rec[4] = htonl((int)(offset - kp->offset));
+	    rec[sz / sizeof(__pmPDU) - 1] = rec[0];
+	    kp->nrec++;
+	    kp->stamp = ++dp->clock;
+	    *recp = rec;
+	    return sz;
+	}
+    }
+
+    /*
+     * a new keyframe, replacing the last one for this group (if any)
+     */
+    if (kp == NULL)
+	kp = key_slot(dp);
+    kp->vol = -1;
+    if (key_room(kp, len) < 0)
+	return 0;
+    memcpy(kp->rec, pb, len);
+    kp->len = len;
+    if ((kp->numpmid = index_record(kp->rec, len, &kp->vset, &kp->maxvset)) <= 0)
+	return 0;
+    kp->vol = lcp->l_curvol;
+    kp->offset = offset;
+    kp->nrec = 0;
+    kp->stamp = ++dp->clock;
+    return 0;
+}
+
+/* read the keyframe at offset in f, restoring the file position */
+static keyframe_t *
+load_keyframe(delta_t *dp, FILE *f, int vol, off_t offset)
+{
+    keyframe_t	*kp;
+    long	save = ftell(f);
+    int		head;
+    int		trail;
+    int		rlen;
+
+    for (kp = &dp->key[0]; vol >= 0 && kp < &dp->key[NKEYS]; kp++) {
+	if (kp->vol == vol && kp->offset == offset) {
+	    kp->stamp = ++dp->clock;
+	    return kp;
+	}
+    }
+
+    kp = key_slot(dp);
+    kp->vol = -1;
+    if (fseek(f, (long)offset, SEEK_SET) < 0 ||
+	fread(&head, 1, sizeof(head), f) != sizeof(head))
+	goto fail;
+    head = ntohl(head);
+    rlen = head - 2 * (int)sizeof(head);
+    if (rlen < 3 * (int)sizeof(__pmPDU) ||
+	key_room(kp, (int)sizeof(__pmPDUHdr) + rlen) < 0 ||
+	fread(&kp->rec[3], 1, rlen, f) != (size_t)rlen ||
+	fread(&trail, 1, sizeof(trail), f) != sizeof(trail) ||
+	ntohl(trail) != head)
+	goto fail;
+    kp->len = (int)sizeof(__pmPDUHdr) + rlen;
+    if ((kp->numpmid = index_record(kp->rec, kp->len, &kp->vset, &kp->maxvset)) <= 0)
+	goto fail;
+    fseek(f, save, SEEK_SET);
+    kp->vol = vol;
+    kp->offset = offset;
+    kp->stamp = ++dp->clock;
+    return kp;
+
+fail:
+#ifdef PCP_DEBUG
+    if (pmDebug & DBG_TRACE_LOG)
+	fprintf(stderr, "\nError: bad keyframe at vol=%d posn=%ld\n",
+		vol, (long)offset);
+#endif
+    clearerr(f);
+    fseek(f, save, SEEK_SET);
+    return NULL;
+}
+
+/* decode a value, appending any pmValueBlock to dp->blocks */
+static __pmPDU
+dec_value(delta_t *dp, reader_t *rp, int valfmt,
+	const keyframe_t *kp, const __pmPDU *kval)
+{
+    const __pmPDU	*kb;
+    __pmPDU		*vb;
+    __uint32_t		hdr;
+    __uint64_t		x;
+    int			code;
+    int			tz;
+    int			off = dp->blocks.used;
+
+    if (valfmt == PM_VAL_INSITU) {
+	__uint32_t	v = unzigzag32((__uint32_t)dec_varint(rp));
+	if (kval != NULL)
+	    v += ntohl(*kval);
+	return htonl(v);
+    }
+
+    code = dec_byte(rp);
+    if (code < 3) {
+	if (kval == NULL) {
+	    rp->err = 1;
+	    return 0;
+	}
+	kb = &kp->rec[ntohl(*kval)];
+	hdr = BLOCK_HDR(kb[0]);
+	if ((vb = dec_words(&dp->blocks, PM_PDU_SIZE(BLOCK_VLEN(hdr)))) == NULL) {
+	    rp->err = 1;
+	    return 0;
+	}
+	memcpy(vb, kb, PM_PDU_SIZE_BYTES(BLOCK_VLEN(hdr)));
+	if (code != 0 && BLOCK_VLEN(hdr) != PM_VAL_HDR_SIZE + 8) {
+	    rp->err = 1;
+	    return 0;
+	}
+	if (code == 1)
+	    put64(&vb[1], get64(&vb[1]) + unzigzag64(dec_varint(rp)));
+	else if (code == 2) {
+	    if ((tz = dec_byte(rp)) > 7) {
+		rp->err = 1;
+		return 0;
+	    }
+	    x = dec_varint(rp) << (8 * tz);
+	    put64(&vb[1], get64(&vb[1]) ^ x);
+	}
+    }
+    else if (code == 3) {
+	hdr = (__uint32_t)dec_varint(rp);
+	if (BLOCK_VLEN(hdr) < PM_VAL_HDR_SIZE ||
+	    BLOCK_VLEN(hdr) - PM_VAL_HDR_SIZE > rp->end - rp->p ||
+	    (vb = dec_words(&dp->blocks, PM_PDU_SIZE(BLOCK_VLEN(hdr)))) == NULL) {
+	    rp->err = 1;
+	    return 0;
+	}
+	vb[0] = htonl(hdr);
+	memcpy(&vb[1], rp->p, BLOCK_VLEN(hdr) - PM_VAL_HDR_SIZE);
+	rp->p += BLOCK_VLEN(hdr) - PM_VAL_HDR_SIZE;
+	/* clear the padding bytes, as __pmEncodeResult() does */
+	memset((char *)vb + BLOCK_VLEN(hdr), '~',
+		PM_PDU_SIZE_BYTES(BLOCK_VLEN(hdr)) - BLOCK_VLEN(hdr));
+    }
+    else {
+	rp->err = 1;
+	return 0;
+    }
+    /* relative to dp->blocks for now, see __pmLogDecodeDelta() */
+    return htonl(off);
+}
+
+#define VS_PUT(w) \
+    do { \
+	__pmPDU	*_p = dec_words(&dp->vsets, 1); \
+	if (_p == NULL) return -oserror(); \
+	*_p = (w); \
+    } while (0)
+
+static int
+dec_vsets(delta_t *dp, reader_t *rp, const keyframe_t *kp,
+	int numpmid)
+{
+    const __pmPDU	*kvp;
+    __uint64_t		h;
+    __uint64_t		r;
+    __pmPDU		val;
+    int			numval;
+    int			valfmt;
+    int			i;
+    int			j;
+
+    for (i = 0; i < numpmid && !rp->err; i++) {
+	h = dec_varint(rp);
+	if (h == 0) {
+	    VS_PUT(__htonpmID((pmID)dec_varint(rp)));
+	    kvp = NULL;
+	}
+	else {
+	    if ((h - 1) / 2 >= kp->numpmid)
+		return PM_ERR_LOGREC;
+	    kvp = &kp->rec[kp->vset[(h - 1) / 2]];
+	    VS_PUT(kvp[0]);
+	    if (h & 1) {
+		numval = ntohl(kvp[1]);
+		VS_PUT(kvp[1]);
+		if (numval <= 0)
+		    continue;
+		VS_PUT(kvp[2]);
+		for (j = 0; j < numval; j++) {
+		    VS_PUT(kvp[3 + 2 * j]);
+		    val = dec_value(dp, rp, ntohl(kvp[2]), kp, &kvp[4 + 2 * j]);
+		    VS_PUT(val);
+		}
+		continue;
+	    }
+	}
+	numval = unzigzag32((__uint32_t)dec_varint(rp));
+	VS_PUT(htonl(numval));
+	if (numval <= 0)
+	    continue;
+	valfmt = (int)dec_varint(rp);
+	if ((valfmt != PM_VAL_INSITU && valfmt != PM_VAL_DPTR &&
+	     valfmt != PM_VAL_SPTR) || numval > rp->end - rp->p)
+	    return PM_ERR_LOGREC;
+	VS_PUT(htonl(valfmt));
+	if (kvp != NULL && ntohl(kvp[1]) <= 0)
+	    kvp = NULL;
+	for (j = 0; j < numval && !rp->err; j++) {
+	    r = dec_varint(rp);
+	    if (r == 0) {
+		VS_PUT(htonl(unzigzag32((__uint32_t)dec_varint(rp))));
+		val = dec_value(dp, rp, valfmt, kp, NULL);
+	    }
+	    else {
+		if (kvp == NULL || r > ntohl(kvp[1]))
+		    return PM_ERR_LOGREC;
+		VS_PUT(kvp[3 + 2 * (r - 1)]);
+		val = dec_value(dp, rp, valfmt, kp,
+			ntohl(kvp[2]) == valfmt ? &kvp[4 + 2 * (r - 1)] : NULL);
+	    }
+	    VS_PUT(val);
+	}
+    }
+    return rp->err ? PM_ERR_LOGREC : 0;
+}
+
+/*
+ * Called from __pmLogRead() with a delta record in *pbp, read from
+ * offset start in f.  Replaces *pbp with a version 2 record, unpinning
+ * the delta record, else returns an error leaving *pbp alone.
+ */
+int
+__pmLogDecodeDelta(__pmLogCtl *lcp, FILE *f, long start, __pmPDU **pbp)
+{
+    delta_t		*dp;
+    keyframe_t		*kp;
+    reader_t		rd;
+    __pmPDU		*pb = *pbp;
+    __pmPDU		*npb;
+    __pmPDUHdr		*php;
+    int			len = ((__pmPDUHdr *)pb)->len;
+    int			numpmid;
+    int			keyback;
+    int			base;
+    int			numval;
+    int			i;
+    int			j;
+    int			w;
+    int			sts;
+
+    if (len < R_BYTES * (int)sizeof(__pmPDU))
+	return PM_ERR_LOGREC;
+    numpmid = -(int)ntohl(pb[R_NUMPMID]);
+    keyback = ntohl(pb[R_KEYBACK]);
+    if (numpmid <= 0 || numpmid > len || keyback <= 0 ||
+	keyback > start - (long)(sizeof(__pmLogLabel) + 2 * sizeof(int)))
+	return PM_ERR_LOGREC;
+    if ((dp = delta_get(lcp)) == NULL)
+	return -oserror();
+
+    kp = load_keyframe(dp, f, f == lcp->l_mfp ? lcp->l_curvol : -1,
+			start - keyback);
+    if (kp == NULL)
+	return PM_ERR_LOGREC;
+
+    rd.p = (const unsigned char *)&pb[R_BYTES];
+    rd.end = (const unsigned char *)pb + len;
+    rd.err = 0;
+    dp->vsets.used = 0;
+    dp->blocks.used = 0;
+    if ((sts = dec_vsets(dp, &rd, kp, numpmid)) < 0)
+	return sts;
+
+    /* pmValueBlocks follow the pmValueSets, offsets from the PDU start */
+    base = R_VSETS + dp->vsets.used;
+    for (i = 0, w = 0; i < numpmid; i++) {
+	numval = ntohl(dp->vsets.buf[w + 1]);
+	w += 2;
+	if (numval <= 0)
+	    continue;
+	if (ntohl(dp->vsets.buf[w]) != PM_VAL_INSITU) {
+	    for (j = 0; j < numval; j++)
+		dp->vsets.buf[w + 2 + 2 * j] =
+		    htonl(ntohl(dp->vsets.buf[w + 2 + 2 * j]) + base);
+	}
+	w += 1 + 2 * numval;
+    }
+
+    len = (base + dp->blocks.used) * (int)sizeof(__pmPDU);
+    if ((npb = __pmFindPDUBuf(len + (int)sizeof(int))) == NULL)
+	return -oserror();
+    php = (__pmPDUHdr *)npb;
+    php->len = len;
+    php->type = PDU_RESULT;
+    php->from = FROM_ANON;
+    npb[R_NUMPMID - 2] = pb[R_NUMPMID - 2];	/* timestamp */
+    npb[R_NUMPMID - 1] = pb[R_NUMPMID - 1];
+    npb[R_NUMPMID] = htonl(numpmid);
+    memcpy(&npb[R_VSETS], dp->vsets.buf, dp->vsets.used * sizeof(__pmPDU));
+    memcpy(&npb[base], dp->blocks.buf, dp->blocks.used * sizeof(__pmPDU));
+
+    __pmUnpinPDUBuf(pb);
+    *pbp = npb;
+    return 0;
+}
@@ -0,0 +1,288 @@
+/*
+ * Copyright (c) 2026 Red Hat.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ */
+
+#include <sys/stat.h>
+#include "pmapi.h"
+#include "impl.h"
+#include "internal.h"
+#if defined(HAVE_SYS_MMAN_H) && defined(HAVE_FOPENCOOKIE)
+#include <sys/mman.h>
+
+/*
+ * Uncompressed archive files opened for reading are mapped, and
+ * presented to the rest of libpcp as a read-only stdio stream over the
+ * mapping, so fread(), fseek() and ftell() never need a system call.
+ * __pmLogRead() goes further, and uses __pmLogMapAddr() to find each
+ * record in the mapping rather than reading it through stdio, which
+ * matters most for backwards replay, where each record costs several
+ * seeks ... with a stdio stream on the file, each of those discards
+ * the buffer and reads it again.
+ *
+ * The stdio buffer is small, as it is refilled (from the mapping)
+ * after every seek, and glibc will not read through a custom stream
+ * other than via the buffer.
+ *
+ * Only the whole pages of a file are mapped.  The partial page at the
+ * end, which pmlogger may still be appending to, is read with pread(),
+ * so a reader never touches a mapped page beyond the end of the file
+ * (that would be SIGBUS).  When a read or seek reaches the end of the
+ * mapping, the file is checked for growth and mapped again if at least
+ * another page is there.  Archive files are not truncated in place, so
+ * pages once mapped stay within the file.
+ *
+ * Each stream is recorded in the private state of the __pmLogCtl it
+ * was opened for (see __pmLogPrivate()), and removed from there when
+ * it is closed, so finding the mapping for a stream only looks at the
+ * streams of that one archive.
+ */
+typedef struct {
+    __pmLogCtl		*lcp;		/* archive this stream belongs to */
+    FILE		*fp;		/* stdio stream for this one */
+    int			fd;		/* of the mapped file */
+    char		*addr;		/* start of mapping, NULL if none */
+    size_t		len;		/* of mapping, whole pages */
+    size_t		pos;		/* offset for next read */
+} mapfile_t;
+
+#define MAP_BUFSIZ	512
+
+/*
+ * If the file has grown by at least a page beyond the mapping, map
+ * all of its whole pages.  Returns 0 on success (even if there was
+ * nothing to do), else -1.
+ */
+static int
+map_grow(mapfile_t *mp)
+{
+    struct stat	sbuf;
+    size_t	len;
+    void	*addr;
+
+    if (fstat(mp->fd, &sbuf) < 0)
+	return -1;
+    if ((off_t)(size_t)sbuf.st_size != sbuf.st_size) {
+	/* larger than the address space, not going to happen */
+	setoserror(EFBIG);
+	return -1;
+    }
+    len = (size_t)sbuf.st_size & ~((size_t)getpagesize() - 1);
+    if (len <= mp->len)
+	return 0;
+    addr = mmap(NULL, len, PROT_READ, MAP_SHARED, mp->fd, 0);
+    if (addr == MAP_FAILED)
+	return -1;
+    if (mp->addr != NULL) {
+#ifdef PCP_DEBUG
+	if (pmDebug & DBG_TRACE_LOG)
+	    fprintf(stderr, "map_grow: fd=%d grown from %zu to %zu bytes\n",
+		mp->fd, mp->len, len);
+#endif
+	munmap(mp->addr, mp->len);
+    }
+    mp->addr = (char *)addr;
+    mp->len = len;
+    return 0;
+}
+
+static ssize_t
+map_read(void *cookie, char *buf, size_t size)
+{
+    mapfile_t	*mp = (mapfile_t *)cookie;
+    ssize_t	n;
+
+    if (mp->pos + size > mp->len)
+	/* if this fails, pread() will report it */
+	map_grow(mp);
+    if (mp->pos < mp->len) {
+	n = mp->len - mp->pos;
+	if (n > size)
+	    n = size;
+	memcpy(buf, mp->addr + mp->pos, n);
+    }
+    else if ((n = pread(mp->fd, buf, size, (off_t)mp->pos)) < 0)
+	return -1;
+    mp->pos += n;
+    return n;
+}
+
+static int
+map_seek(void *cookie, off64_t *offset, int whence)
+{
+    mapfile_t	*mp = (mapfile_t *)cookie;
+    struct stat	sbuf;
+    off64_t	base;
+
+    if (whence == SEEK_SET)
+	base = 0;
+    else if (whence == SEEK_CUR)
+	base = mp->pos;
+    else if (whence == SEEK_END) {
+	if (fstat(mp->fd, &sbuf) < 0)
+	    return -1;
+	map_grow(mp);
+	base = sbuf.st_size;
+    }
+    else {
+	setoserror(EINVAL);
+	return -1;
+    }
+    if (base + *offset < 0) {
+	setoserror(EINVAL);
+	return -1;
+    }
+    mp->pos = base + *offset;
+    *offset = mp->pos;
+    return 0;
+}
+
+static int
+map_close(void *cookie)
+{
+    mapfile_t	*mp = (mapfile_t *)cookie;
+
+    __pmHashDel(PM_LOG_PRIV_MAP, (void *)mp, &mp->lcp->l_hashrange);
+    if (mp->addr != NULL)
+	munmap(mp->addr, mp->len);
+    close(mp->fd);
+    free(mp);
+    return 0;
+}
+
+static FILE *
+map_fopen(__pmLogCtl *lcp, const char *fname)
+{
+    cookie_io_functions_t	io = { map_read, NULL, map_seek, map_close };
+    struct stat		sbuf;
+    mapfile_t		*mp;
+    int			sts;
+    int			fd;
+
+    if ((fd = open(fname, O_RDONLY)) < 0)
+	return NULL;
+    if (fstat(fd, &sbuf) < 0 || !S_ISREG(sbuf.st_mode)) {
+	/* let stdio sort it out */
+	close(fd);
+	return fopen(fname, "r");
+    }
+    if ((mp = (mapfile_t *)calloc(1, sizeof(*mp))) == NULL) {
+	close(fd);
+	setoserror(ENOMEM);
+	return NULL;
+    }
+    mp->lcp = lcp;
+    mp->fd = fd;
+    if (map_grow(mp) < 0 ||
+	__pmHashAdd(PM_LOG_PRIV_MAP, (void *)mp, &lcp->l_hashrange) < 0) {
+	/* cannot map it, use stdio */
+	if (mp->addr != NULL)
+	    munmap(mp->addr, mp->len);
+	free(mp);
+	close(fd);
+	return fopen(fname, "r");
+    }
+#ifdef PCP_DEBUG
+    if (pmDebug & DBG_TRACE_LOG)
+	fprintf(stderr, "__pmLogOpen: mapped %s, %zu of %lld bytes\n",
+	    fname, mp->len, (long long)sbuf.st_size);
+#endif
+
+    if ((mp->fp = fopencookie(mp, "r", io)) == NULL) {
+	sts = oserror();
+	__pmHashDel(PM_LOG_PRIV_MAP, (void *)mp, &lcp->l_hashrange);
+	if (mp->addr != NULL)
+	    munmap(mp->addr, mp->len);
+	free(mp);
+	close(fd);
+	setoserror(sts);
+	return NULL;
+    }
+    setvbuf(mp->fp, NULL, _IOFBF, MAP_BUFSIZ);
+    return mp->fp;
+}
+
+/* mapped stream f of lcp, else NULL */
+static mapfile_t *
+map_lookup(const __pmLogCtl *lcp, FILE *f)
+{
+    __pmHashNode	*hp;
+
+    for (hp = __pmHashSearch(PM_LOG_PRIV_MAP, (__pmHashCtl *)&lcp->l_hashrange);
+	 hp != NULL; hp = hp->next) {
+	if (hp->key == PM_LOG_PRIV_MAP && ((mapfile_t *)hp->data)->fp == f)
+	    return (mapfile_t *)hp->data;
+    }
+    return NULL;
+}
+
+int
+__pmLogMapFileno(const __pmLogCtl *lcp, FILE *f)
+{
+    mapfile_t	*mp;
+
+    if ((mp = map_lookup(lcp, f)) != NULL)
+	return mp->fd;
+    return -1;
+}
+
+/*
+ * Address of the len bytes at offset in the file behind stream f of
+ * lcp, else NULL if f is not a mapped stream, or the mapping does not
+ * (yet) extend that far.  The address is good until the stream is next
+ * read, seeked or closed.
+ */
+const char *
+__pmLogMapAddr(const __pmLogCtl *lcp, FILE *f, long offset, size_t len)
+{
+    mapfile_t	*mp;
+
+    if ((mp = map_lookup(lcp, f)) == NULL || offset < 0)
+	return NULL;
+    if ((size_t)offset + len > mp->len &&
+	(map_grow(mp) < 0 || (size_t)offset + len > mp->len))
+	return NULL;
+    return mp->addr + offset;
+}
+#else
+int
+__pmLogMapFileno(const __pmLogCtl *lcp, FILE *f)
+{
+    (void)lcp;
+    (void)f;
+    return -1;
+}
+
+const char *
+__pmLogMapAddr(const __pmLogCtl *lcp, FILE *f, long offset, size_t len)
+{
+    (void)lcp;
+    (void)f;
+    (void)offset;
+    (void)len;
+    return NULL;
+}
+#endif
+
+/*
+ * fopen(fname, "r") for an uncompressed archive volume, temporal index
+ * or metadata file of lcp, mapped where the platform allows.
+ */
+FILE *
+__pmLogFopen(__pmLogCtl *lcp, const char *fname)
+{
+#if defined(HAVE_SYS_MMAN_H) && defined(HAVE_FOPENCOOKIE)
+    if (getenv("PCP_ARCHIVE_NOMAP") == NULL)
+	return map_fopen(lcp, fname);
+#endif
+    return fopen(fname, "r");
+}
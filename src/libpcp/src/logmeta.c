@@ -485,7 +485,7 @@ PM_FAULT_POINT("libpcp/" __FILE__ ":10", PM_FAULT_ALLOC);
 	out->numnames = out->hdr.len;
     }
 
-    if ((sts = fwrite(out, 1, len, f)) != len) {
+    if ((sts = __pmLogWrite(lcp, f, out, len)) != len) {
 	char	strbuf[20];
 	char	errmsg[PM_MAXERRMSGLEN];
 	pmprintf("__pmLogPutDesc(...,pmid=%s,name=%s): write failed: returned %d expecting %d: %s\n",
@@ -686,7 +686,7 @@ PM_FAULT_POINT("libpcp/" __FILE__ ":6", PM_FAULT_ALLOC);
     /* trailer length */
     memmove((void *)str, &out->hdr.len, sizeof(out->hdr.len));
 
-    if ((sts = fwrite(out, 1, len, lcp->l_mdfp)) != len) {
+    if ((sts = __pmLogWrite(lcp, lcp->l_mdfp, out, len)) != len) {
 	char	strbuf[20];
 	char	errmsg[PM_MAXERRMSGLEN];
 	pmprintf("__pmLogPutInDom(...,indom=%s,numinst=%d): write failed: returned %d expecting %d: %s\n",
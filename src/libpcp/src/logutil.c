@@ -70,9 +70,15 @@ typedef struct {
  * result when the corresponding metric is requested but there is
  * no values available in the pmResult
  *
- * Note, this hash table is global across all contexts.
+ * Note, this hash table is global across all contexts, so has its own
+ * lock rather than holding __pmLock_libpcp for every archive fetch.
  */
 static __pmHashCtl	pc_hc;
+#ifdef PM_MULTI_THREAD
+static __pmMutex	pc_lock = PTHREAD_MUTEX_INITIALIZER;
+#else
+static __pmMutex	pc_lock;
+#endif
 
 #ifdef PCP_DEBUG
 static void
@@ -145,7 +151,7 @@ __pmLogChkLabel(__pmLogCtl *lcp, FILE *f, __pmLogLabel *lp, int vol)
 
 #ifdef PCP_DEBUG
     if (pmDebug & DBG_TRACE_LOG)
-	fprintf(stderr, "__pmLogChkLabel: fd=%d vol=%d", fileno(f), vol);
+	fprintf(stderr, "__pmLogChkLabel: fd=%d vol=%d", __pmLogFileno(lcp, f), vol);
 #endif
 
     fseek(f, (long)0, SEEK_SET);
@@ -215,12 +221,13 @@ __pmLogChkLabel(__pmLogCtl *lcp, FILE *f, __pmLogLabel *lp, int vol)
 
     version = lp->ill_magic & 0xff;
     if ((lp->ill_magic & 0xffffff00) != PM_LOG_MAGIC ||
-	(version != PM_LOG_VERS02) || lp->ill_vol != vol) {
+	(version != PM_LOG_VERS02 && version != PM_LOG_VERS02_DELTA) ||
+	lp->ill_vol != vol) {
 #ifdef PCP_DEBUG
 	if (pmDebug & DBG_TRACE_LOG) {
 	    if ((lp->ill_magic & 0xffffff00) != PM_LOG_MAGIC)
 		fprintf(stderr, " label magic 0x%x not 0x%x as expected", (lp->ill_magic & 0xffffff00), PM_LOG_MAGIC);
-	    if (version != PM_LOG_VERS02)
+	    if (version != PM_LOG_VERS02 && version != PM_LOG_VERS02_DELTA)
 		fprintf(stderr, " label version %d not supported", version);
 	    if (lp->ill_vol != vol)
 		fprintf(stderr, " label volume %d not %d as expected", lp->ill_vol, vol);
@@ -230,7 +237,7 @@ __pmLogChkLabel(__pmLogCtl *lcp, FILE *f, __pmLogLabel *lp, int vol)
 	return PM_ERR_LABEL;
     }
 
-    if (__pmSetVersionIPC(fileno(f), version) < 0)
+    if (__pmSetVersionIPC(__pmLogFileno(lcp, f), version) < 0)
 	return -oserror();
 #ifdef PCP_DEBUG
     if (pmDebug & DBG_TRACE_LOG)
@@ -339,6 +346,17 @@ fopen_compress(const char *fname)
     if ((i = index_compress(fname)) < 0)
 	return NULL;
 
+#if defined(HAVE_LZMA) && defined(HAVE_FOPENCOOKIE)
+    if (compress_ctl[i].appl == USE_XZ && getenv("PCP_ARCHIVE_NOXZ") == NULL) {
+	char	xzname[MAXPATHLEN];
+
+	/* no need for a temporary copy, decompress as we read */
+	snprintf(xzname, sizeof(xzname), "%s%s", fname, compress_ctl[i].suff);
+	if ((fp = __pmLogFopenXz(xzname)) != NULL)
+	    return fp;
+    }
+#endif
+
     if (compress_ctl[i].appl == USE_XZ)
 	cmd = "xz -dc";
     else if (compress_ctl[i].appl == USE_BZIP2)
@@ -410,7 +428,7 @@ _logpeek(__pmLogCtl *lcp, int vol)
     char		fname[MAXPATHLEN];
 
     snprintf(fname, sizeof(fname), "%s.%d", lcp->l_name, vol);
-    if ((f = fopen(fname, "r")) == NULL) {
+    if ((f = __pmLogFopen(lcp, fname)) == NULL) {
 	if ((f = fopen_compress(fname)) == NULL)
 	    return f;
     }
@@ -434,11 +452,11 @@ __pmLogChangeVol(__pmLogCtl *lcp, int vol)
 	return 0;
 
     if (lcp->l_mfp != NULL) {
-	__pmResetIPC(fileno(lcp->l_mfp));
+	__pmResetIPC(__pmLogFileno(lcp, lcp->l_mfp));
 	fclose(lcp->l_mfp);
     }
     snprintf(name, sizeof(name), "%s.%d", lcp->l_name, vol);
-    if ((lcp->l_mfp = fopen(name, "r")) == NULL) {
+    if ((lcp->l_mfp = __pmLogFopen(lcp, name)) == NULL) {
 	/* try for a compressed file */
 	if ((lcp->l_mfp = fopen_compress(name)) == NULL)
 	    return -oserror();
@@ -621,6 +639,45 @@ __pmLogWriteLabel(FILE *f, const __pmLogLabel *lp)
     return sts;
 }
 
+/*
+ * State that libpcp keeps for a log beyond what is in __pmLogCtl (group
+ * commit, and so on) cannot be added to that structure, as applications
+ * allocate it.  Instead it hangs off l_hashrange, which nothing used,
+ * keyed by PM_LOG_PRIV_*.  The table is emptied by __pmLogCreate() and
+ * __pmFindOrOpenArchive(), and freed by __pmLogClose() once the code
+ * that owns each node has released it ... so nothing outlives the log.
+ */
+void *
+__pmLogPrivate(const __pmLogCtl *lcp, unsigned int key)
+{
+    __pmHashNode	*hp;
+
+    if ((hp = __pmHashSearch(key, (__pmHashCtl *)&lcp->l_hashrange)) == NULL)
+	return NULL;
+    return hp->data;
+}
+
+void
+__pmLogFreePrivate(__pmLogCtl *lcp)
+{
+    __pmHashCtl		*hcp = &lcp->l_hashrange;
+    __pmHashNode	*hp;
+    __pmHashNode	*prior_hp;
+    int			i;
+
+    for (i = 0; i < hcp->hsize; i++) {
+	for (hp = hcp->hash[i], prior_hp = NULL; hp != NULL; hp = hp->next) {
+	    if (prior_hp != NULL)
+		free(prior_hp);
+	    prior_hp = hp;
+	}
+	if (prior_hp != NULL)
+	    free(prior_hp);
+    }
+    __pmHashClear(hcp);
+    __pmHashInit(hcp);
+}
+
 int
 __pmLogCreate(const char *host, const char *base, int log_version,
 	      __pmLogCtl *lcp)
@@ -629,8 +686,9 @@ __pmLogCreate(const char *host, const char *base, int log_version,
     char	fname[MAXPATHLEN];
 
     lcp->l_minvol = lcp->l_maxvol = lcp->l_curvol = 0;
-    lcp->l_hashpmid.nodes = lcp->l_hashpmid.hsize = 0;
-    lcp->l_hashindom.nodes = lcp->l_hashindom.hsize = 0;
+    __pmHashInit(&lcp->l_hashpmid);
+    __pmHashInit(&lcp->l_hashindom);
+    __pmHashInit(&lcp->l_hashrange);
     lcp->l_tifp = lcp->l_mdfp = lcp->l_mfp = NULL;
 
     if ((lcp->l_tifp = __pmLogNewFile(base, PM_LOG_VOL_TI)) != NULL) {
@@ -666,7 +724,7 @@ __pmLogCreate(const char *host, const char *base, int log_version,
 		sts = __pmSetVersionIPC(fileno(lcp->l_mdfp), log_version);
 		if (sts < 0)
                     return sts;
-		sts = __pmSetVersionIPC(fileno(lcp->l_mfp), log_version);
+		sts = __pmSetVersionIPC(__pmLogFileno(lcp, lcp->l_mfp), log_version);
 		return sts;
 	    }
 	    else {
@@ -761,18 +819,20 @@ __pmLogClose(__pmLogCtl *lcp)
      * They may be needed by the next archive of a multi-archive context.
      * They are now now freed as needed using logFreePMNS().
      */
+    __pmLogBatchStop(lcp);
+    __pmLogDeltaFree(lcp);
     if (lcp->l_tifp != NULL) {
-	__pmResetIPC(fileno(lcp->l_tifp));
+	__pmResetIPC(__pmLogFileno(lcp, lcp->l_tifp));
 	fclose(lcp->l_tifp);
 	lcp->l_tifp = NULL;
     }
     if (lcp->l_mdfp != NULL) {
-	__pmResetIPC(fileno(lcp->l_mdfp));
+	__pmResetIPC(__pmLogFileno(lcp, lcp->l_mdfp));
 	fclose(lcp->l_mdfp);
 	lcp->l_mdfp = NULL;
     }
     if (lcp->l_mfp != NULL) {
-	__pmResetIPC(fileno(lcp->l_mfp));
+	__pmResetIPC(__pmLogFileno(lcp, lcp->l_mfp));
 	fclose(lcp->l_mfp);
 	lcp->l_mfp = NULL;
     }
@@ -787,6 +847,7 @@ __pmLogClose(__pmLogCtl *lcp)
     }
     if (lcp->l_ti != NULL)
 	free(lcp->l_ti);
+    __pmLogFreePrivate(lcp);
 }
 
 /*
@@ -942,7 +1003,7 @@ __pmLogLoadLabel(__pmLogCtl *lcp, const char *name)
 	    if (strcmp(tp, "index") == 0) {
 		exists = 1;
 		snprintf(filename, sizeof(filename), "%s%c%s", dir, sep, direntp->d_name);
-		if ((lcp->l_tifp = fopen(filename, "r")) == NULL) {
+		if ((lcp->l_tifp = __pmLogFopen(lcp, filename)) == NULL) {
 		    sts = -oserror();
 		    PM_UNLOCK(__pmLock_libpcp);
 		    goto cleanup;
@@ -951,7 +1012,7 @@ __pmLogLoadLabel(__pmLogCtl *lcp, const char *name)
 	    else if (strcmp(tp, "meta") == 0) {
 		exists = 1;
 		snprintf(filename, sizeof(filename), "%s%c%s", dir, sep, direntp->d_name);
-		if ((lcp->l_mdfp = fopen(filename, "r")) == NULL) {
+		if ((lcp->l_mdfp = __pmLogFopen(lcp, filename)) == NULL) {
 		    sts = -oserror();
 		    PM_UNLOCK(__pmLock_libpcp);
 		    goto cleanup;
@@ -1140,14 +1201,14 @@ __pmLogPutIndex(const __pmLogCtl *lcp, const __pmTimeval *tp)
 	/* check for overflow of the offset ... */
 	off_t	tmp;
 
-	tmp = ftell(lcp->l_mdfp);
+	tmp = __pmLogTell(lcp, lcp->l_mdfp);
 	assert(tmp >= 0);
 	ti.ti_meta = (__pm_off_t)tmp;
 	if (tmp != ti.ti_meta) {
 	    __pmNotifyErr(LOG_ERR, "__pmLogPutIndex: PCP archive file (meta) too big\n");
 	    return;
 	}
-	tmp = ftell(lcp->l_mfp);
+	tmp = __pmLogTell(lcp, lcp->l_mfp);
 	assert(tmp >= 0);
 	ti.ti_log = (__pm_off_t)tmp;
 	if (tmp != ti.ti_log) {
@@ -1156,8 +1217,8 @@ __pmLogPutIndex(const __pmLogCtl *lcp, const __pmTimeval *tp)
 	}
     }
     else {
-	ti.ti_meta = (__pm_off_t)ftell(lcp->l_mdfp);
-	ti.ti_log = (__pm_off_t)ftell(lcp->l_mfp);
+	ti.ti_meta = (__pm_off_t)__pmLogTell(lcp, lcp->l_mdfp);
+	ti.ti_log = (__pm_off_t)__pmLogTell(lcp, lcp->l_mfp);
     }
 
 #ifdef PCP_DEBUG
@@ -1173,7 +1234,7 @@ __pmLogPutIndex(const __pmLogCtl *lcp, const __pmTimeval *tp)
     oti.ti_vol = htonl(ti.ti_vol);
     oti.ti_meta = htonl(ti.ti_meta);
     oti.ti_log = htonl(ti.ti_log);
-    if ((sts = fwrite(&oti, 1, sizeof(oti), lcp->l_tifp)) != sizeof(oti)) {
+    if ((sts = __pmLogWrite(lcp, lcp->l_tifp, &oti, sizeof(oti))) != sizeof(oti)) {
 	char	errmsg[PM_MAXERRMSGLEN];
 	pmprintf("__pmLogPutIndex: write failed: returns %d expecting %d: %s\n",
 	    sts, (int)sizeof(oti), osstrerror_r(errmsg, sizeof(errmsg)));
@@ -1212,6 +1273,7 @@ logputresult(int version,__pmLogCtl *lcp, __pmPDU *pb)
     int			sts = 0;
     int			save_from;
     __pmPDU		*start = &pb[2];
+    __pmPDU		*rec;
 
     if (lcp->l_state == PM_LOG_STATE_NEW) {
 	int		i;
@@ -1219,6 +1281,7 @@ logputresult(int version,__pmLogCtl *lcp, __pmPDU *pb)
 	/*
 	 * first result, do the label record
 	 */
+	__pmLogBatchFlush(lcp);
 	i = sizeof(__pmPDUHdr) / sizeof(__pmPDU);
 	tvp = (__pmTimeval *)&pb[i];
 	lcp->l_label.ill_start.tv_sec = ntohl(tvp->tv_sec);
@@ -1232,11 +1295,29 @@ logputresult(int version,__pmLogCtl *lcp, __pmPDU *pb)
 	lcp->l_state = PM_LOG_STATE_INIT;
     }
 
+    if ((lcp->l_label.ill_magic & 0xff) == PM_LOG_VERS02_DELTA &&
+	(sz = __pmLogEncodeDelta(lcp, pb, &rec)) > 0) {
+	/* delta record, ready to go with header and trailer */
+#ifdef PCP_DEBUG
+	if (pmDebug & DBG_TRACE_LOG) {
+	    fprintf(stderr, "logputresult: pdubuf=" PRINTF_P_PFX "%p input len=%d delta len=%d posn=%ld\n", pb, pb[0], sz, (long)__pmLogTell(lcp, lcp->l_mfp));
+	}
+#endif
+	if ((sts = __pmLogWrite(lcp, lcp->l_mfp, rec, sz)) != sz) {
+	    char	errmsg[PM_MAXERRMSGLEN];
+	    pmprintf("__pmLogPutResult2: write failed: returns %d expecting %d: %s\n",
+	    	sts, sz, osstrerror_r(errmsg, sizeof(errmsg)));
+	    pmflush();
+	    sts = -oserror();
+	}
+	return sts;
+    }
+
     sz = pb[0] - (int)sizeof(__pmPDUHdr) + 2 * (int)sizeof(int);
 
 #ifdef PCP_DEBUG
     if (pmDebug & DBG_TRACE_LOG) {
-	fprintf(stderr, "logputresult: pdubuf=" PRINTF_P_PFX "%p input len=%d output len=%d posn=%ld\n", pb, pb[0], sz, (long)ftell(lcp->l_mfp));
+	fprintf(stderr, "logputresult: pdubuf=" PRINTF_P_PFX "%p input len=%d output len=%d posn=%ld\n", pb, pb[0], sz, (long)__pmLogTell(lcp, lcp->l_mfp));
     }
 #endif
 
@@ -1244,7 +1325,7 @@ logputresult(int version,__pmLogCtl *lcp, __pmPDU *pb)
     start[0] = htonl(sz);	/* swab */
 
     if (version == 1) {
-	if ((sts = fwrite(start, 1, sz-sizeof(int), lcp->l_mfp)) != sz-sizeof(int)) {
+	if ((sts = __pmLogWrite(lcp, lcp->l_mfp, start, sz-sizeof(int))) != sz-sizeof(int)) {
 	    char	errmsg[PM_MAXERRMSGLEN];
 	    pmprintf("__pmLogPutResult: write failed: returns %d expecting %d: %s\n",
 		sts, (int)(sz-sizeof(int)), osstrerror_r(errmsg, sizeof(errmsg)));
@@ -1252,7 +1333,7 @@ logputresult(int version,__pmLogCtl *lcp, __pmPDU *pb)
 	    sts = -oserror();
 	}
 	else {
-	    if ((sts = fwrite(start, 1, sizeof(int), lcp->l_mfp)) != sizeof(int)) {
+	    if ((sts = __pmLogWrite(lcp, lcp->l_mfp, start, sizeof(int))) != sizeof(int)) {
 		char	errmsg[PM_MAXERRMSGLEN];
 		pmprintf("__pmLogPutResult: trailer write failed: returns %d expecting %d: %s\n",
 		    sts, (int)sizeof(int), osstrerror_r(errmsg, sizeof(errmsg)));
@@ -1264,7 +1345,7 @@ logputresult(int version,__pmLogCtl *lcp, __pmPDU *pb)
     else {
 	/* assume version == 2 */
 	start[(sz-1)/sizeof(__pmPDU)] = start[0];
-	if ((sts = fwrite(start, 1, sz, lcp->l_mfp)) != sz) {
+	if ((sts = __pmLogWrite(lcp, lcp->l_mfp, start, sz)) != sz) {
 	    char	errmsg[PM_MAXERRMSGLEN];
 	    pmprintf("__pmLogPutResult2: write failed: returns %d expecting %d: %s\n",
 	    	sts, sz, osstrerror_r(errmsg, sizeof(errmsg)));
@@ -1530,6 +1611,177 @@ clearMarkDone(void)
     }
 }
 
+static int
+wantedPmid(pmID pmid, int numpmid, const pmID *pmidlist)
+{
+    int		lo = 0;
+    int		hi = numpmid - 1;
+    int		mid;
+
+    while (lo <= hi) {
+	mid = (lo + hi) / 2;
+	if (pmidlist[mid] == pmid)
+	    return 1;
+	if (pmidlist[mid] < pmid)
+	    lo = mid + 1;
+	else
+	    hi = mid - 1;
+    }
+    return 0;
+}
+
+/*
+ * Cut the record in *pbp (as read from the log, so still in network
+ * byte order) down to the pmValueSets for the metrics in pmidlist[],
+ * so __pmDecodeResult() never sees the others.  The pmValueSets and
+ * pmValueBlocks kept are copied to a new PDU buffer, with the layout
+ * __pmDecodeResult() insists upon, and the old buffer is unpinned.
+ *
+ * Returns the number of pmValueSets kept (if that is all or none of
+ * them, *pbp is left alone), else an error if the record is corrupt.
+ */
+static int
+filterRecord(__pmPDU **pbp, int numpmid, const pmID *pmidlist)
+{
+    __pmPDU	*pb = *pbp;
+    __pmPDU	*npb;
+    int		nwords = ((__pmPDUHdr *)pb)->len / (int)sizeof(__pmPDU);
+    int		nvset = ntohl(pb[5]);
+    int		keep = 0;
+    int		vwords = 0;	/* pmValueSets kept */
+    int		bwords = 0;	/* pmValueBlocks kept */
+    int		numval;
+    int		vlen;
+    int		w;		/* next pmValueSet in pb[] */
+    int		nw;		/* next pmValueSet in npb[] */
+    int		nb;		/* next pmValueBlock in npb[] */
+    int		n;
+    int		i;
+    int		j;
+    __uint32_t	off;
+
+    if (nvset < 0 || nvset > nwords)
+	return PM_ERR_LOGREC;
+    for (w = 6, i = 0; i < nvset; i++, w += n) {
+	if (w + 2 > nwords)
+	    return PM_ERR_LOGREC;
+	numval = ntohl(pb[w+1]);
+	n = numval > 0 ? 3 + 2 * numval : 2;
+	if (numval > nwords || w + n > nwords)
+	    return PM_ERR_LOGREC;
+	if (!wantedPmid(__ntohpmID(pb[w]), numpmid, pmidlist))
+	    continue;
+	keep++;
+	vwords += n;
+	if (numval <= 0 || ntohl(pb[w+2]) == PM_VAL_INSITU)
+	    continue;
+	for (j = 0; j < numval; j++) {
+	    off = ntohl(pb[w+4+2*j]);
+	    if (off < 6 || off >= nwords)
+		return PM_ERR_LOGREC;
+	    vlen = ntohl(pb[off]) & 0xffffff;
+	    if (vlen < PM_VAL_HDR_SIZE || off + PM_PDU_SIZE(vlen) > nwords)
+		return PM_ERR_LOGREC;
+	    bwords += PM_PDU_SIZE(vlen);
+	}
+    }
+    if (keep == 0 || keep == nvset)
+	return keep;
+
+    n = (6 + vwords + bwords) * (int)sizeof(__pmPDU);
+    if ((npb = __pmFindPDUBuf(n + (int)sizeof(int))) == NULL)
+	return -oserror();
+    memcpy(npb, pb, 6 * sizeof(__pmPDU));
+    ((__pmPDUHdr *)npb)->len = n;
+    npb[5] = htonl(keep);
+    nw = 6;
+    nb = 6 + vwords;
+    for (w = 6, i = 0; i < nvset; i++, w += n) {
+	numval = ntohl(pb[w+1]);
+	n = numval > 0 ? 3 + 2 * numval : 2;
+	if (!wantedPmid(__ntohpmID(pb[w]), numpmid, pmidlist))
+	    continue;
+	memcpy(&npb[nw], &pb[w], n * sizeof(__pmPDU));
+	if (numval > 0 && ntohl(pb[w+2]) != PM_VAL_INSITU) {
+	    /* pval is the word offset of the pmValueBlock in the PDU */
+	    for (j = 0; j < numval; j++) {
+		off = ntohl(pb[w+4+2*j]);
+		vlen = ntohl(pb[off]) & 0xffffff;
+		memcpy(&npb[nb], &pb[off], PM_PDU_SIZE_BYTES(vlen));
+		npb[nw+4+2*j] = htonl(nb);
+		nb += PM_PDU_SIZE(vlen);
+	    }
+	}
+	nw += n;
+    }
+    __pmUnpinPDUBuf(pb);
+    *pbp = npb;
+    return keep;
+}
+
+/*
+ * For a mapped volume (see logmap.c), find the record at the current
+ * position of f (PM_MODE_FORW) or the one ending there (PM_MODE_BACK,
+ * positioned at its trailer), straight from the mapping.  On success
+ * the record is copied to a new PDU buffer, *headp is set and f is
+ * left where the stdio reads in __pmLogReadFilter() would leave it.
+ *
+ * Returns NULL if the stdio path is needed, because f is not mapped,
+ * or at the end of the volume, or anything looks wrong ... in these
+ * cases f is not moved, and the stdio path takes care of reporting.
+ */
+static __pmPDU *
+mapRecord(const __pmLogCtl *lcp, FILE *f, int mode, int *headp)
+{
+    const char	*p;
+    long	posn = ftell(f);
+    int		head;
+    int		trail;
+    int		rlen;
+    __pmPDU	*pb;
+    __pmPDUHdr	*header;
+
+    if ((p = __pmLogMapAddr(lcp, f, posn, sizeof(head))) == NULL)
+	return NULL;
+    memcpy(&head, p, sizeof(head));
+    head = ntohl(head);
+    rlen = head - 2 * (int)sizeof(head);
+    if (rlen < 0)
+	return NULL;
+    if (mode == PM_MODE_BACK) {
+	/* at the trailer, so back to the start of the record */
+	posn -= rlen + (int)sizeof(head);
+	if (posn < (long)(sizeof(__pmLogLabel) + 2 * sizeof(int)))
+	    return NULL;
+    }
+    if ((p = __pmLogMapAddr(lcp, f, posn, head)) == NULL)
+	return NULL;
+    memcpy(&trail, p, sizeof(trail));
+    if (ntohl(trail) != head)
+	return NULL;
+    memcpy(&trail, &p[head - sizeof(trail)], sizeof(trail));
+    if (ntohl(trail) != head)
+	return NULL;
+
+    /* see below for the extra int */
+    if ((pb = __pmFindPDUBuf(rlen + (int)sizeof(__pmPDUHdr) + (int)sizeof(int))) == NULL)
+	return NULL;
+    /* swab pdu buffer - done later in __pmDecodeResult */
+    memcpy(&pb[3], &p[sizeof(head)], rlen);
+    header = (__pmPDUHdr *)pb;
+    header->len = sizeof(*header) + rlen;
+    header->type = PDU_RESULT;
+    header->from = FROM_ANON;
+
+    if (mode == PM_MODE_BACK)
+	posn += sizeof(head);
+    else
+	posn += head;
+    fseek(f, posn, SEEK_SET);
+    *headp = head;
+    return pb;
+}
+
 /*
  * read next forward or backward from the log
  *
@@ -1540,6 +1792,18 @@ clearMarkDone(void)
  */
 int
 __pmLogRead(__pmLogCtl *lcp, int mode, FILE *peekf, pmResult **result, int option)
+{
+    return __pmLogReadFilter(lcp, mode, peekf, result, option, 0, NULL);
+}
+
+/*
+ * as for __pmLogRead(), but if numpmid > 0 only the pmValueSets for
+ * the metrics in pmidlist[] (sorted in ascending order) are decoded,
+ * and records containing none of them are skipped ... <mark> records
+ * are always returned
+ */
+int
+__pmLogReadFilter(__pmLogCtl *lcp, int mode, FILE *peekf, pmResult **result, int option, int numpmid, pmID *pmidlist)
 {
     int		head;
     int		rlen;
@@ -1560,12 +1824,13 @@ __pmLogRead(__pmLogCtl *lcp, int mode, FILE *peekf, pmResult **result, int optio
     else
 	f = lcp->l_mfp;
 
+next:
     offset = ftell(f);
     assert(offset >= 0);
 #ifdef PCP_DEBUG
     if (pmDebug & DBG_TRACE_LOG) {
 	fprintf(stderr, "__pmLogRead: fd=%d%s mode=%s vol=%d posn=%ld ",
-	    fileno(f), peekf == NULL ? "" : " (peek)",
+	    __pmLogFileno(lcp, f), peekf == NULL ? "" : " (peek)",
 	    mode == PM_MODE_FORW ? "forw" : "back",
 	    lcp->l_curvol, (long)offset);
     }
@@ -1639,6 +1904,14 @@ __pmLogRead(__pmLogCtl *lcp, int mode, FILE *peekf, pmResult **result, int optio
     }
 
 again:
+    if ((pb = mapRecord(lcp, f, mode, &head)) != NULL) {
+	/* mapped volume, no need for stdio */
+	clearMarkDone();
+	rlen = head - 2 * (int)sizeof(head);
+	trail = head;
+	goto decode;
+    }
+
     n = (int)fread(&head, 1, sizeof(head), f);
     head = ntohl(head); /* swab head */
     if (n != sizeof(head)) {
@@ -1847,6 +2120,56 @@ again:
 	return PM_ERR_LOGREC;
     }
 
+decode:
+    if ((lcp->l_label.ill_magic & 0xff) == PM_LOG_VERS02_DELTA &&
+	rlen > 3 * (int)sizeof(__pmPDU) && (int)ntohl(pb[5]) < 0) {
+	/*
+	 * negative numpmid, delta record ... expand it to the version 2
+	 * record it was encoded from, see logdelta.c
+	 */
+	long	start = ftell(f);
+
+	start -= mode == PM_MODE_BACK ? (long)sizeof(trail) : (long)head;
+	if ((sts = __pmLogDecodeDelta(lcp, f, start, &pb)) < 0) {
+#ifdef PCP_DEBUG
+	    if (pmDebug & DBG_TRACE_LOG) {
+		char	errmsg[PM_MAXERRMSGLEN];
+		fprintf(stderr, "\nError: delta record at posn=%ld: %s\n",
+		    start, pmErrStr_r(sts, errmsg, sizeof(errmsg)));
+	    }
+#endif
+	    __pmUnpinPDUBuf(pb);
+	    return PM_ERR_LOGREC;
+	}
+	rlen = ((__pmPDUHdr *)pb)->len - (int)sizeof(__pmPDUHdr);
+	head = rlen + 2 * (int)sizeof(head);
+    }
+
+    if (numpmid > 0 && (int)ntohl(pb[5]) > 0) {
+	if ((sts = filterRecord(&pb, numpmid, pmidlist)) < 0) {
+#ifdef PCP_DEBUG
+	    if (pmDebug & DBG_TRACE_LOG)
+		fprintf(stderr, "\nError: filter record failed\n");
+#endif
+	    __pmUnpinPDUBuf(pb);
+	    return PM_ERR_LOGREC;
+	}
+	if (sts == 0) {
+	    /* nothing we want here, skip to the next record */
+#ifdef PCP_DEBUG
+	    if (pmDebug & DBG_TRACE_LOG)
+		fprintf(stderr, "skip\n");
+#endif
+	    __pmUnpinPDUBuf(pb);
+	    __pmLogReads++;
+	    if (mode == PM_MODE_BACK)
+		fseek(f, -(long)sizeof(trail), SEEK_CUR);
+	    goto next;
+	}
+	rlen = ((__pmPDUHdr *)pb)->len - (int)sizeof(__pmPDUHdr);
+	head = rlen + 2 * (int)sizeof(head);
+    }
+
     if (option == PMLOGREAD_TO_EOF && paranoidCheck(head, pb) == -1) {
 	__pmUnpinPDUBuf(pb);
 	return PM_ERR_LOGREC;
@@ -1855,7 +2178,7 @@ again:
     if (mode == PM_MODE_BACK)
 	fseek(f, -(long)sizeof(trail), SEEK_CUR);
 
-    __pmOverrideLastFd(fileno(f));
+    __pmOverrideLastFd(__pmLogFileno(lcp, f));
     sts = __pmDecodeResult(pb, result); /* also swabs the result */
 
 #ifdef PCP_DEBUG
@@ -1923,6 +2246,16 @@ check_all_derived(int numpmid, pmID pmidlist[])
 
 int
 __pmLogFetch(__pmContext *ctxp, int numpmid, pmID pmidlist[], pmResult **result)
+{
+    return __pmLogFetchFilter(ctxp, numpmid, pmidlist, 0, NULL, result);
+}
+
+/*
+ * as for __pmLogFetch(), but with the records read from the archive
+ * filtered by __pmLogReadFilter() if nfilter > 0
+ */
+int
+__pmLogFetchFilter(__pmContext *ctxp, int numpmid, pmID pmidlist[], int nfilter, pmID *filter, pmResult **result)
 {
     int		i;
     int		j;
@@ -1968,7 +2301,7 @@ more:
 		tmp_mode = PM_MODE_BACK;
 	    else
 		tmp_mode = PM_MODE_FORW;
-	    while (__pmLogRead(ctxp->c_archctl->ac_log, tmp_mode, NULL, result, PMLOGREAD_NEXT) >= 0) {
+	    while (__pmLogReadFilter(ctxp->c_archctl->ac_log, tmp_mode, NULL, result, PMLOGREAD_NEXT, nfilter, filter) >= 0) {
 		nskip++;
 		tmp.tv_sec = (__int32_t)(*result)->timestamp.tv_sec;
 		tmp.tv_usec = (__int32_t)(*result)->timestamp.tv_usec;
@@ -2010,7 +2343,7 @@ more:
 	}
 	if (found)
 	    break;
-	if ((sts = __pmLogRead(ctxp->c_archctl->ac_log, ctxp->c_mode, NULL, result, PMLOGREAD_NEXT)) < 0)
+	if ((sts = __pmLogReadFilter(ctxp->c_archctl->ac_log, ctxp->c_mode, NULL, result, PMLOGREAD_NEXT, nfilter, filter)) < 0)
 	    break;
 	tmp.tv_sec = (__int32_t)(*result)->timestamp.tv_sec;
 	tmp.tv_usec = (__int32_t)(*result)->timestamp.tv_usec;
@@ -2083,7 +2416,7 @@ more:
 	    newres->timestamp = (*result)->timestamp;
 	    u = 0;
 	    PM_INIT_LOCKS();
-	    PM_LOCK(__pmLock_libpcp);
+	    PM_LOCK(pc_lock);
 	    for (j = 0; j < numpmid; j++) {
 		hp = __pmHashSearch((int)pmidlist[j], &pc_hc);
 		if (hp == NULL) {
@@ -2095,7 +2428,7 @@ more:
 		    pcp->pc_numval = 0;
 		    sts = __pmHashAdd((int)pmidlist[j], (void *)pcp, &pc_hc);
 		    if (sts < 0) {
-			PM_UNLOCK(__pmLock_libpcp);
+			PM_UNLOCK(pc_lock);
 			return sts;
 		    }
 		}
@@ -2117,7 +2450,7 @@ more:
 		    newres->vset[j] = (pmValueSet *)pcp;
 		}
 	    }
-	    PM_UNLOCK(__pmLock_libpcp);
+	    PM_UNLOCK(pc_lock);
 	    if (u == 0 && !all_derived) {
 		/*
 		 * not one of our pmids was in the log record, try
@@ -2127,11 +2460,15 @@ more:
 		free(newres);
 		goto more;
 	    }
-	    /*
-	     * *result malloc'd in __pmLogRead, but vset[]'s are either in
-	     * pdubuf or the pmid_ctl struct
-	     */
-	    free(*result);
+	    if (u == 0)
+		/* nothing in newres refers to the log record */
+		pmFreeResult(*result);
+	    else
+		/*
+		 * *result malloc'd in __pmLogRead, but vset[]'s are either in
+		 * pdubuf or the pmid_ctl struct
+		 */
+		free(*result);
 	    *result = newres;
 	}
 	else
@@ -2318,9 +2655,9 @@ __pmLogSetTime(__pmContext *ctxp)
 		    sbuf.st_size = 0;
 		    vol = lcp->l_maxvol;
 		    if (vol >= 0 && vol < lcp->l_numseen && lcp->l_seen[vol])
-			fstat(fileno(lcp->l_mfp), &sbuf);
+			__pmLogFstat(lcp, lcp->l_mfp, &sbuf);
 		    else if ((f = _logpeek(lcp, lcp->l_maxvol)) != NULL) {
-			fstat(fileno(f), &sbuf);
+			__pmLogFstat(lcp, f, &sbuf);
 			fclose(f);
 		    }
 		}
@@ -2597,7 +2934,7 @@ __pmGetArchiveEnd(__pmLogCtl *lcp, struct timeval *tp)
 	    continue;
 	}
 
-	if (fstat(fileno(f), &sbuf) < 0) {
+	if (__pmLogFstat(lcp, f, &sbuf) < 0) {
 	    /* if we can't stat() this one, then try previous volume(s) */
 	    fclose(f);
 	    f = NULL;
@@ -34,8 +34,18 @@ typedef struct bufctl
     /* The actual buffer happens to follow this struct. */
 } bufctl_t;
 
-/* Protected by global __pmLock_libpcp. */
+/*
+ * Protected by pdubuf_lock rather than __pmLock_libpcp, as pmFreeResult()
+ * probes the tree once per pmValueSet, and would otherwise serialise every
+ * thread's fetches behind the global lock.  pdubuf_lock is not recursive,
+ * and nothing else is locked while it is held.
+ */
 static void *buf_tree;
+#ifdef PM_MULTI_THREAD
+static __pmMutex pdubuf_lock = PTHREAD_MUTEX_INITIALIZER;
+#else
+static __pmMutex pdubuf_lock;
+#endif
 
 #ifdef PCP_DEBUG
 static void
@@ -49,6 +59,7 @@ pdubufdump1(const void *nodep, const VISIT which, const int depth)
 		pcp->bc_pincnt);
 }
 
+/* caller holds pdubuf_lock */
 static void
 pdubufdump(void)
 {
@@ -56,13 +67,11 @@ pdubufdump(void)
      * There is no longer a pdubuf free list, ergo no
      * fprintf(stderr, "   free pdubuf[size]:\n");
      */
-    PM_LOCK(__pmLock_libpcp);
     if (buf_tree != NULL) {
 	fprintf(stderr, "   pinned pdubuf[size](pincnt):");
 	twalk(buf_tree, &pdubufdump1);
 	fprintf(stderr, "\n");
     }
-    PM_UNLOCK(__pmLock_libpcp);
 }
 #endif
 
@@ -95,7 +104,9 @@ __pmFindPDUBuf(int need)
 	/* special diagnostic case ... dump buffer state */
 #ifdef PCP_DEBUG
 	fprintf(stderr, "__pmFindPDUBuf(DEBUG)\n");
+	PM_LOCK(pdubuf_lock);
 	pdubufdump();
+	PM_UNLOCK(pdubuf_lock);
 #endif
 	return NULL;
     }
@@ -108,15 +119,14 @@ __pmFindPDUBuf(int need)
     pcp->bc_size = need;
     pcp->bc_buf = ((char *)pcp) + sizeof(*pcp);
 
-    PM_LOCK(__pmLock_libpcp);
+    PM_LOCK(pdubuf_lock);
     /* Insert the node in the tree. */
     bcp = tsearch((void *)pcp, &buf_tree, &bufctl_t_compare);
     if (unlikely(bcp == NULL)) {	/* ENOMEM */
-	PM_UNLOCK(__pmLock_libpcp);
+	PM_UNLOCK(pdubuf_lock);
 	free(pcp);
 	return NULL;
     }
-    PM_UNLOCK(__pmLock_libpcp);
 
 #ifdef PCP_DEBUG
     if (unlikely(pmDebug & DBG_TRACE_PDUBUF)) {
@@ -125,6 +135,7 @@ __pmFindPDUBuf(int need)
 	pdubufdump();
     }
 #endif
+    PM_UNLOCK(pdubuf_lock);
 
     return (__pmPDU *)pcp->bc_buf;
 }
@@ -137,7 +148,7 @@ __pmPinPDUBuf(void *handle)
 
     assert(((__psint_t)handle % sizeof(int)) == 0);
     PM_INIT_LOCKS();
-    PM_LOCK(__pmLock_libpcp);
+    PM_LOCK(pdubuf_lock);
 
     /*
      * Initialize a dummy bufctl_t to use only as search key;
@@ -158,13 +169,13 @@ __pmPinPDUBuf(void *handle)
 	       ((char *)handle < &pcp->bc_buf[pcp->bc_size]));
 	pcp->bc_pincnt++;
     } else {
-	__pmNotifyErr(LOG_WARNING, "__pmPinPDUBuf: 0x%lx not in pool!",
-			(unsigned long)handle);
 #ifdef PCP_DEBUG
 	if (pmDebug & DBG_TRACE_PDUBUF)
 	    pdubufdump();
 #endif
-	PM_UNLOCK(__pmLock_libpcp);
+	PM_UNLOCK(pdubuf_lock);
+	__pmNotifyErr(LOG_WARNING, "__pmPinPDUBuf: 0x%lx not in pool!",
+			(unsigned long)handle);
 	return;
     }
 
@@ -175,7 +186,7 @@ __pmPinPDUBuf(void *handle)
 		pcp->bc_buf, pcp->bc_pincnt);
 #endif
 
-    PM_UNLOCK(__pmLock_libpcp);
+    PM_UNLOCK(pdubuf_lock);
 }
 
 int
@@ -186,7 +197,7 @@ __pmUnpinPDUBuf(void *handle)
 
     assert(((__psint_t)handle % sizeof(int)) == 0);
     PM_INIT_LOCKS();
-    PM_LOCK(__pmLock_libpcp);
+    PM_LOCK(pdubuf_lock);
 
     /*
      * Initialize a dummy bufctl_t to use only as search key;
@@ -211,7 +222,7 @@ __pmUnpinPDUBuf(void *handle)
 	    pdubufdump();
 	}
 #endif
-	PM_UNLOCK(__pmLock_libpcp);
+	PM_UNLOCK(pdubuf_lock);
 	return 0;
     }
 
@@ -227,11 +238,11 @@ __pmUnpinPDUBuf(void *handle)
 
     if (likely(--pcp->bc_pincnt == 0)) {
 	tdelete(pcp, &buf_tree, &bufctl_t_compare);
-	PM_UNLOCK(__pmLock_libpcp);
+	PM_UNLOCK(pdubuf_lock);
 	free(pcp);
     }
     else {
-	PM_UNLOCK(__pmLock_libpcp);
+	PM_UNLOCK(pdubuf_lock);
     }
 
     return 1;
@@ -239,7 +250,7 @@ __pmUnpinPDUBuf(void *handle)
 
 /*
  * Used to pass context from __pmCountPDUBuf to the pdubufcount callback.
- * They are protected by the __pmLock_libpcp.
+ * They are protected by pdubuf_lock.
  */
 static int	pdu_bufcnt_need;
 static unsigned	pdu_bufcnt;
@@ -258,7 +269,7 @@ void
 __pmCountPDUBuf(int need, int *alloc, int *free)
 {
     PM_INIT_LOCKS();
-    PM_LOCK(__pmLock_libpcp);
+    PM_LOCK(pdubuf_lock);
 
     pdu_bufcnt_need = need;
     pdu_bufcnt = 0;
@@ -267,5 +278,5 @@ __pmCountPDUBuf(int need, int *alloc, int *free)
 
     *free = 0;			/* We don't retain freed nodes. */
 
-    PM_UNLOCK(__pmLock_libpcp);
+    PM_UNLOCK(pdubuf_lock);
 }
@@ -244,7 +244,7 @@ pmGetPMNSLocation(void)
 
 		case PM_CONTEXT_ARCHIVE:
 		    version = ctxp->c_archctl->ac_log->l_label.ill_magic & 0xff;
-		    if (version == PM_LOG_VERS02) {
+		    if (version == PM_LOG_VERS02 || version == PM_LOG_VERS02_DELTA) {
 			pmns_location = PMNS_ARCHIVE;
 			PM_TPD(curr_pmns) = ctxp->c_archctl->ac_log->l_pmns; 
 		    }
@@ -275,23 +275,23 @@ pmGetPMNSLocation(void)
 	    pmns_location = PMNS_LOCAL;
     }
 
-    PM_LOCK(__pmLock_libpcp);
 #ifdef PCP_DEBUG
     if (pmDebug & DBG_TRACE_PMNS) {
 	static int last_pmns_location = -1;
 
+	PM_LOCK(__pmLock_libpcp);
 	if (pmns_location != last_pmns_location) {
 	    fprintf(stderr, "pmGetPMNSLocation() -> %s\n", 
 			    pmPMNSLocationStr(pmns_location));
 	    last_pmns_location = pmns_location;
 	}
+	PM_UNLOCK(__pmLock_libpcp);
     }
 #endif
 
-    /* fix up curr_pmns for API ops */
+    /* fix up curr_pmns for API ops, curr_pmns is thread-private */
     if (pmns_location == PMNS_LOCAL)
 	PM_TPD(curr_pmns) = main_pmns;
-    PM_UNLOCK(__pmLock_libpcp);
 
 done:
     return pmns_location;
@@ -1205,6 +1205,371 @@ loadascii(int dupok, int use_cpp)
     return type;
 }
 
+/*
+ * Binary PMNS ... a compiled image of an ASCII PMNS file, written by
+ * pmnsmerge -b as <file>.bin and loaded in place of the ASCII file
+ * when it has been modified more recently, so neither pmcpp nor the
+ * parser above are needed.
+ *
+ * The image is all 32-bit words in the byte order of the host that
+ * wrote it.  Nodes refer to each other by index and to their names by
+ * offset, so the image can be read (or mapped) as is.
+ *
+ *	header
+ *	node[numnode]		depth-first, node 0 is "root"
+ *	htab[htabsize]		pmid hash table, first node index or -1
+ *	symbol[symlen]		the names, each '\0' terminated
+ *
+ * The pmid hash table and its chains are those of the PMNS that was
+ * written, so they are not rebuilt when the image is loaded.  An image
+ * that is short, from a host of the other byte order, or of some other
+ * version is ignored and the ASCII PMNS file is loaded as before.
+ */
+#define PMNSBIN_MAGIC	0x504d4e62	/* "PMNb" */
+#define PMNSBIN_VERSION	1
+#define PMNSBIN_DUPS	0x1		/* some PMID has more than one name */
+
+typedef struct {
+    __uint32_t	magic;
+    __int32_t	version;
+    __int32_t	flags;
+    __int32_t	numnode;
+    __int32_t	htabsize;
+    __int32_t	symlen;
+} pmnsbin_hdr_t;
+
+typedef struct {
+    __int32_t	parent;
+    __int32_t	next;
+    __int32_t	first;
+    __int32_t	hash;
+    __int32_t	name;		/* offset into symbol[] */
+    __uint32_t	pmid;
+} pmnsbin_node_t;
+
+typedef struct {
+    __pmnsNode	*np;
+    int		index;
+} pmnsbin_map_t;
+
+/*
+ * Depth-first walk of the tree, returning the number of nodes, and if
+ * order is not NULL, filling it in with the nodes in that order.
+ */
+static int
+binwalk(__pmnsNode *np, __pmnsNode **order, int n)
+{
+    __pmnsNode	*cp;
+
+    if (order != NULL)
+	order[n] = np;
+    n++;
+    for (cp = np->first; cp != NULL; cp = cp->next)
+	n = binwalk(cp, order, n);
+    return n;
+}
+
+static int
+binmapcmp(const void *a, const void *b)
+{
+    const __pmnsNode	*pa = ((const pmnsbin_map_t *)a)->np;
+    const __pmnsNode	*pb = ((const pmnsbin_map_t *)b)->np;
+
+    if (pa < pb)
+	return -1;
+    return pa > pb;
+}
+
+static __int32_t
+binindex(pmnsbin_map_t *map, int numnode, __pmnsNode *np)
+{
+    pmnsbin_map_t	key;
+    pmnsbin_map_t	*mp;
+
+    if (np == NULL)
+	return -1;
+    key.np = np;
+    mp = (pmnsbin_map_t *)bsearch(&key, map, numnode, sizeof(map[0]), binmapcmp);
+    return mp == NULL ? -1 : mp->index;
+}
+
+/*
+ * Write the binary image of tree to f.  Only pmnsmerge uses this.
+ */
+int
+__pmWriteBinaryPMNS(FILE *f, __pmnsTree *tree)
+{
+    pmnsbin_hdr_t	hdr;
+    pmnsbin_node_t	node;
+    __pmnsNode		**order = NULL;
+    pmnsbin_map_t	*map = NULL;
+    __pmnsNode		*np;
+    __pmnsNode		*xp;
+    __int32_t		index;
+    int			symlen;
+    int			i;
+    int			sts = 0;
+
+    if (tree == NULL || tree->root == NULL || tree->htabsize < 1)
+	return PM_ERR_NOPMNS;
+
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.magic = PMNSBIN_MAGIC;
+    hdr.version = PMNSBIN_VERSION;
+    hdr.numnode = binwalk(tree->root, NULL, 0);
+    hdr.htabsize = tree->htabsize;
+    order = (__pmnsNode **)malloc(hdr.numnode * sizeof(order[0]));
+    map = (pmnsbin_map_t *)malloc(hdr.numnode * sizeof(map[0]));
+    if (order == NULL || map == NULL) {
+	sts = -oserror();
+	goto done;
+    }
+    binwalk(tree->root, order, 0);
+    for (i = 0; i < hdr.numnode; i++) {
+	map[i].np = order[i];
+	map[i].index = i;
+	hdr.symlen += (int)strlen(order[i]->name) + 1;
+    }
+    qsort(map, hdr.numnode, sizeof(map[0]), binmapcmp);
+
+    /* same test for duplicates as backlink() */
+    for (i = 0; i < tree->htabsize; i++) {
+	for (np = tree->htab[i]; np != NULL; np = np->hash) {
+	    for (xp = np->hash; xp != NULL; xp = xp->hash) {
+		if ((xp->pmid & PMID_MASK) == (np->pmid & PMID_MASK) &&
+		    !IS_DYNAMIC_ROOT(xp->pmid))
+		    hdr.flags |= PMNSBIN_DUPS;
+	    }
+	}
+    }
+
+    fwrite(&hdr, sizeof(hdr), 1, f);
+    symlen = 0;
+    for (i = 0; i < hdr.numnode; i++) {
+	np = order[i];
+	node.parent = binindex(map, hdr.numnode, np->parent);
+	node.next = binindex(map, hdr.numnode, np->next);
+	node.first = binindex(map, hdr.numnode, np->first);
+	node.hash = binindex(map, hdr.numnode, np->hash);
+	node.name = symlen;
+	/* no mark bits, and non-leaf nodes as they are before backlink() */
+	if (np->first != NULL || np->pmid == PM_ID_NULL)
+	    node.pmid = PM_ID_NULL;
+	else
+	    node.pmid = np->pmid & PMID_MASK;
+	fwrite(&node, sizeof(node), 1, f);
+	symlen += (int)strlen(np->name) + 1;
+    }
+    for (i = 0; i < tree->htabsize; i++) {
+	index = binindex(map, hdr.numnode, tree->htab[i]);
+	fwrite(&index, sizeof(index), 1, f);
+    }
+    for (i = 0; i < hdr.numnode; i++)
+	fwrite(order[i]->name, strlen(order[i]->name) + 1, 1, f);
+    if (fflush(f) != 0 || ferror(f))
+	sts = -oserror();
+
+done:
+    free(order);
+    free(map);
+    return sts;
+}
+
+/*
+ * true if a was modified after b
+ */
+static int
+isnewer(struct stat *a, struct stat *b)
+{
+#if defined(HAVE_ST_MTIME_WITH_E)
+    /*
+     * only seconds, so a binary PMNS made in the same second as an
+     * edit of the root cannot be trusted, and loadascii() is used
+     */
+    return a->st_mtime > b->st_mtime;
+#elif defined(HAVE_ST_MTIME_WITH_SPEC)
+    return a->st_mtimespec.tv_sec > b->st_mtimespec.tv_sec ||
+	   (a->st_mtimespec.tv_sec == b->st_mtimespec.tv_sec &&
+	    a->st_mtimespec.tv_nsec > b->st_mtimespec.tv_nsec);
+#else
+    return a->st_mtim.tv_sec > b->st_mtim.tv_sec ||
+	   (a->st_mtim.tv_sec == b->st_mtim.tv_sec &&
+	    a->st_mtim.tv_nsec > b->st_mtim.tv_nsec);
+#endif
+}
+
+static int
+binlink(__pmnsNode *nodes, int numnode, __int32_t index, __pmnsNode **npp)
+{
+    if (index < -1 || index >= numnode)
+	return -1;
+    *npp = index == -1 ? NULL : &nodes[index];
+    return 0;
+}
+
+/*
+ * The links of a binary PMNS have to make a tree ... starting from the
+ * root, first and next reach every node exactly once, each child's
+ * parent is the node it hangs off, and no node is on more than one
+ * hash chain, so no walk of the loaded PMNS can loop
+ */
+static int
+bincheck(__pmnsNode *nodes, int numnode, __pmnsNode **htab, int htabsize)
+{
+    __pmnsNode	*np;
+    char	*seen;
+    int		n = 0;
+    int		i;
+    int		sts = -1;
+
+    if ((seen = (char *)calloc(numnode, sizeof(*seen))) == NULL)
+	return -1;
+    if (nodes[0].next != NULL)
+	goto done;
+    np = &nodes[0];
+    while (np != NULL) {
+	if (seen[np - nodes]++)
+	    goto done;
+	n++;
+	if (np->first != NULL) {
+	    if (np->first->parent != np)
+		goto done;
+	    np = np->first;
+	    continue;
+	}
+	/* parents were all seen before their children, so this ends */
+	while (np != NULL && np->next == NULL)
+	    np = np->parent;
+	if (np != NULL) {
+	    if (np->next->parent != np->parent)
+		goto done;
+	    np = np->next;
+	}
+    }
+    if (n != numnode)
+	goto done;
+
+    memset(seen, 0, numnode);
+    for (i = 0; i < htabsize; i++) {
+	for (np = htab[i]; np != NULL; np = np->hash) {
+	    if (seen[np - nodes]++)
+		goto done;
+	}
+    }
+    sts = 0;
+
+done:
+    free(seen);
+    return sts;
+}
+
+/*
+ * Load the binary image of the PMNS file fname, if there is one that
+ * is newer than the PMNS file (with status rootbuf) and it can be
+ * used, else return -1 and leave it to loadascii().
+ */
+static int
+loadbinary(int dupok, struct stat *rootbuf)
+{
+    char		binname[MAXPATHLEN];
+    struct stat		sbuf;
+    pmnsbin_hdr_t	*hdr;
+    pmnsbin_node_t	*bnp;
+    __int32_t		*bhtab;
+    __pmnsTree		*tree = NULL;
+    __pmnsNode		*nodes = NULL;
+    __pmnsNode		**htab = NULL;
+    char		*buf = NULL;
+    char		*symbol;
+    size_t		len;
+    int			fd;
+    int			i;
+
+    if (getenv("PCP_PMNS_NOBIN") != NULL)
+	return -1;
+    snprintf(binname, sizeof(binname), "%s.bin", fname);
+    if ((fd = open(binname, O_RDONLY)) < 0)
+	return -1;
+    if (fstat(fd, &sbuf) < 0 || !S_ISREG(sbuf.st_mode) ||
+	!isnewer(&sbuf, rootbuf) || sbuf.st_size < (off_t)sizeof(*hdr) ||
+	(off_t)(size_t)sbuf.st_size != sbuf.st_size) {
+	close(fd);
+	return -1;
+    }
+    len = (size_t)sbuf.st_size;
+    if ((buf = (char *)malloc(len)) == NULL ||
+	read(fd, buf, len) != (ssize_t)len) {
+	close(fd);
+	goto bad;
+    }
+    close(fd);
+
+    hdr = (pmnsbin_hdr_t *)buf;
+    if (hdr->magic != PMNSBIN_MAGIC || hdr->version != PMNSBIN_VERSION ||
+	hdr->numnode < 1 || hdr->htabsize < 1 || hdr->symlen < 1 ||
+	(size_t)hdr->numnode > len / sizeof(*bnp) ||
+	(size_t)hdr->htabsize > len / sizeof(*bhtab) ||
+	len != sizeof(*hdr) + hdr->numnode * sizeof(*bnp) +
+		hdr->htabsize * sizeof(*bhtab) + hdr->symlen)
+	goto bad;
+    if ((hdr->flags & PMNSBIN_DUPS) && dupok == NO_DUPS)
+	/* loadascii() will report the duplicates */
+	goto bad;
+    bnp = (pmnsbin_node_t *)&hdr[1];
+    bhtab = (__int32_t *)&bnp[hdr->numnode];
+    symbol = (char *)&bhtab[hdr->htabsize];
+    if (symbol[hdr->symlen-1] != '\0' || bnp[0].parent != -1)
+	goto bad;
+
+    tree = (__pmnsTree *)malloc(sizeof(*tree));
+    nodes = (__pmnsNode *)malloc(hdr->numnode * sizeof(*nodes));
+    htab = (__pmnsNode **)malloc(hdr->htabsize * sizeof(*htab));
+    if (tree == NULL || nodes == NULL || htab == NULL)
+	goto bad;
+    for (i = 0; i < hdr->numnode; i++) {
+	if (binlink(nodes, hdr->numnode, bnp[i].parent, &nodes[i].parent) < 0 ||
+	    binlink(nodes, hdr->numnode, bnp[i].next, &nodes[i].next) < 0 ||
+	    binlink(nodes, hdr->numnode, bnp[i].first, &nodes[i].first) < 0 ||
+	    binlink(nodes, hdr->numnode, bnp[i].hash, &nodes[i].hash) < 0 ||
+	    bnp[i].name < 0 || bnp[i].name >= hdr->symlen)
+	    goto bad;
+	nodes[i].name = &symbol[bnp[i].name];
+	nodes[i].pmid = bnp[i].pmid;
+    }
+    for (i = 0; i < hdr->htabsize; i++) {
+	if (binlink(nodes, hdr->numnode, bhtab[i], &htab[i]) < 0)
+	    goto bad;
+    }
+    if (bincheck(nodes, hdr->numnode, htab, hdr->htabsize) < 0)
+	goto bad;
+
+    /* the names stay in buf, see __pmFreePMNS() */
+    tree->root = nodes;
+    tree->htab = htab;
+    tree->htabsize = hdr->htabsize;
+    tree->symbol = buf;
+    tree->contiguous = 1;
+    tree->mark_state = UNKNOWN_MARK_STATE;
+    mark_all(tree, 0);
+    main_pmns = tree;
+#ifdef PCP_DEBUG
+    if (pmDebug & DBG_TRACE_PMNS)
+	fprintf(stderr, "Loaded binary PMNS %s: %d nodes\n", binname, hdr->numnode);
+#endif
+    return 0;
+
+bad:
+#ifdef PCP_DEBUG
+    if (pmDebug & DBG_TRACE_PMNS)
+	fprintf(stderr, "loadbinary: %s not used\n", binname);
+#endif
+    free(buf);
+    free(tree);
+    free(nodes);
+    free(htab);
+    return -1;
+}
+
 static const char * 
 getfname(const char *filename)
 {
@@ -1326,6 +1691,8 @@ static int
 load(const char *filename, int dupok, int use_cpp)
 {
     const char	*f;
+    struct stat	statbuf;
+    int		havestat;
     int 	i = 0;
 
     if (main_pmns != NULL) {
@@ -1356,19 +1723,15 @@ load(const char *filename, int dupok, int use_cpp)
 #endif
 
     /* Note size and modification time of pmns file */
-    {
-	struct stat statbuf;
-
-	if (stat(fname, &statbuf) == 0) {
-	    last_size = statbuf.st_size;
+    if ((havestat = (stat(fname, &statbuf) == 0))) {
+	last_size = statbuf.st_size;
 #if defined(HAVE_ST_MTIME_WITH_E)
-	    last_mtim = statbuf.st_mtime; /* possible struct assignment */
+	last_mtim = statbuf.st_mtime; /* possible struct assignment */
 #elif defined(HAVE_ST_MTIME_WITH_SPEC)
-	    last_mtim = statbuf.st_mtimespec; /* possible struct assignment */
+	last_mtim = statbuf.st_mtimespec; /* possible struct assignment */
 #else
-	    last_mtim = statbuf.st_mtim; /* possible struct assignment */
+	last_mtim = statbuf.st_mtim; /* possible struct assignment */
 #endif
-	}
     }
 
     /*
@@ -1380,8 +1743,11 @@ load(const char *filename, int dupok, int use_cpp)
 	use_cpp = NO_CPP;
 
     /*
-     * load ASCII PMNS
+     * load binary PMNS compiled from this one by pmnsmerge, if any,
+     * else load ASCII PMNS
      */
+    if (havestat && loadbinary(dupok, &statbuf) == 0)
+	return 0;
     return loadascii(dupok, use_cpp);
 }
 
@@ -1438,7 +1804,8 @@ locate(const char *name, __pmnsNode *root)
  */
 
 /*
- * As of PCP 3.6, there is _only_ the ASCII version of the PMNS.
+ * As of PCP 3.6, there is _only_ the ASCII version of the PMNS, although
+ * a binary image compiled from it by pmnsmerge is used when up to date.
  * As of PCP 3.10.3, the default is to allow duplicates in the PMNS.
  */
 int
@@ -0,0 +1,306 @@
+/*
+ * Copyright (c) 2026 Red Hat.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ */
+
+/*
+ * Input readiness for the main loops of pmcd and pmproxy.
+ *
+ * Unlike __pmFdSet and __pmSelectRead there is no FD_SETSIZE limit on
+ * descriptor values, and the cost of a wakeup depends on the number of
+ * ready descriptors rather than the highest one in use.  epoll(7) is
+ * used where available, else poll(2), else select(2).
+ *
+ * Readiness is level-triggered, as for select(2) ... the daemons read
+ * one PDU per wakeup and rely on being woken again for the next one.
+ */
+
+#include "pmapi.h"
+#include "impl.h"
+#if defined(HAVE_SYS_EPOLL_H)
+#include <sys/epoll.h>
+#endif
+#if defined(HAVE_SYS_EPOLL_H) || defined(HAVE_POLL_H)
+#include <poll.h>
+#endif
+
+struct __pmPollSet {
+    int			nfds;		/* descriptors in the set */
+    int			size;		/* allocated entries below */
+    int			nready;		/* from last __pmPollSetWait */
+    int			*ready;		/* ready descriptors, or -1 */
+#if defined(HAVE_SYS_EPOLL_H)
+    int			epfd;
+    struct epoll_event	*events;
+#elif defined(HAVE_POLL_H)
+    struct pollfd	*fds;
+#else
+    int			*fds;
+    __pmFdSet		set;
+    int			maxfd;
+#endif
+};
+
+#if defined(HAVE_SYS_EPOLL_H) || defined(HAVE_POLL_H)
+static int
+timeout_ms(struct timeval *timeout)
+{
+    if (timeout == NULL)
+	return -1;
+    return timeout->tv_sec * 1000 + (timeout->tv_usec + 999) / 1000;
+}
+#endif
+
+/* make room for one more descriptor */
+static int
+pollset_grow(__pmPollSet *ps)
+{
+    int		size;
+    void	*p;
+
+    if (ps->nfds < ps->size)
+	return 0;
+    size = ps->size ? ps->size * 2 : 64;
+    if ((p = realloc(ps->ready, size * sizeof(ps->ready[0]))) == NULL)
+	return -ENOMEM;
+    ps->ready = p;
+#if defined(HAVE_SYS_EPOLL_H)
+    if ((p = realloc(ps->events, size * sizeof(ps->events[0]))) == NULL)
+	return -ENOMEM;
+    ps->events = p;
+#else
+    if ((p = realloc(ps->fds, size * sizeof(ps->fds[0]))) == NULL)
+	return -ENOMEM;
+    ps->fds = p;
+#endif
+    ps->size = size;
+    return 0;
+}
+
+__pmPollSet *
+__pmPollSetCreate(void)
+{
+    __pmPollSet	*ps;
+
+    if ((ps = (__pmPollSet *)calloc(1, sizeof(*ps))) == NULL)
+	return NULL;
+#if defined(HAVE_SYS_EPOLL_H)
+    if ((ps->epfd = epoll_create(64)) < 0) {
+	free(ps);
+	return NULL;
+    }
+    fcntl(ps->epfd, F_SETFD, FD_CLOEXEC);
+#elif !defined(HAVE_POLL_H)
+    __pmFD_ZERO(&ps->set);
+    ps->maxfd = -1;
+#endif
+    return ps;
+}
+
+void
+__pmPollSetDestroy(__pmPollSet *ps)
+{
+    if (ps == NULL)
+	return;
+#if defined(HAVE_SYS_EPOLL_H)
+    close(ps->epfd);
+    free(ps->events);
+#else
+    free(ps->fds);
+#endif
+    free(ps->ready);
+    free(ps);
+}
+
+int
+__pmPollSetAdd(__pmPollSet *ps, int fd)
+{
+    int			sts;
+#if defined(HAVE_SYS_EPOLL_H)
+    struct epoll_event	event;
+#endif
+
+    if ((sts = pollset_grow(ps)) < 0)
+	return sts;
+#if defined(HAVE_SYS_EPOLL_H)
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN;
+    event.data.fd = fd;
+    if (epoll_ctl(ps->epfd, EPOLL_CTL_ADD, fd, &event) < 0)
+	return -oserror();
+#elif defined(HAVE_POLL_H)
+    ps->fds[ps->nfds].fd = fd;
+    ps->fds[ps->nfds].events = POLLIN;
+    ps->fds[ps->nfds].revents = 0;
+#else
+    ps->fds[ps->nfds] = fd;
+    __pmFD_SET(fd, &ps->set);
+    if (fd > ps->maxfd)
+	ps->maxfd = fd;
+#endif
+    ps->nfds++;
+    return 0;
+}
+
+/*
+ * Remove fd from the set ... call this before closing fd.  If fd was
+ * reported ready by the last __pmPollSetWait() and not yet handled, it
+ * is dropped from the ready list too, so a descriptor number reused
+ * by a later accept() is not mistaken for a ready one.
+ */
+int
+__pmPollSetDel(__pmPollSet *ps, int fd)
+{
+    int		i;
+
+    for (i = 0; i < ps->nready; i++) {
+	if (ps->ready[i] == fd)
+	    ps->ready[i] = -1;
+    }
+#if defined(HAVE_SYS_EPOLL_H)
+    if (epoll_ctl(ps->epfd, EPOLL_CTL_DEL, fd, NULL) < 0)
+	return -oserror();
+#else
+    for (i = 0; i < ps->nfds; i++) {
+#if defined(HAVE_POLL_H)
+	if (ps->fds[i].fd == fd)
+#else
+	if (ps->fds[i] == fd)
+#endif
+	    break;
+    }
+    if (i == ps->nfds)
+	return -ENOENT;
+    ps->fds[i] = ps->fds[ps->nfds-1];
+#if !defined(HAVE_POLL_H)
+    __pmFD_CLR(fd, &ps->set);
+#endif
+#endif
+    ps->nfds--;
+    return 0;
+}
+
+/*
+ * Wait for input on any descriptor in the set, with the same return
+ * convention as __pmSelectRead() ... the ready descriptors are then
+ * available from __pmPollSetReady().
+ */
+int
+__pmPollSetWait(__pmPollSet *ps, struct timeval *timeout)
+{
+    int		n;
+    int		i;
+#if !defined(HAVE_SYS_EPOLL_H) && !defined(HAVE_POLL_H)
+    __pmFdSet	readyfds;
+#endif
+
+    ps->nready = 0;
+#if defined(HAVE_SYS_EPOLL_H)
+    if (ps->size == 0 && (n = pollset_grow(ps)) < 0) {
+	setoserror(-n);
+	return -1;
+    }
+    n = epoll_wait(ps->epfd, ps->events, ps->size, timeout_ms(timeout));
+    for (i = 0; i < n; i++)
+	ps->ready[i] = ps->events[i].data.fd;
+#elif defined(HAVE_POLL_H)
+    n = poll(ps->fds, ps->nfds, timeout_ms(timeout));
+    if (n > 0) {
+	n = 0;
+	for (i = 0; i < ps->nfds; i++) {
+	    if (ps->fds[i].revents != 0)
+		ps->ready[n++] = ps->fds[i].fd;
+	}
+    }
+#else
+    __pmFD_COPY(&readyfds, &ps->set);
+    n = __pmSelectRead(ps->maxfd+1, &readyfds, timeout);
+    if (n > 0) {
+	n = 0;
+	for (i = 0; i < ps->nfds; i++) {
+	    if (__pmFD_ISSET(ps->fds[i], &readyfds))
+		ps->ready[n++] = ps->fds[i];
+	}
+    }
+#endif
+    if (n > 0)
+	ps->nready = n;
+    return n;
+}
+
+/*
+ * i-th ready descriptor from the last __pmPollSetWait(), or -1 if it
+ * has since been removed from the set
+ */
+int
+__pmPollSetReady(__pmPollSet *ps, int i)
+{
+    if (i < 0 || i >= ps->nready)
+	return -1;
+    return ps->ready[i];
+}
+
+/*
+ * Wait for any of a handful of descriptors to be readable, or with
+ * writing set to be writable (a connect in progress) ... select(2) for
+ * callers like __pmSocketReady(), connection setup and pmcd waiting on
+ * its agents, without the FD_SETSIZE limit on descriptor values once
+ * a daemon has many clients.  Negative fds[] entries are ignored, as
+ * for poll(2).  Sets ready[i] for each fds[i] that is ready, and
+ * returns as for select(2).
+ */
+int
+__pmPollFds(int nfds, const int *fds, int *ready, int writing,
+		struct timeval *timeout)
+{
+    int			n;
+    int			i;
+#if defined(HAVE_SYS_EPOLL_H) || defined(HAVE_POLL_H)
+    struct pollfd	onstack[16];
+    struct pollfd	*pfds = onstack;
+
+    if (nfds > sizeof(onstack) / sizeof(onstack[0]) &&
+	(pfds = (struct pollfd *)malloc(nfds * sizeof(*pfds))) == NULL) {
+	setoserror(ENOMEM);
+	return -1;
+    }
+    for (i = 0; i < nfds; i++) {
+	pfds[i].fd = fds[i];
+	pfds[i].events = writing ? POLLOUT : POLLIN;
+	pfds[i].revents = 0;
+    }
+    n = poll(pfds, nfds, timeout_ms(timeout));
+    for (i = 0; i < nfds; i++)
+	ready[i] = (n > 0 && pfds[i].revents != 0);
+    if (pfds != onstack)
+	free(pfds);
+#else
+    __pmFdSet		fdset;
+    int			maxfd = -1;
+
+    __pmFD_ZERO(&fdset);
+    for (i = 0; i < nfds; i++) {
+	if (fds[i] < 0)
+	    continue;
+	__pmFD_SET(fds[i], &fdset);
+	if (fds[i] > maxfd)
+	    maxfd = fds[i];
+    }
+    if (writing)
+	n = __pmSelectWrite(maxfd+1, &fdset, timeout);
+    else
+	n = __pmSelectRead(maxfd+1, &fdset, timeout);
+    for (i = 0; i < nfds; i++)
+	ready[i] = (n > 0 && fds[i] >= 0 && __pmFD_ISSET(fds[i], &fdset));
+#endif
+    return n;
+}
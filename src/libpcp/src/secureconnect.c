@@ -1613,20 +1613,18 @@ __pmRecv(int fd, void *buffer, size_t length, int flags)
  * up that data).
  *
  * PR_Poll does not seem to play well here and so we need to use the
- * native select-based mechanism to block and/or query the state of
+ * native poll/select-based mechanism to block and/or query the state of
  * pending data.
  */
 int
 __pmSocketReady(int fd, struct timeval *timeout)
 {
     __pmSecureSocket socket;
-    __pmFdSet onefd;
+    int ready;
 
     if (__pmDataIPC(fd, &socket) == 0 && socket.sslFd)
         if (SSL_DataPending(socket.sslFd))
 	    return 1;	/* proceed without blocking */
 
-    FD_ZERO(&onefd);
-    FD_SET(fd, &onefd);
-    return select(fd+1, &onefd, NULL, NULL, timeout);
+    return __pmPollFds(1, &fd, &ready, 0, timeout);
 }
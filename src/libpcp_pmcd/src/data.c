@@ -23,6 +23,8 @@
 PMCD_DATA int	pmcd_hi_openfds = -1;   /* Highest open pmcd file descriptor */
 PMCD_DATA int	_pmcd_done;		/* flag from pmcd pmda */
 PMCD_DATA int	_pmcd_timeout = 5;	/* Timeout for hung agents */
+PMCD_DATA struct timeval _pmcd_deadline;	/* Fetch deadline for slow agents */
+PMCD_DATA struct timeval _pmcd_coalesce;	/* Window for coalescing fetches */
 
 PMCD_DATA int	nAgents;		/* Number of active agents */
 PMCD_DATA AgentInfo *agent;		/* Array of agent info structs */
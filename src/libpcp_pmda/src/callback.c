@@ -17,6 +17,7 @@
 #include "impl.h"
 #include "pmda.h"
 #include "libdefs.h"
+#include <limits.h>
 
 /*
  * count the number of instances in an instance domain
@@ -434,9 +435,346 @@ pmdaInstance(pmInDom indom, int inst, char *name, __pmInResult **result, pmdaExt
     return 0;
 }
 
+/*
+ * report an error from a fetch callback, for one instance or (from a
+ * batch fetch callback, inst == PM_IN_NULL) for the whole metric
+ */
+static void
+fetcherror(pmID pmid, int inst, int sts)
+{
+    char	strbuf[20];
+
+    pmIDStr_r(pmid, strbuf, sizeof(strbuf));
+    if (sts == PM_ERR_PMID) {
+	__pmNotifyErr(LOG_ERR, 
+	    "pmdaFetch: PMID %s not handled by fetch callback\n",
+		    strbuf);
+    }
+    else if (sts == PM_ERR_INST) {
+#ifdef PCP_DEBUG
+	if (pmDebug & DBG_TRACE_LIBPMDA) {
+	    __pmNotifyErr(LOG_ERR,
+		"pmdaFetch: Instance %d of PMID %s not handled by fetch callback\n",
+			inst, strbuf);
+	}
+#endif
+    }
+    else if (sts == PM_ERR_APPVERSION ||
+	     sts == PM_ERR_PERMISSION ||
+	     sts == PM_ERR_AGAIN ||
+	     sts == PM_ERR_NYI) {
+#ifdef PCP_DEBUG
+	if (pmDebug & DBG_TRACE_LIBPMDA) {
+	    __pmNotifyErr(LOG_ERR,
+		 "pmdaFetch: Unavailable metric PMID %s[%d]\n",
+			strbuf, inst);
+	}
+#endif
+    }
+    else {
+	__pmNotifyErr(LOG_ERR,
+	    "pmdaFetch: Fetch callback error from metric PMID %s[%d]: %s\n",
+		    strbuf, inst, pmErrStr(sts));
+    }
+}
+
+/*
+ * release a value returned with PMDA_FETCH_DYNAMIC, once it has been
+ * copied into the pmResult
+ */
+static void
+freedynamic(pmID pmid, int type, pmAtomValue *atom)
+{
+    if (type == PM_TYPE_STRING)
+	free(atom->cp);
+    else if (type == PM_TYPE_AGGREGATE)
+	free(atom->vbp);
+    else {
+	char	strbuf[20];
+	char	st2buf[20];
+	__pmNotifyErr(LOG_WARNING,
+		      "pmdaFetch: Attempt to free value for metric %s of wrong type %s\n",
+		      pmIDStr_r(pmid, strbuf, sizeof(strbuf)),
+		      pmTypeStr_r(type, st2buf, sizeof(st2buf)));
+    }
+}
+
+/*
+ * With a batch fetch callback (PMDA_INTERFACE_7 or later) the values
+ * for all instances of a metric are requested in one call, and the
+ * PMDA hands each one back with pmdaFetchBatchValue().  The values are
+ * copied into scratch space that is kept between fetches, where the
+ * pmValueSets (with pmValueBlocks following each one) for the whole
+ * fetch are built, and then copied into a single pinned PDU buffer.
+ * The pmValueBlocks are marked PM_VAL_SPTR, and __pmFreeResultValues()
+ * releases all of the values with one unpin of the PDU buffer, rather
+ * than one malloc() and free() per value as with __pmStuffValue() and
+ * the fetch callback ... refer to the notes in freeresult.c in libpcp.
+ */
+
+#define BATCH_ALIGN(n)	(((n) + sizeof(__int64_t) - 1) & ~(sizeof(__int64_t) - 1))
+
+static int
+batchgrow(e_ext_t *extp, int need)
+{
+    unsigned int	*instlist;
+    pmValue		*vlist;
+    int			maxinst;
+
+    maxinst = extp->maxinst ? extp->maxinst : 4;
+    while (maxinst < need)
+	maxinst *= 2;
+    if ((instlist = (unsigned int *)realloc(extp->instlist, maxinst * sizeof(instlist[0]))) == NULL)
+	return -oserror();
+    extp->instlist = instlist;
+    if ((vlist = (pmValue *)realloc(extp->vlist, maxinst * sizeof(vlist[0]))) == NULL)
+	return -oserror();
+    extp->vlist = vlist;
+    extp->maxinst = maxinst;
+    return 0;
+}
+
+/* make sure there are need bytes in *bufp, doubling its size as required */
+static int
+bufgrow(char **bufp, size_t *sizep, size_t need)
+{
+    size_t	size = *sizep ? *sizep : 1024;
+    char	*buf;
+
+    if (need <= *sizep)
+	return 0;
+    if (need > INT_MAX)
+	return PM_ERR_TOOBIG;
+    while (size < need)
+	size *= 2;
+    if ((buf = (char *)realloc(*bufp, size)) == NULL)
+	return -oserror();
+    *bufp = buf;
+    *sizep = size;
+    return 0;
+}
+
+/*
+ * fetch the values for pmidlist[i] with the batch fetch callback, and
+ * append the pmValueSet to abuf ... dp is NULL for an unknown metric
+ */
+static int
+fetchbatch(int i, pmID pmid, pmdaMetric *metap, pmDesc *dp, pmdaExt *pmda)
+{
+    e_ext_t		*extp = (e_ext_t *)pmda->e_ext;
+    pmdaFetchBatch	batch;
+    pmValueSet		*vset;
+    size_t		hdr;
+    int			numinst = 0;
+    int			inst;
+    int			j;
+    int			sts;
+
+    extp->numval = 0;
+    extp->batchsts = 0;
+    extp->vbuflen = 0;
+    if (dp == NULL)
+	/* dynamic name metrics may often vanish, so no log message */
+	extp->batchsts = PM_ERR_PMID;
+    else {
+	/* the instances in the profile */
+	if (dp->indom == PM_INDOM_NULL) {
+	    if (extp->maxinst < 1 && (sts = batchgrow(extp, 1)) < 0)
+		return sts;
+	    extp->instlist[numinst++] = PM_IN_NULL;
+	}
+	else {
+	    __pmdaStartInst(dp->indom, pmda);
+	    while (__pmdaNextInst(&inst, pmda)) {
+		if (numinst == extp->maxinst &&
+		    (sts = batchgrow(extp, numinst + 1)) < 0)
+		    return sts;
+		extp->instlist[numinst++] = inst;
+	    }
+	}
+
+	extp->batchdesc = dp;
+	if (numinst > 0) {
+	    batch.numinst = numinst;
+	    batch.instlist = extp->instlist;
+	    batch.ext = pmda;
+	    if ((sts = (*(pmda->e_fetchBatchCallBack))(metap, &batch)) < 0) {
+		fetcherror(dp->pmid, PM_IN_NULL, sts);
+		extp->numval = 0;
+		extp->batchsts = sts;
+	    }
+	}
+    }
+
+    if (extp->numval > 0)
+	hdr = sizeof(pmValueSet) + (extp->numval - 1) * sizeof(pmValue);
+    else
+	hdr = sizeof(pmValueSet) - sizeof(pmValue);
+    hdr = BATCH_ALIGN(hdr);
+    if ((sts = bufgrow(&extp->abuf, &extp->abufsize, extp->abuflen + hdr + extp->vbuflen)) < 0)
+	return sts;
+    vset = (pmValueSet *)&extp->abuf[extp->abuflen];
+    extp->aoff[i] = extp->abuflen;
+    extp->afixup[i] = 0;
+    extp->abuflen += hdr;
+    vset->pmid = pmid;
+    if (extp->numval == 0) {
+	vset->numval = extp->batchsts;
+	vset->valfmt = PM_VAL_INSITU;
+	return 0;
+    }
+    vset->numval = extp->numval;
+    memcpy(vset->vlist, extp->vlist, extp->numval * sizeof(pmValue));
+    switch (dp->type) {
+	case PM_TYPE_32:
+	case PM_TYPE_U32:
+	    vset->valfmt = PM_VAL_INSITU;
+	    break;
+	case PM_TYPE_AGGREGATE_STATIC:
+	case PM_TYPE_EVENT:
+	case PM_TYPE_HIGHRES_EVENT:
+	    /* PMDA's own pmValueBlocks, as for __pmStuffValue() */
+	    vset->valfmt = PM_VAL_SPTR;
+	    break;
+	default:
+	    /* pval offsets from vbuf become offsets from the pmValueSet */
+	    vset->valfmt = PM_VAL_SPTR;
+	    memcpy(&extp->abuf[extp->abuflen], extp->vbuf, extp->vbuflen);
+	    extp->abuflen += extp->vbuflen;
+	    for (j = 0; j < vset->numval; j++)
+		vset->vlist[j].value.lval += (int)hdr;
+	    extp->afixup[i] = 1;
+	    break;
+    }
+    return 0;
+}
+
+/*
+ * copy the pmValueSets built by fetchbatch() into one pinned PDU
+ * buffer, and point the pmResult at them
+ */
+static int
+batchresult(int numpmid, pmdaExt *pmda)
+{
+    e_ext_t		*extp = (e_ext_t *)pmda->e_ext;
+    pmValueSet		*vset;
+    char		*base;
+    int			i;
+    int			j;
+
+    if (extp->abuflen > INT_MAX)
+	return PM_ERR_TOOBIG;
+    if ((base = (char *)__pmFindPDUBuf((int)extp->abuflen)) == NULL)
+	return -oserror();
+    memcpy(base, extp->abuf, extp->abuflen);
+    for (i = 0; i < numpmid; i++) {
+	extp->res->vset[i] = vset = (pmValueSet *)&base[extp->aoff[i]];
+	if (!extp->afixup[i])
+	    continue;
+	for (j = 0; j < vset->numval; j++)
+	    vset->vlist[j].value.pval = (pmValueBlock *)
+			((char *)vset + vset->vlist[j].value.lval);
+    }
+    return 0;
+}
+
+/*
+ * called from a batch fetch callback to return the value for
+ * batch->instlist[index] ... sts is as for the return value from a
+ * fetch callback, and the value is copied before this returns
+ */
+int
+pmdaFetchBatchValue(pmdaFetchBatch *batch, int index, int sts, pmAtomValue *atom)
+{
+    e_ext_t		*extp = (e_ext_t *)batch->ext->e_ext;
+    pmDesc		*dp = extp->batchdesc;
+    pmValue		*vp;
+    pmValueBlock	*vbp;
+    const void		*src;
+    size_t		body, need;
+    int			lsts;
+
+    if (index < 0 || index >= batch->numinst || extp->numval >= batch->numinst)
+	return PM_ERR_INST;
+    if (sts < 0) {
+	fetcherror(dp->pmid, batch->instlist[index], sts);
+	extp->batchsts = sts;
+	return sts;
+    }
+    if (sts == PMDA_FETCH_NOVALUES) {
+	/* as for pmdaFetch, the last status is reported if no values */
+	extp->batchsts = 0;
+	return 0;
+    }
+
+    vp = &extp->vlist[extp->numval];
+    vp->inst = batch->instlist[index];
+    switch (dp->type) {
+	case PM_TYPE_32:
+	case PM_TYPE_U32:
+	    vp->value.lval = atom->ul;
+	    extp->numval++;
+	    return 0;
+	case PM_TYPE_AGGREGATE_STATIC:
+	case PM_TYPE_EVENT:
+	case PM_TYPE_HIGHRES_EVENT:
+	    vp->value.pval = atom->vbp;
+	    extp->numval++;
+	    return 0;
+	case PM_TYPE_FLOAT:
+	    body = sizeof(float);
+	    src = &atom->f;
+	    break;
+	case PM_TYPE_64:
+	case PM_TYPE_U64:
+	case PM_TYPE_DOUBLE:
+	    body = sizeof(__int64_t);
+	    src = &atom->ull;
+	    break;
+	case PM_TYPE_AGGREGATE:
+	    body = atom->vbp->vlen - PM_VAL_HDR_SIZE;
+	    src = atom->vbp->vbuf;
+	    break;
+	case PM_TYPE_STRING:
+	    body = strlen(atom->cp) + 1;
+	    src = atom->cp;
+	    break;
+	default: {
+	    char	strbuf[20];
+	    char	st2buf[20];
+	    __pmNotifyErr(LOG_ERR, 
+			 "pmdaFetch: Descriptor type (%s) for metric %s is bad",
+			 pmTypeStr_r(dp->type, strbuf, sizeof(strbuf)),
+			 pmIDStr_r(dp->pmid, st2buf, sizeof(st2buf)));
+	    return PM_ERR_TYPE;
+	}
+    }
+
+    need = body + PM_VAL_HDR_SIZE;
+    if (need < sizeof(pmValueBlock))
+	need = sizeof(pmValueBlock);
+    need = BATCH_ALIGN(need);
+    lsts = bufgrow(&extp->vbuf, &extp->vbufsize, extp->vbuflen + need);
+    if (lsts == 0) {
+	vbp = (pmValueBlock *)&extp->vbuf[extp->vbuflen];
+	vbp->vlen = (int)(body + PM_VAL_HDR_SIZE);
+	vbp->vtype = dp->type;
+	memcpy(vbp->vbuf, src, body);
+	vp->value.lval = (int)extp->vbuflen;	/* offset, fixed up later */
+	extp->vbuflen += need;
+	extp->numval++;
+    }
+    else
+	extp->batchsts = lsts;
+    if (sts == PMDA_FETCH_DYNAMIC)
+	freedynamic(dp->pmid, dp->type, atom);
+    return lsts;
+}
+
 /*
  * resize the pmResult and call the e_callback for each metric instance
- * required in the profile.
+ * required in the profile, or the batch fetch callback once per metric
+ * if there is one.
  */
 
 int
@@ -454,6 +792,7 @@ pmdaFetch(int numpmid, pmID pmidlist[], pmResult **resp, pmdaExt *pmda)
     pmdaMetric		*metap;
     pmAtomValue		atom;
     int			type;
+    int			batch;
     e_ext_t		*extp = (e_ext_t *)pmda->e_ext;
 
     if (extp->dispatch->version.any.ext != pmda)
@@ -477,6 +816,24 @@ pmdaFetch(int numpmid, pmID pmidlist[], pmResult **resp, pmdaExt *pmda)
     extp->res->timestamp.tv_usec = 0;
     extp->res->numpmid = numpmid;
 
+    batch = pmda->e_fetchBatchCallBack != NULL &&
+	    HAVE_V_SEVEN(extp->dispatch->comm.pmda_interface);
+    if (batch) {
+	if (numpmid > extp->maxaoff) {
+	    size_t	*aoff;
+	    char	*afixup;
+
+	    if ((aoff = (size_t *)realloc(extp->aoff, numpmid * sizeof(aoff[0]))) == NULL)
+		return -oserror();
+	    extp->aoff = aoff;
+	    if ((afixup = (char *)realloc(extp->afixup, numpmid)) == NULL)
+		return -oserror();
+	    extp->afixup = afixup;
+	    extp->maxaoff = numpmid;
+	}
+	extp->abuflen = 0;
+    }
+
     /* Look up the pmDesc for the incoming pmids in our pmdaMetrics tables,
        if present.  Fall back to .desc callback if not found (for highly
        dynamic pmdas). */
@@ -505,6 +862,12 @@ pmdaFetch(int numpmid, pmID pmidlist[], pmResult **resp, pmdaExt *pmda)
             }
         }
 
+	if (batch) {
+	    if ((sts = fetchbatch(i, pmidlist[i], metap, dp, pmda)) < 0)
+		return sts;
+	    continue;
+	}
+
 	if (dp != NULL) {
 	    if (dp->indom != PM_INDOM_NULL) {
 		/* count instances in the profile */
@@ -570,42 +933,8 @@ pmdaFetch(int numpmid, pmID pmidlist[], pmResult **resp, pmdaExt *pmda)
 	    }
 	    vset->vlist[j].inst = inst;
 
-	    if ((sts = (*(pmda->e_fetchCallBack))(metap, inst, &atom)) < 0) {
-		char	strbuf[20];
-
-		pmIDStr_r(dp->pmid, strbuf, sizeof(strbuf));
-		if (sts == PM_ERR_PMID) {
-		    __pmNotifyErr(LOG_ERR, 
-		        "pmdaFetch: PMID %s not handled by fetch callback\n",
-				strbuf);
-		}
-		else if (sts == PM_ERR_INST) {
-#ifdef PCP_DEBUG
-		    if (pmDebug & DBG_TRACE_LIBPMDA) {
-			__pmNotifyErr(LOG_ERR,
-			    "pmdaFetch: Instance %d of PMID %s not handled by fetch callback\n",
-				    inst, strbuf);
-		    }
-#endif
-		}
-		else if (sts == PM_ERR_APPVERSION ||
-			 sts == PM_ERR_PERMISSION ||
-			 sts == PM_ERR_AGAIN ||
-			 sts == PM_ERR_NYI) {
-#ifdef PCP_DEBUG
-		    if (pmDebug & DBG_TRACE_LIBPMDA) {
-			__pmNotifyErr(LOG_ERR,
-			     "pmdaFetch: Unavailable metric PMID %s[%d]\n",
-				    strbuf, inst);
-		    }
-#endif
-		}
-		else {
-		    __pmNotifyErr(LOG_ERR,
-			"pmdaFetch: Fetch callback error from metric PMID %s[%d]: %s\n",
-				strbuf, inst, pmErrStr(sts));
-		}
-	    }
+	    if ((sts = (*(pmda->e_fetchCallBack))(metap, inst, &atom)) < 0)
+		fetcherror(dp->pmid, inst, sts);
 	    else {
 		/*
 		 * PMDA_INTERFACE_2
@@ -635,20 +964,8 @@ pmdaFetch(int numpmid, pmID pmidlist[], pmResult **resp, pmdaExt *pmda)
 			vset->valfmt = lsts;
 			j++;
 		    }
-		    if (extp->dispatch->comm.pmda_interface >= PMDA_INTERFACE_5 && sts == PMDA_FETCH_DYNAMIC) {
-			if (type == PM_TYPE_STRING)
-			    free(atom.cp);
-			else if (type == PM_TYPE_AGGREGATE)
-			    free(atom.vbp);
-			else {
-			    char	strbuf[20];
-			    char	st2buf[20];
-			    __pmNotifyErr(LOG_WARNING,
-					  "pmdaFetch: Attempt to free value for metric %s of wrong type %s\n",
-					  pmIDStr_r(dp->pmid, strbuf, sizeof(strbuf)),
-					  pmTypeStr_r(type, st2buf, sizeof(st2buf)));
-			}
-		    }
+		    if (extp->dispatch->comm.pmda_interface >= PMDA_INTERFACE_5 && sts == PMDA_FETCH_DYNAMIC)
+			freedynamic(dp->pmid, type, &atom);
 		    if (lsts < 0)
 			sts = lsts;
 		}
@@ -661,6 +978,8 @@ pmdaFetch(int numpmid, pmID pmidlist[], pmResult **resp, pmdaExt *pmda)
 	    vset->numval = j;
 
     }
+    if (batch && (sts = batchresult(numpmid, pmda)) < 0)
+	return sts;
     *resp = extp->res;
     return 0;
 
@@ -19,7 +19,8 @@
 #define HAVE_V_FOUR(interface)	((interface) >= PMDA_INTERFACE_4)
 #define HAVE_V_FIVE(interface)	((interface) >= PMDA_INTERFACE_5)
 #define HAVE_V_SIX(interface)	((interface) >= PMDA_INTERFACE_6)
-#define HAVE_ANY(interface)	((interface) <= PMDA_INTERFACE_6 && HAVE_V_TWO(interface))
+#define HAVE_V_SEVEN(interface)	((interface) >= PMDA_INTERFACE_7)
+#define HAVE_ANY(interface)	((interface) <= PMDA_INTERFACE_7 && HAVE_V_TWO(interface))
 
 /*
  * Auxilliary structure used to save data from pmdaDSO or pmdaDaemon and
@@ -31,6 +32,27 @@ typedef struct {
     pmResult		*res;		/* high-water allocation for */
     int			maxnpmids;	/* pmResult for each PMDA */
     __pmHashCtl		hashpmids;	/* hashed metrictab lookups */
+    /*
+     * high-water scratch space for pmdaFetch with a batch fetch callback,
+     * the values of one metric are gathered here, then the pmValueSets
+     * for the whole fetch are built in abuf before being copied into a
+     * single pinned PDU buffer
+     */
+    unsigned int	*instlist;	/* instances in the profile */
+    pmValue		*vlist;		/* values, pval as offset into vbuf */
+    int			maxinst;	/* allocated size of instlist, vlist */
+    char		*vbuf;		/* pmValueBlocks for vlist */
+    size_t		vbuflen;	/* bytes used in vbuf */
+    size_t		vbufsize;	/* bytes allocated for vbuf */
+    pmDesc		*batchdesc;	/* metric being fetched */
+    int			numval;		/* values in vlist */
+    int			batchsts;	/* last error from the callback */
+    char		*abuf;		/* pmValueSets and pmValueBlocks */
+    size_t		abuflen;	/* bytes used in abuf */
+    size_t		abufsize;	/* bytes allocated for abuf */
+    size_t		*aoff;		/* offset of each pmValueSet in abuf */
+    char		*afixup;	/* pvals are offsets, to be fixed up */
+    int			maxaoff;	/* allocated size of aoff, afixup */
 } e_ext_t;
 
 #endif /* LIBDEFS_H */
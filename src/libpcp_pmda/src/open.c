@@ -969,6 +969,7 @@ __pmdaSetup(pmdaInterface *dispatch, int version, const char *name)
 
     pmdaSetResultCallBack(dispatch, __pmFreeResultValues);
     pmdaSetFetchCallBack(dispatch, (pmdaFetchCallBack)0);
+    pmdaSetFetchBatchCallBack(dispatch, (pmdaFetchBatchCallBack)0);
     pmdaSetCheckCallBack(dispatch, (pmdaCheckCallBack)0);
     pmdaSetDoneCallBack(dispatch, (pmdaDoneCallBack)0);
     pmdaSetEndContextCallBack(dispatch, (pmdaEndContextCallBack)0);
@@ -85,6 +85,11 @@ CleanupAgent(AgentInfo* aPtr, int why, int status)
     }
     else {
 	pmcd_trace(TR_DEL_AGENT, aPtr->pmDomainId, aPtr->inFd, aPtr->outFd);
+	ClearFetchCache(aPtr);
+	if (aPtr->status.polled) {
+	    __pmPollSetDel(pollFds, aPtr->outFd);
+	    aPtr->status.polled = 0;
+	}
 	if (aPtr->inFd != -1) {
 	    if (aPtr->ipcType == AGENT_SOCKET)
 	      __pmCloseSocket(aPtr->inFd);
@@ -177,6 +182,7 @@ CleanupAgent(AgentInfo* aPtr, int why, int status)
     aPtr->status.connected = 0;
     aPtr->status.busy = 0;
     aPtr->status.notReady = 0;
+    aPtr->status.lagging = 0;
     aPtr->status.flags = 0;
     AgentDied = 1;
 
@@ -19,10 +19,47 @@
 
 #define MIN_CLIENTS_ALLOC 8
 
-int		maxClientFd = -1;	/* largest fd for a client */
-__pmFdSet	clientFds;		/* for client select() */
+__pmPollSet	*pollFds;		/* clients, request ports, agents */
 
 static int	clientSize;
+static int	*fdClient;		/* fd -> client[] index, or -1 */
+static int	fdClientSize;
+
+/* Start waiting for input from a client, and map its fd back to it */
+static int
+AddClientFd(int i, int fd)
+{
+    int		sts;
+
+    if (fd >= fdClientSize) {
+	int	j, size = fdClientSize ? fdClientSize : 64;
+
+	while (size <= fd)
+	    size *= 2;
+	fdClient = (int *)realloc(fdClient, size * sizeof(fdClient[0]));
+	if (fdClient == NULL) {
+	    __pmNoMem("AddClientFd", size * sizeof(fdClient[0]), PM_RECOV_ERR);
+	    Shutdown();
+	    exit(1);
+	}
+	for (j = fdClientSize; j < size; j++)
+	    fdClient[j] = -1;
+	fdClientSize = size;
+    }
+    if ((sts = __pmPollSetAdd(pollFds, fd)) < 0)
+	return sts;
+    fdClient[fd] = i;
+    return 0;
+}
+
+/* Map a client socket to its client, NULL if fd is not one */
+ClientInfo *
+FdToClient(int fd)
+{
+    if (fd < 0 || fd >= fdClientSize || fdClient[fd] < 0)
+	return NULL;
+    return &client[fdClient[fd]];
+}
 
 /*
  * For PMDA_INTERFACE_5 or later PMDAs, post a notification that
@@ -79,7 +116,7 @@ ClientInfo *
 AcceptNewClient(int reqfd)
 {
     static unsigned int	seq = 0;
-    int			i, fd;
+    int			i, fd, sts;
     __pmSockLen		addrlen;
     struct timeval	now;
 
@@ -107,12 +144,8 @@ AcceptNewClient(int reqfd)
 	DeleteClient(&client[i]);
 	return NULL;	
     }
-    if (fd > maxClientFd)
-	maxClientFd = fd;
-
     pmcd_openfds_sethi(fd);
 
-    __pmFD_SET(fd, &clientFds);
     __pmSetVersionIPC(fd, UNKNOWN_VERSION);	/* before negotiation */
     __pmSetSocketIPC(fd);
 
@@ -122,6 +155,13 @@ AcceptNewClient(int reqfd)
     client[i].status.changes = 0;
     memset(&client[i].attrs, 0, sizeof(__pmHashCtl));
 
+    if ((sts = AddClientFd(i, fd)) < 0) {
+	__pmNotifyErr(LOG_ERR, "AcceptNewClient(%d): client fd %d: %s\n",
+			reqfd, fd, pmErrStr(sts));
+	DeleteClient(&client[i]);
+	return NULL;
+    }
+
     /*
      * Note seq needs to be unique, but we're using a free running counter
      * and not bothering to check here ... unless we churn through
@@ -193,7 +233,9 @@ DeleteClient(ClientInfo *cp)
 	return;
     }
     if (cp->fd != -1) {
-	__pmFD_CLR(cp->fd, &clientFds);
+	__pmPollSetDel(pollFds, cp->fd);
+	if (cp->fd < fdClientSize)
+	    fdClient[cp->fd] = -1;
 	__pmCloseSocket(cp->fd);
     }
     if (i == nClients-1) {
@@ -202,13 +244,6 @@ DeleteClient(ClientInfo *cp)
 	    i--;
 	nClients = (i >= 0) ? i + 1 : 0;
     }
-    if (cp->fd == maxClientFd) {
-	maxClientFd = -1;
-	for (i = 0; i < nClients; i++) {
-	    if (client[i].fd > maxClientFd)
-		maxClientFd = client[i].fd;
-	}
-    }
     for (i = 0; i < cp->szProfile; i++) {
 	if (cp->profile[i] != NULL) {
 	    __pmFreeProfile(cp->profile[i]);
@@ -39,14 +39,14 @@ typedef struct {
 
 PMCD_DATA extern ClientInfo *client;		/* Array of clients */
 PMCD_DATA extern int	nClients;		/* Number of entries in array */
-extern int		maxClientFd;		/* largest fd for a client */
-extern __pmFdSet	clientFds;		/* for client select() */
+extern __pmPollSet	*pollFds;		/* clients, request ports, agents */
 PMCD_DATA extern int	this_client_id;		/* client for current request */
 
 /* prototypes */
 extern ClientInfo *AcceptNewClient(int);
 extern int NewClient(void);
 extern void DeleteClient(ClientInfo *);
+extern ClientInfo *FdToClient(int);
 PMCD_CALL extern ClientInfo *GetClient(int);
 PMCD_CALL extern int SetClientAttribute(int, int, char *);
 PMCD_CALL extern void ShowClients(FILE *m);
@@ -575,6 +575,7 @@ FreeAgent(AgentInfo *ap)
     char	**argv = NULL;
 
     free(ap->pmDomainLabel);
+    ClearFetchCache(ap);
     if (ap->ipcType == AGENT_DSO) {
 	free(ap->ipc.dso.pathName);
 	free(ap->ipc.dso.entryPoint);
@@ -2094,7 +2095,7 @@ GetAgentDso(AgentInfo *aPtr)
     }
 
     if (dso->dispatch.comm.pmda_interface < PMDA_INTERFACE_2 ||
-	dso->dispatch.comm.pmda_interface > PMDA_INTERFACE_LATEST) {
+	dso->dispatch.comm.pmda_interface > PMDA_INTERFACE_7) {
 	__pmNotifyErr(LOG_ERR,
 		 "Unknown PMDA interface version (%d) used by DSO %s\n",
 		 dso->dispatch.comm.pmda_interface, aPtr->pmDomainLabel);
@@ -2176,6 +2177,7 @@ ContactAgents(void)
 		pmcd_trace(TR_ADD_AGENT, aPtr->pmDomainId, aPtr->inFd, aPtr->outFd);
 	    MarkStateChanges(PMCD_ADD_AGENT);
 	    aPtr->status.notReady = aPtr->status.startNotReady;
+	    aPtr->status.lagging = 0;
 	}
 	else
 	    aPtr->reason = REASON_NOSTART;
@@ -2401,37 +2403,41 @@ ParseRestartAgents(char *fileName)
     AgentInfo	*oldAgent;
     int		oldNAgents;
     AgentInfo	*ap;
-    __pmFdSet	fds;
+    int		*fds;
+    int		*ready;
 
     /* Clean up any deceased agents.  We haven't seen an agent's death unless
      * a PDU transfer involving the agent has occurred.  This cleans up others
      * as well.
      */
-    __pmFD_ZERO(&fds);
-    j = -1;
+    fds = (int *)malloc(2 * nAgents * sizeof(int));
+    if (nAgents > 0 && fds == NULL)
+	__pmNoMem("ParseRestartAgents.fds", 2 * nAgents * sizeof(int), PM_FATAL_ERR);
+    ready = fds + nAgents;
+    j = 0;
     for (i = 0; i < nAgents; i++) {
 	ap = &agent[i];
 	if (ap->status.connected &&
 	    (ap->ipcType == AGENT_SOCKET || ap->ipcType == AGENT_PIPE)) {
-
-	    __pmFD_SET(ap->outFd, &fds);
-	    if (ap->outFd > j)
-		j = ap->outFd;
+	    fds[i] = ap->outFd;
+	    j++;
 	}
+	else
+	    fds[i] = -1;
     }
-    if (++j) {
+    if (j) {
 	/* any agent with output ready has either closed the file descriptor or
 	 * sent an unsolicited PDU.  Clean up the agent in either case.
 	 */
 	struct timeval	timeout = {0, 0};
 
-	sts = __pmSelectRead(j, &fds, &timeout);
+	sts = __pmPollFds(nAgents, fds, ready, 0, &timeout);
 	if (sts > 0) {
 	    for (i = 0; i < nAgents; i++) {
 		ap = &agent[i];
 		if (ap->status.connected &&
 		    (ap->ipcType == AGENT_SOCKET || ap->ipcType == AGENT_PIPE) &&
-		    __pmFD_ISSET(ap->outFd, &fds)) {
+		    ready[i]) {
 
 		    /* try to discover more ... */
 		    __pmPDU	*pb;
@@ -2454,6 +2460,7 @@ ParseRestartAgents(char *fileName)
 	    fprintf(stderr, "pmcd: deceased agents select: %s\n",
 			 netstrerror());
     }
+    free(fds);
 
     /* gather any deceased children */
     HarvestAgents(0);
@@ -178,12 +178,17 @@ MakeBadResult(int npmids, pmID *list, int sts)
     if (result == NULL) {
 	__pmNoMem("MakeBadResult.result", need, PM_FATAL_ERR);
     }
+    /*
+     * All of the pmValueSets go in one pinned PDU buffer, released by
+     * __pmFreeResultValues() with a single unpin
+     */
+    need = npmids * (int)sizeof(pmValueSet);
+    vSet = (pmValueSet *)__pmFindPDUBuf(need);
+    if (vSet == NULL) {
+	__pmNoMem("MakeBadResult.vSet", need, PM_FATAL_ERR);
+    }
     result->numpmid = npmids;
-    for (i = 0; i < npmids; i++) {
-	vSet = (pmValueSet *)malloc(sizeof(pmValueSet));
-	if (vSet == NULL) {
-	    __pmNoMem("MakeBadResult.vSet", sizeof(pmValueSet), PM_FATAL_ERR);
-	}
+    for (i = 0; i < npmids; i++, vSet++) {
 	result->vset[i] = vSet;
 	vSet->pmid = list[i];
 	vSet->numval = sts;
@@ -191,6 +196,175 @@ MakeBadResult(int npmids, pmID *list, int sts)
     return result;
 }
 
+/*
+ * With a coalescing window (-W), the last result from each daemon agent
+ * is kept (along with the pinned PDU its values point into), and a later
+ * fetch of the same pmIDs with the same instance profile that arrives
+ * within the window is answered from it without another round-trip to
+ * the agent.
+ */
+typedef struct FetchCache {
+    int			npmids;
+    pmID		*pmids;
+    __pmProfile		*profile;
+    struct timeval	when;		/* when the fetch was sent */
+    pmResult		*result;
+} FetchCache;
+
+void
+ClearFetchCache(AgentInfo *ap)
+{
+    FetchCache	*fcp = ap->fetchCache;
+
+    if (fcp == NULL)
+	return;
+    free(fcp->pmids);
+    __pmFreeProfile(fcp->profile);
+    if (fcp->result != NULL)
+	pmFreeResult(fcp->result);
+    free(fcp);
+    ap->fetchCache = NULL;
+}
+
+static __pmProfile *
+DupProfile(const __pmProfile *prof)
+{
+    __pmProfile		*copy;
+    __pmInDomProfile	*ip;
+    int			i;
+
+    if ((copy = (__pmProfile *)calloc(1, sizeof(*copy))) == NULL)
+	return NULL;
+    copy->state = prof->state;
+    if (prof->profile_len == 0)
+	return copy;
+    copy->profile = (__pmInDomProfile *)calloc(prof->profile_len, sizeof(*ip));
+    if (copy->profile == NULL) {
+	free(copy);
+	return NULL;
+    }
+    copy->profile_len = prof->profile_len;
+    for (i = 0; i < prof->profile_len; i++) {
+	ip = &copy->profile[i];
+	*ip = prof->profile[i];
+	ip->instances = NULL;
+	if (ip->instances_len == 0)
+	    continue;
+	ip->instances = (int *)malloc(ip->instances_len * sizeof(int));
+	if (ip->instances == NULL) {
+	    __pmFreeProfile(copy);
+	    return NULL;
+	}
+	memcpy(ip->instances, prof->profile[i].instances,
+		ip->instances_len * sizeof(int));
+    }
+    return copy;
+}
+
+static int
+SameProfile(const __pmProfile *a, const __pmProfile *b)
+{
+    const __pmInDomProfile	*pa, *pb;
+    int				i;
+
+    if (a->state != b->state || a->profile_len != b->profile_len)
+	return 0;
+    for (i = 0; i < a->profile_len; i++) {
+	pa = &a->profile[i];
+	pb = &b->profile[i];
+	if (pa->indom != pb->indom || pa->state != pb->state ||
+	    pa->instances_len != pb->instances_len)
+	    return 0;
+	if (pa->instances_len != 0 &&
+	    memcmp(pa->instances, pb->instances, pa->instances_len * sizeof(int)) != 0)
+	    return 0;
+    }
+    return 1;
+}
+
+/*
+ * Only agents that answer every client alike are eligible ... not DSOs
+ * (pmcd's own metrics differ per client), not agents that are sent the
+ * client's credentials or container, and not results with event records
+ * which are consumed per client context.
+ */
+static int
+Coalescable(AgentInfo *ap, pmResult *rp)
+{
+    pmValueSet	*vsp;
+    int		i, j;
+
+    if (ap->ipcType == AGENT_DSO ||
+	(ap->status.flags & (PDU_FLAG_AUTH|PDU_FLAG_CONTAINER)) != 0)
+	return 0;
+    for (i = 0; i < rp->numpmid; i++) {
+	vsp = rp->vset[i];
+	if (vsp->valfmt == PM_VAL_INSITU)
+	    continue;
+	for (j = 0; j < vsp->numval; j++) {
+	    if (vsp->vlist[j].value.pval->vtype == PM_TYPE_EVENT ||
+		vsp->vlist[j].value.pval->vtype == PM_TYPE_HIGHRES_EVENT)
+		return 0;
+	}
+    }
+    return 1;
+}
+
+/* Keep the result from ap for later fetches, return 1 if it was kept */
+static int
+SaveFetchCache(AgentInfo *ap, DomPmidList *dpList, __pmProfile *prof,
+		pmResult *rp)
+{
+    FetchCache	*fcp;
+
+    ClearFetchCache(ap);
+    if (!Coalescable(ap, rp))
+	return 0;
+    if ((fcp = (FetchCache *)calloc(1, sizeof(*fcp))) == NULL)
+	return 0;
+    fcp->pmids = (pmID *)malloc(dpList->listSize * sizeof(pmID));
+    fcp->profile = DupProfile(prof);
+    if (fcp->pmids == NULL || fcp->profile == NULL) {
+	free(fcp->pmids);
+	__pmFreeProfile(fcp->profile);
+	free(fcp);
+	return 0;
+    }
+    fcp->npmids = dpList->listSize;
+    memcpy(fcp->pmids, dpList->list, dpList->listSize * sizeof(pmID));
+    fcp->when = ap->fetchTime;
+    fcp->result = rp;
+    ap->fetchCache = fcp;
+    return 1;
+}
+
+/* Result of an identical fetch sent to ap within the window, else NULL */
+static pmResult *
+FindFetchCache(AgentInfo *ap, DomPmidList *dpList, __pmProfile *prof,
+		double window)
+{
+    FetchCache		*fcp = ap->fetchCache;
+    struct timeval	now;
+
+    if (fcp == NULL || ap->status.notReady)
+	return NULL;
+    __pmtimevalNow(&now);
+    if (__pmtimevalSub(&now, &fcp->when) >= window) {
+	ClearFetchCache(ap);
+	return NULL;
+    }
+    if (fcp->npmids != dpList->listSize ||
+	memcmp(fcp->pmids, dpList->list, fcp->npmids * sizeof(pmID)) != 0 ||
+	!SameProfile(fcp->profile, prof))
+	return NULL;
+#ifdef PCP_DEBUG
+    if (pmDebug & DBG_TRACE_APPL0)
+	fprintf(stderr, "FindFetchCache: %d metrics for PMDA domain %d from result %.3f sec old\n",
+	    dpList->listSize, dpList->domain, __pmtimevalSub(&now, &fcp->when));
+#endif
+    return fcp->result;
+}
+
 static pmResult *
 SendFetch(DomPmidList *dpList, AgentInfo *aPtr, ClientInfo *cPtr, int ctxnum)
 {
@@ -345,25 +519,40 @@ DoFetch(ClientInfo *cip, __pmPDU* pb)
     static int		nDoms = 0;
     static pmResult	**results = NULL;
     static int		*resIndex = NULL;
-    __pmFdSet		waitFds;
-    __pmFdSet		readyFds;
+    static int		*waitFds = NULL;	/* per-agent, -1 if not busy */
+    static int		*readyFds = NULL;	/* per-agent, from __pmPollFds */
+    static int		*cached = NULL;		/* per-agent, result in fetchCache */
     int			nWait;
-    int			maxFd;
     struct timeval	timeout;
+    struct timeval	now;
+    double		deadline;
+    double		left;
+    double		window;
 
     if (nAgents > nDoms) {
 	if (results != NULL)
 	    free(results);
 	if (resIndex != NULL)
 	    free(resIndex);
+	if (waitFds != NULL)
+	    free(waitFds);
+	if (readyFds != NULL)
+	    free(readyFds);
+	if (cached != NULL)
+	    free(cached);
 	results = (pmResult **)malloc((nAgents + 1) * sizeof (pmResult *));
 	resIndex = (int *)malloc((nAgents + 1) * sizeof(int));
-	if (results == NULL || resIndex == NULL) {
-	    __pmNoMem("DoFetch.results", (nAgents + 1) * sizeof (pmResult *) + (nAgents + 1) * sizeof(int), PM_FATAL_ERR);
+	waitFds = (int *)malloc(nAgents * sizeof(int));
+	readyFds = (int *)malloc(nAgents * sizeof(int));
+	cached = (int *)malloc(nAgents * sizeof(int));
+	if (results == NULL || resIndex == NULL ||
+	    waitFds == NULL || readyFds == NULL || cached == NULL) {
+	    __pmNoMem("DoFetch.results", (nAgents + 1) * sizeof (pmResult *) + (4 * nAgents + 1) * sizeof(int), PM_FATAL_ERR);
 	}
 	nDoms = nAgents;
     }
     memset(results, 0, (nAgents + 1) * sizeof(results[0]));
+    memset(cached, 0, nAgents * sizeof(cached[0]));
 
     sts = __pmDecodeFetch(pb, &ctxnum, &when, &nPmids, &pmidList);
     if (sts < 0)
@@ -397,20 +586,23 @@ DoFetch(ClientInfo *cip, __pmPDU* pb)
      * of pmIDs to the appropriate agent.  For DSO agents, the pmResult will
      * come back immediately.  If a request cannot be sent to an agent, a
      * suitable pmResult (containing metric not available values) will be
-     * returned.
+     * returned.  Within the coalescing window, an agent's last result is
+     * reused for an identical request.
      */
-    __pmFD_ZERO(&waitFds);
+    window = __pmtimevalToReal(&_pmcd_coalesce);
     nWait = 0;
-    maxFd = -1;
     for (i = 0; dList[i].domain != -1; i++) {
 	j = mapdom[dList[i].domain];
+	if (window > 0 &&
+	    (results[j] = FindFetchCache(&agent[j], &dList[i],
+					 cip->profile[ctxnum], window)) != NULL) {
+	    cached[j] = 1;
+	    continue;
+	}
 	results[j] = SendFetch(&dList[i], &agent[j], cip, ctxnum);
 	if (results[j] == NULL) { /* Wait for agent's response */
-	    int fd = agent[j].outFd;
 	    agent[j].status.busy = 1;
-	    __pmFD_SET(fd, &waitFds);
-	    if (fd > maxFd)
-		maxFd = fd;
+	    __pmtimevalNow(&agent[j].fetchTime);
 	    nWait++;
 	}
     }
@@ -418,18 +610,75 @@ DoFetch(ClientInfo *cip, __pmPDU* pb)
     if (dList[i].listSize != 0)
 	results[nAgents] = MakeBadResult(dList[i].listSize, dList[i].list, PM_ERR_NOAGENT);
 
+    /*
+     * With a fetch deadline (-F) shorter than the PMDA timeout, each
+     * agent gets until its own deadline to respond and then the client
+     * is answered without it, so a timed wait is needed even for one agent.
+     */
+    deadline = __pmtimevalToReal(&_pmcd_deadline);
+    if (_pmcd_timeout > 0 && deadline >= _pmcd_timeout)
+	deadline = 0;
+
     /* Wait for results to roll in from agents */
     while (nWait > 0) {
-        __pmFD_COPY(&readyFds, &waitFds);
-	if (nWait > 1) {
-	    timeout.tv_sec = _pmcd_timeout;
-	    timeout.tv_usec = 0;
+	for (i = 0; i < nAgents; i++) {
+	    waitFds[i] = agent[i].status.busy ? agent[i].outFd : -1;
+	    readyFds[i] = 1;
+	}
+	if (nWait > 1 || deadline > 0) {
+	    if (deadline > 0) {
+		__pmtimevalNow(&now);
+		left = deadline;
+		for (i = 0; i < nAgents; i++) {
+		    if (agent[i].status.busy &&
+			deadline - __pmtimevalSub(&now, &agent[i].fetchTime) < left)
+			left = deadline - __pmtimevalSub(&now, &agent[i].fetchTime);
+		}
+		__pmtimevalFromReal(left > 0 ? left : 0, &timeout);
+	    }
+	    else {
+		timeout.tv_sec = _pmcd_timeout;
+		timeout.tv_usec = 0;
+	    }
 
             retry:
 	    setoserror(0);
-	    sts = __pmSelectRead(maxFd+1, &readyFds, &timeout);
-
-	    if (sts == 0) {
+	    sts = __pmPollFds(nAgents, waitFds, readyFds, 0, &timeout);
+
+	    if (sts == 0 && deadline > 0) {
+		/*
+		 * Deadline passed, reply with PM_ERR_AGAIN for these agents.
+		 * They stay notReady until their overdue result arrives and
+		 * is discarded by HandleLateAgent(), or until the PMDA
+		 * timeout expires and ExpireLateAgents() cleans them up.
+		 */
+		__pmtimevalNow(&now);
+		for (i = 0; i < nAgents; i++) {
+		    if (!agent[i].status.busy ||
+			deadline - __pmtimevalSub(&now, &agent[i].fetchTime) > 0.001)
+			continue;
+		    /* Find entry in dList for this agent */
+		    for (j = 0; dList[j].domain != -1; j++)
+			if (dList[j].domain == agent[i].pmDomainId)
+			    break;
+		    if (dList[j].domain != -1)
+			results[i] = MakeBadResult(dList[j].listSize,
+						   dList[j].list,
+						   PM_ERR_AGAIN);
+		    pmcd_trace(TR_RECV_TIMEOUT, agent[i].outFd, PDU_RESULT, 0);
+#ifdef PCP_DEBUG
+		    if (pmDebug & DBG_TRACE_APPL0)
+			__pmNotifyErr(LOG_INFO, "DoFetch: \"%s\" agent missed fetch deadline\n",
+				     agent[i].pmDomainLabel);
+#endif
+		    agent[i].status.busy = 0;
+		    agent[i].status.notReady = 1;
+		    agent[i].status.lagging = 1;
+		    nWait--;
+		}
+		continue;
+	    }
+	    else if (sts == 0) {
 		__pmNotifyErr(LOG_INFO, "DoFetch: select timeout");
 
 		/* Timeout, terminate agents with undelivered results */
@@ -463,16 +712,15 @@ DoFetch(ClientInfo *cip, __pmPDU* pb)
 	for (i = 0; i < nAgents; i++) {
 	    AgentInfo	*ap = &agent[i];
 	    int		pinpdu;
-	    if (!ap->status.busy || !__pmFD_ISSET(ap->outFd, &readyFds))
+	    if (!ap->status.busy || !readyFds[i])
 		continue;
 	    ap->status.busy = 0;
-	    __pmFD_CLR(ap->outFd, &waitFds);
 	    nWait--;
 	    pinpdu = sts = __pmGetPDU(ap->outFd, ANY_SIZE, _pmcd_timeout, &pb);
 	    if (sts > 0)
 		pmcd_trace(TR_RECV_PDU, ap->outFd, sts, (int)((__psint_t)pb & 0xffffffff));
 	    if (sts == PDU_RESULT) {
-		if ((sts = __pmDecodeResult(pb, &results[i])) >= 0)
+		if ((sts = __pmDecodeResult(pb, &results[i])) >= 0) {
 		    if (results[i]->numpmid != aFreq[i]) {
 			pmFreeResult(results[i]);
 			sts = PM_ERR_IPC;
@@ -482,6 +730,16 @@ DoFetch(ClientInfo *cip, __pmPDU* pb)
 					 ap->pmDomainLabel, aFreq[i], results[i]->numpmid);
 #endif
 		    }
+		    else if (window > 0) {
+			/* Find entry in dList for this agent */
+			for (j = 0; dList[j].domain != -1; j++)
+			    if (dList[j].domain == agent[i].pmDomainId)
+				break;
+			if (dList[j].domain != -1)
+			    cached[i] = SaveFetchCache(ap, &dList[j],
+					cip->profile[ctxnum], results[i]);
+		    }
+		}
 	    }
 	    else {
 		if (sts == PDU_ERROR) {
@@ -566,6 +824,9 @@ DoFetch(ClientInfo *cip, __pmPDU* pb)
      */
     for (i = 0; dList[i].domain != -1; i++) {
 	j = mapdom[dList[i].domain];
+	if (cached[j])
+	    /* Owned by the agent's fetchCache, freed when that is cleared */
+	    continue;
 	if (agent[j].ipcType == AGENT_DSO && agent[j].status.connected &&
 	    !agent[j].status.madeDsoResult)
 	    /* Living DSO's manage their own pmResult skeleton unless
@@ -584,3 +845,111 @@ DoFetch(ClientInfo *cip, __pmPDU* pb)
     __pmUnpinPDUBuf(pmidList);
     return 0;
 }
+
+/*
+ * Overdue result from an agent that missed the fetch deadline ... the
+ * client has already been answered, so consume and discard it, and
+ * the agent can be sent PDUs again.
+ */
+int
+HandleLateAgent(AgentInfo *ap)
+{
+    int		pinpdu;
+    int		sts;
+    int		s;
+    int		notReady = 0;
+    __pmPDU	*pb;
+
+    pinpdu = sts = __pmGetPDU(ap->outFd, ANY_SIZE, _pmcd_timeout, &pb);
+    if (sts > 0)
+	pmcd_trace(TR_RECV_PDU, ap->outFd, sts, (int)((__psint_t)pb & 0xffffffff));
+    if (sts == PDU_RESULT)
+	sts = 0;
+    else if (sts == PDU_ERROR) {
+	if ((s = __pmDecodeError(pb, &sts)) < 0)
+	    sts = s;
+	else {
+	    /* agent failed the fetch, that's fine too */
+	    pmcd_trace(TR_RECV_ERR, ap->outFd, PDU_RESULT, sts);
+	    notReady = (sts == PM_ERR_PMDANOTREADY);
+	    sts = 0;
+	}
+    }
+    else if (sts >= 0) {
+	pmcd_trace(TR_WRONG_PDU, ap->outFd, PDU_RESULT, sts);
+	sts = PM_ERR_IPC;
+    }
+    else
+	pmcd_trace(TR_RECV_ERR, ap->outFd, PDU_RESULT, sts);
+    if (pinpdu > 0)
+	__pmUnpinPDUBuf(pb);
+
+#ifdef PCP_DEBUG
+    if (pmDebug & DBG_TRACE_APPL0)
+	__pmNotifyErr(LOG_INFO, "HandleLateAgent: \"%s\" agent overdue result: %s\n",
+		     ap->pmDomainLabel, pmErrStr(sts));
+#endif
+    if (sts < 0) {
+	CleanupAgent(ap, AT_COMM, ap->outFd);
+	return sts;
+    }
+    ap->status.lagging = 0;
+    ap->status.notReady = notReady;	/* wait for PM_ERR_PMDAREADY */
+    return 0;
+}
+
+/*
+ * Time until the first agent that missed a fetch deadline reaches the
+ * PMDA timeout, for the ClientLoop select ... NULL if there are no such
+ * agents or timeouts are off.
+ */
+struct timeval *
+LateAgentTimeout(struct timeval *tv)
+{
+    struct timeval	now;
+    double		left = 0;
+    double		t;
+    int			found = 0;
+    int			i;
+
+    if (_pmcd_timeout == 0)
+	return NULL;
+    __pmtimevalNow(&now);
+    for (i = 0; i < nAgents; i++) {
+	if (!agent[i].status.lagging)
+	    continue;
+	t = _pmcd_timeout - __pmtimevalSub(&now, &agent[i].fetchTime);
+	if (!found || t < left)
+	    left = t;
+	found = 1;
+    }
+    if (!found)
+	return NULL;
+    __pmtimevalFromReal(left > 0 ? left : 0, tv);
+    return tv;
+}
+
+/*
+ * Agents that missed a fetch deadline and have still not responded
+ * within the PMDA timeout are treated as hung, as DoFetch would have
+ * done without the deadline.
+ */
+void
+ExpireLateAgents(void)
+{
+    struct timeval	now;
+    int			i;
+
+    if (_pmcd_timeout == 0)
+	return;
+    __pmtimevalNow(&now);
+    for (i = 0; i < nAgents; i++) {
+	if (!agent[i].status.lagging ||
+	    __pmtimevalSub(&now, &agent[i].fetchTime) < _pmcd_timeout)
+	    continue;
+	__pmNotifyErr(LOG_INFO, "ExpireLateAgents: \"%s\" agent timeout",
+		     agent[i].pmDomainLabel);
+	pmcd_trace(TR_RECV_TIMEOUT, agent[i].outFd, PDU_RESULT, 0);
+	CleanupAgent(&agent[i], AT_COMM, agent[i].inFd);
+    }
+}
@@ -134,10 +134,10 @@ DoStore(ClientInfo *cp, __pmPDU* pb)
     pmResult	*result;
     pmResult	**dResult;
     int		i;
-    __pmFdSet	readyFds;
-    __pmFdSet	waitFds;
+    static int	*readyFds;		/* per-agent, from __pmPollFds */
+    static int	*waitFds;		/* per-agent, -1 if not busy */
+    static int	nFds;
     int		nWait = 0;
-    int		maxFd = -1;
     int		badStore;		/* != 0 => store to nonexistent agent */
     int		notReady = 0;		/* != 0 => store to agent that's not ready */
     struct timeval	timeout;
@@ -148,11 +148,19 @@ DoStore(ClientInfo *cp, __pmPDU* pb)
 
     dResult = SplitResult(result);
 
+    if (nAgents > nFds) {
+	free(readyFds);
+	free(waitFds);
+	readyFds = (int *)malloc(nAgents * sizeof(int));
+	waitFds = (int *)malloc(nAgents * sizeof(int));
+	if (readyFds == NULL || waitFds == NULL)
+	    __pmNoMem("DoStore.waitFds", 2 * nAgents * sizeof(int), PM_FATAL_ERR);
+	nFds = nAgents;
+    }
+
     /* Send the per-domain results to their respective agents */
 
-    __pmFD_ZERO(&waitFds);
     for (i = 0; dResult[i]->numpmid > 0; i++) {
-	int fd;
 	ap = FindDomainAgent(((__pmID_int *)&dResult[i]->vset[0]->pmid)->domain);
 	/* If it's in a "good" list, pmID has agent that is connected */
 	assert(ap != NULL);
@@ -164,16 +172,14 @@ DoStore(ClientInfo *cp, __pmPDU* pb)
 				       ap->ipc.dso.dispatch.version.any.ext);
 	}
 	else {
+	    /* values from before the store must not be coalesced after it */
+	    ClearFetchCache(ap);
 	    if (ap->status.notReady == 0) {
 		/* agent is ready for PDUs */
 		pmcd_trace(TR_XMIT_PDU, ap->inFd, PDU_RESULT, dResult[i]->numpmid);
 		s = __pmSendResult(ap->inFd, cp - client, dResult[i]);
 		if (s >= 0) {
 		    ap->status.busy = 1;
-		    fd = ap->outFd;
-		    __pmFD_SET(fd, &waitFds);
-		    if (fd > maxFd)
-			maxFd = fd;
 		    nWait++;
 		}
 		else if (s == PM_ERR_IPC || sts == PM_ERR_TIMEOUT || s == -EPIPE) {
@@ -200,14 +206,17 @@ DoStore(ClientInfo *cp, __pmPDU* pb)
     /* Collect error PDUs containing store status from each active agent */
 
     while (nWait > 0) {
-        __pmFD_COPY(&readyFds, &waitFds);
+	for (i = 0; i < nAgents; i++) {
+	    waitFds[i] = agent[i].status.busy ? agent[i].outFd : -1;
+	    readyFds[i] = 1;
+	}
 	if (nWait > 1) {
 	    timeout.tv_sec = _pmcd_timeout;
 	    timeout.tv_usec = 0;
 
 	    retry:
 	    setoserror(0);
-	    s = __pmSelectRead(maxFd+1, &readyFds, &timeout);
+	    s = __pmPollFds(nAgents, waitFds, readyFds, 0, &timeout);
 
 	    if (s == 0) {
 		__pmNotifyErr(LOG_INFO, "DoStore: select timeout");
@@ -236,10 +245,9 @@ DoStore(ClientInfo *cp, __pmPDU* pb)
 	for (i = 0; i < nAgents; i++) {
 	    int		pinpdu;
 	    ap = &agent[i];
-	    if (!ap->status.busy || !__pmFD_ISSET(ap->outFd, &readyFds))
+	    if (!ap->status.busy || !readyFds[i])
 		continue;
 	    ap->status.busy = 0;
-	    __pmFD_CLR(ap->outFd, &waitFds);
 	    nWait--;
 	    pinpdu = s = __pmGetPDU(ap->outFd, ANY_SIZE, _pmcd_timeout, &pb);
 	    if (s > 0)
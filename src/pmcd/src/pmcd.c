@@ -33,6 +33,7 @@ int		AgentPendingRestart;	/* for automatic restart */
 static int	timeToDie;		/* For SIGINT handling */
 static int	restart;		/* For SIGHUP restart */
 static int	maxReqPortFd;		/* Largest request port fd */
+static __pmFdSet reqPortFds;		/* Request port fds */
 static char	configFileName[MAXPATHLEN]; /* path to pmcd.conf */
 static char	*logfile = "pmcd.log";	/* log file name */
 static int	run_daemon = 1;		/* run as a daemon, see -f */
@@ -101,6 +102,8 @@ static pmLongOptions longopts[] = {
     { "certdb", 1, 'C', "PATH", "path to NSS certificate database" },
     { "passfile", 1, 'P', "PATH", "password file for certificate database access" },
     { "", 1, 'L', "BYTES", "maximum size for PDUs from clients [default 65536]" },
+    { "", 1, 'F', "TIME", "PMDA fetch deadline, reply without late PMDAs [default none]" },
+    { "", 1, 'W', "TIME", "answer identical PMDA fetches within this window from one result [default none]" },
     { "", 1, 'q', "TIME", "PMDA initial negotiation timeout (seconds) [default 3]" },
     { "", 1, 't', "TIME", "PMDA response timeout (seconds) [default 5]" },
     { "verify", 0, 'v', 0, "check validity of pmcd configuration, then exit" },
@@ -117,7 +120,7 @@ static pmLongOptions longopts[] = {
 
 static pmOptions opts = {
     .flags = PM_OPTFLAG_POSIX,
-    .short_options = "Ac:C:D:fH:i:l:L:M:N:n:p:P:q:Qs:St:T:U:vx:?",
+    .short_options = "Ac:C:D:fF:H:i:l:L:M:N:n:p:P:q:Qs:St:T:U:vW:x:?",
     .long_options = longopts,
 };
 
@@ -164,6 +167,16 @@ ParseOptions(int argc, char *argv[], int *nports)
 		run_daemon = 0;
 		break;
 
+	    case 'F':
+		/* fetch deadline, after which slow PMDAs are not waited for */
+		if (pmParseInterval(opts.optarg, &_pmcd_deadline, &endptr) < 0) {
+		    pmprintf("%s: -F requires a time interval: %s\n",
+			pmProgname, endptr);
+		    free(endptr);
+		    opts.errors++;
+		}
+		break;
+
 	    case 'i':
 		/* one (of possibly several) interfaces for client requests */
 		__pmServerAddInterface(opts.optarg);
@@ -268,6 +281,16 @@ ParseOptions(int argc, char *argv[], int *nports)
 		verify = 1;
 		break;
 
+	    case 'W':
+		/* coalescing window for identical fetches to the same PMDA */
+		if (pmParseInterval(opts.optarg, &_pmcd_coalesce, &endptr) < 0) {
+		    pmprintf("%s: -W requires a time interval: %s\n",
+			pmProgname, endptr);
+		    free(endptr);
+		    opts.errors++;
+		}
+		break;
+
 	    case 'x':
 		fatalfile = opts.optarg;
 		break;
@@ -297,24 +320,26 @@ ParseOptions(int argc, char *argv[], int *nports)
 
 /*
  * Determine which clients (if any) have sent data to the server and handle it
- * as required.
+ * as required ... nready descriptors are ready in pollFds, and those closed
+ * since __pmPollSetWait() show up as -1.
  */
 void
-HandleClientInput(__pmFdSet *fdsPtr)
+HandleClientInput(int nready)
 {
     int		sts;
-    int		i;
+    int		i, r, fd;
     __pmPDU	*pb;
     __pmPDUHdr	*php;
     ClientInfo	*cp;
 
-    for (i = 0; i < nClients; i++) {
+    for (r = 0; r < nready; r++) {
 	int		pinpdu;
 
-	if (!client[i].status.connected || !__pmFD_ISSET(client[i].fd, fdsPtr))
+	if ((fd = __pmPollSetReady(pollFds, r)) < 0 ||
+	    (cp = FdToClient(fd)) == NULL || !cp->status.connected)
 	    continue;
 
-	cp = &client[i];
+	i = cp - client;
 	this_client_id = i;
 
 	pinpdu = sts = __pmGetPDU(cp->fd, LIMIT_SIZE, _pmcd_timeout, &pb);
@@ -581,11 +606,24 @@ SignalReloadPMNS(void)
     }
 }
 
+/* Was fd one of the nready descriptors from the last __pmPollSetWait()? */
+static int
+IsReady(int fd, int nready)
+{
+    int		i;
+
+    for (i = 0; i < nready; i++) {
+	if (__pmPollSetReady(pollFds, i) == fd)
+	    return 1;
+    }
+    return 0;
+}
+
 /* Process I/O on file descriptors from agents that were marked as not ready
  * to handle PDUs.
  */
 static int
-HandleReadyAgents(__pmFdSet *readyFds)
+HandleReadyAgents(int nready)
 {
     int		i, s, sts;
     int		fd;
@@ -596,9 +634,15 @@ HandleReadyAgents(__pmFdSet *readyFds)
 
     for (i = 0; i < nAgents; i++) {
 	ap = &agent[i];
-	if (ap->status.notReady) {
+	if (ap->status.notReady && ap->status.polled) {
 	    fd = ap->outFd;
-	    if (__pmFD_ISSET(fd, readyFds)) {
+	    if (ap->status.lagging) {
+		/* overdue fetch result, not a ready notification */
+		if (IsReady(fd, nready))
+		    HandleLateAgent(ap);
+		continue;
+	    }
+	    if (IsReady(fd, nready)) {
 		int		pinpdu;
 
 		/* Expect an error PDU containing PM_ERR_PMDAREADY */
@@ -731,54 +775,70 @@ static void
 ClientLoop(void)
 {
     int		i, fd, sts;
-    int		maxFd;
     int		checkAgents;
     int		reload_ns = 0;
     int		restartAgents = -1;	/* initial state unknown */
-    __pmFdSet	readableFds;
+    __pmFdSet	readyReqFds;
+    struct timeval	timeout;
 
     for (;;) {
 
-	/* Figure out which file descriptors to wait for input on.  Keep
-	 * track of the highest numbered descriptor for the select call.
-	 */
-	readableFds = clientFds;
-	maxFd = maxClientFd + 1;
-
 	/* If an agent was not ready, it may send an ERROR PDU to indicate it
-	 * is now ready.  Add such agents to the list of file descriptors.
+	 * is now ready.  Wait for input from such agents as well as from
+	 * clients and the request ports, and stop waiting for agents that
+	 * have since become ready.
 	 */
 	checkAgents = 0;
 	for (i = 0; i < nAgents; i++) {
 	    AgentInfo	*ap = &agent[i];
 
-	    if (ap->status.notReady) {
+	    if (ap->status.notReady && !ap->status.polled && ap->outFd != -1) {
 		fd = ap->outFd;
-		__pmFD_SET(fd, &readableFds);
-		if (fd > maxFd)
-		    maxFd = fd + 1;
-		checkAgents = 1;
+		if ((sts = __pmPollSetAdd(pollFds, fd)) < 0) {
+		    __pmNotifyErr(LOG_ERR, "ClientLoop: %s agent fd %d: %s\n",
+				 ap->pmDomainLabel, fd, pmErrStr(sts));
+		    continue;
+		}
+		ap->status.polled = 1;
 		if (pmDebug & DBG_TRACE_APPL0)
 		    __pmNotifyErr(LOG_INFO,
-				 "not ready: check %s agent on fd %d (max = %d)\n",
-				 ap->pmDomainLabel, fd, maxFd);
+				 "not ready: check %s agent on fd %d\n",
+				 ap->pmDomainLabel, fd);
+	    }
+	    else if (!ap->status.notReady && ap->status.polled) {
+		__pmPollSetDel(pollFds, ap->outFd);
+		ap->status.polled = 0;
 	    }
+	    if (ap->status.polled)
+		checkAgents = 1;
 	}
 
-	sts = __pmSelectRead(maxFd, &readableFds, NULL);
+	/* agents that missed a fetch deadline still have the PMDA timeout */
+	sts = __pmPollSetWait(pollFds, LateAgentTimeout(&timeout));
+	ExpireLateAgents();
 	if (sts > 0) {
-	    if (pmDebug & DBG_TRACE_APPL0)
-		for (i = 0; i <= maxClientFd; i++)
-		    if (__pmFD_ISSET(i, &readableFds))
-			fprintf(stderr, "DATA: from %s (fd %d)\n",
-				FdToString(i), i);
-	    __pmServerAddNewClients(&readableFds, CheckNewClient);
+	    /*
+	     * Request ports are few and opened first, so __pmServerAddNewClients
+	     * is still handed an fd_set ... clients and agents are found from
+	     * the ready descriptors, not by scanning every connection.
+	     */
+	    __pmFD_ZERO(&readyReqFds);
+	    for (i = 0; i < sts; i++) {
+		if ((fd = __pmPollSetReady(pollFds, i)) < 0)
+		    continue;
+		if (pmDebug & DBG_TRACE_APPL0)
+		    fprintf(stderr, "DATA: from %s (fd %d)\n",
+			    FdToString(fd), fd);
+		if (fd <= maxReqPortFd && __pmFD_ISSET(fd, &reqPortFds))
+		    __pmFD_SET(fd, &readyReqFds);
+	    }
+	    __pmServerAddNewClients(&readyReqFds, CheckNewClient);
 	    if (checkAgents)
-		reload_ns = HandleReadyAgents(&readableFds);
-	    HandleClientInput(&readableFds);
+		reload_ns = HandleReadyAgents(sts);
+	    HandleClientInput(sts);
 	}
 	else if (sts == -1 && neterror() != EINTR) {
-	    __pmNotifyErr(LOG_ERR, "ClientLoop select: %s\n", netstrerror());
+	    __pmNotifyErr(LOG_ERR, "ClientLoop poll: %s\n", netstrerror());
 	    break;
 	}
 	if (AgentDied) {
@@ -891,7 +951,7 @@ SigBad(int sig)
 int
 main(int argc, char *argv[])
 {
-    int		sts;
+    int		i, sts;
     int		nport = 0;
     int		localhost = 0;
     int		maxpending = MAXPENDING;
@@ -949,9 +1009,22 @@ main(int argc, char *argv[])
     __pmSetSignalHandler(SIGBUS, SigBad);
     __pmSetSignalHandler(SIGSEGV, SigBad);
 
-    if ((sts = __pmServerOpenRequestPorts(&clientFds, maxpending)) < 0)
+    if ((sts = __pmServerOpenRequestPorts(&reqPortFds, maxpending)) < 0)
 	DontStart();
-    maxReqPortFd = maxClientFd = sts;
+    maxReqPortFd = sts;
+    if ((pollFds = __pmPollSetCreate()) == NULL) {
+	__pmNotifyErr(LOG_ERR, "pmcd: __pmPollSetCreate: %s\n",
+			pmErrStr(-oserror()));
+	DontStart();
+    }
+    for (i = 0; i <= maxReqPortFd; i++) {
+	if (__pmFD_ISSET(i, &reqPortFds) &&
+	    (sts = __pmPollSetAdd(pollFds, i)) < 0) {
+	    __pmNotifyErr(LOG_ERR, "pmcd: request port fd %d: %s\n",
+			    i, pmErrStr(sts));
+	    DontStart();
+	}
+    }
 
     /*
      * would prefer open log earlier so any messages up to this point
@@ -1103,9 +1176,6 @@ CleanupClient(ClientInfo *cp, int sts)
     pmcd_trace(TR_DEL_CLIENT, cp-client, cp->fd, sts);
     DeleteClient(cp);
 
-    if (maxClientFd < maxReqPortFd)
-	maxClientFd = maxReqPortFd;
-
     for (i = 0; i < nAgents; i++)
 	if (agent[i].profClient == cp)
 	    agent[i].profClient = NULL;
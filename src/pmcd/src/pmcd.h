@@ -92,7 +92,9 @@ typedef struct {
 	    restartKeep : 1,		/* Keep agent if set during restart */
 	    notReady : 1,		/* Agent not ready to process PDUs */
 	    startNotReady : 1,		/* Agent starts in non-ready state */
-	    unused : 8,			/* Zero-padded, unused space */
+	    lagging : 1,		/* Missed fetch deadline, result owed */
+	    polled : 1,			/* outFd is in pollFds */
+	    unused : 6,			/* Zero-padded, unused space */
 	    flags : 16;			/* Agent-supplied connection flags */
     } status;
     int		reason;			/* if ! connected */
@@ -101,6 +103,8 @@ typedef struct {
 	SocketInfo socket;
 	PipeInfo   pipe;
     } ipc;
+    struct timeval fetchTime;		/* When last fetch was sent */
+    struct FetchCache *fetchCache;	/* Last result, for coalescing (-W) */
 } AgentInfo;
 
 PMCD_DATA extern AgentInfo	*agent;		/* Array of domain agent structs */
@@ -154,6 +158,12 @@ extern int	pmdarootfd;
 /* timeout to PMDAs (secs) */
 PMCD_DATA extern int	_pmcd_timeout;
 
+/* fetch deadline for PMDAs, partial results after this (zero => none) */
+PMCD_DATA extern struct timeval	_pmcd_deadline;
+
+/* window for answering identical PMDA fetches from one result (zero => none) */
+PMCD_DATA extern struct timeval	_pmcd_coalesce;
+
 /* timeout for credentials */
 extern int	_creds_timeout;
 
@@ -210,6 +220,10 @@ extern int DoPMNSIDs(ClientInfo *, __pmPDU *);
 extern int DoPMNSNames(ClientInfo *, __pmPDU *);
 extern int DoPMNSChild(ClientInfo *, __pmPDU *);
 extern int DoPMNSTraverse(ClientInfo *, __pmPDU *);
+extern int HandleLateAgent(AgentInfo *);
+extern struct timeval *LateAgentTimeout(struct timeval *);
+extern void ExpireLateAgents(void);
+extern void ClearFetchCache(AgentInfo *);
 
 /*
  * General purpose routines
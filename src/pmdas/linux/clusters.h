@@ -86,6 +86,7 @@ enum {
 	CLUSTER_SOFTIRQS,	/* 63 /proc/softirqs percpu counters */
 	CLUSTER_SHM_STAT,	/* 64 shmctl(SHM_STAT) system call */
 	CLUSTER_MSG_STAT,	/* 65 msgctl(MSG_STAT) system call */
+	CLUSTER_REFRESH,	/* 66 refresh memoization, pmda.refresh.* */
 
 	NUM_CLUSTERS		/* one more than highest numbered cluster */
 };
@@ -48,6 +48,7 @@ enum {
 	SOFTIRQS_NAMES_INDOM,	/* 27 - persistent percpu softirqs IDs */
 	IPC_STAT_INDOM,	        /* 28 - ipc shm_stat shmid */
 	IPC_MSG_INDOM,	        /* 29 - ipc msg_stat msgid */
+	REFRESH_INDOM,		/* 30 - memoized refresh clusters */
 
 	NUM_INDOMS		/* one more than highest numbered cluster */
 };
@@ -300,6 +300,54 @@ static pmdaInstid nfs4_svr_indom_id[NR_RPC4_SVR_COUNTERS] = {
 	{ 71, "write_same" },
 };
 
+/*
+ * Clusters whose refresh may be memoized, see linux_refresh_memo().
+ * Instance identifiers are the cluster numbers.
+ */
+static pmdaInstid refresh_indom_id[] = {
+    { CLUSTER_STAT, "stat" },
+    { CLUSTER_MEMINFO, "meminfo" },
+    { CLUSTER_LOADAVG, "loadavg" },
+    { CLUSTER_NET_DEV, "net_dev" },
+    { CLUSTER_INTERRUPTS, "interrupts" },
+    { CLUSTER_SWAPDEV, "swapdev" },
+    { CLUSTER_NET_NFS, "net_rpc" },
+    { CLUSTER_PARTITIONS, "partitions" },
+    { CLUSTER_NET_SOCKSTAT, "net_sockstat" },
+    { CLUSTER_NET_SNMP, "net_snmp" },
+    { CLUSTER_SCSI, "scsi" },
+    { CLUSTER_CPUINFO, "cpuinfo" },
+    { CLUSTER_NET_TCP, "net_tcp" },
+    { CLUSTER_SEM_LIMITS, "sem_limits" },
+    { CLUSTER_MSG_LIMITS, "msg_limits" },
+    { CLUSTER_SHM_LIMITS, "shm_limits" },
+    { CLUSTER_UPTIME, "uptime" },
+    { CLUSTER_VFS, "vfs" },
+    { CLUSTER_VMSTAT, "vmstat" },
+    { CLUSTER_SYSFS_KERNEL, "sysfs_kernel" },
+    { CLUSTER_NUMA_MEMINFO, "numa_meminfo" },
+    { CLUSTER_NET_NETSTAT, "net_netstat" },
+    { CLUSTER_SHM_INFO, "shm_info" },
+    { CLUSTER_NET_SOFTNET, "net_softnet" },
+    { CLUSTER_NET_SNMP6, "net_snmp6" },
+    { CLUSTER_SEM_INFO, "sem_info" },
+    { CLUSTER_MSG_INFO, "msg_info" },
+    { CLUSTER_SOFTIRQS, "softirqs" },
+    { CLUSTER_SHM_STAT, "shm_stat" },
+    { CLUSTER_MSG_STAT, "msg_stat" },
+};
+
+#define NUM_REFRESH_MEMO (sizeof(refresh_indom_id)/sizeof(refresh_indom_id[0]))
+
+typedef struct {
+    unsigned int	maxage;		/* milliseconds, zero to always refresh */
+    struct timeval	last;		/* time of last refresh, zero if none */
+    __uint64_t		count;		/* refreshes */
+    __uint64_t		hits;		/* refreshes avoided */
+} refresh_memo_t;
+
+static refresh_memo_t refresh_memo[NUM_REFRESH_MEMO];
+
 static pmdaIndom indomtab[] = {
     { CPU_INDOM, 0, NULL },
     { DISK_INDOM, 0, NULL }, /* cached */
@@ -331,6 +379,7 @@ static pmdaIndom indomtab[] = {
     { SOFTIRQS_NAMES_INDOM, 0, NULL },
     { IPC_STAT_INDOM, 0, NULL },
     { IPC_MSG_INDOM, 0, NULL },
+    { REFRESH_INDOM, NUM_REFRESH_MEMO, refresh_indom_id },
 };
 
 
@@ -4657,6 +4706,22 @@ static pmdaMetric metrictab[] = {
     /* network.softnet.percpu.flow_limit_count */
     { NULL, { PMDA_PMID(CLUSTER_NET_SOFTNET,11), PM_TYPE_U64, CPU_INDOM,
       PM_SEM_COUNTER, PMDA_PMUNITS(0,0,1,0,0,PM_COUNT_ONE) }, },
+
+/*
+ * refresh memoization cluster
+ */
+
+    /* pmda.refresh.maxage */
+    { NULL, { PMDA_PMID(CLUSTER_REFRESH,0), PM_TYPE_U32, REFRESH_INDOM,
+      PM_SEM_DISCRETE, PMDA_PMUNITS(0,1,0,0,PM_TIME_MSEC,0) }, },
+
+    /* pmda.refresh.count */
+    { NULL, { PMDA_PMID(CLUSTER_REFRESH,1), PM_TYPE_U64, REFRESH_INDOM,
+      PM_SEM_COUNTER, PMDA_PMUNITS(0,0,1,0,0,PM_COUNT_ONE) }, },
+
+    /* pmda.refresh.hits */
+    { NULL, { PMDA_PMID(CLUSTER_REFRESH,2), PM_TYPE_U64, REFRESH_INDOM,
+      PM_SEM_COUNTER, PMDA_PMUNITS(0,0,1,0,0,PM_COUNT_ONE) }, },
 };
 
 typedef struct {
@@ -4699,6 +4764,102 @@ linux_ctx_container(int ctx)
     return NULL;
 }
 
+static int
+refresh_memo_lookup(int cluster)
+{
+    int		i;
+
+    for (i = 0; i < NUM_REFRESH_MEMO; i++) {
+	if (refresh_indom_id[i].i_inst == cluster)
+	    return i;
+    }
+    return -1;
+}
+
+/*
+ * Refresh memoization.  When several clients fetch the same metrics
+ * at much the same time (pmlogger, pmie and a few pmcharts, say) each
+ * fetch would otherwise read and parse the same files.  A cluster that
+ * was refreshed less than its maxage milliseconds ago is not refreshed
+ * again, and the values from that refresh are used.  maxage is set with
+ * the -m option or by pmstore(1) into pmda.refresh.maxage, and zero (the
+ * default) refreshes every time.
+ *
+ * Only clusters whose values are the same for every client are listed
+ * in refresh_indom_id[].  /proc/net/dev is always refreshed for a
+ * container, and the next refresh for the host is not memoized.
+ */
+static void
+linux_refresh_memo(int *need_refresh, linux_container_t *cp)
+{
+    struct timeval	now = { 0, 0 };
+    refresh_memo_t	*mp;
+    double		age;
+    int			cluster;
+    int			need;
+    int			i;
+
+    for (i = 0; i < NUM_REFRESH_MEMO; i++) {
+	cluster = refresh_indom_id[i].i_inst;
+	need = need_refresh[cluster];
+	if (cluster == CLUSTER_INTERRUPTS)	/* one refresh for all three */
+	    need += need_refresh[CLUSTER_INTERRUPT_LINES] +
+		    need_refresh[CLUSTER_INTERRUPT_OTHER];
+	if (need == 0)
+	    continue;
+	mp = &refresh_memo[i];
+	if (mp->maxage != 0 && (cp == NULL || cluster != CLUSTER_NET_DEV)) {
+	    if (now.tv_sec == 0)
+		__pmtimevalNow(&now);
+	    age = __pmtimevalSub(&now, &mp->last) * 1000;
+	    if (mp->last.tv_sec != 0 && age >= 0 && age < mp->maxage) {
+		need_refresh[cluster] = 0;
+		if (cluster == CLUSTER_INTERRUPTS)
+		    need_refresh[CLUSTER_INTERRUPT_LINES] =
+		    need_refresh[CLUSTER_INTERRUPT_OTHER] = 0;
+		mp->hits++;
+		continue;
+	    }
+	    mp->last = now;
+	}
+	else
+	    mp->last.tv_sec = mp->last.tv_usec = 0;
+	mp->count++;
+    }
+}
+
+/*
+ * Parse a -m option, [NAME=]MSEC, NAME being a refresh_indom_id[]
+ * name, else all of them.
+ */
+static int
+linux_refresh_maxage(const char *arg)
+{
+    const char		*value;
+    char		*end;
+    unsigned long	msec;
+    size_t		length = 0;
+    int			count = 0;
+    int			i;
+
+    if ((value = strchr(arg, '=')) != NULL)
+	length = value++ - arg;
+    else
+	value = arg;
+    msec = strtoul(value, &end, 10);
+    if (*value == '\0' || *end != '\0' || msec > UINT_MAX)
+	return -1;
+    for (i = 0; i < NUM_REFRESH_MEMO; i++) {
+	if (value != arg &&
+	    (strlen(refresh_indom_id[i].i_name) != length ||
+	     strncmp(refresh_indom_id[i].i_name, arg, length) != 0))
+	    continue;
+	refresh_memo[i].maxage = (unsigned int)msec;
+	count++;
+    }
+    return count ? 0 : -1;
+}
+
 static int
 linux_refresh(pmdaExt *pmda, int *need_refresh, int context)
 {
@@ -4712,6 +4873,8 @@ linux_refresh(pmdaExt *pmda, int *need_refresh, int context)
     if (cp && (sts = container_lookup(rootfd, cp)) < 0)
 	return sts;
 
+    linux_refresh_memo(need_refresh, cp);
+
     if (need_refresh[CLUSTER_PARTITIONS])
     	refresh_proc_partitions(INDOM(DISK_INDOM),
 				INDOM(PARTITIONS_INDOM),
@@ -6744,6 +6907,24 @@ linux_fetchCallBack(pmdaMetric *mdesc, unsigned int inst, pmAtomValue *atom)
 	}
 	break;
 
+    case CLUSTER_REFRESH:
+	if ((i = refresh_memo_lookup(inst)) < 0)
+	    return PM_ERR_INST;
+	switch (idp->item) {
+	case 0: /* pmda.refresh.maxage */
+	    atom->ul = refresh_memo[i].maxage;
+	    break;
+	case 1: /* pmda.refresh.count */
+	    atom->ull = refresh_memo[i].count;
+	    break;
+	case 2: /* pmda.refresh.hits */
+	    atom->ull = refresh_memo[i].hits;
+	    break;
+	default:
+	    return PM_ERR_PMID;
+	}
+	break;
+
     default: /* unknown cluster */
 	return PM_ERR_PMID;
     }
@@ -6751,6 +6932,26 @@ linux_fetchCallBack(pmdaMetric *mdesc, unsigned int inst, pmAtomValue *atom)
     return 1;
 }
 
+/*
+ * batch callback provided to pmdaFetch, all instances of one metric
+ */
+
+static int
+linux_fetchBatchCallBack(pmdaMetric *mdesc, pmdaFetchBatch *batch)
+{
+    pmAtomValue		atom;
+    int			i;
+    int			sts;
+
+    for (i = 0; i < batch->numinst; i++) {
+	sts = linux_fetchCallBack(mdesc, batch->instlist[i], &atom);
+	if (sts == PM_ERR_PMID)
+	    return sts;
+	pmdaFetchBatchValue(batch, i, sts, &atom);
+    }
+    return 0;
+}
+
 
 static int
 linux_fetch(int numpmid, pmID pmidlist[], pmResult **resp, pmdaExt *pmda)
@@ -6835,6 +7036,44 @@ linux_fetch(int numpmid, pmID pmidlist[], pmResult **resp, pmdaExt *pmda)
     return pmdaFetch(numpmid, pmidlist, resp, pmda);
 }
 
+static int
+linux_store(pmResult *result, pmdaExt *pmda)
+{
+    linux_access_t	*access = access_ctx(pmda->e_context);
+    pmValueSet		*vsp;
+    __pmID_int		*idp;
+    pmAtomValue		av;
+    int			i, j, k;
+    int			sts = 0;
+
+    for (i = 0; i < result->numpmid && sts == 0; i++) {
+	vsp = result->vset[i];
+	idp = (__pmID_int *)&(vsp->pmid);
+
+	if (idp->cluster != CLUSTER_REFRESH || idp->item != 0) {
+	    /* only pmda.refresh.maxage is modifiable */
+	    sts = PM_ERR_PERMISSION;
+	    break;
+	}
+	if (access == NULL || !access->uid_flag || access->uid != 0) {
+	    /* only for an authenticated root client */
+	    sts = PM_ERR_PERMISSION;
+	    break;
+	}
+	for (j = 0; j < vsp->numval; j++) {
+	    if ((k = refresh_memo_lookup(vsp->vlist[j].inst)) < 0) {
+		sts = PM_ERR_INST;
+		break;
+	    }
+	    if ((sts = pmExtractValue(vsp->valfmt, &vsp->vlist[j],
+				PM_TYPE_U32, &av, PM_TYPE_U32)) < 0)
+		break;
+	    refresh_memo[k].maxage = av.ul;
+	}
+    }
+    return sts;
+}
+
 static int
 linux_text(int ident, int type, char **buf, pmdaExt *pmda)
 {
@@ -6989,7 +7228,7 @@ linux_init(pmdaInterface *dp)
 	int sep = __pmPathSeparator();
 	snprintf(helppath, sizeof(helppath), "%s%c" "linux" "%c" "help",
 		pmGetConfig("PCP_PMDAS_DIR"), sep, sep);
-	pmdaDSO(dp, PMDA_INTERFACE_6, "linux DSO", helppath);
+	pmdaDSO(dp, PMDA_INTERFACE_7, "linux DSO", helppath);
     } else {
 	if (username)
 	    __pmSetProcessIdentity(username);
@@ -7001,6 +7240,7 @@ linux_init(pmdaInterface *dp)
 
     dp->version.six.instance = linux_instance;
     dp->version.six.fetch = linux_fetch;
+    dp->version.six.store = linux_store;
     dp->version.six.text = linux_text;
     dp->version.six.pmid = linux_pmid;
     dp->version.six.name = linux_name;
@@ -7008,6 +7248,7 @@ linux_init(pmdaInterface *dp)
     dp->version.six.attribute = linux_attribute;
     dp->version.six.ext->e_endCallBack = linux_end_context;
     pmdaSetFetchCallBack(dp, linux_fetchCallBack);
+    pmdaSetFetchBatchCallBack(dp, linux_fetchBatchCallBack);
 
     proc_stat.cpu_indom = proc_cpuinfo.cpuindom = &indomtab[CPU_INDOM];
     numa_meminfo.node_indom = proc_cpuinfo.node_indom = &indomtab[NODE_INDOM];
@@ -7121,13 +7362,14 @@ pmLongOptions	longopts[] = {
     PMOPT_DEBUG,
     PMDAOPT_DOMAIN,
     PMDAOPT_LOGFILE,
+    { "maxage", 1, 'm', "[NAME=]MSEC", "refresh cluster NAME (default all) at most every MSEC milliseconds" },
     PMDAOPT_USERNAME,
     PMOPT_HELP,
     PMDA_OPTIONS_END
 };
 
 pmdaOptions	opts = {
-    .short_options = "D:d:l:U:?",
+    .short_options = "D:d:l:m:U:?",
     .long_options = longopts,
 };
 
@@ -7137,7 +7379,7 @@ pmdaOptions	opts = {
 int
 main(int argc, char **argv)
 {
-    int			sep = __pmPathSeparator();
+    int			c, sep = __pmPathSeparator();
     pmdaInterface	dispatch;
     char		helppath[MAXPATHLEN];
 
@@ -7146,9 +7388,19 @@ main(int argc, char **argv)
 
     snprintf(helppath, sizeof(helppath), "%s%c" "linux" "%c" "help",
 		pmGetConfig("PCP_PMDAS_DIR"), sep, sep);
-    pmdaDaemon(&dispatch, PMDA_INTERFACE_6, pmProgname, LINUX, "linux.log", helppath);
-
-    pmdaGetOptions(argc, argv, &opts, &dispatch);
+    pmdaDaemon(&dispatch, PMDA_INTERFACE_7, pmProgname, LINUX, "linux.log", helppath);
+
+    while ((c = pmdaGetOptions(argc, argv, &opts, &dispatch)) != EOF) {
+	switch (c) {
+	case 'm':
+	    if (linux_refresh_maxage(opts.optarg) < 0) {
+		fprintf(stderr, "%s: -m requires [NAME=]MSEC, NAME a refresh cluster (%s)\n",
+			pmProgname, opts.optarg);
+		opts.errors++;
+	    }
+	    break;
+	}
+    }
     if (opts.errors) {
 	pmdaUsageMessage(&opts);
 	exit(1);
@@ -19,30 +19,24 @@
 #include "pmda.h"
 #include "indom.h"
 #include "proc_loadavg.h"
+#include "procfile.h"
 
 int
 refresh_proc_loadavg(proc_loadavg_t *proc_loadavg)
 {
-    char buf[1024];
-    FILE *fp;
-    int sts = 0;
+    static procfile_t loadavg = { "/proc/loadavg", -1 };
+    int sts;
 
-    if ((fp = linux_statsfile("/proc/loadavg", buf, sizeof(buf))) == NULL)
-	return -oserror();
+    if ((sts = procfile_read(&loadavg, 0)) < 0)
+	return sts;
 
-    if (fgets(buf, sizeof(buf), fp) == NULL)
-	sts = -oserror();
-    fclose(fp);
-
-    if (sts == 0) {
-	/*
-	 * 0.00 0.00 0.05 1/67 17563
-	 * Lastpid added by Mike Mason <mmlnx@us.ibm.com>
-	 */
-	sscanf((const char *)buf, "%f %f %f %u/%u %u",
-		&proc_loadavg->loadavg[0], &proc_loadavg->loadavg[1], 
-		&proc_loadavg->loadavg[2], &proc_loadavg->runnable,
-		&proc_loadavg->nprocs, &proc_loadavg->lastpid);
-    }
-    return sts;
+    /*
+     * 0.00 0.00 0.05 1/67 17563
+     * Lastpid added by Mike Mason <mmlnx@us.ibm.com>
+     */
+    sscanf((const char *)loadavg.buf, "%f %f %f %u/%u %u",
+	    &proc_loadavg->loadavg[0], &proc_loadavg->loadavg[1], 
+	    &proc_loadavg->loadavg[2], &proc_loadavg->runnable,
+	    &proc_loadavg->nprocs, &proc_loadavg->lastpid);
+    return 0;
 }
@@ -21,6 +21,7 @@
 #include "indom.h"
 #include <sys/stat.h>
 #include "proc_meminfo.h"
+#include "procfile.h"
 
 static proc_meminfo_t moff;
 extern size_t _pm_system_pagesize;
@@ -92,10 +93,13 @@ static struct {
 int
 refresh_proc_meminfo(proc_meminfo_t *proc_meminfo)
 {
+    static procfile_t meminfo = { "/proc/meminfo", -1 };
     char	buf[1024];
-    char	*bufp;
+    char	*bufp, *np, *next;
     int64_t	*p;
+    int		line;
     int		i;
+    int		sts;
     FILE	*fp;
 
     for (i = 0; meminfo_fields[i].field != NULL; i++) {
@@ -103,29 +107,26 @@ refresh_proc_meminfo(proc_meminfo_t *proc_meminfo)
 	*p = -1; /* marked as "no value available" */
     }
 
-    if ((fp = linux_statsfile("/proc/meminfo", buf, sizeof(buf))) == NULL)
-	return -oserror();
+    if ((sts = procfile_read(&meminfo, 0)) < 0)
+	return sts;
 
-    while (fgets(buf, sizeof(buf), fp) != NULL) {
-	if ((bufp = strchr(buf, ':')) == NULL)
+    next = meminfo.buf;
+    for (line = 0; (bufp = procfile_getline(&next)) != NULL; line++) {
+	if ((np = strchr(bufp, ':')) == NULL)
 	    continue;
-	*bufp = '\0';
-	for (i=0; meminfo_fields[i].field != NULL; i++) {
-	    if (strcmp(buf, meminfo_fields[i].field) != 0)
-		continue;
-	    p = MOFFSET(i, proc_meminfo);
-	    for (bufp++; *bufp; bufp++) {
-	    	if (isdigit((int)*bufp)) {
-		    sscanf(bufp, "%llu", (unsigned long long *)p);
-		    *p *= 1024; /* kbytes -> bytes */
-		    break;
-		}
+	*np = '\0';
+	if ((i = procfile_field(&meminfo, line, bufp, meminfo_fields, sizeof(meminfo_fields[0]))) < 0)
+	    continue;
+	p = MOFFSET(i, proc_meminfo);
+	for (np++; *np; np++) {
+	    if (isdigit((int)*np)) {
+		procfile_strtoull(np, (unsigned long long *)p);
+		*p *= 1024; /* kbytes -> bytes */
+		break;
 	    }
 	}
     }
 
-    fclose(fp);
-
     /*
      * MemAvailable is only in 3.x or later kernels but we can calculate it
      * using other values, similar to upstream kernel commit 34e431b0ae.
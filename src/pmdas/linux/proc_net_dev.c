@@ -26,6 +26,7 @@
 #include <ctype.h>
 #include "namespaces.h"
 #include "proc_net_dev.h"
+#include "procfile.h"
 
 static int
 refresh_inet_socket(linux_container_t *container)
@@ -234,14 +235,15 @@ refresh_proc_net_dev(pmInDom indom, linux_container_t *container)
 {
     static uint32_t	gen;	/* refresh generation number */
     static uint32_t	cache_err;	/* throttle messages */
-    char		buf[1024];
-    FILE		*fp;
+    static procfile_t	netdev = { "/proc/net/dev", -1 };
+    char		*buf, *next;
     char		*p, *v;
     int			j, sts;
     net_interface_t	*netip;
 
-    if ((fp = linux_statsfile("/proc/net/dev", buf, sizeof(buf))) == NULL)
-    	return -oserror();
+    /* a container has its own network namespace, so its own /proc/net/dev */
+    if ((sts = procfile_read(&netdev, container ? PROCFILE_REOPEN : 0)) < 0)
+    	return sts;
 
     if (gen == 0) {
 	/*
@@ -261,7 +263,8 @@ Inter-|   Receive                                                |  Transmit
 
     pmdaCacheOp(indom, PMDA_CACHE_INACTIVE);
 
-    while (fgets(buf, sizeof(buf), fp) != NULL) {
+    next = netdev.buf;
+    while ((buf = procfile_getline(&next)) != NULL) {
 	if ((p = v = strchr(buf, ':')) == NULL)
 	    continue;
 	*p = '\0';
@@ -293,15 +296,14 @@ Inter-|   Receive                                                |  Transmit
 	}
 
 	memset(&netip->ioc, 0, sizeof(netip->ioc));
-	for (p=v, j=0; j < PROC_DEV_COUNTERS_PER_LINE; j++) {
-	    for (; !isdigit((int)*p); p++) {;}
-	    sscanf(p, "%llu", (long long unsigned int *)&netip->counters[j]);
-	    for (; !isspace((int)*p); p++) {;}
+	for (p=v+1, j=0; j < PROC_DEV_COUNTERS_PER_LINE; j++) {
+	    p = procfile_strtoull(p, (unsigned long long *)&netip->counters[j]);
+	    if (p == NULL)
+		break;
 	}
     }
 
     /* success */
-    fclose(fp);
 
     if (!container)
 	pmdaCacheOp(indom, PMDA_CACHE_SAVE);
@@ -15,15 +15,166 @@
  */
 
 #include <ctype.h>
+#include <sys/socket.h>
+#include <linux/netlink.h>
+#include <linux/inet_diag.h>
 #include "pmapi.h"
+#include "impl.h"
 #include "pmda.h"
 #include "indom.h"
 #include "proc_net_tcp.h"
 
 #define MYBUFSZ (1<<14) /*16k*/
 
-int
-refresh_proc_net_tcp(proc_net_tcp_t *proc_net_tcp)
+/*
+ * Connection states from the kernel via inet_diag netlink requests
+ * (NETLINK_INET_DIAG, also known as NETLINK_SOCK_DIAG) rather than
+ * /proc/net/tcp, which costs well over a second of CPU per refresh
+ * once there are hundreds of thousands of sockets, all formatted as
+ * text by the kernel only to be parsed again here.  The netlink reply
+ * is a binary record per socket, of which only the state is used.
+ *
+ * Like /proc/net/tcp, only IPv4 sockets are counted.  The original
+ * (TCPDIAG_GETSOCK) request is used as it is supported by all kernels
+ * with inet_diag, although newer kernels then ignore idiag_family and
+ * reply for IPv6 sockets too.  The socket is kept open between
+ * refreshes, with a receive timeout so a missing reply cannot hang
+ * the PMDA.
+ *
+ * If inet_diag is not available (or when stats files are read from
+ * below linux_statspath, for QA) /proc/net/tcp is parsed instead.
+ */
+#define DIAG_TIMEOUT	2	/* seconds to wait for each reply datagram */
+
+static int	diag_fd = -1;
+static int	diag_disabled;
+static __uint32_t diag_seq;
+
+static int
+diag_open(void)
+{
+    struct timeval	tv = { DIAG_TIMEOUT, 0 };
+    int			fd;
+    int			sts;
+
+#ifdef SOCK_CLOEXEC
+    fd = socket(AF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC, NETLINK_INET_DIAG);
+#else
+    fd = socket(AF_NETLINK, SOCK_DGRAM, NETLINK_INET_DIAG);
+#endif
+    if (fd < 0)
+	return -oserror();
+    if (setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)) < 0) {
+	sts = -oserror();
+	close(fd);
+	return sts;
+    }
+    return fd;
+}
+
+static void
+diag_close(void)
+{
+    if (diag_fd >= 0) {
+	close(diag_fd);
+	diag_fd = -1;
+    }
+}
+
+/*
+ * Returns 0 on success, else a negative errno, and the caller falls
+ * back to /proc/net/tcp.  On failure the socket is closed, as replies
+ * to the failed request may still be queued on it.  A timeout is only
+ * a failure of this refresh, but if the kernel rejected the request
+ * outright, or a reply datagram did not fit in buf, diag_disabled is
+ * set and /proc/net/tcp is used from then on.
+ */
+static int
+refresh_net_tcp_diag(proc_net_tcp_t *proc_net_tcp)
+{
+    static char		buf[1<<15];	/* at least the largest dump datagram */
+    struct {
+	struct nlmsghdr		nlh;
+	struct inet_diag_req	r;
+    } req;
+    struct sockaddr_nl	nladdr;
+    struct nlmsghdr	*h;
+    struct nlmsgerr	*err;
+    struct inet_diag_msg *msg;
+    ssize_t		n;
+    int			sts;
+
+    if (diag_fd < 0) {
+	if ((diag_fd = diag_open()) < 0) {
+	    sts = diag_fd;
+	    diag_fd = -1;
+	    diag_disabled = 1;
+	    return sts;
+	}
+    }
+
+    memset(&req, 0, sizeof(req));
+    req.nlh.nlmsg_len = sizeof(req);
+    req.nlh.nlmsg_type = TCPDIAG_GETSOCK;
+    req.nlh.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+    req.nlh.nlmsg_seq = ++diag_seq;
+    req.r.idiag_family = AF_INET;
+    req.r.idiag_states = ~0U;		/* all states */
+    memset(&nladdr, 0, sizeof(nladdr));
+    nladdr.nl_family = AF_NETLINK;
+
+    if (sendto(diag_fd, &req, sizeof(req), 0,
+		(struct sockaddr *)&nladdr, sizeof(nladdr)) < 0) {
+	sts = -oserror();
+	goto fail;
+    }
+
+    for (;;) {
+	/* MSG_TRUNC returns the real length of a datagram cut short */
+	if ((n = recv(diag_fd, buf, sizeof(buf), MSG_TRUNC)) < 0) {
+	    if (oserror() == EINTR)
+		continue;
+	    sts = -oserror();
+	    goto fail;
+	}
+	if (n == 0) {
+	    sts = -EIO;
+	    goto fail;
+	}
+	if (n > (ssize_t)sizeof(buf)) {
+	    sts = -EMSGSIZE;
+	    diag_disabled = 1;
+	    goto fail;
+	}
+	for (h = (struct nlmsghdr *)buf; NLMSG_OK(h, n); h = NLMSG_NEXT(h, n)) {
+	    if (h->nlmsg_seq != diag_seq)
+		continue;
+	    if (h->nlmsg_type == NLMSG_DONE)
+		return 0;
+	    if (h->nlmsg_type == NLMSG_ERROR) {
+		err = (struct nlmsgerr *)NLMSG_DATA(h);
+		sts = (h->nlmsg_len >= NLMSG_LENGTH(sizeof(*err)) && err->error)
+			? err->error : -EPROTO;
+		diag_disabled = 1;
+		goto fail;
+	    }
+	    if (h->nlmsg_len < NLMSG_LENGTH(sizeof(*msg)))
+		continue;
+	    msg = (struct inet_diag_msg *)NLMSG_DATA(h);
+	    if (msg->idiag_family != AF_INET)
+		continue;	/* compat requests dump IPv6 too */
+	    if (msg->idiag_state < _PM_TCP_LAST)
+		proc_net_tcp->stat[msg->idiag_state]++;
+	}
+    }
+
+fail:
+    diag_close();
+    return sts;
+}
+
+static int
+refresh_net_tcp_file(proc_net_tcp_t *proc_net_tcp)
 {
     FILE *fp;
     char buf[MYBUFSZ]; 
@@ -32,22 +183,21 @@ refresh_proc_net_tcp(proc_net_tcp_t *proc_net_tcp)
     unsigned int n;
     ssize_t got = 0;
     ptrdiff_t remnant = 0;
-
-    memset(proc_net_tcp, 0, sizeof(*proc_net_tcp));
+    int header = 1;
 
     if ((fp = linux_statsfile("/proc/net/tcp", buf, sizeof(buf))) == NULL)
 	return -oserror();
 
-    /* skip header */
-    if (fgets(buf, sizeof(buf), fp) == NULL) {
-    	/* oops, no header! */
-	fclose(fp);
-	return -oserror();
-    }
+    /*
+     * All reads are read(2)s on the underlying fd - a stdio read (of
+     * the header, say) would buffer and so skip the lines following.
+     */
     for (buf[0]='\0';;) {
 	q = strchrnul(p, '\n');
 	if (*q == '\n') {
-	    if (1 == sscanf(p, " %*s %*s %*s %x", &n)
+	    if (header)
+		header = 0;	/* skip header */
+	    else if (1 == sscanf(p, " %*s %*s %*s %x", &n)
 		&& n < _PM_TCP_LAST) {
 		proc_net_tcp->stat[n]++;
             }
@@ -69,3 +219,23 @@ refresh_proc_net_tcp(proc_net_tcp_t *proc_net_tcp)
     fclose(fp);
     return 0;
 }
+
+int
+refresh_proc_net_tcp(proc_net_tcp_t *proc_net_tcp)
+{
+    int		sts;
+
+    memset(proc_net_tcp, 0, sizeof(*proc_net_tcp));
+
+    if (!diag_disabled && *linux_statspath == '\0') {
+	if ((sts = refresh_net_tcp_diag(proc_net_tcp)) == 0)
+	    return 0;
+#ifdef PCP_DEBUG
+	if (pmDebug & DBG_TRACE_LIBPMDA)
+	    fprintf(stderr, "refresh_proc_net_tcp: inet_diag: %s%s\n",
+		    pmErrStr(sts), diag_disabled ? ", using /proc/net/tcp" : "");
+#endif
+	memset(proc_net_tcp, 0, sizeof(*proc_net_tcp));
+    }
+    return refresh_net_tcp_file(proc_net_tcp);
+}
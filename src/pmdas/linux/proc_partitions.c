@@ -29,6 +29,7 @@
 #include "clusters.h"
 #include "indom.h"
 #include "proc_partitions.h"
+#include "procfile.h"
 
 int _pm_have_kernel_2_6_partition_stats;
 
@@ -345,13 +346,46 @@ persistent_md_name(char *namebuf, int namelen)
     return found;
 }
 
+/*
+ * Device name following the major and minor numbers in a line of
+ * /proc/diskstats, in place of sscanf(buf, "%u %u %s", ...).  Returns
+ * the address following the name, else NULL if the line is not of
+ * this form.
+ */
+static char *
+diskstats_name(char *buf, unsigned int *major, unsigned int *minor,
+		char *name, int size)
+{
+    unsigned long long	v[2];
+    char		*p;
+    int			n;
+
+    if ((p = procfile_strtoull(buf, &v[0])) == NULL ||
+	(p = procfile_strtoull(p, &v[1])) == NULL)
+	return NULL;
+    p = procfile_skipspace(p);
+    for (n = 0; *p && !isspace((int)*p); p++) {
+	if (n < size - 1)
+	    name[n++] = *p;
+    }
+    if (n == 0)
+	return NULL;
+    name[n] = '\0';
+    *major = (unsigned int)v[0];
+    *minor = (unsigned int)v[1];
+    return p;
+}
+
 int
 refresh_proc_partitions(pmInDom disk_indom, pmInDom partitions_indom,
 			pmInDom dm_indom, pmInDom md_indom)
 {
-    FILE *fp;
-    int devmin;
-    int devmaj;
+    static procfile_t diskstats = { "/proc/diskstats", -1 };
+    static procfile_t partitions = { "/proc/partitions", -1 };
+    procfile_t *pf;
+    unsigned long long v[11];
+    unsigned int devmin;
+    unsigned int devmaj;
     int n;
     int indom;
     int have_proc_diskstats;
@@ -360,7 +394,7 @@ refresh_proc_partitions(pmInDom disk_indom, pmInDom partitions_indom,
     partitions_entry_t *p;
     int indom_changes = 0;
     char *dmname, *mdname;
-    char buf[MAXPATHLEN];
+    char *buf, *next, *vp = NULL;
     char namebuf[MAXPATHLEN];
     static int first = 1;
 
@@ -380,15 +414,20 @@ refresh_proc_partitions(pmInDom disk_indom, pmInDom partitions_indom,
     pmdaCacheOp(dm_indom, PMDA_CACHE_INACTIVE);
     pmdaCacheOp(md_indom, PMDA_CACHE_INACTIVE);
 
-    if ((fp = linux_statsfile("/proc/diskstats", buf, sizeof(buf))))
+    if (procfile_read(&diskstats, 0) == 0) {
 	/* 2.6 style disk stats */
 	have_proc_diskstats = 1;
-    else if ((fp = linux_statsfile("/proc/partitions", buf, sizeof(buf))))
+	pf = &diskstats;
+    }
+    else if ((n = procfile_read(&partitions, 0)) == 0) {
 	have_proc_diskstats = 0;
+	pf = &partitions;
+    }
     else
-	return -oserror();
+	return n;
 
-    while (fgets(buf, sizeof(buf), fp) != NULL) {
+    next = pf->buf;
+    while ((buf = procfile_getline(&next)) != NULL) {
 	dmname = mdname = NULL;
 	if (buf[0] != ' ' || buf[0] == '\n') {
 	    /* skip heading */
@@ -396,12 +435,13 @@ refresh_proc_partitions(pmInDom disk_indom, pmInDom partitions_indom,
 	}
 
 	if (have_proc_diskstats) {
-	    if ((n = sscanf(buf, "%d %d %s", &devmaj, &devmin, namebuf)) != 3)
+	    vp = diskstats_name(buf, &devmaj, &devmin, namebuf, sizeof(namebuf));
+	    if (vp == NULL)
 		continue;
 	}
 	else {
 	    /* /proc/partitions */
-	    if ((n = sscanf(buf, "%d %d %llu %s", &devmaj, &devmin, &blocks, namebuf)) != 4)
+	    if ((n = sscanf(buf, "%u %u %llu %s", &devmaj, &devmin, &blocks, namebuf)) != 4)
 		continue;
 	}
 
@@ -467,14 +507,25 @@ refresh_proc_partitions(pmInDom disk_indom, pmInDom partitions_indom,
 	if (have_proc_diskstats) {
 	    /* 2.6 style /proc/diskstats */
 	    p->nr_blocks = 0;
-	    namebuf[0] = '\0';
+	    p->major = devmaj;
+	    p->minor = devmin;
 	    /* Linux source: block/genhd.c::diskstats_show(1) */
-	    n = sscanf(buf, "%u %u %s %lu %lu %llu %u %lu %lu %llu %u %u %u %u",
-		&p->major, &p->minor, namebuf,
-		&p->rd_ios, &p->rd_merges, &p->rd_sectors, &p->rd_ticks,
-		&p->wr_ios, &p->wr_merges, &p->wr_sectors, &p->wr_ticks,
-		&p->ios_in_flight, &p->io_ticks, &p->aveq);
-	    if (n != 14) {
+	    for (n = 0; n < 11 && (vp = procfile_strtoull(vp, &v[n])) != NULL; n++)
+		;
+	    if (n == 11) {
+		p->rd_ios = v[0];
+		p->rd_merges = v[1];
+		p->rd_sectors = v[2];
+		p->rd_ticks = v[3];
+		p->wr_ios = v[4];
+		p->wr_merges = v[5];
+		p->wr_sectors = v[6];
+		p->wr_ticks = v[7];
+		p->ios_in_flight = v[8];
+		p->io_ticks = v[9];
+		p->aveq = v[10];
+	    }
+	    else {
                 /*
 		 * From 2.6.25 onward, the full set of statistics is
 		 * available again for both partitions and disks.
@@ -483,10 +534,14 @@ refresh_proc_partitions(pmInDom disk_indom, pmInDom partitions_indom,
 		p->rd_merges = p->wr_merges = p->wr_ticks =
 			p->ios_in_flight = p->io_ticks = p->aveq = 0;
 		/* Linux source: block/genhd.c::diskstats_show(2) */
-		n = sscanf(buf, "%u %u %s %u %u %u %u\n",
-		    &p->major, &p->minor, namebuf,
-		    (unsigned int *)&p->rd_ios, (unsigned int *)&p->rd_sectors,
-		    (unsigned int *)&p->wr_ios, (unsigned int *)&p->wr_sectors);
+		if (n > 0)
+		    p->rd_ios = (unsigned int)v[0];
+		if (n > 1)
+		    p->rd_sectors = (unsigned int)v[1];
+		if (n > 2)
+		    p->wr_ios = (unsigned int)v[2];
+		if (n > 3)
+		    p->wr_sectors = (unsigned int)v[3];
 	    }
 	}
 	else {
@@ -521,8 +576,6 @@ refresh_proc_partitions(pmInDom disk_indom, pmInDom partitions_indom,
     /*
      * success
      */
-    if (fp)
-	fclose(fp);
     return 0;
 }
 
@@ -25,48 +25,59 @@
 #include <sys/stat.h>
 #include "proc_cpuinfo.h"
 #include "proc_stat.h"
+#include "procfile.h"
+
+/*
+ * Values following the name at the start of a line, in place of
+ * sscanf(line, "name %llu %llu ...", ...) ... as with sscanf, any
+ * not present (older kernels) are left unchanged.
+ */
+static void
+stat_values(char *line, unsigned long long **vp, int n)
+{
+    unsigned long long	v;
+    char		*p;
+    int			i;
+
+    for (p = line; *p && !isspace((int)*p); p++)
+	;
+    for (i = 0; i < n && (p = procfile_strtoull(p, &v)) != NULL; i++)
+	*vp[i] = v;
+}
+
+/*
+ * First value following the name at the start of a line, else v.
+ */
+static unsigned long long
+stat_value(char *line, unsigned long long v)
+{
+    unsigned long long	*vp = &v;
+
+    stat_values(line, &vp, 1);
+    return v;
+}
 
 int
 refresh_proc_stat(proc_cpuinfo_t *proc_cpuinfo, proc_stat_t *proc_stat)
 {
     pmdaIndom *idp = PMDAINDOM(CPU_INDOM);
-    char buf[MAXPATHLEN];
-    char fmt[64];
-    static int fd = -1; /* kept open until exit() */
+    static procfile_t statfile = { "/proc/stat", -1 }; /* kept open until exit() */
     static int started;
-    static char *statbuf;
-    static int maxstatbuf;
     static char **bufindex;
     static int nbufindex;
     static int maxbufindex;
+    unsigned long long *values[10];
+    char *statbuf;
     int size;
+    int sts;
     int n;
     int i;
     int j;
 
-    if (fd >= 0) {
-	if (lseek(fd, 0, SEEK_SET) < 0)
-	    return -oserror();
-    } else {
-	snprintf(buf, sizeof(buf), "%s/proc/stat", linux_statspath);
-	if ((fd = open(buf, O_RDONLY)) < 0)
-	    return -oserror();
-    }
-
-    for (n=0;;) {
-	while (n >= maxstatbuf) {
-	    size = maxstatbuf + 512;
-	    if ((statbuf = (char *)realloc(statbuf, size)) == NULL)
-		return -ENOMEM;
-	    maxstatbuf = size;
-	}
-	size = (statbuf + maxstatbuf) - (statbuf + n);
-	if ((i = read(fd, statbuf + n, size)) > 0)
-	    n += i;
-	else
-	    break;
-    }
-    statbuf[n] = '\0';
+    if ((sts = procfile_read(&statfile, 0)) < 0)
+	return sts;
+    statbuf = statfile.buf;
+    n = statfile.len;
 
     if (bufindex == NULL) {
 	size = 4 * sizeof(char *);
@@ -159,13 +170,19 @@ refresh_proc_stat(proc_cpuinfo_t *proc_cpuinfo, proc_stat_t *proc_stat)
      * 2.6 kernels have 3 additional fields
      * for wait, irq and soft_irq.
      */
-    strcpy(fmt, "cpu %llu %llu %llu %llu %llu %llu %llu %llu %llu %llu");
-    n = sscanf((const char *)bufindex[0], fmt,
-	&proc_stat->user, &proc_stat->nice,
-	&proc_stat->sys, &proc_stat->idle,
-	&proc_stat->wait, &proc_stat->irq,
-	&proc_stat->sirq, &proc_stat->steal,
-	&proc_stat->guest, &proc_stat->guest_nice);
+    if (strncmp("cpu", bufindex[0], 3) == 0) {
+	values[0] = &proc_stat->user;
+	values[1] = &proc_stat->nice;
+	values[2] = &proc_stat->sys;
+	values[3] = &proc_stat->idle;
+	values[4] = &proc_stat->wait;
+	values[5] = &proc_stat->irq;
+	values[6] = &proc_stat->sirq;
+	values[7] = &proc_stat->steal;
+	values[8] = &proc_stat->guest;
+	values[9] = &proc_stat->guest_nice;
+	stat_values(bufindex[0], values, 10);
+    }
 
     /*
      * per-cpu stats
@@ -193,25 +210,23 @@ refresh_proc_stat(proc_cpuinfo_t *proc_cpuinfo, proc_stat_t *proc_stat)
     	proc_stat->p_guest_nice[0] = proc_stat->n_guest_nice[0] = proc_stat->guest_nice;
     }
     else {
-	strcpy(fmt, "cpu%d %llu %llu %llu %llu %llu %llu %llu %llu %llu %llu");
 	for (i=0; i < proc_stat->ncpu; i++) {
 	    for (j=0; j < nbufindex; j++) {
 		if (strncmp("cpu", bufindex[j], 3) == 0 && isdigit((int)bufindex[j][3])) {
-		    int c;
 		    int cpunum = atoi(&bufindex[j][3]);
 		    int node;
 		    if (cpunum >= 0 && cpunum < proc_stat->ncpu) {
-			n = sscanf(bufindex[j], fmt, &c,
-			    &proc_stat->p_user[cpunum],
-			    &proc_stat->p_nice[cpunum],
-			    &proc_stat->p_sys[cpunum],
-			    &proc_stat->p_idle[cpunum],
-			    &proc_stat->p_wait[cpunum],
-			    &proc_stat->p_irq[cpunum],
-			    &proc_stat->p_sirq[cpunum],
-			    &proc_stat->p_steal[cpunum],
-			    &proc_stat->p_guest[cpunum],
-			    &proc_stat->p_guest_nice[cpunum]);
+			values[0] = &proc_stat->p_user[cpunum];
+			values[1] = &proc_stat->p_nice[cpunum];
+			values[2] = &proc_stat->p_sys[cpunum];
+			values[3] = &proc_stat->p_idle[cpunum];
+			values[4] = &proc_stat->p_wait[cpunum];
+			values[5] = &proc_stat->p_irq[cpunum];
+			values[6] = &proc_stat->p_sirq[cpunum];
+			values[7] = &proc_stat->p_steal[cpunum];
+			values[8] = &proc_stat->p_guest[cpunum];
+			values[9] = &proc_stat->p_guest_nice[cpunum];
+			stat_values(bufindex[j], values, 10);
 			if ((node = proc_cpuinfo->cpuinfo[cpunum].node) != -1) {
 			    proc_stat->n_user[node] += proc_stat->p_user[cpunum];
 			    proc_stat->n_nice[node] += proc_stat->p_nice[cpunum];
@@ -236,11 +251,14 @@ refresh_proc_stat(proc_cpuinfo_t *proc_cpuinfo, proc_stat_t *proc_stat)
      * page 59739 34786
      * Note: this has moved to /proc/vmstat in 2.6 kernels
      */
-    strcpy(fmt, "page %u %u");
     for (j=0; j < nbufindex; j++) {
-    	if (strncmp(fmt, bufindex[j], 5) == 0) {
-	    sscanf((const char *)bufindex[j], fmt,
-		&proc_stat->page[0], &proc_stat->page[1]);
+    	if (strncmp("page ", bufindex[j], 5) == 0) {
+	    unsigned long long page[2] = { proc_stat->page[0], proc_stat->page[1] };
+	    values[0] = &page[0];
+	    values[1] = &page[1];
+	    stat_values(bufindex[j], values, 2);
+	    proc_stat->page[0] = page[0];
+	    proc_stat->page[1] = page[1];
 	    break;
 	}
     }
@@ -249,11 +267,14 @@ refresh_proc_stat(proc_cpuinfo_t *proc_cpuinfo, proc_stat_t *proc_stat)
      * swap 0 1
      * Note: this has moved to /proc/vmstat in 2.6 kernels
      */
-    strcpy(fmt, "swap %u %u");
     for (j=0; j < nbufindex; j++) {
-    	if (strncmp(fmt, bufindex[j], 5) == 0) {
-	    sscanf((const char *)bufindex[j], fmt,
-		&proc_stat->swap[0], &proc_stat->swap[1]);
+    	if (strncmp("swap ", bufindex[j], 5) == 0) {
+	    unsigned long long swap[2] = { proc_stat->swap[0], proc_stat->swap[1] };
+	    values[0] = &swap[0];
+	    values[1] = &swap[1];
+	    stat_values(bufindex[j], values, 2);
+	    proc_stat->swap[0] = swap[0];
+	    proc_stat->swap[1] = swap[1];
 	    break;
 	}
     }
@@ -262,10 +283,9 @@ refresh_proc_stat(proc_cpuinfo_t *proc_cpuinfo, proc_stat_t *proc_stat)
      * intr 32845463 24099228 2049 0 2 ....
      * (just export the first number, which is total interrupts)
      */
-    strcpy(fmt, "intr %llu");
     for (j=0; j < nbufindex; j++) {
-    	if (strncmp(fmt, bufindex[j], 5) == 0) {
-	    sscanf((const char *)bufindex[j], fmt, &proc_stat->intr);
+    	if (strncmp("intr ", bufindex[j], 5) == 0) {
+	    proc_stat->intr = stat_value(bufindex[j], proc_stat->intr);
 	    break;
 	}
     }
@@ -273,10 +293,9 @@ refresh_proc_stat(proc_cpuinfo_t *proc_cpuinfo, proc_stat_t *proc_stat)
     /*
      * ctxt 1733480
      */
-    strcpy(fmt, "ctxt %llu");
     for (j=0; j < nbufindex; j++) {
-    	if (strncmp(fmt, bufindex[j], 5) == 0) {
-	    sscanf((const char *)bufindex[j], fmt, &proc_stat->ctxt);
+    	if (strncmp("ctxt ", bufindex[j], 5) == 0) {
+	    proc_stat->ctxt = stat_value(bufindex[j], proc_stat->ctxt);
 	    break;
 	}
     }
@@ -284,10 +303,9 @@ refresh_proc_stat(proc_cpuinfo_t *proc_cpuinfo, proc_stat_t *proc_stat)
     /*
      * btime 1733480
      */
-    strcpy(fmt, "btime %lu");
     for (j=0; j < nbufindex; j++) {
-    	if (strncmp(fmt, bufindex[j], 6) == 0) {
-	    sscanf((const char *)bufindex[j], fmt, &proc_stat->btime);
+    	if (strncmp("btime ", bufindex[j], 6) == 0) {
+	    proc_stat->btime = stat_value(bufindex[j], proc_stat->btime);
 	    break;
 	}
     }
@@ -295,10 +313,9 @@ refresh_proc_stat(proc_cpuinfo_t *proc_cpuinfo, proc_stat_t *proc_stat)
     /*
      * processes 2213
      */
-    strcpy(fmt, "processes %lu");
     for (j=0; j < nbufindex; j++) {
-    	if (strncmp(fmt, bufindex[j], 10) == 0) {
-	    sscanf((const char *)bufindex[j], fmt, &proc_stat->processes);
+    	if (strncmp("processes ", bufindex[j], 10) == 0) {
+	    proc_stat->processes = stat_value(bufindex[j], proc_stat->processes);
 	    break;
 	}
     }
@@ -306,10 +323,9 @@ refresh_proc_stat(proc_cpuinfo_t *proc_cpuinfo, proc_stat_t *proc_stat)
     /*
      * procs_running 1
      */
-    strcpy(fmt, "procs_running %lu");
     for (j=0; j < nbufindex; j++) {
-    	if (strncmp(fmt, bufindex[j], 10) == 0) {
-	    sscanf((const char *)bufindex[j], fmt, &proc_stat->procs_running);
+    	if (strncmp("procs_running ", bufindex[j], 14) == 0) {
+	    proc_stat->procs_running = stat_value(bufindex[j], proc_stat->procs_running);
 	    break;
 	}
     }
@@ -317,10 +333,9 @@ refresh_proc_stat(proc_cpuinfo_t *proc_cpuinfo, proc_stat_t *proc_stat)
     /*
      * procs_blocked 0
      */
-    strcpy(fmt, "procs_blocked %lu");
     for (j=0; j < nbufindex; j++) {
-    	if (strncmp(fmt, bufindex[j], 10) == 0) {
-	    sscanf((const char *)bufindex[j], fmt, &proc_stat->procs_blocked);
+    	if (strncmp("procs_blocked ", bufindex[j], 14) == 0) {
+	    proc_stat->procs_blocked = stat_value(bufindex[j], proc_stat->procs_blocked);
 	    break;
 	}
     }
@@ -14,33 +14,24 @@
  * for more details.
  */
 
-#include <fcntl.h>
 #include "pmapi.h"
 #include "pmda.h"
 #include "indom.h"
 #include "proc_uptime.h"
+#include "procfile.h"
 
 int
 refresh_proc_uptime(proc_uptime_t *proc_uptime)
 {
-    char buf[MAXPATHLEN];
-    int fd, n;
+    static procfile_t uptimefile = { "/proc/uptime", -1 };
     float uptime = 0.0, idletime = 0.0;
+    int sts;
 
     memset(proc_uptime, 0, sizeof(proc_uptime_t));
-    snprintf(buf, sizeof(buf), "%s/proc/uptime", linux_statspath);
-    if ((fd = open(buf, O_RDONLY)) < 0)
-	return -oserror();
+    if ((sts = procfile_read(&uptimefile, 0)) < 0)
+	return sts;
 
-    n = read(fd, buf, sizeof(buf));
-    close(fd);
-    if (n < 0)
-	return -oserror();
-    else if (n > 0)
-	n--;
-    buf[n] = '\0';
-
-    sscanf((const char *)buf, "%f %f", &uptime, &idletime);
+    sscanf((const char *)uptimefile.buf, "%f %f", &uptime, &idletime);
     proc_uptime->uptime = (unsigned long) uptime;
     proc_uptime->idletime = (unsigned long) idletime;
     return 0;
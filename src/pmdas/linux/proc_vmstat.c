@@ -21,6 +21,7 @@
 #include "pmda.h"
 #include "indom.h"
 #include "proc_vmstat.h"
+#include "procfile.h"
 
 static struct {
     const char	*field;
@@ -268,39 +269,38 @@ proc_vmstat_init(void)
 int
 refresh_proc_vmstat(proc_vmstat_t *proc_vmstat)
 {
-    char	buf[1024];
-    char	*bufp;
+    static procfile_t vmstat = { "/proc/vmstat", -1 };
+    char	*bufp, *np, *next;
     int64_t	*p;
+    int		line;
     int		i;
-    FILE	*fp;
+    int		sts;
 
     for (i = 0; vmstat_fields[i].field != NULL; i++) {
 	p = VMSTAT_OFFSET(i, proc_vmstat);
 	*p = -1; /* marked as "no value available" */
     }
 
-    if ((fp = linux_statsfile("/proc/vmstat", buf, sizeof(buf))) == NULL)
-    	return -oserror();
+    if ((sts = procfile_read(&vmstat, 0)) < 0)
+	return sts;
 
     _pm_have_proc_vmstat = 1;
 
-    while (fgets(buf, sizeof(buf), fp) != NULL) {
-	if ((bufp = strchr(buf, ' ')) == NULL)
+    next = vmstat.buf;
+    for (line = 0; (bufp = procfile_getline(&next)) != NULL; line++) {
+	if ((np = strchr(bufp, ' ')) == NULL)
+	    continue;
+	*np = '\0';
+	if ((i = procfile_field(&vmstat, line, bufp, vmstat_fields, sizeof(vmstat_fields[0]))) < 0)
 	    continue;
-	*bufp = '\0';
-	for (i = 0; vmstat_fields[i].field != NULL; i++) {
-	    if (strcmp(buf, vmstat_fields[i].field) != 0)
-		continue;
-	    p = VMSTAT_OFFSET(i, proc_vmstat);
-	    for (bufp++; *bufp; bufp++) {
-	    	if (isdigit((int)*bufp)) {
-		    sscanf(bufp, "%llu", (unsigned long long *)p);
-		    break;
-		}
+	p = VMSTAT_OFFSET(i, proc_vmstat);
+	for (np++; *np; np++) {
+	    if (isdigit((int)*np)) {
+		procfile_strtoull(np, (unsigned long long *)p);
+		break;
 	    }
 	}
     }
-    fclose(fp);
 
     if (proc_vmstat->nr_slab == -1)	/* split apart in 2.6.18 */
 	proc_vmstat->nr_slab = proc_vmstat->nr_slab_reclaimable +
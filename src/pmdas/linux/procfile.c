@@ -0,0 +1,201 @@
+/*
+ * Copyright (c) 2026 Red Hat.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ */
+
+#include <fcntl.h>
+#include <ctype.h>
+#include "pmapi.h"
+#include "impl.h"
+#include "pmda.h"
+#include "indom.h"
+#include "procfile.h"
+
+#define PROCFILE_BUFSIZ	4096
+
+/*
+ * Read all of fd, from the start, into pf->buf.  Reads continue until
+ * end of file, as /proc files may return less than was asked for well
+ * short of the end.
+ */
+static int
+procfile_pread(procfile_t *pf, int fd)
+{
+    ssize_t	n;
+    size_t	size;
+    char	*p;
+
+    pf->len = 0;
+    for (;;) {
+	if (pf->len + 1 >= pf->size) {
+	    size = pf->size ? pf->size * 2 : PROCFILE_BUFSIZ;
+	    if ((p = (char *)realloc(pf->buf, size)) == NULL)
+		return -ENOMEM;
+	    pf->buf = p;
+	    pf->size = size;
+	}
+	n = pread(fd, pf->buf + pf->len, pf->size - pf->len - 1, (off_t)pf->len);
+	if (n < 0) {
+	    if (oserror() == EINTR)
+		continue;
+	    return -oserror();
+	}
+	if (n == 0)
+	    break;
+	pf->len += n;
+    }
+    pf->buf[pf->len] = '\0';
+    return 0;
+}
+
+/*
+ * Refresh the contents of pf.  Returns 0 on success, else a negative
+ * errno, in which case the fd is closed and the file will be opened
+ * again on the next call.
+ */
+int
+procfile_read(procfile_t *pf, int flags)
+{
+    char	path[MAXPATHLEN];
+    int		oflags = O_RDONLY;
+    int		fd;
+    int		sts;
+
+    if (pf->fd < 0 || (flags & PROCFILE_REOPEN)) {
+#ifdef O_CLOEXEC
+	oflags |= O_CLOEXEC;	/* pmcd forks PMDAs, do not leak into them */
+#endif
+	snprintf(path, sizeof(path), "%s%s", linux_statspath, pf->path);
+	if ((fd = open(path, oflags)) < 0)
+	    return -oserror();
+	if (flags & PROCFILE_REOPEN) {
+	    sts = procfile_pread(pf, fd);
+	    close(fd);
+	    return sts;
+	}
+	pf->fd = fd;
+    }
+
+    if ((sts = procfile_pread(pf, pf->fd)) < 0)
+	procfile_close(pf);
+    return sts;
+}
+
+void
+procfile_close(procfile_t *pf)
+{
+    if (pf->fd >= 0) {
+	close(pf->fd);
+	pf->fd = -1;
+    }
+}
+
+/*
+ * Iterate over the lines of a buffer filled by procfile_read, e.g.
+ *
+ *	char *next = pf->buf;
+ *	while ((line = procfile_getline(&next)) != NULL)
+ *	    ...
+ *
+ * Each line is null terminated in place (the newline is overwritten).
+ */
+char *
+procfile_getline(char **next)
+{
+    char	*line = *next;
+    char	*p;
+
+    if (*line == '\0')
+	return NULL;
+    for (p = line; *p != '\n' && *p != '\0'; p++)
+	;
+    if (*p == '\n')
+	*p++ = '\0';
+    *next = p;
+    return line;
+}
+
+/*
+ * Index of name in a table of structures of the given size, each
+ * starting with the name of a field, and terminated by a NULL name,
+ * else -1.  The result is remembered for this line number, and if the
+ * line has the same name on the next refresh the table is not searched.
+ */
+int
+procfile_field(procfile_t *pf, int line, const char *name,
+		const void *table, size_t stride)
+{
+    procfile_index_t	*ip = NULL;
+    const char		*field;
+    int			size;
+    int			i;
+
+    if (line >= pf->nindex) {
+	size = line + 16;
+	ip = (procfile_index_t *)realloc(pf->index, size * sizeof(*ip));
+	if (ip != NULL) {
+	    memset(&ip[pf->nindex], 0, (size - pf->nindex) * sizeof(*ip));
+	    pf->index = ip;
+	    pf->nindex = size;
+	}
+    }
+    if (line < pf->nindex) {
+	ip = &pf->index[line];
+	if (ip->name != NULL && strcmp(ip->name, name) == 0)
+	    return ip->field;
+    }
+
+    /* new (or changed) line, search the table */
+    for (i = 0; ; i++) {
+	field = *(const char **)((const char *)table + i * stride);
+	if (field == NULL) {
+	    i = -1;
+	    break;
+	}
+	if (strcmp(field, name) == 0)
+	    break;
+    }
+    if (ip != NULL) {
+	free(ip->name);
+	ip->name = strdup(name);
+	ip->field = i;
+    }
+    return i;
+}
+
+char *
+procfile_skipspace(char *p)
+{
+    while (*p == ' ' || *p == '\t')
+	p++;
+    return p;
+}
+
+/*
+ * Decimal value following optional blanks at p, in place of
+ * sscanf(p, "%llu", vp).  Returns the address following the digits,
+ * else NULL (and *vp is unchanged) if there are none.
+ */
+char *
+procfile_strtoull(char *p, unsigned long long *vp)
+{
+    unsigned long long	v = 0;
+
+    p = procfile_skipspace(p);
+    if (!isdigit((int)*p))
+	return NULL;
+    do {
+	v = v * 10 + (*p++ - '0');
+    } while (isdigit((int)*p));
+    *vp = v;
+    return p;
+}
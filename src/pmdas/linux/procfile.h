@@ -0,0 +1,60 @@
+/*
+ * Copyright (c) 2026 Red Hat.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ */
+
+#ifndef _PROCFILE_H
+#define _PROCFILE_H
+/*
+ * A /proc (or /sys) file that is read on every refresh.  The file is
+ * opened once, below linux_statspath, and kept open until exit, and
+ * each refresh re-reads it from the start with pread(2) into a buffer
+ * that is reused (and grown as needed) from one refresh to the next.
+ *
+ * Declared statically, with only the path initialized, e.g.
+ *
+ *	static procfile_t meminfo = { "/proc/meminfo", -1 };
+ *
+ * Files whose contents depend on the namespace of the reader (e.g.
+ * /proc/net/dev) must be opened afresh when reading on behalf of a
+ * container - pass PROCFILE_REOPEN for these.
+ *
+ * For "name value" files such as /proc/meminfo and /proc/vmstat, the
+ * lines come in the same order every time, so procfile_field() keeps
+ * the field table index matching each line, and costs one strcmp per
+ * line rather than a search of the table.
+ */
+typedef struct {
+    char	*name;		/* name at the start of this line */
+    int		field;		/* matching field table index, else -1 */
+} procfile_index_t;
+
+typedef struct {
+    const char	*path;		/* below linux_statspath */
+    int		fd;		/* kept open, else -1 */
+    char	*buf;		/* contents, null terminated */
+    size_t	len;		/* bytes in buf, excluding the null */
+    size_t	size;		/* allocated size of buf */
+    procfile_index_t *index;	/* per-line procfile_field() cache */
+    int		nindex;
+} procfile_t;
+
+#define PROCFILE_REOPEN	0x1	/* read via a transient fd */
+
+extern int procfile_read(procfile_t *, int);
+extern void procfile_close(procfile_t *);
+extern char *procfile_getline(char **);
+extern int procfile_field(procfile_t *, int, const char *, const void *, size_t);
+extern char *procfile_skipspace(char *);
+extern char *procfile_strtoull(char *, unsigned long long *);
+
+#endif /* _PROCFILE_H */
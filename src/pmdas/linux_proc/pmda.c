@@ -3040,6 +3040,26 @@ proc_fetchCallBack(pmdaMetric *mdesc, unsigned int inst, pmAtomValue *atom)
     return PMDA_FETCH_STATIC;
 }
 
+/*
+ * batch callback provided to pmdaFetch, all instances of one metric
+ */
+
+static int
+proc_fetchBatchCallBack(pmdaMetric *mdesc, pmdaFetchBatch *batch)
+{
+    pmAtomValue		atom;
+    int			i;
+    int			sts;
+
+    for (i = 0; i < batch->numinst; i++) {
+	sts = proc_fetchCallBack(mdesc, batch->instlist[i], &atom);
+	if (sts == PM_ERR_PMID)
+	    return sts;
+	pmdaFetchBatchValue(batch, i, sts, &atom);
+    }
+    return 0;
+}
+
 static int
 proc_fetch(int numpmid, pmID pmidlist[], pmResult **resp, pmdaExt *pmda)
 {
@@ -3286,7 +3306,7 @@ proc_init(pmdaInterface *dp)
 	int sep = __pmPathSeparator();
 	snprintf(helppath, sizeof(helppath), "%s%c" "proc" "%c" "help",
 		pmGetConfig("PCP_PMDAS_DIR"), sep, sep);
-	pmdaDSO(dp, PMDA_INTERFACE_6, "proc DSO", helppath);
+	pmdaDSO(dp, PMDA_INTERFACE_7, "proc DSO", helppath);
     }
 
     if (dp->status != 0)
@@ -3303,6 +3323,7 @@ proc_init(pmdaInterface *dp)
     dp->version.six.attribute = proc_ctx_attrs;
     pmdaSetEndContextCallBack(dp, proc_ctx_end);
     pmdaSetFetchCallBack(dp, proc_fetchCallBack);
+    pmdaSetFetchBatchCallBack(dp, proc_fetchBatchCallBack);
 
     /*
      * Initialize the instance domain table.
@@ -3390,7 +3411,7 @@ main(int argc, char **argv)
     __pmSetProgname(argv[0]);
     snprintf(helppath, sizeof(helppath), "%s%c" "proc" "%c" "help",
 		pmGetConfig("PCP_PMDAS_DIR"), sep, sep);
-    pmdaDaemon(&dispatch, PMDA_INTERFACE_6, pmProgname, PROC, "proc.log", helppath);
+    pmdaDaemon(&dispatch, PMDA_INTERFACE_7, pmProgname, PROC, "proc.log", helppath);
 
     while ((c = pmdaGetOptions(argc, argv, &opts, &dispatch)) != EOF) {
 	switch (c) {
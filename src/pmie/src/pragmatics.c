@@ -1091,6 +1091,130 @@ mark_all(Host *hdown)
     }
 }
 
+/* report failed fetch, and mark host of Fetch as "down" */
+static void
+fetchFailed(Fetch *f, int sts)
+{
+    Host	*h = f->host;
+
+    f->result = NULL;
+    if (h->down)
+	/* already reported for another Fetch of this host */
+	return;
+    __pmNotifyErr(LOG_ERR, "pmFetch from %s failed: %s\n",
+		symName(h->name), pmErrStr(sts));
+    host_state_changed(symName(h->conn), STATE_LOSTCONN);
+    h->down = 1;
+    mark_all(h);
+}
+
+/*
+ * Live fetches for a Task are all sent before any reply is collected,
+ * so the time taken is that of the slowest host rather than the sum
+ * over all hosts.  Hosts that have not replied within the request
+ * timeout are treated as down, as pmFetch() would have done.
+ *
+ * Only one fetch may be outstanding on a pmcd connection, and the
+ * contexts for a host may share one, so a Fetch whose connection is
+ * busy is sent in the next round, once the replies to this one are in.
+ */
+static void
+fetchAll(Task *t)
+{
+    static Fetch	**sent;		/* Fetches with a reply pending */
+    static int		*fds;		/* their pmcd sockets, -1 once done */
+    static int		*ready;
+    static int		size;
+    Host		*h;
+    Fetch		*f;
+    int			nsent;
+    int			nbusy;
+    int			nwait;
+    int			i;
+    int			sts;
+    double		limit = __pmRequestTimeout();
+    struct timeval	start;
+    struct timeval	now;
+    struct timeval	timeout;
+
+    for (h = t->hosts; h != NULL; h = h->next) {
+	for (f = h->fetches; f != NULL; f = f->next) {
+	    if (f->result) pmFreeResult(f->result);
+	    f->result = NULL;
+	}
+    }
+
+    do {
+	nsent = nbusy = 0;
+	for (h = t->hosts; h != NULL; h = h->next) {
+	    for (f = h->fetches; f != NULL; f = f->next) {
+		if (h->down || f->result != NULL)
+		    continue;
+		if ((sts = __pmFetchSend(f->handle, f->npmids, f->pmids)) < 0) {
+		    if (sts == PM_ERR_AGAIN)
+			/* connection shared with a Fetch already sent */
+			nbusy++;
+		    else
+			fetchFailed(f, sts);
+		    continue;
+		}
+		if (nsent == size) {
+		    size = size ? size * 2 : 16;
+		    sent = (Fetch **) ralloc(sent, size * sizeof(Fetch *));
+		    fds = (int *) ralloc(fds, size * sizeof(int));
+		    ready = (int *) ralloc(ready, size * sizeof(int));
+		}
+		sent[nsent] = f;
+		fds[nsent] = sts;
+		nsent++;
+	    }
+	}
+
+	__pmtimevalNow(&start);
+	nwait = nsent;
+	while (nwait > 0) {
+	    if (limit > 0) {
+		__pmtimevalNow(&now);
+		if (limit - __pmtimevalSub(&now, &start) <= 0)
+		    break;
+		__pmtimevalFromReal(limit - __pmtimevalSub(&now, &start), &timeout);
+	    }
+	    sts = __pmPollFds(nsent, fds, ready, 0, limit > 0 ? &timeout : NULL);
+	    if (sts < 0 && oserror() == EINTR)
+		continue;
+	    if (sts <= 0)
+		break;
+	    for (i = 0; i < nsent; i++) {
+		if (fds[i] < 0 || !ready[i])
+		    continue;
+		fds[i] = -1;
+		nwait--;
+		f = sent[i];
+		if ((sts = __pmFetchRecv(f->handle, &f->result)) < 0)
+		    fetchFailed(f, sts);
+	    }
+	}
+
+	/* no reply in time */
+	for (i = 0; i < nsent; i++) {
+	    if (fds[i] < 0)
+		continue;
+	    f = sent[i];
+	    fetchFailed(f, __pmFetchCancel(f->handle));
+	}
+    } while (nbusy > 0 && nsent > 0);
+
+    if (nbusy > 0) {
+	/* nothing was sent, so no busy connection is going to free up */
+	for (h = t->hosts; h != NULL; h = h->next) {
+	    for (f = h->fetches; f != NULL; f = f->next) {
+		if (!h->down && f->result == NULL)
+		    fetchFailed(f, PM_ERR_AGAIN);
+	    }
+	}
+    }
+}
+
 /* execute fetches for given Task */
 void
 taskFetch(Task *t)
@@ -1105,29 +1229,21 @@ taskFetch(Task *t)
     int		sts;
 
     /* do all fetches, quick as you can */
-    h = t->hosts;
-    while (h) {
-	f = h->fetches;
-	while (f) {
-	    if (f->result) pmFreeResult(f->result);
-	    if (! h->down) {
+    if (! archives)
+	fetchAll(t);
+    else {
+	h = t->hosts;
+	while (h) {
+	    f = h->fetches;
+	    while (f) {
+		if (f->result) pmFreeResult(f->result);
 		pmUseContext(f->handle);
-		if ((sts = pmFetch(f->npmids, f->pmids, &f->result)) < 0) {
-		    if (! archives) {
-			__pmNotifyErr(LOG_ERR, "pmFetch from %s failed: %s\n",
-				symName(f->host->name), pmErrStr(sts));
-			host_state_changed(symName(f->host->conn), STATE_LOSTCONN);
-			h->down = 1;
-			mark_all(h);
-		    }
+		if ((sts = pmFetch(f->npmids, f->pmids, &f->result)) < 0)
 		    f->result = NULL;
-		}
+		f = f->next;
 	    }
-	    else
-		f->result = NULL;
-	    f = f->next;
+	    h = h->next;
 	}
-	h = h->next;
     }
 
     /* sort and distribute pmValueSets to requesting Metrics */
@@ -74,9 +74,10 @@ checklabel(FILE *f, char *fname)
 	    fname, label.ill_magic & 0xffffff00, PM_LOG_MAGIC);
 	sts = STS_FATAL;
     }
-    if ((label.ill_magic & 0xff) != PM_LOG_VERS02) {
-	fprintf(stderr, "%s: bad label version: %d not %d as expected\n",
-	    fname, label.ill_magic & 0xff, PM_LOG_VERS02);
+    if ((label.ill_magic & 0xff) != PM_LOG_VERS02 &&
+	(label.ill_magic & 0xff) != PM_LOG_VERS02_DELTA) {
+	fprintf(stderr, "%s: bad label version: %d not %d or %d as expected\n",
+	    fname, label.ill_magic & 0xff, PM_LOG_VERS02, PM_LOG_VERS02_DELTA);
 	sts = STS_FATAL;
     }
     if (log_label.ill_start.tv_sec == 0) {
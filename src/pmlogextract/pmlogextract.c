@@ -38,6 +38,7 @@ static pmLongOptions longopts[] = {
     { "samples", 1, 's', "NUM", "terminate after NUM log records have been written" },
     PMOPT_FINISH,
     { "", 1, 'v', "SAMPLES", "switch log volumes after this many samples" },
+    { "", 1, 'V', "VERSION", "output archive version, 2 or delta [default is input version]" },
     { "", 0, 'w', 0, "ignore day/month/year" },
     PMOPT_TIMEZONE,
     PMOPT_HOSTZONE,
@@ -45,7 +46,7 @@ static pmLongOptions longopts[] = {
 };
 
 static pmOptions opts = {
-    .short_options = "c:D:dfS:s:T:v:wZ:z?",
+    .short_options = "c:D:dfS:s:T:v:V:wZ:z?",
     .long_options = longopts,
     .short_usage = "[options] input-archive output-archive",
 };
@@ -268,12 +269,15 @@ typedef struct {
 static int	exit_status = 0;
 static int	inarchvers = PM_LOG_VERS02;	/* version of input archive */
 static int	outarchvers = PM_LOG_VERS02;	/* version of output archive */
+static int	Varg = 0;			/* -V arg - output archive version */
 static int	first_datarec = 1;		/* first record flag */
 static int	pre_startwin = 1;		/* outside time win flag */
 static int	written = 0;			/* num log writes so far */
 int		ml_numpmid = 0;			/* num pmid in ml list */
 int		ml_size = 0;			/* actual size of ml array */
 mlist_t		*ml = NULL;			/* list of pmids with indoms */
+static int	ml_nfilter = 0;			/* num pmid in ml_filter */
+static pmID	*ml_filter = NULL;		/* sorted pmids from ml list */
 rlist_t		*rl = NULL;			/* list of pmResults */
 
 
@@ -433,16 +437,16 @@ newlabel(void)
 
     /* check version number */
     inarchvers = iap->label.ll_magic & 0xff;
-    outarchvers = inarchvers;
+    outarchvers = Varg ? Varg : inarchvers;
 
-    if (inarchvers != PM_LOG_VERS02) {
+    if (inarchvers != PM_LOG_VERS02 && inarchvers != PM_LOG_VERS02_DELTA) {
 	fprintf(stderr,"%s: Error: illegal version number %d in archive (%s)\n",
 		pmProgname, inarchvers, iap->name);
 	abandon_extract();
     }
 
-    /* copy magic number, pid, host and timezone */
-    lp->ill_magic = iap->label.ll_magic;
+    /* set magic number, copy pid, host and timezone */
+    lp->ill_magic = PM_LOG_MAGIC | outarchvers;
     lp->ill_pid = (int)getpid();
     strncpy(lp->ill_hostname, iap->label.ll_hostname, PM_LOG_MAXHOSTLEN);
     lp->ill_hostname[PM_LOG_MAXHOSTLEN-1] = '\0';
@@ -463,8 +467,13 @@ newlabel(void)
     for (i=0; i<inarchnum; i++) {
 	iap = &inarch[i];
 
-	/* Ensure all archives of the same version number */
-        if ((iap->label.ll_magic & 0xff) != inarchvers) {
+	/*
+	 * Ensure all archives of compatible version numbers ... delta
+	 * encoded archives differ from version 2 only in the encoding of
+	 * the data volumes, which libpcp undoes, so the two may be mixed
+	 */
+	if ((iap->label.ll_magic & 0xff) != PM_LOG_VERS02 &&
+	    (iap->label.ll_magic & 0xff) != PM_LOG_VERS02_DELTA) {
 	    fprintf(stderr, 
 		"%s: Error: input archives with different version numbers\n"
 		"archive: %s version: %d\n"
@@ -1301,7 +1310,7 @@ nextlog(void)
 	lcp = ctxp->c_archctl->ac_log;
 
 againlog:
-	if ((sts=__pmLogRead(lcp, PM_MODE_FORW, NULL, &iap->_result, PMLOGREAD_NEXT)) < 0) {
+	if ((sts=__pmLogReadFilter(lcp, PM_MODE_FORW, NULL, &iap->_result, PMLOGREAD_NEXT, ml_nfilter, ml_filter)) < 0) {
 	    if (sts != PM_ERR_EOL) {
 		fprintf(stderr, "%s: Error: __pmLogRead[log %s]: %s\n",
 			pmProgname, iap->name, pmErrStr(sts));
@@ -1451,6 +1460,19 @@ parseargs(int argc, char *argv[])
 	    }
 	    break;
 
+	case 'V':	/* output archive version */
+	    if (strcmp(opts.optarg, "delta") == 0) {
+		Varg = PM_LOG_VERS02_DELTA;
+		break;
+	    }
+	    Varg = (int)strtol(opts.optarg, &endnum, 10);
+	    if (*endnum != '\0' || Varg != PM_LOG_VERS02) {
+		pmprintf("%s: -V requires a version number of %d, or delta\n",
+			pmProgname, PM_LOG_VERS02);
+		opts.errors++;
+	    }
+	    break;
+
 	case 'w':	/* ignore day/month/year */
 	    warg++;
 	    break;
@@ -1516,6 +1538,36 @@ parseconfig(void)
     return(-errflag);
 }
 
+static int
+pmidcmp(const void *a, const void *b)
+{
+    pmID	pa = *(const pmID *)a;
+    pmID	pb = *(const pmID *)b;
+
+    return pa < pb ? -1 : pa > pb;
+}
+
+/*
+ * the pmids from the config file, sorted for __pmLogReadFilter() so
+ * that pmValueSets for other metrics are dropped before they are
+ * decoded, and records with none of our metrics are skipped entirely
+ */
+static void
+setfilter(void)
+{
+    int		j;
+
+    if ((ml_filter = (pmID *)malloc(ml_numpmid * sizeof(pmID))) == NULL) {
+	fprintf(stderr, "%s: Error: cannot malloc space for pmid filter.\n",
+		pmProgname);
+	exit(1);
+    }
+    for (j=0; j<ml_numpmid; j++)
+	ml_filter[j] = ml[j].idesc->pmid;
+    qsort(ml_filter, ml_numpmid, sizeof(pmID), pmidcmp);
+    ml_nfilter = ml_numpmid;
+}
+
 /*
  *  we are within time window ... return 0
  *  we are outside of time window & mk new window ... return 1
@@ -1916,6 +1968,8 @@ main(int argc, char **argv)
      */
     if (configfile && parseconfig() < 0)
 	exit(1);
+    if (ml != NULL && ml_numpmid > 0)
+	setfilter();
 
     if (zarg) {
 	/* use TZ from metrics source (input-archive) */
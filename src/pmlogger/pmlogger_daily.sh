@@ -235,6 +235,16 @@ done
 
 [ $# -ne 0 ] && _usage
 
+# with a block index, libpcp can seek within xz-compressed data volumes
+# without decompressing them from the start
+if [ "$COMPRESS" = xz ]
+then
+    if xz --long-help 2>/dev/null | grep -e --block-size >/dev/null
+    then
+	COMPRESS="xz --block-size=10MiB"
+    fi
+fi
+
 # after argument checking, everything must be logged to ensure no mail is
 # accidentally sent from cron.  Close stdout and stderr, then open stdout
 # as our logfile and redirect stderr there too.
@@ -64,6 +64,7 @@ pmnewlog options:
   --help
 
 pmlogger options:
+  -b=SIZE, --batch=SIZE   group archive writes by size or time
   --debug
   -c=FILE, --config=FILE  file to load configuration from
   -l=FILE, --log=FILE     redirect diagnostics and trace output
@@ -283,7 +284,7 @@ do
 		args="${args}$1 "
 		;;
 
-	-D|-K|-m|-t|-T|-v)
+	-b|-D|-K|-m|-t|-T|-v)
 		args="${args}$1 $2 "
 		shift
 		;;
@@ -1283,7 +1283,7 @@ sendstatus(void)
 	ls.ls_timenow.tv_sec = (__int32_t)now.tv_sec;
 	ls.ls_timenow.tv_usec = (__int32_t)now.tv_usec;
 	ls.ls_vol = logctl.l_curvol;
-	ls.ls_size = ftell(logctl.l_mfp);
+	ls.ls_size = __pmLogTell(&logctl, logctl.l_mfp);
 	assert(ls.ls_size >= 0);
 
 	/* be careful of buffer size mismatches when copying strings */
@@ -1359,12 +1359,12 @@ do_request(__pmPDU *pb)
 
 	case LOG_REQUEST_SYNC:
 	    /*
-	     * Don't need to check access controls, as this is now
-	     * a no-op with unbuffered I/O from pmlogger.
-	     *
-	     * Do nothing, simply send status 0 back to pmlc.
+	     * Don't need to check access controls, as this only
+	     * writes out records staged with -b, else it is a no-op
+	     * with unbuffered I/O from pmlogger.
 	     */
-	    sts = __pmSendError(clientfd, FROM_ANON, 0);
+	    sts = __pmLogBatchFlush(&logctl);
+	    sts = __pmSendError(clientfd, FROM_ANON, sts);
 	    break;
 
 	/*
@@ -54,6 +54,10 @@ static int 	    pmcdfd = -1;	/* comms to pmcd */
 static __pmFdSet    fds;		/* file descriptors mask for select */
 static int	    numfds;		/* number of file descriptors in mask */
 
+static int	batch;		/* group commit of archive writes, see -b */
+static __int64_t batch_bytes = 64 * 1024;
+static struct timeval batch_time = { 5, 0 };
+
 static int	rsc_fd = -1;	/* recording session control see -x */
 static int	rsc_replay;
 static time_t	rsc_start;
@@ -62,6 +66,19 @@ static char	*folio_name = "<unknown>";
 static char	*dialog_title = "PCP Archive Recording Session";
 static int	sep;
 
+/*
+ * write out archive records staged by -b, before cleanup() removes
+ * the control files
+ */
+static void
+batch_done(void)
+{
+    int		sts;
+
+    if ((sts = __pmLogBatchStop(&logctl)) < 0)
+	fprintf(stderr, "pmlogger: archive write failed: %s\n", pmErrStr(sts));
+}
+
 void
 run_done(int sts, char *msg)
 {
@@ -81,9 +98,10 @@ run_done(int sts, char *msg)
 	__pmTimeval	tmp;
 	tmp.tv_sec = (__int32_t)last_stamp.tv_sec;
 	tmp.tv_usec = (__int32_t)last_stamp.tv_usec;
-	fseek(logctl.l_mfp, last_log_offset, SEEK_SET);
+	__pmLogSeek(&logctl, logctl.l_mfp, last_log_offset);
 	__pmLogPutIndex(&logctl, &tmp);
     }
+    batch_done();
 
     exit(sts);
 }
@@ -317,7 +335,7 @@ do_dialog(char cmd)
 	/* hack is close enough! */
 	now = 1;
 
-    archsize = vol_bytes + ftell(logctl.l_mfp);
+    archsize = vol_bytes + __pmLogTell(&logctl, logctl.l_mfp);
 
     nchar = add_msg(&p, 0, "");
     p[0] = '\0';
@@ -464,6 +482,7 @@ failed:
 
 static pmLongOptions longopts[] = {
     PMAPI_OPTIONS_HEADER("Options"),
+    { "batch", 1, 'b', "SIZE", "group archive writes by size or time" },
     { "config", 1, 'c', "FILE", "file to load configuration from" },
     { "check", 0, 'C', 0, "parse configuration and exit" },
     PMOPT_DEBUG,
@@ -483,7 +502,7 @@ static pmLongOptions longopts[] = {
     { "", 0, 'u', 0, "output is unbuffered [default now, so -u is a no-op]" },
     { "username", 1, 'U', "USER", "in daemon mode, run as named user [default pcp]" },
     { "volsize", 1, 'v', "SIZE", "switch log volumes after size has been accumulated" },
-    { "version", 1, 'V', "NUM", "version for archive (default and only version is 2)" },
+    { "version", 1, 'V', "VERSION", "version for archive, 2 (default) or delta" },
     { "", 1, 'x', "FD", "control file descriptor for running from pmRecordControl(3)" },
     { "", 0, 'y', 0, "set timezone for times to local time rather than from PMCD host" },
     PMOPT_HELP,
@@ -491,7 +510,7 @@ static pmLongOptions longopts[] = {
 };
 
 static pmOptions opts = {
-    .short_options = "c:CD:h:l:K:Lm:n:op:Prs:T:t:uU:v:V:x:y?",
+    .short_options = "b:c:CD:h:l:K:Lm:n:op:Prs:T:t:uU:v:V:x:y?",
     .long_options = longopts,
     .short_usage = "[options] archive",
 };
@@ -559,6 +578,8 @@ main(int argc, char **argv)
     __pmContext  	*ctxp;		/* pmlogger has just this one context */
     int			niter;
     pid_t               target_pid = 0;
+    __int64_t		bytes;
+    struct timeval	interval;
 
     __pmGetUsername(&username);
     sep = __pmPathSeparator();
@@ -574,6 +595,20 @@ main(int argc, char **argv)
     while ((c = pmgetopt_r(argc, argv, &opts)) != EOF) {
 	switch (c) {
 
+	case 'b':		/* group commit of archive writes */
+	    sts = ParseSize(opts.optarg, &i, &bytes, &interval);
+	    if (sts < 0 || i != -1) {
+		pmprintf("%s: illegal size argument '%s' for batch size\n",
+			pmProgname, opts.optarg);
+		opts.errors++;
+	    }
+	    else if (bytes != -1)
+		batch_bytes = bytes;
+	    else
+		batch_time = interval;
+	    batch = 1;
+	    break;
+
 	case 'c':		/* config file */
 	    if (access(opts.optarg, F_OK) == 0)
 		configfile = strdup(opts.optarg);
@@ -723,9 +758,13 @@ main(int argc, char **argv)
 	    break;
 
         case 'V': 
+	    if (strcmp(opts.optarg, "delta") == 0) {
+		archive_version = PM_LOG_VERS02_DELTA;
+		break;
+	    }
 	    archive_version = (int)strtol(opts.optarg, &endnum, 10);
 	    if (*endnum != '\0' || archive_version != PM_LOG_VERS02) {
-		pmprintf("%s: -V requires a version number of %d\n",
+		pmprintf("%s: -V requires a version number of %d, or delta\n",
 			 pmProgname, PM_LOG_VERS02); 
 		opts.errors++;
 	    }
@@ -1002,6 +1041,16 @@ main(int argc, char **argv)
 	fprintf(stderr, "Warning: problem writing archive preamble: %s\n",
 	    pmErrStr(sts));
 
+    if (batch) {
+	if ((sts = __pmLogBatchStart(&logctl, batch_bytes, &batch_time)) < 0)
+	    fprintf(stderr, "Warning: archive writes will not be batched: %s\n",
+		pmErrStr(sts));
+#if defined(HAVE_ATEXIT)
+	else
+	    atexit(batch_done);
+#endif
+    }
+
     sts = 0;		/* default exit status */
 
     parse_done = 1;	/* enable callback processing */
@@ -1223,6 +1272,8 @@ newvolume(int vol_switch_type)
     };
 
     vol_samples_counter = 0;
+    /* staged records belong to the old volume, and stdio is used below */
+    __pmLogBatchFlush(&logctl);
     vol_bytes += ftell(logctl.l_mfp);
     if (exit_bytes != -1) {
         if (vol_bytes >= exit_bytes) 
@@ -39,7 +39,8 @@ typedef struct {
 __pmPDU *
 rewrite_pdu(__pmPDU *pb, int version)
 {
-    if (version == PM_LOG_VERS02)
+    /* delta encoding differs only in how libpcp writes the data volume */
+    if (version == PM_LOG_VERS02 || version == PM_LOG_VERS02_DELTA)
 	return pb;
 
     fprintf(stderr, "Errors: do not know how to re-write the PDU buffer for a version %d archive\n", version);
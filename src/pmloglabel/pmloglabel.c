@@ -93,7 +93,7 @@ verify_label(FILE *f, const char *file)
 	fprintf(stderr, "Bad magic (%x) in %s\n", magic, file);
 	status = 2;
     }
-    if (version != PM_LOG_VERS02) {
+    if (version != PM_LOG_VERS02 && version != PM_LOG_VERS02_DELTA) {
 	fprintf(stderr, "Bad version (%x) in %s\n", version, file);
 	status = 2;
     }
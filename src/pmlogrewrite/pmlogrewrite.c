@@ -40,6 +40,7 @@ static pmLongOptions longopts[] = {
     { "quick", 0, 'q', 0, "quick mode, no output if no change" },
     { "scale", 0, 's', 0, "do scale conversion" },
     { "verbose", 0, 'v', 0, "increased diagnostic verbosity" },
+    { "", 1, 'V', "VERSION", "output archive version, 2 or delta [default is input version]" },
     { "warnings", 0, 'w', 0, "emit warnings [default is silence]" },
     PMAPI_OPTIONS_TEXT(""),
     PMAPI_OPTIONS_TEXT("output-archive is required unless -i is specified"),
@@ -47,7 +48,7 @@ static pmLongOptions longopts[] = {
 };
 
 static pmOptions opts = {
-    .short_options = "c:CdD:iqsvw?",
+    .short_options = "c:CdD:iqsvV:w?",
     .long_options = longopts,
     .short_usage = "[options] input-archive [output-archive]",
 };
@@ -76,6 +77,7 @@ int	iflag;				/* -i in-place */
 int	qflag;				/* -q quick or quiet */
 int	sflag;				/* -s scale values */
 int	vflag;				/* -v verbosity */
+static int	Vflag;			/* -V output archive version */
 int	wflag;				/* -w emit warnings */
 
 /*
@@ -129,8 +131,11 @@ newlabel(void)
 {
     __pmLogLabel	*lp = &outarch.logctl.l_label;
 
-    /* copy magic number, pid, host and timezone */
-    lp->ill_magic = inarch.label.ll_magic;
+    /* copy (or set) magic number, copy pid, host and timezone */
+    if (Vflag)
+	lp->ill_magic = PM_LOG_MAGIC | Vflag;
+    else
+	lp->ill_magic = inarch.label.ll_magic;
     lp->ill_pid = inarch.label.ll_pid;
     if (global.flags & GLOBAL_CHANGE_HOSTNAME)
 	strncpy(lp->ill_hostname, global.hostname, PM_LOG_MAXHOSTLEN);
@@ -255,6 +260,7 @@ parseargs(int argc, char *argv[])
     int			c;
     int			sts;
     int			sep = __pmPathSeparator();
+    char		*endnum;
     struct stat		sbuf;
 
     while ((c = pmgetopt_r(argc, argv, &opts)) != EOF) {
@@ -351,6 +357,19 @@ parseargs(int argc, char *argv[])
 	    vflag++;
 	    break;
 
+	case 'V':	/* output archive version */
+	    if (strcmp(opts.optarg, "delta") == 0) {
+		Vflag = PM_LOG_VERS02_DELTA;
+		break;
+	    }
+	    Vflag = (int)strtol(opts.optarg, &endnum, 10);
+	    if (*endnum != '\0' || Vflag != PM_LOG_VERS02) {
+		pmprintf("%s: -V requires a version number of %d, or delta\n",
+			pmProgname, PM_LOG_VERS02);
+		opts.errors++;
+	    }
+	    break;
+
 	case 'w':	/* print warnings */
 	    wflag = 1;
 	    break;
@@ -573,6 +592,8 @@ anychange(void)
 
     if (global.flags != 0)
 	return 1;
+    if (Vflag != 0 && Vflag != (inarch.label.ll_magic & 0xff))
+	return 1;
     for (ip = indom_root; ip != NULL; ip = ip->i_next) {
 	if (ip->new_indom != ip->old_indom)
 	    return 1;
@@ -905,7 +926,8 @@ main(int argc, char **argv)
 	exit(1);
     }
 
-    if ((inarch.label.ll_magic & 0xff) != PM_LOG_VERS02) {
+    if ((inarch.label.ll_magic & 0xff) != PM_LOG_VERS02 &&
+	(inarch.label.ll_magic & 0xff) != PM_LOG_VERS02_DELTA) {
 	fprintf(stderr,"%s: Error: illegal version number %d in archive (%s)\n",
 		pmProgname, inarch.label.ll_magic & 0xff, inarch.name);
 	exit(1);
@@ -1044,7 +1066,7 @@ main(int argc, char **argv)
 	exit(0);
 
     /* create output log - must be done before writing label */
-    if ((sts = __pmLogCreate("", outarch.name, PM_LOG_VERS02, &outarch.logctl)) < 0) {
+    if ((sts = __pmLogCreate("", outarch.name, Vflag ? Vflag : (inarch.label.ll_magic & 0xff), &outarch.logctl)) < 0) {
 	fprintf(stderr, "%s: Error: __pmLogCreate(%s): %s\n",
 		pmProgname, outarch.name, pmErrStr(sts));
 	abandon();
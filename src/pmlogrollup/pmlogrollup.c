@@ -0,0 +1,467 @@
+/*
+ * pmlogrollup - build a time-bucketed summary sidecar for a PCP archive
+ *
+ * Copyright (c) 2026 Red Hat.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ *
+ * Debug flags
+ *   APPL0
+ *	bucket levels and output summary
+ */
+
+#include <ctype.h>
+#include <sys/stat.h>
+#include "pmapi.h"
+#include "impl.h"
+#include "rollup.h"
+
+#define MAXLEVELS	8
+
+typedef struct {
+    unsigned int	count;
+    double		min;
+    double		max;
+    double		sum;
+    double		last;
+} bucket_t;
+
+typedef struct {
+    pmID		pmid;
+    int			inst;
+    bucket_t		*buckets[MAXLEVELS];
+} series_t;
+
+typedef struct {
+    pmDesc		desc;
+    int			skip;		/* not a numeric metric */
+    __pmHashCtl		insts;		/* inst -> series_t */
+} metric_t;
+
+static __pmHashCtl	metrics;	/* pmid -> metric_t */
+static series_t		**serieslist;
+static int		nseries;
+
+static int		nlevels;
+static rollup_level_t	levels[MAXLEVELS];
+
+static char		*oname;		/* -o arg - output file */
+
+static pmLongOptions longopts[] = {
+    PMAPI_OPTIONS_HEADER("Options"),
+    PMOPT_DEBUG,
+    { "buckets", 1, 'b', "LIST", "bucket widths [default 1min,10min,1hour]" },
+    { "output", 1, 'o', "FILE", "write rollup to FILE [default ARCHIVE.rollup]" },
+    PMOPT_HELP,
+    PMAPI_OPTIONS_END
+};
+
+static pmOptions opts = {
+    .short_options = "b:D:o:?",
+    .long_options = longopts,
+    .short_usage = "[options] archive",
+};
+
+static int
+compare_levels(const void *a, const void *b)
+{
+    const rollup_level_t	*la = (const rollup_level_t *)a;
+    const rollup_level_t	*lb = (const rollup_level_t *)b;
+
+    return (int)la->bucket - (int)lb->bucket;
+}
+
+static int
+parse_buckets(char *arg)
+{
+    struct timeval	interval;
+    char		*list = strdup(arg);
+    char		*p, *save = NULL;
+    char		*msg;
+    int			sts = 0;
+
+    if (list == NULL)
+	__pmNoMem("parse_buckets", strlen(arg), PM_FATAL_ERR);
+    nlevels = 0;
+    for (p = strtok_r(list, ",", &save); p != NULL; p = strtok_r(NULL, ",", &save)) {
+	if (nlevels == MAXLEVELS) {
+	    pmprintf("%s: at most %d bucket widths allowed\n",
+		    pmProgname, MAXLEVELS);
+	    sts = -1;
+	    break;
+	}
+	if (pmParseInterval(p, &interval, &msg) < 0) {
+	    pmprintf("%s", msg);
+	    free(msg);
+	    sts = -1;
+	    break;
+	}
+	if (interval.tv_sec < 1 || interval.tv_usec != 0) {
+	    pmprintf("%s: bucket width \"%s\" must be a whole number of seconds\n",
+		    pmProgname, p);
+	    sts = -1;
+	    break;
+	}
+	levels[nlevels++].bucket = interval.tv_sec;
+    }
+    free(list);
+    qsort(levels, nlevels, sizeof(levels[0]), compare_levels);
+    return sts;
+}
+
+static metric_t *
+lookup_metric(pmID pmid)
+{
+    __pmHashNode	*hp;
+    metric_t		*mp;
+    int			sts;
+
+    if ((hp = __pmHashSearch(pmid, &metrics)) != NULL)
+	return (metric_t *)hp->data;
+
+    if ((mp = (metric_t *)calloc(1, sizeof(metric_t))) == NULL)
+	__pmNoMem("lookup_metric", sizeof(metric_t), PM_FATAL_ERR);
+    __pmHashInit(&mp->insts);
+    if ((sts = pmLookupDesc(pmid, &mp->desc)) < 0) {
+	fprintf(stderr, "%s: Warning: no descriptor for %s: %s\n",
+		pmProgname, pmIDStr(pmid), pmErrStr(sts));
+	mp->skip = 1;
+    }
+    else {
+	switch (mp->desc.type) {
+	    case PM_TYPE_32:
+	    case PM_TYPE_U32:
+	    case PM_TYPE_64:
+	    case PM_TYPE_U64:
+	    case PM_TYPE_FLOAT:
+	    case PM_TYPE_DOUBLE:
+		break;
+	    default:
+		mp->skip = 1;
+		break;
+	}
+    }
+    if (__pmHashAdd(pmid, mp, &metrics) < 0)
+	__pmNoMem("lookup_metric", sizeof(__pmHashNode), PM_FATAL_ERR);
+    return mp;
+}
+
+static series_t *
+lookup_series(metric_t *mp, pmID pmid, int inst)
+{
+    __pmHashNode	*hp;
+    series_t		*sp;
+    size_t		need;
+    int			i;
+
+    if ((hp = __pmHashSearch((unsigned int)inst, &mp->insts)) != NULL)
+	return (series_t *)hp->data;
+
+    if ((sp = (series_t *)calloc(1, sizeof(series_t))) == NULL)
+	__pmNoMem("lookup_series", sizeof(series_t), PM_FATAL_ERR);
+    sp->pmid = pmid;
+    sp->inst = inst;
+    for (i = 0; i < nlevels; i++) {
+	need = levels[i].nbuckets * sizeof(bucket_t);
+	if ((sp->buckets[i] = (bucket_t *)calloc(levels[i].nbuckets, sizeof(bucket_t))) == NULL)
+	    __pmNoMem("lookup_series", need, PM_FATAL_ERR);
+    }
+    if (__pmHashAdd((unsigned int)inst, sp, &mp->insts) < 0)
+	__pmNoMem("lookup_series", sizeof(__pmHashNode), PM_FATAL_ERR);
+
+    need = (nseries + 1) * sizeof(series_t *);
+    if ((serieslist = (series_t **)realloc(serieslist, need)) == NULL)
+	__pmNoMem("lookup_series", need, PM_FATAL_ERR);
+    serieslist[nseries++] = sp;
+    return sp;
+}
+
+static void
+accumulate(series_t *sp, time_t when, double value)
+{
+    bucket_t	*bp;
+    __uint32_t	index;
+    int		i;
+
+    for (i = 0; i < nlevels; i++) {
+	index = when / levels[i].bucket - levels[i].first;
+	if (index >= levels[i].nbuckets)
+	    continue;		/* beyond archive end seen at startup */
+	bp = &sp->buckets[i][index];
+	if (bp->count == 0 || value < bp->min)
+	    bp->min = value;
+	if (bp->count == 0 || value > bp->max)
+	    bp->max = value;
+	bp->sum += value;
+	bp->last = value;
+	bp->count++;
+    }
+}
+
+/*
+ * Strip any .meta, .index or .<volume> suffix from an archive name,
+ * in place, to give the basename the sidecar is named after.
+ */
+static void
+strip_suffix(char *name)
+{
+    char	*q;
+    char	*p;
+
+    if ((q = strrchr(name, '.')) == NULL || strchr(q, '/') != NULL)
+	return;
+    if (strcmp(q, ".meta") == 0 || strcmp(q, ".index") == 0) {
+	*q = '\0';
+	return;
+    }
+    for (p = q + 1; isdigit((int)*p); p++)
+	;
+    if (p > q + 1 && *p == '\0')
+	*q = '\0';
+}
+
+static int
+compare_series(const void *a, const void *b)
+{
+    const series_t	*sa = *(const series_t **)a;
+    const series_t	*sb = *(const series_t **)b;
+
+    if (sa->pmid != sb->pmid)
+	return sa->pmid < sb->pmid ? -1 : 1;
+    if (sa->inst != sb->inst)
+	return sa->inst < sb->inst ? -1 : 1;
+    return 0;
+}
+
+static void
+write_rollup(const char *path, pmLogLabel *label, struct timeval *end)
+{
+    rollup_header_t	header;
+    rollup_series_t	series;
+    rollup_level_t	level;
+    rollup_value_t	value;
+    bucket_t		*bp;
+    char		tmppath[MAXPATHLEN];
+    FILE		*fp;
+    int			fd;
+    int			i, j;
+    __uint32_t		k;
+
+    qsort(serieslist, nseries, sizeof(serieslist[0]), compare_series);
+
+    /* write to a temporary file and rename, so readers never see a partial rollup */
+    snprintf(tmppath, sizeof(tmppath), "%s.XXXXXX", path);
+    if ((fd = mkstemp(tmppath)) < 0) {
+	fprintf(stderr, "%s: Error: cannot create \"%s\": %s\n",
+		pmProgname, tmppath, osstrerror());
+	exit(1);
+    }
+    if ((fp = fdopen(fd, "w")) == NULL) {
+	fprintf(stderr, "%s: Error: cannot open \"%s\": %s\n",
+		pmProgname, tmppath, osstrerror());
+	close(fd);
+	unlink(tmppath);
+	exit(1);
+    }
+    (void)fchmod(fd, 0644);
+
+    memcpy(header.magic, ROLLUP_MAGIC, sizeof(header.magic));
+    header.nlevels = htonl(nlevels);
+    header.nseries = htonl(nseries);
+    header.start = htonl(label->ll_start.tv_sec);
+    header.end = htonl(end->tv_sec);
+    fwrite(&header, sizeof(header), 1, fp);
+
+    for (i = 0; i < nseries; i++) {
+	series.pmid = htonl(serieslist[i]->pmid);
+	series.inst = htonl(serieslist[i]->inst);
+	fwrite(&series, sizeof(series), 1, fp);
+    }
+
+    for (i = 0; i < nlevels; i++) {
+	level.bucket = htonl(levels[i].bucket);
+	level.first = htonl(levels[i].first);
+	level.nbuckets = htonl(levels[i].nbuckets);
+	fwrite(&level, sizeof(level), 1, fp);
+    }
+
+    for (i = 0; i < nlevels; i++) {
+	for (j = 0; j < nseries; j++) {
+	    for (k = 0; k < levels[i].nbuckets; k++) {
+		bp = &serieslist[j]->buckets[i][k];
+		value.count = htonl(bp->count);
+		value.min = rollup_htonf((float)bp->min);
+		value.max = rollup_htonf((float)bp->max);
+		value.avg = rollup_htonf(bp->count ? (float)(bp->sum / bp->count) : 0.0);
+		value.last = rollup_htonf((float)bp->last);
+		fwrite(&value, sizeof(value), 1, fp);
+	    }
+	}
+    }
+
+    if (ferror(fp) || fclose(fp) != 0) {
+	fprintf(stderr, "%s: Error: cannot write \"%s\": %s\n",
+		pmProgname, tmppath, osstrerror());
+	unlink(tmppath);
+	exit(1);
+    }
+    if (rename(tmppath, path) < 0) {
+	fprintf(stderr, "%s: Error: cannot rename \"%s\" to \"%s\": %s\n",
+		pmProgname, tmppath, path, osstrerror());
+	unlink(tmppath);
+	exit(1);
+    }
+}
+
+int
+main(int argc, char **argv)
+{
+    int			c;
+    int			sts;
+    int			i, j;
+    char		*archive;
+    char		*base;
+    char		path[MAXPATHLEN];
+    pmLogLabel		label;
+    struct timeval	end;
+    pmResult		*rp;
+    pmValueSet		*vsp;
+    metric_t		*mp;
+    series_t		*sp;
+    pmAtomValue		atom;
+    long		nrecords = 0;
+
+    /* no derived or anon metrics, please */
+    __pmSetInternalState(PM_STATE_PMCS);
+
+    while ((c = pmgetopt_r(argc, argv, &opts)) != EOF) {
+	switch (c) {
+
+	case 'b':	/* bucket widths */
+	    if (parse_buckets(opts.optarg) < 0)
+		opts.errors++;
+	    break;
+
+	case 'D':	/* debug flag */
+	    sts = __pmParseDebug(opts.optarg);
+	    if (sts < 0) {
+		pmprintf("%s: unrecognized debug flag specification (%s)\n",
+			pmProgname, opts.optarg);
+		opts.errors++;
+	    }
+	    else
+		pmDebug |= sts;
+	    break;
+
+	case 'o':	/* output file */
+	    oname = opts.optarg;
+	    break;
+
+	case '?':
+	default:
+	    opts.errors++;
+	    break;
+	}
+    }
+
+    if (opts.errors == 0 && opts.optind != argc-1) {
+	pmprintf("%s: Error: exactly one archive argument required\n", pmProgname);
+	opts.errors++;
+    }
+    if (opts.errors) {
+	pmUsageMessage(&opts);
+	exit(1);
+    }
+
+    if (nlevels == 0) {
+	levels[nlevels++].bucket = 60;
+	levels[nlevels++].bucket = 600;
+	levels[nlevels++].bucket = 3600;
+    }
+
+    archive = argv[opts.optind];
+    if ((sts = pmNewContext(PM_CONTEXT_ARCHIVE, archive)) < 0) {
+	fprintf(stderr, "%s: Error: cannot open archive \"%s\": %s\n",
+		pmProgname, archive, pmErrStr(sts));
+	exit(1);
+    }
+    if ((sts = pmGetArchiveLabel(&label)) < 0) {
+	fprintf(stderr, "%s: Error: cannot get archive label record (%s): %s\n",
+		pmProgname, archive, pmErrStr(sts));
+	exit(1);
+    }
+    if ((sts = pmGetArchiveEnd(&end)) < 0) {
+	fprintf(stderr, "%s: Error: cannot get end of archive (%s): %s\n",
+		pmProgname, archive, pmErrStr(sts));
+	exit(1);
+    }
+
+    for (i = 0; i < nlevels; i++) {
+	levels[i].first = label.ll_start.tv_sec / levels[i].bucket;
+	levels[i].nbuckets = end.tv_sec / levels[i].bucket - levels[i].first + 1;
+#if PCP_DEBUG
+	if (pmDebug & DBG_TRACE_APPL0)
+	    fprintf(stderr, "level[%d] bucket=%us first=%u nbuckets=%u\n",
+		    i, levels[i].bucket, levels[i].first, levels[i].nbuckets);
+#endif
+    }
+
+    if (oname == NULL) {
+	if ((base = strdup(archive)) == NULL)
+	    __pmNoMem("base", strlen(archive), PM_FATAL_ERR);
+	strip_suffix(base);
+	snprintf(path, sizeof(path), "%s%s", base, ROLLUP_SUFFIX);
+	free(base);
+	oname = path;
+    }
+
+    __pmHashInit(&metrics);
+    if ((sts = pmSetMode(PM_MODE_FORW, &label.ll_start, 0)) < 0) {
+	fprintf(stderr, "%s: pmSetMode(PM_MODE_FORW ...) failed: %s\n",
+		pmProgname, pmErrStr(sts));
+	exit(1);
+    }
+
+    while ((sts = pmFetchArchive(&rp)) >= 0) {
+	nrecords++;
+	for (i = 0; i < rp->numpmid; i++) {
+	    vsp = rp->vset[i];
+	    if (vsp->numval <= 0)
+		continue;
+	    mp = lookup_metric(vsp->pmid);
+	    if (mp->skip)
+		continue;
+	    for (j = 0; j < vsp->numval; j++) {
+		if (pmExtractValue(vsp->valfmt, &vsp->vlist[j], mp->desc.type,
+				   &atom, PM_TYPE_DOUBLE) < 0)
+		    continue;
+		sp = lookup_series(mp, vsp->pmid, vsp->vlist[j].inst);
+		accumulate(sp, rp->timestamp.tv_sec, atom.d);
+	    }
+	}
+	pmFreeResult(rp);
+    }
+    if (sts != PM_ERR_EOL) {
+	fprintf(stderr, "%s: Error: pmFetchArchive: %s\n",
+		pmProgname, pmErrStr(sts));
+	exit(1);
+    }
+
+    write_rollup(oname, &label, &end);
+
+#if PCP_DEBUG
+    if (pmDebug & DBG_TRACE_APPL0)
+	fprintf(stderr, "%s: %ld records, %d series, %d levels -> %s\n",
+		pmProgname, nrecords, nseries, nlevels, oname);
+#endif
+
+    exit(0);
+}
@@ -0,0 +1,79 @@
+/*
+ * Copyright (c) 2026 Red Hat.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ */
+#ifndef PCP_ROLLUP_H
+#define PCP_ROLLUP_H
+
+/*
+ * On-disk format of the ARCHIVE.rollup sidecar written by pmlogrollup(1)
+ * and read by pmwebd(1).  All fields are in network byte order.
+ *
+ *	rollup_header_t
+ *	rollup_series_t [nseries]	sorted by (pmid, inst)
+ *	rollup_level_t  [nlevels]	increasing bucket width
+ *	for each level:
+ *	    rollup_value_t [nseries][nbuckets]	series-major
+ *
+ * Bucket i of a level covers [(first+i)*bucket, (first+i+1)*bucket)
+ * seconds since the epoch, so buckets are aligned across archives.
+ */
+
+#define ROLLUP_MAGIC	"PCPROLL1"
+#define ROLLUP_SUFFIX	".rollup"
+
+typedef struct {
+    char	magic[8];
+    __uint32_t	nlevels;
+    __uint32_t	nseries;
+    __int32_t	start;		/* archive label start, seconds */
+    __int32_t	end;		/* archive end when the rollup was built */
+} rollup_header_t;
+
+typedef struct {
+    __uint32_t	pmid;
+    __int32_t	inst;		/* PM_IN_NULL for singular metrics */
+} rollup_series_t;
+
+typedef struct {
+    __uint32_t	bucket;		/* bucket width, seconds */
+    __uint32_t	first;		/* start of first bucket, divided by width */
+    __uint32_t	nbuckets;
+} rollup_level_t;
+
+typedef struct {
+    __uint32_t	count;		/* number of samples, 0 for an empty bucket */
+    __uint32_t	min;		/* remaining fields are floats, see below */
+    __uint32_t	max;
+    __uint32_t	avg;
+    __uint32_t	last;		/* latest sample in the bucket */
+} rollup_value_t;
+
+static inline __uint32_t
+rollup_htonf(float value)
+{
+    union { float f; __uint32_t i; } u;
+
+    u.f = value;
+    return htonl(u.i);
+}
+
+static inline float
+rollup_ntohf(__uint32_t value)
+{
+    union { float f; __uint32_t i; } u;
+
+    u.i = ntohl(value);
+    return u.f;
+}
+
+#endif /* PCP_ROLLUP_H */
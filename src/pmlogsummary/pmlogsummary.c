@@ -18,6 +18,9 @@
 #include <limits.h>
 #include "pmapi.h"
 #include "impl.h"
+#if defined(HAVE_SYS_WAIT_H)
+#include <sys/wait.h>
+#endif
 
 static pmLongOptions longopts[] = {
     PMAPI_OPTIONS_HEADER("Options"),
@@ -30,6 +33,7 @@ static pmLongOptions longopts[] = {
     { "header", 0, 'H', 0, "print one-line header at start showing each column" },
     { "mintime", 0, 'i', 0, "also print timestamp for minimum value" },
     { "maxtime", 0, 'I', 0, "also print timestamp for maximum value" },
+    { "jobs", 1, 'j', "N", "summarise N partitions of the time window in parallel" },
     { "label", 0, 'l', 0, "also print the archive label and time window" },
     { "minimum", 0, 'm', 0, "also print minimum value" },
     { "maximum", 0, 'M', 0, "also print maximum value" },
@@ -51,12 +55,20 @@ static pmLongOptions longopts[] = {
 static int override(int, pmOptions *);
 static pmOptions opts = {
     .flags = PM_OPTFLAG_DONE | PM_OPTFLAG_BOUNDARIES | PM_OPTFLAG_STDOUT_TZ,
-    .short_options = "abB:D:fFHiIlmMNn:p:rsS:T:vVxyzZ:?",
+    .short_options = "abB:D:fFHiIj:lmMNn:p:rsS:T:vVxyzZ:?",
     .long_options = longopts,
     .short_usage = "[options] archive [metricname ...]",
     .override = override,
 };
 
+/*
+ * The sum, stochastic and time average of an instance are accumulated
+ * with compensated (Kahan) summation, so the partial totals from each
+ * partition (-j) merge to the total of a single pass, to within the
+ * rounding of the last digit
+ */
+enum { TERM_SUM, TERM_STOCAVE, TERM_TIMEAVE, NTERMS };
+
 typedef struct {
     int			inst;
     unsigned int	count;
@@ -74,6 +86,12 @@ typedef struct {
     int			marked;		/* seen since last "mark" record? */
     unsigned int	bintotal;	/* copy of count for 2nd pass */
     unsigned int	*bin;		/* bins for value distribution */
+    double		startval;	/* value of first sample in partition */
+    struct timeval	starttime;	/* time of first sample in partition */
+    struct timeval	ratetime;	/* time of first counter rate */
+    int			premarks;	/* marks in partition before first sample */
+    int			merged;		/* seen in the partition being merged? */
+    double		comp[NTERMS];	/* rounding compensation for totals */
 } instData;
 
 typedef struct {
@@ -103,6 +121,12 @@ static unsigned int	delimiter = ' ';/* output field separator */
 static unsigned int	nbins;		/* number of distribution bins */
 static unsigned int	precision = 3;	/* number of digits after "." */
 
+/* partitions of the time window summarised in parallel */
+static int		njobs = 1;
+static int		worker;		/* summarising one partition (-j) */
+static int		nmarks;		/* mark records seen in partition */
+static struct timeval	*marks;
+
 /* time window stuff */
 static int		dayflag;
 static char		timebuf[32];		/* for pmCtime result + .xxx */
@@ -113,6 +137,10 @@ static double		logspan;
 /* optional metric specification, optionally with instances */
 pmMetricSpec		*msp;
 
+/* pmids of the metrics to be reported (sorted), if not all of them */
+static pmID		*filter;
+static int		nfilter;
+
 /* time manipulation */
 static int
 tsub(struct timeval *a, struct timeval *b)
@@ -137,6 +165,16 @@ tadd(struct timeval *a, struct timeval *b)
     return 0;
 }
 
+static int
+tcmp(struct timeval *a, struct timeval *b)
+{
+    if (a->tv_sec != b->tv_sec)
+	return a->tv_sec < b->tv_sec ? -1 : 1;
+    if (a->tv_usec != b->tv_usec)
+	return a->tv_usec < b->tv_usec ? -1 : 1;
+    return 0;
+}
+
 static void
 pmiderr(pmID pmid, const char *msg, ...)
 {
@@ -400,41 +438,41 @@ unwrap(double current, double previous, int pmtype)
     return outval;
 }
 
-static void
-newHashInst(pmValue *vp,
-	aveData *avedata,		/* updated by this function */
-	int valfmt,
+/*
+ * Add instance inst at position pos in the instlist of avedata, with
+ * value as its first sample.  When summarising one partition of the
+ * time window (worker), the first sample of a non-counter metric only
+ * seeds the min/max here - the merge counts it, see mergeinst().
+ */
+static instData *
+addinst(aveData *avedata,		/* updated by this function */
+	int inst,
+	double value,
 	struct timeval *timestamp,	/* timestamp for this sample */
 	int pos)			/* position of this inst in instlist */
 {
-    int		sts;
+    int		j;
     size_t	size;
     instData	*instdata;
-    pmAtomValue av;
 
-    if ((sts = pmExtractValue(valfmt, vp, avedata->desc.type, &av, PM_TYPE_DOUBLE)) < 0) {
-	pmiderr(avedata->desc.pmid, "failed to extract value: %s\n", pmErrStr(sts));
-	fprintf(stderr, "%s: possibly corrupt archive?\n", pmProgname);
-	exit(1);
-    }
     size = (pos+1) * sizeof(instData *);
     avedata->instlist = (instData **) realloc(avedata->instlist, size);
     if (avedata->instlist == NULL)
-	__pmNoMem("newHashInst.instlist", size, PM_FATAL_ERR);
+	__pmNoMem("addinst.instlist", size, PM_FATAL_ERR);
     size = sizeof(instData);
     avedata->instlist[pos] = instdata = (instData *) malloc(size);
     if (instdata == NULL)
-	__pmNoMem("newHashInst.instlist[inst]", size, PM_FATAL_ERR);
+	__pmNoMem("addinst.instlist[inst]", size, PM_FATAL_ERR);
     if (nbins == 0)
 	instdata->bin = NULL;
     else {	/* we are doing binning ... make space for the bins */
 	size = nbins * sizeof(unsigned int);
 	instdata->bin = (unsigned int *)malloc(size);
 	if (instdata->bin == NULL)
-	    __pmNoMem("newHashInst.instlist[inst].bin", size, PM_FATAL_ERR);
+	    __pmNoMem("addinst.instlist[inst].bin", size, PM_FATAL_ERR);
 	memset(instdata->bin, 0, size);
     }
-    instdata->inst = vp->inst;
+    instdata->inst = inst;
     if (avedata->desc.sem == PM_SEM_COUNTER) {
 	instdata->min = 0.0;
 	instdata->max = 0.0;
@@ -445,22 +483,39 @@ newHashInst(pmValue *vp,
 	instdata->timeave = 0.0;
 	instdata->count = 0;
     }
+    else if (worker) {
+	instdata->min = value;
+	instdata->max = value;
+	instdata->sum = 0.0;
+	instdata->mintime = *timestamp;
+	instdata->maxtime = *timestamp;
+	instdata->stocave = 0.0;
+	instdata->timeave = 0.0;
+	instdata->count = 0;
+    }
     else {	/* for the other semantics */
-	instdata->min = av.d;
-	instdata->max = av.d;
-	instdata->sum = av.d;
+	instdata->min = value;
+	instdata->max = value;
+	instdata->sum = value;
 	instdata->mintime = *timestamp;
 	instdata->maxtime = *timestamp;
-	instdata->stocave = av.d;
+	instdata->stocave = value;
 	instdata->timeave = 0.0;
 	instdata->count = 1;
     }
     instdata->marked = 0;
     instdata->bintotal = 0;
     instdata->markcount = 0;
-    instdata->lastval = av.d;
+    instdata->lastval = value;
     instdata->firsttime = *timestamp;
     instdata->lasttime = *timestamp;
+    instdata->startval = value;
+    instdata->starttime = *timestamp;
+    instdata->ratetime = *timestamp;
+    instdata->premarks = nmarks;
+    instdata->merged = 0;
+    for (j = 0; j < NTERMS; j++)
+	instdata->comp[j] = 0.0;
     avedata->listsize++;
 #ifdef PCP_DEBUG
     if (pmDebug & DBG_TRACE_APPL0) {
@@ -473,6 +528,27 @@ newHashInst(pmValue *vp,
 	if (numnames > 0) free(names);
     }
 #endif
+    return instdata;
+}
+
+static void
+newHashInst(pmValue *vp,
+	aveData *avedata,		/* updated by this function */
+	int valfmt,
+	struct timeval *timestamp,	/* timestamp for this sample */
+	int pos)			/* position of this inst in instlist */
+{
+    int		sts;
+    pmAtomValue av;
+
+    if ((sts = pmExtractValue(valfmt, vp, avedata->desc.type, &av, PM_TYPE_DOUBLE)) < 0) {
+	if (!worker) {	/* else reported by the single pass that follows */
+	    pmiderr(avedata->desc.pmid, "failed to extract value: %s\n", pmErrStr(sts));
+	    fprintf(stderr, "%s: possibly corrupt archive?\n", pmProgname);
+	}
+	exit(1);
+    }
+    addinst(avedata, vp->inst, av.d, timestamp, pos);
 }
 
 static void
@@ -544,19 +620,68 @@ findbin(pmID pmid, double val, double min, double max)
     return index;
 }
 
+static double *
+termtotal(instData *instdata, int which)
+{
+    switch (which) {
+	case TERM_SUM:
+	    return &instdata->sum;
+	case TERM_STOCAVE:
+	    return &instdata->stocave;
+    }
+    return &instdata->timeave;
+}
+
+/*
+ * Add value to the sum or average selected by which, carrying the low
+ * order bits lost to rounding over into the next addition
+ */
+static void
+addterm(instData *instdata, int which, double value)
+{
+    double	*total = termtotal(instdata, which);
+    double	y, t;
+
+    y = value - instdata->comp[which];
+    t = *total + y;
+    if (fabs(t) != HUGE_VAL)
+	instdata->comp[which] = (t - *total) - y;
+    else	/* infinite, nothing to compensate */
+	instdata->comp[which] = 0.0;
+    *total = t;
+}
+
 /*
  * must keep a note for every instance of every metric whenever a mark
  * record has been seen between now & the last fetch for that instance
  */
+static void
+markinst(aveData *avedata, instData *instdata, struct timeval *stamp)
+{
+    double		val;
+    struct timeval	timediff;
+
+    if (avedata->desc.sem == PM_SEM_DISCRETE) {
+	/* extend discrete metrics to the mark point */
+	timediff = *stamp;
+	tsub(&timediff, &instdata->lasttime);
+	val = instdata->lastval;
+	addterm(instdata, TERM_STOCAVE, val);
+	addterm(instdata, TERM_TIMEAVE, val*__pmtimevalToReal(&timediff));
+	instdata->lasttime = *stamp;
+	instdata->count++;
+    }
+    instdata->marked = 1;
+    instdata->markcount++;
+}
+
 static void
 markrecord(pmResult *result)
 {
-    int			i, j;
+    int			j;
+    size_t		size;
     __pmHashNode	*hptr;
     aveData		*avedata;
-    instData		*instdata;
-    double		val;
-    struct timeval	timediff;
 
 #ifdef PCP_DEBUG
     if (pmDebug & DBG_TRACE_APPL0) {
@@ -564,25 +689,20 @@ markrecord(pmResult *result)
 	printf(" - mark record\n\n");
     }
 #endif
-    for (i = 0; i < hashlist.hsize; i++) {
-	for (hptr = hashlist.hash[i]; hptr != NULL; hptr = hptr->next) {
-	    avedata = (aveData *)hptr->data;
-	    for (j = 0; j < avedata->listsize; j++) {
-		instdata = avedata->instlist[j];
-		if (avedata->desc.sem == PM_SEM_DISCRETE) {
-		    /* extend discrete metrics to the mark point */
-		    timediff = result->timestamp;
-		    tsub(&timediff, &instdata->lasttime);
-		    val = instdata->lastval;
-		    instdata->stocave += val;
-		    instdata->timeave += val*__pmtimevalToReal(&timediff);
-		    instdata->lasttime = result->timestamp;
-		    instdata->count++;
-		}
-		instdata->marked = 1;
-		instdata->markcount++;
-	    }
-	}
+    for (hptr = __pmHashWalk(&hashlist, PM_HASH_WALK_START);
+	 hptr != NULL;
+	 hptr = __pmHashWalk(&hashlist, PM_HASH_WALK_NEXT)) {
+	avedata = (aveData *)hptr->data;
+	for (j = 0; j < avedata->listsize; j++)
+	    markinst(avedata, avedata->instlist[j], &result->timestamp);
+    }
+
+    if (worker) {
+	/* instances first seen in a later partition are not marked here */
+	size = (nmarks + 1) * sizeof(struct timeval);
+	if ((marks = (struct timeval *)realloc(marks, size)) == NULL)
+	    __pmNoMem("markrecord.marks", size, PM_FATAL_ERR);
+	marks[nmarks++] = result->timestamp;
     }
 }
 
@@ -712,13 +832,189 @@ calcbinning(pmResult *result)
     }
 }
 
+/*
+ * Fold the value sampled at stamp into the statistics for one instance
+ */
+static void
+updateinst(aveData *avedata, instData *instdata, double value, struct timeval *stamp)
+{
+    int			wrap;
+    double		val;
+    double		diff;
+    double		rate = 0;
+    struct timeval	timediff;
+
+    timediff = *stamp;
+    tsub(&timediff, &instdata->lasttime);
+    diff = __pmtimevalToReal(&timediff);
+    wrap = 0;
+    if (avedata->desc.sem == PM_SEM_COUNTER) {
+	diff *= avedata->scale;
+	if (diff == 0.0) return;
+	if (instdata->marked)
+	    val = value;
+	else
+	    val = unwrap(value, instdata->lastval, avedata->desc.type);
+#ifdef PCP_DEBUG
+	if (pmDebug & DBG_TRACE_APPL0) {
+	    int	numnames;
+	    char	**names;
+	    numnames = pmNameAll(avedata->desc.pmid, &names);
+	    __pmPrintMetricNames(stderr, numnames, names, " or ");
+	    fprintf(stderr, " base value is %f, count %d\n",
+		    val, instdata->count+1);
+	    if (numnames > 0) free(names);
+	}
+#endif
+	if (instdata->marked || val < instdata->lastval) {
+	    /* either previous record was a "mark", or this is not */
+	    /* the first one, and counter not monotonic increasing */
+#ifdef PCP_DEBUG
+	    if (pmDebug & DBG_TRACE_APPL1) {
+		int	numnames;
+		char	**names;
+		numnames = pmNameAll(avedata->desc.pmid, &names);
+		__pmPrintMetricNames(stderr, numnames, names, " or ");
+		fprintf(stderr, " counter wrapped or <mark>\n");
+		if (numnames > 0) free(names);
+	    }
+#endif
+	    wrap = 1;
+	    instdata->marked = 0;
+	    tadd(&instdata->firsttime, stamp);
+	    tsub(&instdata->firsttime, &instdata->lasttime);
+	}
+	else {
+	    rate = (val - instdata->lastval) / diff;
+	    addterm(instdata, TERM_STOCAVE, rate);
+	    if (!instdata->marked)
+		addterm(instdata, TERM_TIMEAVE, val - instdata->lastval);
+	    else {
+		instdata->marked = 0;
+		/* remove the timeslice in question from time-based calc */
+		tadd(&instdata->firsttime, stamp);
+		tsub(&instdata->firsttime, &instdata->lasttime);
+	    }
+	    if (instdata->count == 0) {		/* 1st time */
+		instdata->min = instdata->max = rate;
+		instdata->ratetime = *stamp;
+		/* sum is still zero */
+		addterm(instdata, TERM_SUM, val - instdata->lastval);
+	    }
+	    else {
+#ifdef PCP_DEBUG
+		if (pmDebug & DBG_TRACE_APPL2) {
+		    int	numnames;
+		    char	**names;
+		    char	*istr = NULL;
+
+		    numnames = pmNameAll(avedata->desc.pmid, &names);
+		    if (pmNameInDom(avedata->desc.indom,
+			instdata->inst, &istr) < 0)
+			istr = NULL;
+		    if (rate < instdata->min) {
+			fprintf(stderr, "new min value for ");
+			__pmPrintMetricNames(stderr, numnames, names, " or ");
+			fprintf(stderr, " (inst[%s]: %f) at ",
+			    (istr == NULL ? "":istr), rate);
+			__pmPrintStamp(stderr, stamp);
+			fprintf(stderr, "\n");
+		    }
+		    if (rate > instdata->max) {
+			fprintf(stderr, "new max value for ");
+			__pmPrintMetricNames(stderr, numnames, names, " or ");
+			fprintf(stderr, " (inst[%s]: %f) at ",
+			    (istr == NULL ? "":istr), rate);
+			__pmPrintStamp(stderr, stamp);
+			fprintf(stderr, "\n");
+		    }
+		    if (numnames > 0) free(names);
+		    if (istr) free(istr);
+		}
+#endif
+		if (rate < instdata->min) {
+		    instdata->min = rate;
+		    instdata->mintime = *stamp;
+		}
+		if (rate > instdata->max) {
+		    instdata->max = rate;
+		    instdata->maxtime = *stamp;
+		}
+		addterm(instdata, TERM_SUM, val - instdata->lastval);
+	    }
+	}
+    }
+    else {	/* for the other semantics - discrete & instantaneous */
+	val = value;
+	addterm(instdata, TERM_SUM, val);
+	addterm(instdata, TERM_STOCAVE, val);
+	if (val < instdata->min) {
+	    instdata->min = val;
+	    instdata->mintime = *stamp;
+	}
+	if (val > instdata->max) {
+	    instdata->max = val;
+	    instdata->maxtime = *stamp;
+	}
+	if (!instdata->marked)
+	    addterm(instdata, TERM_TIMEAVE, instdata->lastval*diff);
+	else {
+	    instdata->marked = 0;
+	    /* remove the timeslice in question from time-based calc */
+	    tadd(&instdata->firsttime, stamp);
+	    tsub(&instdata->firsttime, &instdata->lasttime);
+	}
+    }
+    if (!wrap) {
+	instdata->count++;
+#ifdef PCP_DEBUG
+	if ((pmDebug & DBG_TRACE_APPL1) &&
+	    (avedata->desc.sem != PM_SEM_COUNTER || instdata->count > 0)) {
+	    int	numnames;
+	    char	**names;
+	    double	metricspan = 0.0;
+	    struct timeval	metrictimespan;
+
+	    metrictimespan = *stamp;
+	    tsub(&metrictimespan, &instdata->firsttime);
+	    metricspan = __pmtimevalToReal(&metrictimespan);
+	    numnames = pmNameAll(avedata->desc.pmid, &names);
+	    fprintf(stderr, "++ ");
+	    __pmPrintMetricNames(stderr, numnames, names, " or ");
+
+	    if (avedata->desc.sem == PM_SEM_COUNTER) {
+		fprintf(stderr, " timedelta=%f count=%d\n"
+				"sum=%f min=%f max=%f stocsum=%f\n"
+				"rate=%f timesum=%f (+%f) timespan=%f\n",
+			diff, instdata->count, instdata->sum,
+			instdata->min, instdata->max,
+			instdata->stocave, rate, instdata->timeave,
+			diff * (val - instdata->lastval) / 2,
+			metricspan);
+	    }
+	    else {	/* non-counters */
+		fprintf(stderr, " timedelta=%f count=%d\n"
+				"sum=%f min=%f max=%f stocsum=%f\n"
+				"lastval=%f timesum=%f (+%f) timespan=%f\n",
+			diff, instdata->count, instdata->sum,
+			instdata->min, instdata->max,
+			instdata->stocave, instdata->lastval,
+			instdata->timeave, instdata->lastval*diff,
+			metricspan);
+	    }
+	    if (numnames > 0) free(names);
+	}
+#endif
+    }
+    instdata->lastval = value;
+    instdata->lasttime = *stamp;
+}
+
 static void
 calcaverage(pmResult *result)
 {
     int			i, j, k;
     int			sts;
-    int			wrap;
-    double		val;
     pmDesc		desc;
     pmAtomValue 	av;
     pmValue		*vp;
@@ -726,9 +1022,6 @@ calcaverage(pmResult *result)
     __pmHashNode	*hptr = NULL;
     aveData		*avedata = NULL;
     instData		*instdata;
-    double		diff;
-    double		rate = 0;
-    struct timeval	timediff;
 
     if (result->numpmid == 0)	/* mark record */
 	markrecord(result);
@@ -808,171 +1101,471 @@ calcaverage(pmResult *result)
 #endif
 		if (fp_bad)
 		    continue;
-		timediff = result->timestamp;
-		tsub(&timediff, &instdata->lasttime);
-		diff = __pmtimevalToReal(&timediff);
-		wrap = 0;
-		if (avedata->desc.sem == PM_SEM_COUNTER) {
-		    diff *= avedata->scale;
-		    if (diff == 0.0) continue;
-		    if (instdata->marked)
-			val = av.d;
-		    else
-			val = unwrap(av.d, instdata->lastval, avedata->desc.type);
-#ifdef PCP_DEBUG
-		    if (pmDebug & DBG_TRACE_APPL0) {
-			int	numnames;
-			char	**names;
-			numnames = pmNameAll(avedata->desc.pmid, &names);
-			__pmPrintMetricNames(stderr, numnames, names, " or ");
-			fprintf(stderr, " base value is %f, count %d\n",
-				val, instdata->count+1);
-			if (numnames > 0) free(names);
-		    }
-#endif
-		    if (instdata->marked || val < instdata->lastval) {
-			/* either previous record was a "mark", or this is not */
-			/* the first one, and counter not monotonic increasing */
-#ifdef PCP_DEBUG
-			if (pmDebug & DBG_TRACE_APPL1) {
-			    int	numnames;
-			    char	**names;
-			    numnames = pmNameAll(avedata->desc.pmid, &names);
-			    __pmPrintMetricNames(stderr, numnames, names, " or ");
-			    fprintf(stderr, " counter wrapped or <mark>\n");
-			    if (numnames > 0) free(names);
-			}
+		updateinst(avedata, instdata, av.d, &result->timestamp);
+	    }
+	}
+    }
+}
+
+/*
+ * Pass the archive records from start (if not NULL) up to end to calc(),
+ * those at end itself only when inclusive is set
+ */
+static int
+fetchloop(void (*calc)(pmResult *), struct timeval *start,
+	struct timeval *end, int inclusive)
+{
+    int			sts;
+    int			cmp;
+    pmResult		*result;
+
+    for ( ; ; ) {
+	if ((sts = __pmFetchArchiveFilter(nfilter, filter, &result)) < 0)
+	    break;
+
+	if (start != NULL && tcmp(&result->timestamp, start) < 0) {
+	    pmFreeResult(result);
+	    continue;
+	}
+	cmp = tcmp(&result->timestamp, end);
+	if (cmp < 0 || (cmp == 0 && inclusive)) {
+	    calc(result);
+	    pmFreeResult(result);
+	}
+	else {
+	    pmFreeResult(result);
+	    sts = PM_ERR_EOL;
+	    break;
+	}
+    }
+    return sts;
+}
+
+#ifndef IS_MINGW
+static void
+putdata(int fd, const void *buf, size_t len)
+{
+    const char		*p = (const char *)buf;
+    ssize_t		n;
+
+    while (len > 0) {
+	if ((n = write(fd, p, len)) < 0) {
+	    if (errno == EINTR)
+		continue;
+	    exit(1);
+	}
+	p += n;
+	len -= n;
+    }
+}
+
+static int
+getdata(int fd, void *buf, size_t len)
+{
+    char		*p = (char *)buf;
+    ssize_t		n;
+
+    while (len > 0) {
+	if ((n = read(fd, p, len)) < 0) {
+	    if (errno == EINTR)
+		continue;
+	    fprintf(stderr, "%s: partition read failed: %s\n",
+		    pmProgname, osstrerror());
+	    exit(1);
+	}
+	if (n == 0)
+	    return -1;	/* worker exited early, reaped by caller */
+	p += n;
+	len -= n;
+    }
+    return 0;
+}
+
+/*
+ * Summarise the records from start up to end (and including end for
+ * the last partition) in a new context, then send the fetch status,
+ * the mark record timestamps and the partial statistics (counts, the
+ * compensated totals, min/max and the first and last samples of each
+ * instance) up the pipe.
+ * The inherited context goes first, else the new one would share its
+ * open archive files, and so their file offsets, with every process.
+ * Errors are left for the single pass that follows a failed worker.
+ */
+static void
+partition(int ctx, const char *archive, struct timeval *start,
+	struct timeval *end, int first, int last, int fd)
+{
+    int			j;
+    int			sts;
+    int			more = 1;
+    struct timeval	origin = *start;
+    __pmHashNode	*hptr;
+    aveData		*avedata;
+
+    pmDestroyContext(ctx);
+    if (pmNewContext(PM_CONTEXT_ARCHIVE, archive) < 0)
+	exit(1);
+    if (!first) {
+	/*
+	 * position just before the partition, as setting the mode to
+	 * the exact time of a record can see that record fetched twice
+	 */
+	if (origin.tv_usec > 0)
+	    origin.tv_usec--;
+	else {
+	    origin.tv_sec--;
+	    origin.tv_usec = 999999;
+	}
+    }
+    if (pmSetMode(PM_MODE_FORW, &origin, 0) < 0)
+	exit(1);
+
+    worker = 1;
+    sts = fetchloop(calcaverage, start, end, last);
+
+    putdata(fd, &sts, sizeof(sts));
+    putdata(fd, &nmarks, sizeof(nmarks));
+    putdata(fd, marks, nmarks * sizeof(struct timeval));
+    for (hptr = __pmHashWalk(&hashlist, PM_HASH_WALK_START);
+	 hptr != NULL;
+	 hptr = __pmHashWalk(&hashlist, PM_HASH_WALK_NEXT)) {
+	avedata = (aveData *)hptr->data;
+	putdata(fd, &more, sizeof(more));
+	putdata(fd, avedata, sizeof(aveData));
+	for (j = 0; j < avedata->listsize; j++)
+	    putdata(fd, avedata->instlist[j], sizeof(instData));
+    }
+    more = 0;
+    putdata(fd, &more, sizeof(more));
+    exit(0);
+}
+
+/*
+ * Fold the statistics b for one instance from the next partition into
+ * those in a.  The marks before, and the first sample of, the partition
+ * are replayed onto a, so the step across the partition edge (counter
+ * rate, time average slice) is the one a single pass would take; the
+ * remaining statistics in b follow on from there, and the totals in b
+ * are added to those in a along with their rounding compensation.
+ * When added is set, a has just been created from that first sample.
+ */
+static void
+mergeinst(aveData *avedata, instData *a, instData *b, int added)
+{
+    int			m;
+    struct timeval	shift;
+
+    if (!added) {
+	for (m = 0; m < b->premarks; m++)
+	    markinst(avedata, a, &marks[m]);
+	updateinst(avedata, a, b->startval, &b->starttime);
+    }
+
+    if (avedata->desc.sem != PM_SEM_COUNTER) {
+	/* b starts with min/max at the first sample, which a has seen */
+	if (b->min < a->min) {
+	    a->min = b->min;
+	    a->mintime = b->mintime;
+	}
+	if (b->max > a->max) {
+	    a->max = b->max;
+	    a->maxtime = b->maxtime;
+	}
+    }
+    else if (b->count > 0) {
+	/*
+	 * b starts with min/max at its first rate, stamped with the time
+	 * of its first sample - so that time means "not since improved"
+	 */
+	if (a->count == 0 || b->min < a->min) {
+	    a->min = b->min;
+	    if (tcmp(&b->mintime, &b->starttime) != 0)
+		a->mintime = b->mintime;
+	    else if (a->count > 0)
+		a->mintime = b->ratetime;
+	}
+	if (a->count == 0 || b->max > a->max) {
+	    a->max = b->max;
+	    if (tcmp(&b->maxtime, &b->starttime) != 0)
+		a->maxtime = b->maxtime;
+	    else if (a->count > 0)
+		a->maxtime = b->ratetime;
+	}
+    }
+
+    for (m = 0; m < NTERMS; m++) {
+	addterm(a, m, *termtotal(b, m));
+	addterm(a, m, -b->comp[m]);
+    }
+    a->count += b->count;
+    a->markcount += b->markcount;
+    shift = b->firsttime;
+    tsub(&shift, &b->starttime);
+    tadd(&a->firsttime, &shift);
+    a->lastval = b->lastval;
+    a->lasttime = b->lasttime;
+    a->marked = b->marked;
+    a->merged = 1;
+}
+
+/*
+ * Merge the partial statistics of the next partition, read from fd,
+ * into the hash list, and return the fetch status of that partition
+ * via fetchsts.  Returns -1 if the worker did not complete, and 1 if
+ * the partition cannot be merged.
+ */
+static int
+mergepartial(int fd, int *fetchsts)
+{
+    int			j, k, m;
+    int			more;
+    size_t		size;
+    aveData		partial;
+    aveData		*avedata;
+    instData		b;
+    instData		*instdata;
+    __pmHashNode	*hptr;
+
+    if (getdata(fd, fetchsts, sizeof(*fetchsts)) < 0 ||
+	getdata(fd, &nmarks, sizeof(nmarks)) < 0)
+	return -1;
+    size = nmarks * sizeof(struct timeval);
+    if (nmarks > 0 && (marks = (struct timeval *)realloc(marks, size)) == NULL)
+	__pmNoMem("mergepartial.marks", size, PM_FATAL_ERR);
+    if (getdata(fd, marks, size) < 0)
+	return -1;
+
+    for ( ; ; ) {
+	if (getdata(fd, &more, sizeof(more)) < 0)
+	    return -1;
+	if (!more)
+	    break;
+	if (getdata(fd, &partial, sizeof(partial)) < 0)
+	    return -1;
+	if ((hptr = __pmHashSearch(partial.desc.pmid, &hashlist)) != NULL)
+	    avedata = (aveData *)hptr->data;
+	else {
+	    if ((avedata = (aveData *)malloc(sizeof(aveData))) == NULL)
+		__pmNoMem("mergepartial.avedata", sizeof(aveData), PM_FATAL_ERR);
+	    avedata->desc = partial.desc;
+	    avedata->scale = partial.scale;
+	    avedata->listsize = 0;
+	    avedata->instlist = NULL;
+	    if (__pmHashAdd(avedata->desc.pmid, (void*)avedata, &hashlist) < 0) {
+		fprintf(stderr, "%s: failed %s hash table insertion\n",
+			pmProgname, pmIDStr(avedata->desc.pmid));
+		exit(1);
+	    }
+	}
+	k = -1;
+	for (j = 0; j < partial.listsize; j++) {
+	    if (getdata(fd, &b, sizeof(b)) < 0)
+		return -1;
+	    /*
+	     * instances are mostly in the same order in each partition,
+	     * and singular metrics are matched by position, as in
+	     * calcaverage()
+	     */
+	    if (++k < avedata->listsize && avedata->desc.indom == PM_INDOM_NULL)
+		;
+	    else if (k >= avedata->listsize || avedata->instlist[k]->inst != b.inst) {
+		for (k = 0; k < avedata->listsize; k++) {
+		    if (avedata->instlist[k]->inst == b.inst)
+			break;
+		}
+	    }
+	    if (k < avedata->listsize) {
+		int	fp_bad = 0;
+#ifdef HAVE_FPCLASSIFY
+		fp_bad = fpclassify(b.startval) == FP_NAN;
+#else
+#ifdef HAVE_ISNAN
+		fp_bad = isnan(b.startval);
 #endif
-			wrap = 1;
-			instdata->marked = 0;
-			tadd(&instdata->firsttime, &result->timestamp);
-			tsub(&instdata->firsttime, &instdata->lasttime);
-		    }
-		    else {
-			rate = (val - instdata->lastval) / diff;
-			instdata->stocave += rate;
-			if (!instdata->marked)
-			    instdata->timeave += (val - instdata->lastval);
-			else {
-			    instdata->marked = 0;
-			    /* remove the timeslice in question from time-based calc */
-			    tadd(&instdata->firsttime, &result->timestamp);
-			    tsub(&instdata->firsttime, &instdata->lasttime);
-			}
-			if (instdata->count == 0) {		/* 1st time */
-			    instdata->min = instdata->max = rate;
-			    instdata->sum = (val - instdata->lastval);
-			}
-			else {
-#ifdef PCP_DEBUG
-			    if (pmDebug & DBG_TRACE_APPL2) {
-				int	numnames;
-				char	**names;
-				char	*istr = NULL;
-
-				numnames = pmNameAll(avedata->desc.pmid, &names);
-				if (pmNameInDom(avedata->desc.indom,
-				    instdata->inst, &istr) < 0)
-				    istr = NULL;
-				if (rate < instdata->min) {
-				    fprintf(stderr, "new min value for ");
-				    __pmPrintMetricNames(stderr, numnames, names, " or ");
-				    fprintf(stderr, " (inst[%s]: %f) at ",
-					(istr == NULL ? "":istr), rate);
-				    __pmPrintStamp(stderr, &result->timestamp);
-				    fprintf(stderr, "\n");
-				}
-				if (rate > instdata->max) {
-				    fprintf(stderr, "new max value for ");
-				    __pmPrintMetricNames(stderr, numnames, names, " or ");
-				    fprintf(stderr, " (inst[%s]: %f) at ",
-					(istr == NULL ? "":istr), rate);
-				    __pmPrintStamp(stderr, &result->timestamp);
-				    fprintf(stderr, "\n");
-				}
-				if (numnames > 0) free(names);
-				if (istr) free(istr);
-			    }
 #endif
-			    if (rate < instdata->min) {
-				instdata->min = rate;
-				instdata->mintime = result->timestamp;
-			    }
-			    if (rate > instdata->max) {
-				instdata->max = rate;
-				instdata->maxtime = result->timestamp;
-			    }
-			    instdata->sum += (val - instdata->lastval);
-			}
-		    }
-		}
-		else {	/* for the other semantics - discrete & instantaneous */
-		    val = av.d;
-		    instdata->sum += val;
-		    instdata->stocave += val;
-		    if (val < instdata->min) {
-			instdata->min = val;
-			instdata->mintime = result->timestamp;
-		    }
-		    if (val > instdata->max) {
-			instdata->max = val;
-			instdata->maxtime = result->timestamp;
-		    }
-		    if (!instdata->marked)
-			instdata->timeave += instdata->lastval*diff;
-		    else {
-			instdata->marked = 0;
-			/* remove the timeslice in question from time-based calc */
-			tadd(&instdata->firsttime, &result->timestamp);
-			tsub(&instdata->firsttime, &instdata->lasttime);
-		    }
-		}
-		if (!wrap) {
-		    instdata->count++;
-#ifdef PCP_DEBUG
-		    if ((pmDebug & DBG_TRACE_APPL1) &&
-			(avedata->desc.sem != PM_SEM_COUNTER || instdata->count > 0)) {
-			int	numnames;
-			char	**names;
-			double	metricspan = 0.0;
-			struct timeval	metrictimespan;
-
-			metrictimespan = result->timestamp;
-			tsub(&metrictimespan, &instdata->firsttime);
-			metricspan = __pmtimevalToReal(&metrictimespan);
-			numnames = pmNameAll(avedata->desc.pmid, &names);
-			fprintf(stderr, "++ ");
-			__pmPrintMetricNames(stderr, numnames, names, " or ");
+		/*
+		 * a single pass skips this sample, but the partition has
+		 * carried it forward as the previous value
+		 */
+		if (fp_bad)
+		    return 1;
+		mergeinst(avedata, avedata->instlist[k], &b, 0);
+	    }
+	    else {
+		instdata = addinst(avedata, b.inst, b.startval, &b.starttime, k);
+		mergeinst(avedata, instdata, &b, 1);
+	    }
+	}
+    }
 
-			if (avedata->desc.sem == PM_SEM_COUNTER) {
-			    fprintf(stderr, " timedelta=%f count=%d\n"
-					    "sum=%f min=%f max=%f stocsum=%f\n"
-					    "rate=%f timesum=%f (+%f) timespan=%f\n",
-				    diff, instdata->count, instdata->sum,
-				    instdata->min, instdata->max,
-				    instdata->stocave, rate, instdata->timeave,
-				    diff * (val - instdata->lastval) / 2,
-				    metricspan);
-			}
-			else {	/* non-counters */
-			    fprintf(stderr, " timedelta=%f count=%d\n"
-					    "sum=%f min=%f max=%f stocsum=%f\n"
-					    "lastval=%f timesum=%f (+%f) timespan=%f\n",
-				    diff, instdata->count, instdata->sum,
-				    instdata->min, instdata->max,
-				    instdata->stocave, instdata->lastval,
-				    instdata->timeave, instdata->lastval*diff,
-				    metricspan);
-			}
-			if (numnames > 0) free(names);
-		    }
-#endif
-		}
-		instdata->lastval = av.d;
-		instdata->lasttime = result->timestamp;
+    /* instances with no samples in this partition still see its marks */
+    for (hptr = __pmHashWalk(&hashlist, PM_HASH_WALK_START);
+	 hptr != NULL;
+	 hptr = __pmHashWalk(&hashlist, PM_HASH_WALK_NEXT)) {
+	avedata = (aveData *)hptr->data;
+	for (j = 0; j < avedata->listsize; j++) {
+	    instdata = avedata->instlist[j];
+	    if (!instdata->merged) {
+		for (m = 0; m < nmarks; m++)
+		    markinst(avedata, instdata, &marks[m]);
 	    }
+	    instdata->merged = 0;
 	}
     }
+
+    return 0;
+}
+
+/*
+ * Split the time window into njobs partitions, summarise each one in
+ * a child process with its own context and merge the partial results
+ * back in time order
+ */
+static int
+partitions(int ctx, const char *archive)
+{
+    int			i;
+    int			sts;
+    int			status;
+    int			fd[2];
+    int			*fds;
+    pid_t		*pids;
+    __int64_t		span;
+    __int64_t		usec;
+    struct timeval	start;
+    struct timeval	end;
+    int			inexact = 0;
+    __pmHashNode	*hptr;
+    aveData		*avedata;
+
+    if ((fds = (int *)malloc(njobs * sizeof(int))) == NULL)
+	__pmNoMem("partitions.fds", njobs * sizeof(int), PM_FATAL_ERR);
+    if ((pids = (pid_t *)malloc(njobs * sizeof(pid_t))) == NULL)
+	__pmNoMem("partitions.pids", njobs * sizeof(pid_t), PM_FATAL_ERR);
+
+    span = (__int64_t)(opts.finish.tv_sec - opts.start.tv_sec) * 1000000 +
+		opts.finish.tv_usec - opts.start.tv_usec;
+    end = opts.start;
+
+    /* no buffered output to be flushed again by each child */
+    fflush(stdout);
+    fflush(stderr);
+
+    for (i = 0; i < njobs; i++) {
+	start = end;
+	usec = opts.start.tv_usec + span * (i+1) / njobs;
+	end.tv_sec = opts.start.tv_sec + usec / 1000000;
+	end.tv_usec = usec % 1000000;
+
+	if (pipe(fd) < 0) {
+	    fprintf(stderr, "%s: pipe failed: %s\n", pmProgname, osstrerror());
+	    exit(1);
+	}
+	if ((pids[i] = fork()) < 0) {
+	    fprintf(stderr, "%s: fork failed: %s\n", pmProgname, osstrerror());
+	    exit(1);
+	}
+	if (pids[i] == 0) {
+	    close(fd[0]);
+	    partition(ctx, archive, &start, &end, i == 0, i == njobs-1, fd[1]);
+	    /*NOTREACHED*/
+	}
+	close(fd[1]);
+	fds[i] = fd[0];
+    }
+
+    for (i = 0; i < njobs; i++) {
+	if (!inexact && (mergepartial(fds[i], &sts) != 0 || sts != PM_ERR_EOL))
+	    inexact = 1;
+	close(fds[i]);
+    }
+
+    for (i = 0; i < njobs; i++) {
+	while (waitpid(pids[i], &status, 0) < 0) {
+	    if (errno != EINTR)
+		break;
+	}
+    }
+
+    free(fds);
+    free(pids);
+
+    if (inexact) {
+	/*
+	 * a worker failed or its partition cannot be merged, so
+	 * start over and summarise the whole time window in one pass -
+	 * which also reports any errors just as it always has
+	 */
+	for (hptr = __pmHashWalk(&hashlist, PM_HASH_WALK_START);
+	     hptr != NULL;
+	     hptr = __pmHashWalk(&hashlist, PM_HASH_WALK_NEXT)) {
+	    avedata = (aveData *)hptr->data;
+	    for (i = 0; i < avedata->listsize; i++) {
+		if (avedata->instlist[i]->bin)
+		    free(avedata->instlist[i]->bin);
+		free(avedata->instlist[i]);
+	    }
+	    if (avedata->instlist) free(avedata->instlist);
+	    __pmHashDel(hptr->key, (void *)avedata, &hashlist);
+	    free(avedata);
+	}
+	__pmHashClear(&hashlist);
+	__pmHashInit(&hashlist);
+	return fetchloop(calcaverage, NULL, &opts.finish, 1);
+    }
+
+    /* instance names are resolved at the end, as after a single pass */
+    if ((sts = pmSetMode(PM_MODE_FORW, &opts.finish, 0)) < 0) {
+	fprintf(stderr, "%s: pmSetMode failed: %s\n", pmProgname, pmErrStr(sts));
+	exit(1);
+    }
+    return PM_ERR_EOL;
+}
+#endif
+
+/*
+ * Is the temporal index fit to position each partition?  Entries with
+ * bad timestamps, or out of time order, can see records skipped.
+ */
+static int
+goodindex(__pmLogCtl *lcp)
+{
+    int			i;
+    __pmLogTI		*tip;
+
+    for (i = 0; i < lcp->l_numti; i++) {
+	tip = &lcp->l_ti[i];
+	if (tip->ti_stamp.tv_sec < 0 || tip->ti_stamp.tv_usec < 0 ||
+	    tip->ti_stamp.tv_usec > 999999)
+	    return 0;
+	if (i > 0 && __pmTimevalSub(&tip->ti_stamp, &tip[-1].ti_stamp) < 0)
+	    return 0;
+    }
+    return 1;
+}
+
+static void
+addfilter(const char *name)
+{
+    pmID		pmid;
+    size_t		size;
+
+    /* cast away const, pmLookupName should never modify name */
+    if (pmLookupName(1, (char **)&name, &pmid) < 0)
+	return;		/* reported later, in printsummary() */
+    size = (nfilter + 1) * sizeof(pmID);
+    if ((filter = (pmID *)realloc(filter, size)) == NULL)
+	__pmNoMem("addfilter.filter", size, PM_FATAL_ERR);
+    filter[nfilter++] = pmid;
+}
+
+static int
+pmidcmp(const void *a, const void *b)
+{
+    pmID	pa = *(const pmID *)a;
+    pmID	pb = *(const pmID *)b;
+
+    return pa < pb ? -1 : pa > pb;
 }
 
 static int
@@ -986,10 +1579,9 @@ override(int opt, pmOptions *opts)
 int
 main(int argc, char *argv[])
 {
-    int			c, i, sts, trip, exitstatus = 0;
+    int			c, i, sts, exitstatus = 0;
     int			lflag = 0;		/* no label by default */
     int			Hflag = 0;		/* no header by default */
-    pmResult		*result;
     struct timeval 	timespan = {0, 0};
     char		*endnum;
     char		*archive;
@@ -1039,6 +1631,17 @@ main(int argc, char *argv[])
 	    maxtimeflag = 1;
 	    break;
 
+	case 'j':	/* number of parallel partitions */
+	    sts = (int)strtol(opts.optarg, &endnum, 10);
+	    if (*endnum != '\0' || sts < 1) {
+		pmprintf("%s: -j requires positive numeric argument\n",
+			pmProgname);
+		opts.errors++;
+	    }
+	    else
+		njobs = sts;
+	    break;
+
 	case 'l':	/* display label */
 	    lflag = 1;
 	    break;
@@ -1132,40 +1735,60 @@ main(int argc, char *argv[])
     if (timespan.tv_sec > 86400) /* seconds per day: 60*60*24 */
 	dayflag = 1;
 
-    for (trip = 0; trip < 2; trip++) {	/* two passes if binning */
-	for ( ; ; ) {
-	    if ((sts = pmFetchArchive(&result)) < 0)
-		break;
+    for (i = opts.optind; i < argc; i++) {	/* metrics to be reported */
+	pmMetricSpec *mp;
+	char *msg;
 
-	    if (opts.finish.tv_sec > result->timestamp.tv_sec ||
-		(opts.finish.tv_sec == result->timestamp.tv_sec &&
-		 opts.finish.tv_usec >= result->timestamp.tv_usec)) {
-		if (trip == 0)
-		    calcaverage(result);
-		else
-		    calcbinning(result);
-		pmFreeResult(result);
-	    }
-	    else {
-		pmFreeResult(result);
-		sts = PM_ERR_EOL;
-		break;
-	    }
+	if (pmParseMetricSpec(argv[i], 1, archive, &mp, &msg) < 0) {
+	    free(msg);
+	    nfilter = 0;
+	    break;
 	}
+	sts = pmTraversePMNS(mp->metric, addfilter);
+	pmFreeMetricSpec(mp);
+	if (sts < 0) {
+	    nfilter = 0;
+	    break;
+	}
+    }
+    if (nfilter > 0)
+	qsort(filter, nfilter, sizeof(pmID), pmidcmp);
+
+    if (njobs > 1) {
+	__pmContext	*ctxp;
+
+	/*
+	 * partition edges must not fall in the gaps between archives,
+	 * and each partition is found via the temporal index
+	 */
+	if ((ctxp = __pmHandleToPtr(c)) != NULL) {
+	    if (ctxp->c_archctl->ac_num_logs > 1 ||
+		!goodindex(ctxp->c_archctl->ac_log))
+		njobs = 1;
+	    PM_UNLOCK(ctxp->c_lock);
+	}
+	if (opts.finish.tv_sec == INT_MAX)
+	    njobs = 1;
+    }
+
+#ifndef IS_MINGW
+    if (njobs > 1)
+	sts = partitions(c, archive);
+    else
+#endif
+	sts = fetchloop(calcaverage, NULL, &opts.finish, 1);
 
-	if (trip == 0 && nbins > 0) {	/* distribute values into bins */
+    if (nbins > 0) {	/* distribute values into bins */
 #ifdef PCP_DEBUG
-	    if (pmDebug & DBG_TRACE_APPL0)
-		fprintf(stderr, "resetting for second iteration\n");
+	if (pmDebug & DBG_TRACE_APPL0)
+	    fprintf(stderr, "resetting for second iteration\n");
 #endif
-	    if ((sts = pmSetMode(PM_MODE_FORW, &opts.start, 0)) < 0) {
-		fprintf(stderr, "%s: pmSetMode reset failed: %s\n",
-		    pmProgname, pmErrStr(sts));
-		exit(1);
-	    }
+	if ((sts = pmSetMode(PM_MODE_FORW, &opts.start, 0)) < 0) {
+	    fprintf(stderr, "%s: pmSetMode reset failed: %s\n",
+		pmProgname, pmErrStr(sts));
+	    exit(1);
 	}
-	else
-	    break;	/* two passes only when doing binning */
+	sts = fetchloop(calcbinning, NULL, &opts.finish, 1);
     }
 
     if (sts != PM_ERR_EOL) {
@@ -20,8 +20,58 @@
 ClientInfo	*client;
 int		nClients;		/* Number in array, (not all in use) */
 int		maxReqPortFd;		/* highest request port fd */
-int		maxSockFd;		/* largest fd for a client */
-__pmFdSet	sockFds;		/* for client select() */
+__pmFdSet	reqPortFds;		/* request port fds */
+__pmPollSet	*pollFds;		/* all fds we wait for input on */
+
+static int	*fdClient;		/* fd -> client[] index, or -1 */
+static int	fdClientSize;
+
+/*
+ * Start waiting for input on fd (the client socket or pmcd socket of
+ * cp), and remember which client it belongs to
+ */
+int
+AddClientFd(ClientInfo *cp, int fd)
+{
+    int		sts;
+
+    if (fd >= fdClientSize) {
+	int	i, size = fdClientSize ? fdClientSize : 64;
+
+	while (size <= fd)
+	    size *= 2;
+	fdClient = (int *)realloc(fdClient, size * sizeof(fdClient[0]));
+	if (fdClient == NULL) {
+	    __pmNoMem("AddClientFd", size * sizeof(fdClient[0]), PM_RECOV_ERR);
+	    Shutdown();
+	    exit(1);
+	}
+	for (i = fdClientSize; i < size; i++)
+	    fdClient[i] = -1;
+	fdClientSize = size;
+    }
+    if ((sts = __pmPollSetAdd(pollFds, fd)) < 0)
+	return sts;
+    fdClient[fd] = cp - client;
+    return 0;
+}
+
+static void
+DelClientFd(int fd)
+{
+    __pmPollSetDel(pollFds, fd);
+    if (fd < fdClientSize)
+	fdClient[fd] = -1;
+}
+
+/* Map a client or pmcd socket to its client, NULL if neither */
+ClientInfo *
+FdToClient(int fd)
+{
+    if (fd < 0 || fd >= fdClientSize || fdClient[fd] < 0)
+	return NULL;
+    return &client[fdClient[fd]];
+}
 
 static int
 NewClient(void)
@@ -69,6 +119,7 @@ AcceptNewClient(int reqfd)
 {
     int		i;
     int		fd;
+    int		sts;
     __pmSockLen	addrlen;
     int		ok = 0;
     char	buf[MY_BUFLEN];
@@ -86,9 +137,6 @@ AcceptNewClient(int reqfd)
 	exit(1);
     }
     __pmSetSocketIPC(fd);
-    if (fd > maxSockFd)
-	maxSockFd = fd;
-    __pmFD_SET(fd, &sockFds);
 
     client[i].fd = fd;
     client[i].pmcd_fd = -1;
@@ -96,6 +144,13 @@ AcceptNewClient(int reqfd)
     client[i].status.allowed = 0;
     client[i].pmcd_hostname = NULL;
 
+    if ((sts = AddClientFd(&client[i], fd)) < 0) {
+	__pmNotifyErr(LOG_ERR, "AcceptNewClient(%d) fd=%d: %s",
+			reqfd, fd, pmErrStr(sts));
+	DeleteClient(&client[i]);
+	return NULL;
+    }
+
     /*
      * version negotiation (converse to negotiate_proxy() logic in
      * libpcp
@@ -230,33 +285,22 @@ DeleteClient(ClientInfo *cp)
 #endif
 
     if (cp->fd >= 0) {
-	__pmFD_CLR(cp->fd, &sockFds);
+	DelClientFd(cp->fd);
 	__pmCloseSocket(cp->fd);
     }
     if (cp->pmcd_fd >= 0) {
-	__pmFD_CLR(cp->pmcd_fd, &sockFds);
+	DelClientFd(cp->pmcd_fd);
 	__pmCloseSocket(cp->pmcd_fd);
     }
+    cp->status.connected = 0;
     if (i == nClients-1) {
 	i--;
 	while (i >= 0 && !client[i].status.connected)
 	    i--;
 	nClients = (i >= 0) ? i + 1 : 0;
     }
-    if (cp->fd == maxSockFd || cp->pmcd_fd == maxSockFd) {
-	maxSockFd = maxReqPortFd;
-	for (i = 0; i < nClients; i++) {
-	    if (cp->status.connected == 0)
-		continue;
-	    if (client[i].fd > maxSockFd)
-		maxSockFd = client[i].fd;
-	    if (client[i].pmcd_fd > maxSockFd)
-		maxSockFd = client[i].pmcd_fd;
-	}
-    }
     __pmSockAddrFree(cp->addr);
     cp->addr = NULL;
-    cp->status.connected = 0;
     cp->fd = -1;
     cp->pmcd_fd = -1;
     if (cp->pmcd_hostname != NULL) {
@@ -291,87 +291,94 @@ __ntohpmPDUInfo(__pmPDUInfo info)
     return info;
 }
 
-/* Determine which clients (if any) have sent data to the server and handle it
- * as required.
- */
-void
-HandleInput(__pmFdSet *fdsPtr)
+/* Handle a PDU from a client, forwarding it to the client's pmcd */
+static void
+HandleClientInput(ClientInfo *cp)
 {
-    int		i, sts;
+    int		sts;
     __pmPDU	*pb;
-    ClientInfo	*cp;
-
-    /* input from clients */
-    for (i = 0; i < nClients; i++) {
-	if (!client[i].status.connected || !__pmFD_ISSET(client[i].fd, fdsPtr))
-	    continue;
-
-	cp = &client[i];
-
-	sts = __pmGetPDU(cp->fd, LIMIT_SIZE, 0, &pb);
-	if (sts <= 0) {
-	    CleanupClient(cp, sts);
-	    continue;
-	}
 
-	/* We *must* see a credentials PDU as the first PDU */
-	if (!cp->status.allowed) {
-	    sts = VerifyClient(cp, pb);
-	    __pmUnpinPDUBuf(pb);
-	    if (sts < 0) {
-		CleanupClient(cp, sts);
-		continue;
-	    }
-	    cp->status.allowed = 1;
-	    continue;
-	}
+    sts = __pmGetPDU(cp->fd, LIMIT_SIZE, 0, &pb);
+    if (sts <= 0) {
+	CleanupClient(cp, sts);
+	return;
+    }
 
-	sts = __pmXmitPDU(cp->pmcd_fd, pb);
+    /* We *must* see a credentials PDU as the first PDU */
+    if (!cp->status.allowed) {
+	sts = VerifyClient(cp, pb);
 	__pmUnpinPDUBuf(pb);
-	if (sts <= 0) {
+	if (sts < 0) {
 	    CleanupClient(cp, sts);
-	    continue;
+	    return;
 	}
+	cp->status.allowed = 1;
+	return;
     }
 
-    /* input from pmcds */
-    for (i = 0; i < nClients; i++) {
-	if (!client[i].status.connected ||
-	    !__pmFD_ISSET(client[i].pmcd_fd, fdsPtr))
-	    continue;
+    sts = __pmXmitPDU(cp->pmcd_fd, pb);
+    __pmUnpinPDUBuf(pb);
+    if (sts <= 0)
+	CleanupClient(cp, sts);
+}
 
-	cp = &client[i];
+/* Handle a PDU from a client's pmcd, forwarding it to the client */
+static void
+HandlePMCDInput(ClientInfo *cp)
+{
+    int		sts;
+    __pmPDU	*pb;
 
-	sts = __pmGetPDU(cp->pmcd_fd, ANY_SIZE, 0, &pb);
+    sts = __pmGetPDU(cp->pmcd_fd, ANY_SIZE, 0, &pb);
 
-	/*
-	 * We need to know if the pmcd has PDU_FLAG_CERT_REQD so we can
-	 * setup our own secure connection with the client. Need to intercept
-	 * the first message from the pmcd.  See __pmConnectHandshake
-	 * discussion in connect.c. This code happens before VerifyClient
-	 * above.
-	 */
+    /*
+     * We need to know if the pmcd has PDU_FLAG_CERT_REQD so we can
+     * setup our own secure connection with the client. Need to intercept
+     * the first message from the pmcd.  See __pmConnectHandshake
+     * discussion in connect.c. This code happens before VerifyClient
+     * above.
+     */
 
-	if( (!cp->status.allowed) && (sts == PDU_ERROR) ){
-	    unsigned int server_features;
-	    server_features = __pmServerGetFeaturesFromPDU( pb );
-	    if( server_features & PDU_FLAG_CERT_REQD ){
-		/* Add as a server feature */
-		cp->server_features |= PDU_FLAG_CERT_REQD;
-	    }
+    if( (!cp->status.allowed) && (sts == PDU_ERROR) ){
+	unsigned int server_features;
+	server_features = __pmServerGetFeaturesFromPDU( pb );
+	if( server_features & PDU_FLAG_CERT_REQD ){
+	    /* Add as a server feature */
+	    cp->server_features |= PDU_FLAG_CERT_REQD;
 	}
+    }
 
-	if (sts <= 0) {
-	    CleanupClient(cp, sts);
-	    continue;
-	}
+    if (sts <= 0) {
+	CleanupClient(cp, sts);
+	return;
+    }
 
-	sts = __pmXmitPDU(cp->fd, pb);
-	__pmUnpinPDUBuf(pb);
-	if (sts <= 0) {
-	    CleanupClient(cp, sts);
+    sts = __pmXmitPDU(cp->fd, pb);
+    __pmUnpinPDUBuf(pb);
+    if (sts <= 0)
+	CleanupClient(cp, sts);
+}
+
+/*
+ * Handle input on the client and pmcd sockets that were ready after
+ * the last __pmPollSetWait() ... sockets closed while handling input
+ * on an earlier one show up as -1 here.
+ */
+static void
+HandleInput(int nready)
+{
+    int		i, fd;
+    ClientInfo	*cp;
+
+    for (i = 0; i < nready; i++) {
+	if ((fd = __pmPollSetReady(pollFds, i)) < 0)
 	    continue;
-	}
+	if ((cp = FdToClient(fd)) == NULL)
+	    continue;
+	if (fd == cp->fd)
+	    HandleClientInput(cp);
+	else if (fd == cp->pmcd_fd)
+	    HandlePMCDInput(cp);
     }
 }
 
@@ -401,6 +408,7 @@ SignalShutdown(void)
 static void
 CheckNewClient(__pmFdSet * fdset, int rfd, int family)
 {
+    int		sts;
     ClientInfo	*cp;
 
     if (__pmFD_ISSET(rfd, fdset)) {
@@ -420,10 +428,12 @@ CheckNewClient(__pmFdSet * fdset, int rfd, int family)
 #endif
 	    CleanupClient(cp, -oserror());
 	}
+	else if ((sts = AddClientFd(cp, cp->pmcd_fd)) < 0) {
+	    __pmNotifyErr(LOG_ERR, "CheckNewClient: pmcd fd=%d: %s",
+			    cp->pmcd_fd, pmErrStr(sts));
+	    CleanupClient(cp, sts);
+	}
 	else {
-	    if (cp->pmcd_fd > maxSockFd)
-		maxSockFd = cp->pmcd_fd;
-	    __pmFD_SET(cp->pmcd_fd, &sockFds);
 #ifdef PCP_DEBUG
 	    if (pmDebug & DBG_TRACE_CONTEXT)
 		/* append to message started in AcceptNewClient() */
@@ -437,30 +447,32 @@ CheckNewClient(__pmFdSet * fdset, int rfd, int family)
 static void
 ClientLoop(void)
 {
-    int		i, sts;
-    int		maxFd;
-    __pmFdSet	readableFds;
+    int		i, fd, sts;
+    __pmFdSet	readyReqFds;
 
     for (;;) {
-	/* Figure out which file descriptors to wait for input on.  Keep
-	 * track of the highest numbered descriptor for the select call.
-	 */
-	readableFds = sockFds;
-	maxFd = maxSockFd + 1;
-
-	sts = __pmSelectRead(maxFd, &readableFds, NULL);
+	sts = __pmPollSetWait(pollFds, NULL);
 
 	if (sts > 0) {
-	    if (pmDebug & DBG_TRACE_APPL0)
-		for (i = 0; i <= maxSockFd; i++)
-		    if (__pmFD_ISSET(i, &readableFds))
-			fprintf(stderr, "__pmSelectRead(): from %s fd=%d\n",
-				FdToString(i), i);
-	    __pmServerAddNewClients(&readableFds, CheckNewClient);
-	    HandleInput(&readableFds);
+	    /*
+	     * Request ports are few and opened first, so an fd_set still
+	     * suits them and __pmServerAddNewClients() ... everything
+	     * else is handled by descriptor, not by scanning.
+	     */
+	    __pmFD_ZERO(&readyReqFds);
+	    for (i = 0; i < sts; i++) {
+		fd = __pmPollSetReady(pollFds, i);
+		if (pmDebug & DBG_TRACE_APPL0)
+		    fprintf(stderr, "__pmPollSetWait(): from %s fd=%d\n",
+				FdToString(fd), fd);
+		if (fd <= maxReqPortFd && __pmFD_ISSET(fd, &reqPortFds))
+		    __pmFD_SET(fd, &readyReqFds);
+	    }
+	    __pmServerAddNewClients(&readyReqFds, CheckNewClient);
+	    HandleInput(sts);
 	}
 	else if (sts == -1 && neterror() != EINTR) {
-	    __pmNotifyErr(LOG_ERR, "ClientLoop select: %s\n", netstrerror());
+	    __pmNotifyErr(LOG_ERR, "ClientLoop poll: %s\n", netstrerror());
 	    break;
 	}
 	if (timeToDie) {
@@ -530,7 +542,7 @@ GetProxyHostname(void)
 int
 main(int argc, char *argv[])
 {
-    int		sts;
+    int		i, sts;
     int		nport = 0;
     int		localhost = 0;
     int		maxpending = MAXPENDING;
@@ -578,9 +590,22 @@ main(int argc, char *argv[])
     __pmSetSignalHandler(SIGSEGV, SigBad);
 
     /* Open request ports for client connections */
-    if ((sts = __pmServerOpenRequestPorts(&sockFds, maxpending)) < 0)
+    if ((sts = __pmServerOpenRequestPorts(&reqPortFds, maxpending)) < 0)
+	DontStart();
+    maxReqPortFd = sts;
+    if ((pollFds = __pmPollSetCreate()) == NULL) {
+	__pmNotifyErr(LOG_ERR, "pmproxy: __pmPollSetCreate: %s\n",
+			pmErrStr(-oserror()));
 	DontStart();
-    maxReqPortFd = maxSockFd = sts;
+    }
+    for (i = 0; i <= maxReqPortFd; i++) {
+	if (__pmFD_ISSET(i, &reqPortFds) &&
+	    (sts = __pmPollSetAdd(pollFds, i)) < 0) {
+	    __pmNotifyErr(LOG_ERR, "pmproxy: request port fd=%d: %s\n",
+			    i, pmErrStr(sts));
+	    DontStart();
+	}
+    }
 
     /* lose root privileges if we have them */
     __pmSetProcessIdentity(username);
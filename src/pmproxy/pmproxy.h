@@ -36,13 +36,14 @@ typedef struct {
 extern ClientInfo	*client;	/* Array of clients */
 extern int		nClients;	/* Number of entries in array */
 extern int		maxReqPortFd;	/* highest request port fd */
-extern int		maxSockFd;	/* largest fd for a clients
-					 * and pmcd connections */
-extern __pmFdSet	sockFds;	/* for select() */
+extern __pmFdSet	reqPortFds;	/* request port fds */
+extern __pmPollSet	*pollFds;	/* request port, client and pmcd fds */
 
 /* prototypes */
 extern ClientInfo *AcceptNewClient(int);
 extern void DeleteClient(ClientInfo *);
+extern int AddClientFd(ClientInfo *, int);
+extern ClientInfo *FdToClient(int);
 extern void StartDaemon(int, char **);
 extern void Shutdown(void);
 
@@ -22,6 +22,11 @@
 #include <fstream>
 #include <sstream>
 
+extern "C"
+{
+#include "mmv_stats.h"
+}
+
 using namespace std;
 
 string uriprefix = "pmapi";
@@ -41,10 +46,104 @@ static __pmServerPresence *presence;
 unsigned multithread = 0;       /* set by -M option */
 unsigned graphite_timestep = 60;  /* set by -i option */
 unsigned graphite_archivedir = 0; /* set by -I option */
+unsigned graphite_cachesize = 32; /* set by -J option */
 string logfile = "";		/* set by -l option */
 string fatalfile = "/dev/tty";	/* fatal messages at startup go here */
 
 
+/* Self-instrumentation, exported via the MMV PMDA as mmv.pmwebd.* */
+#define PMWEBD_MMV_CLUSTER 443
+
+static mmv_metric_t pmwebd_metrics[] = {
+    {
+        "graphite.archive_cache.hits", 1, MMV_TYPE_U64, MMV_SEM_COUNTER,
+        MMV_UNITS (0, 0, 1, 0, 0, PM_COUNT_ONE), PM_INDOM_NULL,
+        (char *) "Graphite archive context cache hits",
+        (char *) "Number of graphite fetches served from an already open archive context."
+    },
+    {
+        "graphite.archive_cache.misses", 2, MMV_TYPE_U64, MMV_SEM_COUNTER,
+        MMV_UNITS (0, 0, 1, 0, 0, PM_COUNT_ONE), PM_INDOM_NULL,
+        (char *) "Graphite archive context cache misses",
+        (char *) "Number of graphite fetches that had to open a new archive context."
+    },
+    {
+        "graphite.archive_cache.invalidations", 3, MMV_TYPE_U64, MMV_SEM_COUNTER,
+        MMV_UNITS (0, 0, 1, 0, 0, PM_COUNT_ONE), PM_INDOM_NULL,
+        (char *) "Graphite archive contexts dropped as stale",
+        (char *) "Number of cached archive contexts closed because the archive\n"
+        "metadata changed (mtime or size) since the context was opened."
+    },
+    {
+        "graphite.archive_cache.evictions", 4, MMV_TYPE_U64, MMV_SEM_COUNTER,
+        MMV_UNITS (0, 0, 1, 0, 0, PM_COUNT_ONE), PM_INDOM_NULL,
+        (char *) "Graphite archive contexts evicted",
+        (char *) "Number of least-recently-used archive contexts closed to keep\n"
+        "the cache within its -J size limit."
+    },
+    {
+        "graphite.archive_cache.size", 5, MMV_TYPE_U32, MMV_SEM_INSTANT,
+        MMV_UNITS (0, 0, 1, 0, 0, PM_COUNT_ONE), PM_INDOM_NULL,
+        (char *) "Graphite archive contexts currently cached",
+        (char *) "Number of archive contexts held open in the graphite cache."
+    },
+    {
+        "pool.jobs", 6, MMV_TYPE_U64, MMV_SEM_COUNTER,
+        MMV_UNITS (0, 0, 1, 0, 0, PM_COUNT_ONE), PM_INDOM_NULL,
+        (char *) "Jobs run by the worker thread pool",
+        (char *) "Number of jobs (graphite series fetches, archive enumerations)\n"
+        "submitted to the -M worker thread pool."
+    },
+    {
+        "pool.threads", 7, MMV_TYPE_U32, MMV_SEM_INSTANT,
+        MMV_UNITS (0, 0, 1, 0, 0, PM_COUNT_ONE), PM_INDOM_NULL,
+        (char *) "Worker threads in the pool",
+        (char *) "Number of -M worker threads started."
+    },
+};
+
+static void *pmwebd_mmv;
+#ifdef HAVE_PTHREAD_H
+static pthread_mutex_t pmwebd_mmv_lock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+static void
+pmwebd_stats_init (void)
+{
+    pmwebd_mmv = mmv_stats_init ("pmwebd", PMWEBD_MMV_CLUSTER, MMV_FLAG_PROCESS,
+                                 pmwebd_metrics,
+                                 sizeof (pmwebd_metrics) / sizeof (pmwebd_metrics[0]),
+                                 NULL, 0);
+    if (pmwebd_mmv == NULL && verbosity) {
+        timestamp (clog) << "Cannot initialize MMV statistics" << endl;
+    }
+}
+
+void
+pmwebd_stats_add (const char *name, double value)
+{
+#ifdef HAVE_PTHREAD_H
+    pthread_mutex_lock (&pmwebd_mmv_lock);
+#endif
+    mmv_stats_add (pmwebd_mmv, name, NULL, value);
+#ifdef HAVE_PTHREAD_H
+    pthread_mutex_unlock (&pmwebd_mmv_lock);
+#endif
+}
+
+void
+pmwebd_stats_set (const char *name, double value)
+{
+#ifdef HAVE_PTHREAD_H
+    pthread_mutex_lock (&pmwebd_mmv_lock);
+#endif
+    mmv_stats_set (pmwebd_mmv, name, NULL, value);
+#ifdef HAVE_PTHREAD_H
+    pthread_mutex_unlock (&pmwebd_mmv_lock);
+#endif
+}
+
+
 
 /* Print a best-effort message as a plain-text http response; anything
    to avoid a dreaded MHD_NO, which results in a 500 return code.
@@ -385,6 +484,7 @@ server_dump_configuration ()
 
     clog << "\tGraphite API " << (graphite_p ? "enabled" : "disabled") << endl;
     clog << "\tGraphite API name encoding " << (graphite_encode ? "long" : "short") << endl;
+    clog << "\tGraphite API archive cache up to " << graphite_cachesize << " contexts" << endl;
     clog << "\tGraphite API Cairo graphics rendering "
 #ifdef HAVE_CAIRO
          << "compiled-in"
@@ -405,7 +505,7 @@ server_dump_configuration ()
         clog << "\tPeriodic client statistics not dumped" << endl;
     }
 #if HAVE_PTHREAD_H
-    clog << "\tUsing up to " << multithread << " auxiliary threads" << endl;
+    clog << "\tUsing a pool of " << multithread << " auxiliary threads" << endl;
 #endif
 }
 
@@ -441,7 +541,13 @@ pmweb_shutdown (struct MHD_Daemon *d4, struct MHD_Daemon *d6)
      * Let's politely clean up all the active contexts.
      * The OS will do all that for us anyway, but let's make valgrind happy.
      */
+    pmwebd_pool_stop ();
     pmwebapi_deallocate_all ();
+    pmgraphite_deallocate_all ();
+
+    if (pmwebd_mmv) {
+        mmv_stats_stop ("pmwebd", pmwebd_mmv);
+    }
 
     timestamp (clog) << "pmwebd shutdown" << endl;
     fflush (stderr);
@@ -466,6 +572,7 @@ option_overrides (int opt, pmOptions * opts)
     case 't':
     case 'i':
     case 'I':
+    case 'J':
     case 'X':
         return 1;
     }
@@ -483,6 +590,7 @@ longopts[] = {
     {"graphite-noencode", 0, 'X', 0, "don't encode special characters that are now allowed by graphite"},
     {"graphite-timestamp", 1, 'i', "SEC", "minimum graphite timestep (s) [default 60]"},
     {"graphite-archivedir", 0, 'I', 0, "prefer archive directories [default OFF]"},
+    {"graphite-cache", 1, 'J', "NUM", "max cached graphite archive contexts [default 32]"},
     PMAPI_OPTIONS_HEADER ("Context options"),
     {"timeout", 1, 't', "SEC", "max time (seconds) for PMAPI polling [default 300]"},
     {"context", 1, 'c', "NUM", "set next permanent-binding context number"},
@@ -536,7 +644,7 @@ main (int argc, char *argv[])
     __pmGetUsername (&username_str);
     __pmServerSetFeature (PM_SERVER_FEATURE_DISCOVERY);
 
-    opts.short_options = "A:a:c:D:h:Ll:NM:Pp:R:Gi:It:U:vx:d:SX46?";
+    opts.short_options = "A:a:c:D:h:J:Ll:NM:Pp:R:Gi:It:U:vx:d:SX46?";
     opts.long_options = longopts;
     opts.override = option_overrides;
 
@@ -586,6 +694,14 @@ main (int argc, char *argv[])
             graphite_archivedir = 1;
             break;
 
+        case 'J':
+            graphite_cachesize = strtoul (opts.optarg, &endptr, 0);
+            if (*endptr != '\0') {
+                pmprintf ("%s: invalid graphite cache size %s\n", pmProgname, opts.optarg);
+                opts.errors++;
+            }
+            break;
+
         case 'A':
             archivesdir = opts.optarg;
             break;
@@ -775,6 +891,10 @@ main (int argc, char *argv[])
     server_dump_request_ports (d4 != NULL, d6 != NULL, port);
     server_dump_configuration ();
 
+    /* NB: after __pmSetProcessIdentity(), so the MMV file is ours to update */
+    pmwebd_stats_init ();
+    pmwebd_pool_start (multithread);
+
     /* Set up signal handlers. */
     __pmSetSignalHandler (SIGHUP, SIG_IGN);
     __pmSetSignalHandler (SIGINT, handle_signals);
@@ -28,6 +28,7 @@
 #include <sstream>
 #include <set>
 #include <map>
+#include <list>
 
 using namespace std;
 
@@ -51,6 +52,7 @@ extern "C"
 #ifdef HAVE_CAIRO
 #include <cairo/cairo.h>
 #endif
+#include "rollup.h"
 };
 
 
@@ -190,43 +192,100 @@ pmgraphite_metric_decode (const string & foo)
 // ------------------------------------------------------------------------
 
 
-typedef multimap<pmInDom,string> pmis_t;
+// A persistent index of the graphite names offered by each archive, so
+// that metrics/find, metrics/grep and render target expansion need not
+// open and traverse every archive on every query.  Each archive's names
+// (below its own archive component) are kept as a trie of graphite name
+// components.  An entry is rebuilt only when the archive metadata changes,
+// since that is where new metrics and instances get recorded, and is
+// forgotten once its archive disappears.  Archives that fail to open are
+// remembered as such too, until they change.
+//
+// The index is only used from the microhttpd thread; rebuilt entries are
+// produced in parallel on the -M thread pool and merged in afterwards.
 
-struct pmg_enum_context {
-    const vector <string> *patterns;
-    vector <string> *output;
-    string archivepart;
-    pmis_t indom_instance_parts; // filtered indom instance names
+struct pmg_name_node {
+    map <string, pmg_name_node> children; // by next name component
+    bool leaf_p;                // a complete graphite name ends here
+
+    pmg_name_node (): leaf_p (false) {}
 };
 
+struct pmg_name_index_entry {
+    time_t mtime;               // of the .meta file(s)
+    off_t size;
+    bool valid_p;               // archive could be opened
+    bool seen_p;                // found by the latest directory walk
+    pmg_name_node root;
 
+    pmg_name_index_entry (): mtime (0), size (0), valid_p (false), seen_p (false) {}
+};
 
-// Callback from pmTraversePMNS_r.  We have a working archive, we just received
-// a working metric name.  All we need now is to enumerate
-void
-pmg_enumerate_pmns (const char *name, void *cls)
-{
-    pmg_enum_context *c = (pmg_enum_context *) cls;
-    string metricpart = name;
+static map <string, pmg_name_index_entry> pmg_name_index; // by archive path
 
-    if (exit_p) {
+
+// Compute the staleness signature of an archive found by fts(3): the
+// .meta file itself, or for an archive-directory (-I), all its .meta files.
+static void
+pmg_name_index_stat (const string & archive, const struct stat *st,
+                     time_t & mtime, off_t & size)
+{
+    if (! S_ISDIR (st->st_mode)) {
+        mtime = st->st_mtime;
+        size = st->st_size;
         return;
     }
 
-    // Filter out mismatches of the metric name components
-    vector <string> metric_parts = split (metricpart, '.');
-    for (unsigned i = 0; i < metric_parts.size (); i++) {
-        if (c->patterns->size () > i + 1) {
-            // patterns[0] was already used for the archive name
-            const string & metricpart = metric_parts[i];
-            const string & pattern = (*c->patterns)[i + 1];
-            if (fnmatch (pattern.c_str (), metricpart.c_str (), FNM_NOESCAPE) != 0) {
-                return;
-            }
+    mtime = st->st_mtime;
+    size = 0;
+    DIR *d = opendir (archive.c_str ());
+    if (d == NULL) {
+        return;
+    }
+    struct dirent *de;
+    while ((de = readdir (d)) != NULL) {
+        if (fnmatch ("*.meta", de->d_name, FNM_NOESCAPE) != 0) {
+            continue;
+        }
+        struct stat mst;
+        string meta = archive + (char) __pmPathSeparator () + de->d_name;
+        if (stat (meta.c_str (), &mst) == 0) {
+            mtime = max (mtime, mst.st_mtime);
+            size += mst.st_size;
         }
     }
+    closedir (d);
+}
+
+
+// Add one graphite name, split into components, to a trie.
+static void
+pmg_name_insert (pmg_name_node & root, const vector <string> & parts)
+{
+    pmg_name_node *n = & root;
+    for (unsigned i = 0; i < parts.size (); i++) {
+        n = & n->children[parts[i]];
+    }
+    n->leaf_p = true;
+}
+
+
+struct pmg_index_context {
+    pmg_name_node *root;
+    map <pmInDom, vector <string> > indom_instance_parts; // encoded instance names
+};
+
 
-    string final_metric_name = c->archivepart + "." + metricpart;
+// Callback from pmTraversePMNS_r.  We have a working archive, we just received
+// a working metric name.  All we need now is to enumerate its instances.
+void
+pmg_index_pmns (const char *name, void *cls)
+{
+    pmg_index_context *c = (pmg_index_context *) cls;
+
+    if (exit_p) {
+        return;
+    }
 
     // look up the metric to make sure it exists; fan out to instance domains while at it
     char *namelist[1];
@@ -257,50 +316,114 @@ pmg_enumerate_pmns (const char *name, void *cls)
         return;
     }
 
+    vector <string> parts = split (name, '.');
     if (pmd.indom == PM_INDOM_NULL) { // no more
-        c->output->push_back (final_metric_name);
-    } else { // has instance domain - get one more graphite name component
-        // check indom instance cache
-        if (c->indom_instance_parts.find(pmd.indom) == c->indom_instance_parts.end()) {
-            // populate it
-            int *instlist;
-            char **namelist;
-            sts = pmGetInDomArchive (pmd.indom, &instlist, &namelist);
-            if (sts >= 1) {
-                for (int i=0; i<sts; i++) {
-                    string instance_part = pmgraphite_metric_encode (namelist[i]);
-                    // must filter out mismatches here too!
-                    if (c->patterns->size () > metric_parts.size ()+1) {
-                        const string & pattern = (*c->patterns)[metric_parts.size ()+1];
-                        if (fnmatch (pattern.c_str (), instance_part.c_str (), FNM_NOESCAPE) != 0) {
-                            continue;
-                        }
-                    }
-                    c->indom_instance_parts.insert(make_pair(pmd.indom, instance_part));
-                }
-                free (instlist);
-                free (namelist);
-            } else {
-                // should not happen
+        pmg_name_insert (*c->root, parts);
+        return;
+    }
+
+    // has instance domain - get one more graphite name component
+    map <pmInDom, vector <string> >::iterator it = c->indom_instance_parts.find (pmd.indom);
+    if (it == c->indom_instance_parts.end ()) {
+        // populate it
+        it = c->indom_instance_parts.insert (make_pair (pmd.indom, vector <string> ())).first;
+        int *instlist;
+        char **namelist;
+        sts = pmGetInDomArchive (pmd.indom, &instlist, &namelist);
+        if (sts >= 1) {
+            for (int i=0; i<sts; i++) {
+                it->second.push_back (pmgraphite_metric_encode (namelist[i]));
             }
+            free (instlist);
+            free (namelist);
+        } else {
+            // should not happen
         }
+    }
 
-        // iterate across instance cache
-        pair<pmis_t::iterator,pmis_t::iterator> range = c->indom_instance_parts.equal_range(pmd.indom);
-        for (pmis_t::iterator a = range.first; a != range.second; a++) {
-            c->output->push_back (final_metric_name + "." + a->second);
+    parts.push_back ("");
+    for (unsigned i = 0; i < it->second.size (); i++) {
+        parts.back () = it->second[i];
+        pmg_name_insert (*c->root, parts);
+    }
+}
+
+
+// Open one archive and index all its graphite names.  Return false if
+// it could not be opened as an archive.
+static bool
+pmg_name_index_build (const string & archive, pmg_name_node & root)
+{
+    int ctx = pmNewContext (PM_CONTEXT_ARCHIVE, archive.c_str ());
+    if (ctx < 0) {
+        return false;
+    }
+
+    // Wondertastic.  We have an archive.  Let's open 'er up and
+    // enumerate them metrics.
+    pmg_index_context c;
+    c.root = & root;
+    (void) pmTraversePMNS_r ("", &pmg_index_pmns, &c);
+
+    pmDestroyContext (ctx);
+    return true;
+}
+
+
+// One archive's (re)indexing, run on the -M thread pool.
+struct pmg_index_job {
+    string archive;
+    string archivepart;
+    pmg_name_index_entry *e;    // NB: stable, as pmg_name_index is a map
+};
+
+static void
+pmg_name_index_job (void *cls, unsigned job)
+{
+    vector <pmg_index_job> *jobs = (vector <pmg_index_job> *) cls;
+    pmg_index_job & j = (*jobs)[job];
+
+    j.e->valid_p = pmg_name_index_build (j.archive, j.e->root);
+}
+
+
+// Append all names in the trie that match the patterns (componentwise,
+// via fnmatch(3)) to output.  patterns[0] is the archive component, which
+// the caller has already matched; depth counts the components below it.
+static void
+pmg_name_index_query (const pmg_name_node & n, const vector <string> & patterns,
+                      unsigned depth, const string & prefix, vector <string> & output)
+{
+    if (n.leaf_p) {
+        output.push_back (prefix);
+    }
+    for (map <string, pmg_name_node>::const_iterator it = n.children.begin ();
+         it != n.children.end (); it++) {
+        if (exit_p) {
+            return;
+        }
+        if (patterns.size () > depth + 1) {
+            const string & pattern = patterns[depth + 1];
+            if (fnmatch (pattern.c_str (), it->first.c_str (), FNM_NOESCAPE) != 0) {
+                continue;
+            }
         }
+        pmg_name_index_query (it->second, patterns, depth + 1, prefix + "." + it->first, output);
     }
 }
 
+
 // Heavy lifter.  Enumerate all archives, all metrics, all instances.
 // This is not unbearably slow, since it involves only a scan of
-// directories & metadata.
+// directories, plus reindexing of those archives whose metadata changed
+// since the last time (in parallel on the -M thread pool).
 
 vector <string> pmgraphite_enumerate_metrics (struct MHD_Connection * connection,
                                               const vector<string> & patterns_tok)
 {
     vector <string> output;
+    vector <pmg_index_job> jobs;
+    unsigned reused = 0;
 
     // The javascript guis may feed us wildcardy partial metric names.  We
     // apply them (via componentwise fnsearch(3)) as an optimization.
@@ -331,6 +454,10 @@ vector <string> pmgraphite_enumerate_metrics (struct MHD_Connection * connection
         connstamp (cerr, connection) << "cannot fts_open " << archivesdir << endl;
         goto out;
     }
+    for (map <string, pmg_name_index_entry>::iterator it = pmg_name_index.begin ();
+         it != pmg_name_index.end (); it++) {
+        it->second.seen_p = false;
+    }
     for (FTSENT * ent = fts_read (f); ent != NULL; ent = fts_read (f)) {
         if (exit_p) {
             break; // don't bypass the fts_close()
@@ -362,6 +489,11 @@ vector <string> pmgraphite_enumerate_metrics (struct MHD_Connection * connection
             fnmatch ("*.meta", ent->fts_path, FNM_NOESCAPE) != 0)
             continue;
 
+        // Still there, so keep any index entry for it
+        map <string, pmg_name_index_entry>::iterator it = pmg_name_index.find (archive);
+        if (it != pmg_name_index.end ())
+            it->second.seen_p = true;
+
         // Abbrevate archive to clip off the archivesdir prefix (if
         // it's there).
         string archivepart = archive;
@@ -389,33 +521,78 @@ vector <string> pmgraphite_enumerate_metrics (struct MHD_Connection * connection
             continue;
         }
 
-        int ctx = pmNewContext (PM_CONTEXT_ARCHIVE, archive.c_str ());
-        if (ctx < 0) {
+        // Reuse the index entry if the archive metadata hasn't changed.
+        time_t mtime;
+        off_t size;
+        pmg_name_index_stat (archive, ent->fts_statp, mtime, size);
+        bool dir_p = ((ent->fts_info == FTS_D) && graphite_archivedir);
+        if (it != pmg_name_index.end () && it->second.mtime == mtime && it->second.size == size) {
+            pmg_name_index_entry & e = it->second;
+            if (e.valid_p) {
+                pmg_name_index_query (e.root, patterns_tok, 0, archivepart, output);
+                // Don't recurse if this was a successfully opened archive-directory
+                if (dir_p)
+                    (void) fts_set (f, ent, FTS_SKIP);
+            }
+            reused++;
             continue;
         }
 
-        // Wondertastic.  We have an archive.  Let's open 'er up and
-        // enumerate them metrics.
-        pmg_enum_context c;
-        c.patterns = &patterns_tok;
-        c.output = &output;
-        c.archivepart = archivepart;
+        pmg_name_index_entry & e = pmg_name_index[archive];
+        e = pmg_name_index_entry ();
+        e.mtime = mtime;
+        e.size = size;
+        e.seen_p = true;
+
+        // Archive-directories must be tried right here, since whether
+        // they open decides whether fts recurses into them.
+        if (dir_p) {
+            e.valid_p = pmg_name_index_build (archive, e.root);
+            if (e.valid_p) {
+                pmg_name_index_query (e.root, patterns_tok, 0, archivepart, output);
+                // Don't recurse if this was a successfully opened archive-directory
+                (void) fts_set (f, ent, FTS_SKIP);
+            }
+            continue;
+        }
 
-        (void) pmTraversePMNS_r ("", &pmg_enumerate_pmns, &c);
+        pmg_index_job j;
+        j.archive = archive;
+        j.archivepart = archivepart;
+        j.e = & e;
+        jobs.push_back (j);
+    }
+    fts_close (f);
 
-        pmDestroyContext (ctx);
+    pmwebd_pool_run (& pmg_name_index_job, (void *) & jobs, jobs.size ());
+    for (unsigned i = 0; i < jobs.size (); i++) {
+        if (jobs[i].e->valid_p)
+            pmg_name_index_query (jobs[i].e->root, patterns_tok, 0, jobs[i].archivepart, output);
+    }
 
-        // Don't recurse if this was a successfully opened archive-directory
-        if ((ent->fts_info == FTS_D) && graphite_archivedir)
-            (void) fts_set (f, ent, FTS_SKIP);
+    // Forget archives that have gone away, unless we were interrupted
+    // before the walk was complete.
+    if (! exit_p) {
+        for (map <string, pmg_name_index_entry>::iterator it = pmg_name_index.begin ();
+             it != pmg_name_index.end (); ) {
+            if (it->second.seen_p)
+                it++;
+            else
+                pmg_name_index.erase (it++);
+        }
+    } else {
+        // Partially built entries must not be taken as complete later.
+        for (unsigned i = 0; i < jobs.size (); i++)
+            pmg_name_index.erase (jobs[i].archive);
     }
-    fts_close (f);
 
 #endif
 
 out:
     if (verbosity > 2) {
-        connstamp (clog, connection) << "enumerated " << output.size () << " metrics" << endl;
+        connstamp (clog, connection) << "enumerated " << output.size () << " metrics"
+                                     << ", reindexed " << jobs.size () << " archives"
+                                     << ", reused " << reused << endl;
     }
 
     // As a service to the user, alpha-sort the returned list of metrics.
@@ -706,98 +883,531 @@ struct fetch_series_jobspec {
 
 template <class Spec>
 struct fetch_series_jobqueue {
-#ifdef HAVE_PTHREAD_H
-    pthread_mutex_t lock; // protects following field
-#endif
-    unsigned next_job_nr;
-
     vector<Spec> jobs; // vector itself read-only
     typedef void (*runner_t) (Spec *);
     runner_t runner;
 
-    fetch_series_jobqueue (runner_t);
-    ~fetch_series_jobqueue ();
+    fetch_series_jobqueue (runner_t r): runner (r) {}
 
-    static void* thread_main (void *);
+    static void run_one (void *, unsigned);
 
     void run ();
 };
 
 
 template <class Spec>
-fetch_series_jobqueue<Spec>::fetch_series_jobqueue (runner_t r)
+void fetch_series_jobqueue<Spec>::run_one (void *cls, unsigned job)
 {
-#ifdef HAVE_PTHREAD_H
-    pthread_mutex_init (& this->lock, NULL);
-#endif
-    this->runner = r;
-    this->next_job_nr = 0;
+    fetch_series_jobqueue<Spec>* q = (fetch_series_jobqueue<Spec>*) cls;
+    assert (q != 0);
+
+    (*q->runner) (& q->jobs[job]);
 }
 
 
+
+// Hand the jobs to the shared -M thread pool, and wait for them all.
 template <class Spec>
-fetch_series_jobqueue<Spec>::~fetch_series_jobqueue ()
+void fetch_series_jobqueue<Spec>::run ()
 {
+    // Permute the job queue randomly, to make it less likely that
+    // concurrent threads are processing the same archive.
+    // ... but some experimentaton shows harm rather than benefit.
+    // random_shuffle (this->jobs.begin(), this->jobs.end());
+    // ... plus we'd have to unshuffle before results are collected.
+
+    pmwebd_pool_run (& this->run_one, (void*) this, this->jobs.size ());
+}
+
+
+
+// ------------------------------------------------------------------------
+
+
+// A bounded LRU cache of open archive contexts, plus the pmID / pmDesc /
+// instance lookups already resolved against each.  Dashboards re-render
+// the same archives every few seconds, and reloading the .meta file for
+// each of them used to dominate the time spent per render.
+//
+// An entry is checked out by one fetch_series job at a time, and is
+// dropped when the archive metadata (mtime or size) or its containing
+// directory (e.g. a new volume) changes, since the already-open context
+// would not notice new metrics, instances or volumes.
+
+struct pmg_archive_signature {
+    time_t meta_mtime;
+    off_t meta_size;
+    time_t dir_mtime;
+
+    bool operator != (const pmg_archive_signature & o) const {
+        return meta_mtime != o.meta_mtime || meta_size != o.meta_size ||
+               dir_mtime != o.dir_mtime;
+    }
+};
+
+// The index part of a pmlogrollup(1) sidecar, loaded on first use.
+struct pmg_rollup {
+    string path;                // empty if the archive cannot have one
+    time_t mtime;               // of the loaded sidecar; 0 if none loaded
+    off_t size;
+    time_t end;                 // archive end covered by the sidecar
+    vector <rollup_series_t> series; // host byte order, sorted
+    vector <rollup_level_t> levels;  // host byte order, increasing bucket
+    vector <off_t> offsets;     // file offset of each level's values
+};
+
+struct pmg_archive_entry {
+    string archive;
+    int pmc;
+    bool busy_p;                // checked out by some fetch_series job
+    bool cacheable_p;           // signature known, may stay in the cache
+    pmg_archive_signature signature;
+    pmLogLabel label;
+    map <string, pmID> pmids;   // metric name -> pmid, PM_ID_NULL if absent
+    map <pmID, pmDesc> descs;
+    map <pair <pmInDom, string>, int> insts; // (indom, instance name) -> inst
+    pmg_rollup rollup;
+};
+
+static list <pmg_archive_entry *> pmg_archive_cache; // most recently used first
 #ifdef HAVE_PTHREAD_H
-    pthread_mutex_destroy (& this->lock);
+static pthread_mutex_t pmg_archive_cache_lock = PTHREAD_MUTEX_INITIALIZER;
 #endif
+
+
+// Compute the invalidation signature of an archive.  The name may be a
+// directory (-I), a metadata file name (long graphite encoding), or an
+// archive basename.
+static int
+pmg_archive_stat (const string & archive, pmg_archive_signature & sig)
+{
+    struct stat st;
+    string meta = archive;
+    string dir;
+
+    memset (&sig, 0, sizeof (sig));
+    if (stat (meta.c_str (), &st) == 0 && S_ISDIR (st.st_mode)) {
+        sig.dir_mtime = st.st_mtime;
+        return 0;
+    }
+    if (stat (meta.c_str (), &st) < 0 || !S_ISREG (st.st_mode)) {
+        meta = archive + ".meta";
+        if (stat (meta.c_str (), &st) < 0) {
+            return -errno;
+        }
+    }
+    sig.meta_mtime = st.st_mtime;
+    sig.meta_size = st.st_size;
+
+    string::size_type slash = meta.rfind ((char) __pmPathSeparator ());
+    dir = (slash == string::npos) ? string (".") : meta.substr (0, slash);
+    if (stat (dir.c_str (), &st) == 0) {
+        sig.dir_mtime = st.st_mtime;
+    }
+    return 0;
 }
 
 
-template <class Spec>
-void* fetch_series_jobqueue<Spec>::thread_main (void *cls)
+// Name the pmlogrollup(1) sidecar of an archive: its basename, stripped
+// of any .meta/.index/.N suffix, plus ".rollup".  Directory archives (-I)
+// have none.
+static string
+pmg_rollup_path (const string & archive)
 {
-    fetch_series_jobqueue<Spec>* q = (fetch_series_jobqueue<Spec>*) cls;
-    assert (q != 0);
+    struct stat st;
+    string base = archive;
+
+    if (stat (archive.c_str (), &st) == 0 && S_ISDIR (st.st_mode)) {
+        return "";
+    }
+    string::size_type dot = base.rfind ('.');
+    if (dot != string::npos && base.find ((char) __pmPathSeparator (), dot) == string::npos) {
+        string suffix = base.substr (dot + 1);
+        if (suffix == "meta" || suffix == "index" ||
+                (suffix != "" && suffix.find_first_not_of ("0123456789") == string::npos)) {
+            base.erase (dot);
+        }
+    }
+    return base + ROLLUP_SUFFIX;
+}
+
+
+// Close and forget one cache entry.  Caller holds pmg_archive_cache_lock.
+static void
+pmg_archive_destroy (list <pmg_archive_entry *>::iterator it)
+{
+    pmg_archive_entry *e = *it;
+
+    pmg_archive_cache.erase (it);
+    (void) pmDestroyContext (e->pmc);
+    delete e;
+    pmwebd_stats_set ("graphite.archive_cache.size", pmg_archive_cache.size ());
+}
+
+
+// Return an exclusively-held cache entry for the given archive, with its
+// context current for this thread; or NULL if the archive cannot be opened.
+static pmg_archive_entry *
+pmg_archive_checkout (const string & archive, ostream & message)
+{
+    pmg_archive_signature sig;
+    pmg_archive_entry *e;
+
+    // Without a signature a cached entry could never be invalidated, so
+    // such an archive is opened afresh and dropped again on release.
+    bool cacheable_p = (pmg_archive_stat (archive, sig) == 0);
 
-    while (1) {
 #ifdef HAVE_PTHREAD_H
-        pthread_mutex_lock (& q->lock);
+    pthread_mutex_lock (&pmg_archive_cache_lock);
 #endif
-        unsigned my_jobid = q->next_job_nr++;
+    for (list <pmg_archive_entry *>::iterator it = pmg_archive_cache.begin ();
+            it != pmg_archive_cache.end (); it++) {
+        e = *it;
+        if (e->busy_p || e->archive != archive) {
+            continue;
+        }
+        if (! cacheable_p || e->signature != sig) {
+            pmg_archive_destroy (it);
+            pmwebd_stats_add ("graphite.archive_cache.invalidations", 1);
+            break;
+        }
+        if (pmUseContext (e->pmc) < 0) {
+            pmg_archive_destroy (it);
+            break;
+        }
+        e->busy_p = true;
+        pmg_archive_cache.splice (pmg_archive_cache.begin (), pmg_archive_cache, it);
+#ifdef HAVE_PTHREAD_H
+        pthread_mutex_unlock (&pmg_archive_cache_lock);
+#endif
+        pmwebd_stats_add ("graphite.archive_cache.hits", 1);
+        return e;
+    }
 #ifdef HAVE_PTHREAD_H
-        pthread_mutex_unlock (& q->lock);
+    pthread_mutex_unlock (&pmg_archive_cache_lock);
 #endif
+    pmwebd_stats_add ("graphite.archive_cache.misses", 1);
 
-        if ((my_jobid >= q->jobs.size ()) || exit_p) {
-            break;
+    // Open the bad boy, outside the lock: this is the expensive part.
+    int pmc = pmNewContext (PM_CONTEXT_ARCHIVE, archive.c_str ());
+    if (pmc < 0) {
+        // error already noted XXX where?
+        return NULL;
+    }
+
+    e = new pmg_archive_entry;
+    e->archive = archive;
+    e->pmc = pmc;
+    e->busy_p = true;
+    e->cacheable_p = cacheable_p;
+    e->signature = sig;
+    e->rollup.path = pmg_rollup_path (archive);
+    e->rollup.mtime = 0;
+    if (pmGetArchiveLabel (&e->label) < 0) {
+        message << "cannot find archive label";
+        (void) pmDestroyContext (pmc);
+        delete e;
+        return NULL;
+    }
+
+#ifdef HAVE_PTHREAD_H
+    pthread_mutex_lock (&pmg_archive_cache_lock);
+#endif
+    pmg_archive_cache.push_front (e);
+    pmwebd_stats_set ("graphite.archive_cache.size", pmg_archive_cache.size ());
+#ifdef HAVE_PTHREAD_H
+    pthread_mutex_unlock (&pmg_archive_cache_lock);
+#endif
+    return e;
+}
+
+
+// Hand back an entry obtained from pmg_archive_checkout, closing it if it
+// cannot stay cached, then trim the cache down to its -J limit by closing
+// the least recently used idle contexts.
+static void
+pmg_archive_release (pmg_archive_entry *e, bool discard_p)
+{
+#ifdef HAVE_PTHREAD_H
+    pthread_mutex_lock (&pmg_archive_cache_lock);
+#endif
+    e->busy_p = false;
+    if (discard_p || ! e->cacheable_p) {
+        list <pmg_archive_entry *>::iterator it =
+            find (pmg_archive_cache.begin (), pmg_archive_cache.end (), e);
+        if (it != pmg_archive_cache.end ()) {
+            pmg_archive_destroy (it);
+        }
+    }
+
+    list <pmg_archive_entry *>::iterator it = pmg_archive_cache.end ();
+    while (pmg_archive_cache.size () > graphite_cachesize &&
+            it != pmg_archive_cache.begin ()) {
+        it--;
+        if ((*it)->busy_p) {
+            continue;
+        }
+        list <pmg_archive_entry *>::iterator victim = it++;
+        pmg_archive_destroy (victim);
+        pmwebd_stats_add ("graphite.archive_cache.evictions", 1);
+    }
+#ifdef HAVE_PTHREAD_H
+    pthread_mutex_unlock (&pmg_archive_cache_lock);
+#endif
+}
+
+
+// Cached equivalents of pmLookupName / pmLookupDesc / pmLookupInDomArchive
+// for a checked-out entry.  Negative name lookups are cached too, since
+// pmgraphite_fetch_series probes for an instance-less metric name first.
+static int
+pmg_archive_lookup_name (pmg_archive_entry *e, const string & name, pmID *pmid)
+{
+    map <string, pmID>::iterator it = e->pmids.find (name);
+    if (it == e->pmids.end ()) {
+        char *namelist[1];
+        namelist[0] = (char *) name.c_str ();
+        if (pmLookupName (1, namelist, pmid) != 1) {
+            *pmid = PM_ID_NULL;
         }
+        it = e->pmids.insert (make_pair (name, *pmid)).first;
+    }
+    *pmid = it->second;
+    return (*pmid == PM_ID_NULL) ? PM_ERR_NAME : 1;
+}
 
-        (*q->runner) (& q->jobs[my_jobid]);
+static int
+pmg_archive_lookup_desc (pmg_archive_entry *e, pmID pmid, pmDesc *desc)
+{
+    map <pmID, pmDesc>::iterator it = e->descs.find (pmid);
+    if (it == e->descs.end ()) {
+        int sts = pmLookupDesc (pmid, desc);
+        if (sts != 0) {
+            return sts;
+        }
+        it = e->descs.insert (make_pair (pmid, *desc)).first;
     }
+    *desc = it->second;
     return 0;
 }
 
+static int
+pmg_archive_lookup_inst (pmg_archive_entry *e, pmInDom indom, const string & name)
+{
+    pair <pmInDom, string> key = make_pair (indom, name);
+    map <pair <pmInDom, string>, int>::iterator it = e->insts.find (key);
+    if (it == e->insts.end ()) {
+        int inst = pmLookupInDomArchive (indom, (char *) name.c_str ());	// XXX: why not pmLookupInDom?
+        it = e->insts.insert (make_pair (key, inst)).first;
+    }
+    return it->second;
+}
 
 
-// simple contention
-template <class Spec>
-void fetch_series_jobqueue<Spec>::run ()
+// (Re)load the sidecar index if the file changed.  Return false if there
+// is no usable sidecar.
+static bool
+pmg_rollup_load (pmg_rollup & r)
 {
-    // Permute the job queue randomly, to make it less likely that
-    // concurrent threads are processing the same archive.
-    // ... but some experimentaton shows harm rather than benefit.
-    // random_shuffle (this->jobs.begin(), this->jobs.end());
-    // ... plus we'd have to unshuffle before results are collected.
+    struct stat st;
 
-#ifdef HAVE_PTHREAD_H
-    vector<pthread_t> threads;
-    for (unsigned i=0; i<multithread; i++) {
-        pthread_t x;
-        int rc = pthread_create (&x, NULL, & this->thread_main, (void*) this);
-        if (rc == 0) {
-            threads.push_back (x);
+    if (r.path == "" || stat (r.path.c_str (), &st) < 0) {
+        r.mtime = 0;
+        return false;
+    }
+    if (r.mtime == st.st_mtime && r.size == st.st_size) {
+        return true;
+    }
+
+    r.mtime = 0;
+    r.series.clear ();
+    r.levels.clear ();
+    r.offsets.clear ();
+
+    FILE *fp = fopen (r.path.c_str (), "r");
+    if (fp == NULL) {
+        return false;
+    }
+
+    rollup_header_t header;
+    bool ok = (fread (&header, sizeof (header), 1, fp) == 1 &&
+               memcmp (header.magic, ROLLUP_MAGIC, sizeof (header.magic)) == 0);
+    if (ok) {
+        r.end = (int32_t) ntohl (header.end);
+        r.series.resize (ntohl (header.nseries));
+        r.levels.resize (ntohl (header.nlevels));
+        if (r.series.size () > 0) {
+            ok = fread (&r.series[0], sizeof (rollup_series_t), r.series.size (), fp) == r.series.size ();
         }
     }
-#endif
-    // have main thread also have a go
-    (void)this->thread_main (this);
+    if (ok && r.levels.size () > 0) {
+        ok = fread (&r.levels[0], sizeof (rollup_level_t), r.levels.size (), fp) == r.levels.size ();
+    }
+    fclose (fp);
+
+    if (ok) {
+        for (unsigned i = 0; i < r.series.size (); i++) {
+            r.series[i].pmid = ntohl (r.series[i].pmid);
+            r.series[i].inst = ntohl (r.series[i].inst);
+        }
+        off_t offset = sizeof (rollup_header_t) +
+                       r.series.size () * sizeof (rollup_series_t) +
+                       r.levels.size () * sizeof (rollup_level_t);
+        for (unsigned i = 0; i < r.levels.size (); i++) {
+            r.levels[i].bucket = ntohl (r.levels[i].bucket);
+            r.levels[i].first = ntohl (r.levels[i].first);
+            r.levels[i].nbuckets = ntohl (r.levels[i].nbuckets);
+            r.offsets.push_back (offset);
+            offset += (off_t) r.series.size () * r.levels[i].nbuckets * sizeof (rollup_value_t);
+            if (r.levels[i].bucket == 0) {
+                ok = false;
+            }
+        }
+        ok = ok && (offset == st.st_size);
+    }
+    if (! ok) {
+        r.series.clear ();
+        r.levels.clear ();
+        r.offsets.clear ();
+        return false;
+    }
+
+    r.mtime = st.st_mtime;
+    r.size = st.st_size;
+    return true;
+}
+
+
+static bool
+pmg_rollup_series_less (const rollup_series_t & a, const rollup_series_t & b)
+{
+    return (a.pmid != b.pmid) ? (a.pmid < b.pmid) : (a.inst < b.inst);
+}
+
+
+// Answer a fetch_series job from the archive's pmlogrollup(1) sidecar, if
+// there is one that covers the whole archive with a bucket no wider than
+// t_step.  Each point then summarizes the buckets starting within
+// (t - t_step, t]: the latest value for counters (rate-converted later
+// just like interpolated values), else the sample-weighted average.
+// That makes wide-range renders O(buckets) rather than O(records).
+// Return false to have the caller fall back to interpolation.
+static bool
+pmg_rollup_fetch (pmg_archive_entry *e, fetch_series_jobspec *spec,
+                  const vector<pmID> & pmids, const vector<pmDesc> & pmdescs,
+                  const vector<int> & pminsts, const struct timeval & archive_end,
+                  unsigned & entries, unsigned & entries_good, ostream & message)
+{
+    pmg_rollup & r = e->rollup;
+    time_t t_start = spec->t_start;
+    time_t t_end = spec->t_end;
+    time_t t_step = spec->t_step;
+
+    if (! pmg_rollup_load (r) || r.end < archive_end.tv_sec) {
+        return false;		// absent, or stale for a growing archive
+    }
+
+    int level = -1;
+    for (unsigned i = 0; i < r.levels.size (); i++)
+        if ((time_t) r.levels[i].bucket <= t_step) {
+            level = i;
+        }
+    if (level < 0) {
+        return false;
+    }
+
+    FILE *fp = fopen (r.path.c_str (), "r");
+    entries = (t_end - t_start) / t_step + 1;
+    if (fp == NULL) {
+        return false;
+    }
+
+    const rollup_level_t & lv = r.levels[level];
+    time_t bucket = lv.bucket;
+    // range of bucket numbers needed over the whole request, clipped to the sidecar
+    time_t k_min = max ((time_t) ((t_start - t_step) / bucket + 1), (time_t) lv.first);
+    time_t k_max = min ((time_t) (t_end / bucket), (time_t) (lv.first + lv.nbuckets) - 1);
+    vector <rollup_value_t> values;
+
+    for (unsigned i = 0; i < spec->targets.size () && k_min <= k_max; i++) {
+        if (exit_p)
+            break;
+        if (pmids[i] == 0)
+            continue;
+
+        rollup_series_t key;
+        key.pmid = pmids[i];
+        key.inst = pminsts[i];
+        vector <rollup_series_t>::const_iterator it =
+            lower_bound (r.series.begin (), r.series.end (), key, pmg_rollup_series_less);
+        if (it == r.series.end () || it->pmid != key.pmid || it->inst != key.inst) {
+            continue;		// never had a value in this archive; leave the NaNs
+        }
+
+        // supply the pmDesc to caller
+        *(spec->output_descs[i]) = pmdescs[i];
 
+        off_t offset = r.offsets[level] +
+                       ((off_t) (it - r.series.begin ()) * lv.nbuckets + (k_min - lv.first)) *
+                       sizeof (rollup_value_t);
+        values.resize (k_max - k_min + 1);
+        if (fseeko (fp, offset, SEEK_SET) < 0 ||
+                fread (&values[0], sizeof (rollup_value_t), values.size (), fp) != values.size ()) {
+            message << "cannot read rollup " << r.path;
+            break;
+        }
+
+        vector<timestamped_float>& output = *spec->outputs[i];
+        unsigned n = 0;
+        for (time_t t = t_start; t <= t_end; t += t_step, n++) {
+            // We only want values within known time boundaries of the archive.
+            if (t < e->label.ll_start.tv_sec || t > archive_end.tv_sec)
+                continue;
+
+            double sum = 0;
+            unsigned count = 0;
+            float last = 0;
+            time_t k_lo = max ((time_t) ((t - t_step) / bucket + 1), k_min);
+            time_t k_hi = min ((time_t) (t / bucket), k_max);
+            for (time_t k = k_lo; k <= k_hi; k++) {
+                const rollup_value_t & v = values[k - k_min];
+                unsigned c = ntohl (v.count);
+                if (c == 0)
+                    continue;
+                sum += (double) rollup_ntohf (v.avg) * c;
+                count += c;
+                last = rollup_ntohf (v.last);
+            }
+            if (count == 0)
+                continue;
+
+            output[n].what = (pmdescs[i].sem == PM_SEM_COUNTER) ? last : (float) (sum / count);
+            entries_good++;
+        }
+    }
+    fclose (fp);
+
+    if (verbosity > 3) {
+        message << "rollup " << bucket << "s ";
+    }
+    return true;
+}
+
+
+// Close all cached archive contexts, at shutdown.
+void
+pmgraphite_deallocate_all (void)
+{
 #ifdef HAVE_PTHREAD_H
-    for (unsigned i=0; i<threads.size (); i++) {
-        (void) pthread_join (threads[i], NULL);
+    pthread_mutex_lock (&pmg_archive_cache_lock);
+#endif
+    while (! pmg_archive_cache.empty ()) {
+        pmg_archive_destroy (pmg_archive_cache.begin ());
     }
+#ifdef HAVE_PTHREAD_H
+    pthread_mutex_unlock (&pmg_archive_cache_lock);
 #endif
+    pmg_name_index.clear ();
 }
 
 
@@ -824,7 +1434,8 @@ void pmgraphite_fetch_series (fetch_series_jobspec *spec)
     time_t t_step = spec->t_step;
     int sts;
     string last_component;
-    int pmc;
+    pmg_archive_entry *pmae;
+    bool pmae_discard_p = false;
     string archive;
     string archive_part;
     unsigned entries_good = 0, entries;
@@ -845,8 +1456,6 @@ void pmgraphite_fetch_series (fetch_series_jobspec *spec)
 
     // XXX: in future, parse graphite functions-of-metrics
     // http://graphite.readthedocs.org/en/latest/functions.html
-    //
-    // XXX: in future, cache the pmid/pmdesc/inst# -> pcp-context
 
     // -------------------- PART 1 - per-archive processing
 
@@ -863,28 +1472,25 @@ void pmgraphite_fetch_series (fetch_series_jobspec *spec)
         goto out0;
     }
 
-    // Open the bad boy.
-    pmc = pmNewContext (PM_CONTEXT_ARCHIVE, archive.c_str ());
-    if (pmc < 0) {
-        // error already noted XXX where?
+    // Open the bad boy, or reuse an already open context.
+    pmae = pmg_archive_checkout (archive, message);
+    if (pmae == NULL) {
         goto out0;
     }
 
-    // NB: past this point, exit via 'goto out;' to release pmc
+    // NB: past this point, exit via 'goto out;' to release pmae
 
     // Fetch end of archive time boundaries, to avoid having libpcp
     // iterate across vast regions of void.  This would be especially
     // bad if libpcp worries the archive might have grown since last
-    // call, go and do an fstat(2)/lseek(2) every point.
-    sts = pmGetArchiveLabel (& archive_label);
-    if (sts < 0) {
-        message << "cannot find archive label";
-        goto out;
-    }
+    // call, go and do an fstat(2)/lseek(2) every point.  The label is
+    // fixed, but the end is re-read since a cached archive may be live.
+    archive_label = pmae->label;
 
     sts = pmGetArchiveEnd (& archive_end);
     if (sts < 0) {
         message << "cannot find archive end";
+        pmae_discard_p = true;
         goto out;
     }
 
@@ -930,14 +1536,12 @@ void pmgraphite_fetch_series (fetch_series_jobspec *spec)
         }
         last_component = target_tok[target_tok.size () - 1];
 
-        char *namelist[1];
         pmID pmidlist[1]; // fetch here instead of pmids[i], so an early error continue leaves latter zero
-        namelist[0] = (char *) metric_name.c_str ();
-        int sts = pmLookupName (1, namelist, & pmidlist[0]);
+        int sts = pmg_archive_lookup_name (pmae, metric_name, & pmidlist[0]);
 
         if (sts == 1) {
             // found ... last name must be instance domain name
-            sts = pmLookupDesc (pmidlist[0], &pmdescs[j]);
+            sts = pmg_archive_lookup_desc (pmae, pmidlist[0], &pmdescs[j]);
             if (sts != 0) {
                 message << "cannot find metric descriptor " << metric_name;
                 continue;
@@ -950,8 +1554,7 @@ void pmgraphite_fetch_series (fetch_series_jobspec *spec)
             }
             // look up that instance name
             string instance_name = pmgraphite_metric_decode (last_component);
-            int inst = pmLookupInDomArchive (pmdescs[j].indom,
-                                             (char *) instance_name.c_str ());	// XXX: why not pmLookupInDom?
+            int inst = pmg_archive_lookup_inst (pmae, pmdescs[j].indom, instance_name);
             if (inst < 0) {
                 message << "metric " << metric_name << " lacks recognized indom "
                         << last_component;
@@ -964,15 +1567,14 @@ void pmgraphite_fetch_series (fetch_series_jobspec *spec)
         } else {
             // not found ... ok, try again with that last component
             metric_name = metric_name + '.' + last_component;
-            namelist[0] = (char *) metric_name.c_str ();
-            int sts = pmLookupName (1, namelist, pmidlist);
+            int sts = pmg_archive_lookup_name (pmae, metric_name, & pmidlist[0]);
             if (sts != 1) {
                 // still not found .. give up
                 message << "cannot find metric name " << metric_name;
                 continue;
             }
 
-            sts = pmLookupDesc (pmidlist[0], &pmdescs[j]);
+            sts = pmg_archive_lookup_desc (pmae, pmidlist[0], &pmdescs[j]);
             if (sts != 0) {
                 message << "cannot find metric descriptor " << metric_name;
                 continue;
@@ -1023,6 +1625,10 @@ void pmgraphite_fetch_series (fetch_series_jobspec *spec)
             spec->outputs[i]->push_back(x);
         }
 
+    // Coarse renders may be answered from a precomputed rollup instead.
+    if (pmg_rollup_fetch (pmae, spec, pmids, pmdescs, pminsts, archive_end,
+                          entries, entries_good, message))
+        goto rates;
 
     entries = 0; // index in (*outputs[i]) to fill - i.e., a scaled time coordinate
     for (time_t iteration_time = t_start; iteration_time <= t_end; iteration_time += t_step, entries++) {
@@ -1108,6 +1714,7 @@ void pmgraphite_fetch_series (fetch_series_jobspec *spec)
         }
     } // iterate over time
 
+ rates:
     // -------------------- PART 4 - rate-conversion post-processing
     // Rate conversion for COUNTER semantics values; perhaps should be a libpcp feature.
     // XXX: make this optional
@@ -1163,7 +1770,7 @@ void pmgraphite_fetch_series (fetch_series_jobspec *spec)
     }
 
  out:
-    pmDestroyContext (pmc);
+    pmg_archive_release (pmae, pmae_discard_p);
  out0:
     // vector output already returned via jobspec pointer
 
@@ -2449,32 +3056,28 @@ out1:
 /* ------------------------------------------------------------------------ */
 
 
-// Render raw archive data in JSON form.
-int
-pmgraphite_respond_render_json (struct MHD_Connection *connection,
-                                const http_params & params, const vector <string> &url,
-                                bool rawdata_flavour_p)
-{
-    int rc;
-    struct MHD_Response *resp;
-
+// Produce the JSON text of a render/rawdata response, one target at a time.
+struct pmgraphite_render_streamer: public NOTMHD_streamer {
+    bool rawdata_flavour_p;
     vector <string> targets;
+    vector <vector <timestamped_float> > all_results; // indexed as targets[]
     time_t t_start, t_end, t_step;
-    int t_relative_p;
-    rc = pmgraphite_gather_data (connection, params, url, targets, t_start, t_end, t_step, t_relative_p);
-    if (rc) {
-        return mhd_notify_error (connection, rc);
-    }
+    unsigned k;                 // next target to print
 
-    vector <vector <timestamped_float> > all_results; // indexed as targets[]
-    vector <pmDesc> all_result_descs; // indexed as targets[]
-    pmgraphite_fetch_all_series (connection, targets, all_results, all_result_descs, t_start, t_end, t_step);
+    pmgraphite_render_streamer (bool r): rawdata_flavour_p (r), k (0) {}
+    bool next (ostream & output);
+};
 
-    stringstream output;
-    output << "[";
-    for (unsigned k = 0; k < targets.size (); k++) {
+
+bool
+pmgraphite_render_streamer::next (ostream & output)
+{
+    if (k == 0) {
+        output << "[";
+    }
+    if (k < targets.size ()) {
         const string& target = targets[k];
-        const vector<timestamped_float>& results = all_results[k];
+        vector<timestamped_float>& results = all_results[k];
 
         if (k > 0) {
             output << ",";
@@ -2520,13 +3123,51 @@ pmgraphite_respond_render_json (struct MHD_Connection *connection,
             }
             output << "]}";
         }
+
+        // this target's data won't be needed again
+        vector<timestamped_float> ().swap (results);
+        k++;
+    }
+    if (k < targets.size ()) {
+        return true;
     }
     output << "]";
+    return false;
+}
 
-    // wrap it up in mhd response ribbons
-    resp = NOTMHD_compressible_response (connection, output.str());
+
+// Render raw archive data in JSON form.
+int
+pmgraphite_respond_render_json (struct MHD_Connection *connection,
+                                const http_params & params, const vector <string> &url,
+                                bool rawdata_flavour_p)
+{
+    int rc;
+    struct MHD_Response *resp;
+
+    vector <string> targets;
+    time_t t_start, t_end, t_step;
+    int t_relative_p;
+    rc = pmgraphite_gather_data (connection, params, url, targets, t_start, t_end, t_step, t_relative_p);
+    if (rc) {
+        return mhd_notify_error (connection, rc);
+    }
+
+    vector <vector <timestamped_float> > all_results; // indexed as targets[]
+    vector <pmDesc> all_result_descs; // indexed as targets[]
+    pmgraphite_fetch_all_series (connection, targets, all_results, all_result_descs, t_start, t_end, t_step);
+
+    pmgraphite_render_streamer *gen = new pmgraphite_render_streamer (rawdata_flavour_p);
+    gen->targets.swap (targets);
+    gen->all_results.swap (all_results);
+    gen->t_start = t_start;
+    gen->t_end = t_end;
+    gen->t_step = t_step;
+
+    // wrap it up in mhd response ribbons; the JSON is generated as it's sent
+    resp = NOTMHD_streaming_response (connection, gen);
     if (resp == NULL) {
-        connstamp (cerr, connection) << "MHD_create_response_from_buffer failed" << endl;
+        connstamp (cerr, connection) << "MHD_create_response_from_callback failed" << endl;
         rc = -ENOMEM;
         goto out1;
     }
@@ -655,6 +655,125 @@ pmwebapi_format_value (ostream & output, pmDesc * desc, pmValueSet * pvs, int vs
 
 
 
+/* Produce the JSON text of a /_fetch response from its pmResult, a
+   bounded number of instances at a time.  Metric descriptors and names
+   (and any event records, which need more lookups) are resolved up
+   front, since the PMAPI context may not be current, or even still
+   around, by the time MHD gets to sending the rest. */
+struct pmwebapi_fetch_streamer: public NOTMHD_streamer {
+    pmResult *results;
+    vector <bool> print_p;	// indexed as results->vset[]
+    vector <pmDesc> descs;
+    vector <bool> name_p;
+    vector <string> names;
+    vector <string> events;	// pre-formatted event-typed values
+    bool started_p;
+    int i, j;			// next vset[i]->vlist[j] to print
+    bool open_p;		// vset[i] header already printed
+    int printed_metrics;	/* exclude skipped ones */
+
+    pmwebapi_fetch_streamer (pmResult *r);
+    ~pmwebapi_fetch_streamer () { pmFreeResult (results); }
+    bool next (ostream & output);
+};
+
+
+pmwebapi_fetch_streamer::pmwebapi_fetch_streamer (pmResult *r):
+    results (r), print_p (r->numpmid), descs (r->numpmid), name_p (r->numpmid),
+    names (r->numpmid), events (r->numpmid), started_p (false), i (0), j (0),
+    open_p (false), printed_metrics (0)
+{
+    for (int k = 0; k < results->numpmid; k++) {
+        pmValueSet *pvs = results->vset[k];
+        char *metric_name;
+        if (pvs->numval <= 0) {
+            continue;		/* error code; skip metric */
+        }
+        int rc = pmLookupDesc (pvs->pmid, &descs[k]);	/* need to find desc.type only */
+        if (rc < 0) {
+            continue;		/* quietly skip it */
+        }
+        print_p[k] = true;
+
+        rc = pmNameID (pvs->pmid, &metric_name);
+        if (rc == 0) {
+            name_p[k] = true;
+            names[k] = metric_name;
+            free (metric_name);
+        }
+
+        if (descs[k].type == PM_TYPE_EVENT || descs[k].type == PM_TYPE_HIGHRES_EVENT) {
+            ostringstream output;
+            for (int l = 0; l < pvs->numval; l++) {
+                output << "{";
+                json_key_value (output, "instance", pvs->vlist[l].inst, ", ");
+                pmwebapi_format_value (output, &descs[k], pvs, l);
+                output << "}";
+                if (l + 1 < pvs->numval) {
+                    output << ",";
+                }
+            }
+            events[k] = output.str ();
+        }
+    }
+}
+
+
+bool
+pmwebapi_fetch_streamer::next (ostream & output)
+{
+    if (! started_p) {
+        output << "{" << "\"timestamp\":{";
+        json_key_value (output, "s", results->timestamp.tv_sec, ",");
+        json_key_value (output, "us", results->timestamp.tv_usec);
+        output << "}" << ", \"values\":[";
+        started_p = true;
+    }
+
+    int budget = 256;		/* instances per piece */
+    for (; i < results->numpmid; i++, j = 0, open_p = false) {
+        pmValueSet *pvs = results->vset[i];
+        if (! print_p[i]) {
+            continue;
+        }
+        if (! open_p) {
+            open_p = true;
+            if (printed_metrics >= 1) {
+                output << ",\n";
+            }
+
+            output << "{";
+            json_key_value (output, "pmid", pvs->pmid, ",");
+            if (name_p[i]) {
+                json_key_value (output, "name", names[i], ",");
+            }
+            output << "\"instances\":[\n";
+            if (descs[i].type == PM_TYPE_EVENT || descs[i].type == PM_TYPE_HIGHRES_EVENT) {
+                output << events[i];
+                j = pvs->numval;
+            }
+        }
+        for (; j < pvs->numval; j++) {
+            if (budget-- == 0) {
+                return true;	/* resume at this instance */
+            }
+            pmValue *val = &pvs->vlist[j];
+            output << "{";
+            json_key_value (output, "instance", val->inst, ", ");
+            pmwebapi_format_value (output, &descs[i], pvs, j);
+            output << "}";
+            if (j + 1 < pvs->numval) {
+                output << ",";
+            }
+        }
+        output << "]}";		// iteration over instances
+        printed_metrics++;	/* comma separation at beginning of loop */
+    }
+    output << "]}";		// iteration over metrics
+    return false;
+}
+
+
 static int
 pmwebapi_respond_metric_fetch (struct MHD_Connection *connection,
                                const http_params & /*params*/, struct webcontext *c)
@@ -665,11 +784,8 @@ pmwebapi_respond_metric_fetch (struct MHD_Connection *connection,
     int rc = 0;
     int max_num_metrics;
     int num_metrics;
-    ostringstream output;
-    int printed_metrics;		/* exclude skipped ones */
     pmID *metrics;
     pmResult *results;
-    int i;
 
     (void) c;
     val_pmids = MHD_lookup_connection_value (connection, MHD_GET_ARGUMENT_KIND, "pmids");
@@ -751,61 +867,15 @@ pmwebapi_respond_metric_fetch (struct MHD_Connection *connection,
     /* NB: we don't care about the possibility of PMCD_*_AGENT bits
        being set, so rc > 0. */
 
-    output << "{" << "\"timestamp\":{";
-    json_key_value (output, "s", results->timestamp.tv_sec, ",");
-    json_key_value (output, "us", results->timestamp.tv_usec);
-    output << "}" << ", \"values\":[";
-
     assert (results->numpmid == num_metrics);
-    printed_metrics = 0;
-    for (i = 0; i < results->numpmid; i++) {
-        int j;
-        pmValueSet *pvs = results->vset[i];
-        char *metric_name;
-        pmDesc desc;
-        if (pvs->numval <= 0) {
-            continue;		/* error code; skip metric */
-        }
-        rc = pmLookupDesc (pvs->pmid, &desc);	/* need to find desc.type only */
-        if (rc < 0) {
-            continue;		/* quietly skip it */
-        }
-        if (printed_metrics >= 1) {
-            output << ",\n";
-        }
 
-
-        output << "{";
-        json_key_value (output, "pmid", pvs->pmid, ",");
-
-        rc = pmNameID (pvs->pmid, &metric_name);
-        if (rc == 0) {
-            json_key_value (output, "name", string (metric_name), ",");
-            free (metric_name);
-        }
-        output << "\"instances\":[\n";
-        for (j = 0; j < pvs->numval; j++) {
-            pmValue *val = &pvs->vlist[j];
-            output << "{";
-            json_key_value (output, "instance", val->inst, ", ");
-            pmwebapi_format_value (output, &desc, pvs, j);
-            output << "}";
-            if (j + 1 < pvs->numval) {
-                output << ",";
-            }
-        }
-        output << "]}";		// iteration over instances
-        printed_metrics++;	/* comma separation at beginning of loop */
-    }
-    output << "]}";		// iteration over metrics
-    pmFreeResult (results);	/* not needed any more */
-
-    {
-        string s = output.str ();
-        resp = NOTMHD_compressible_response (connection, s);
-    }
+    /* The JSON text is produced piecemeal as MHD sends it, so that
+       large fetches (e.g. proc.* with thousands of processes) need not
+       be held in memory as a whole. */
+    resp = NOTMHD_streaming_response (connection,
+                                      new pmwebapi_fetch_streamer (results));
     if (resp == NULL) {
-        connstamp (cerr, connection) << "MHDB_create_response_from_buffer failed" << endl;
+        connstamp (cerr, connection) << "MHD_create_response_from_callback failed" << endl;
         rc = -ENOMEM;
         goto out;
     }
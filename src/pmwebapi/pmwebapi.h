@@ -55,6 +55,7 @@ extern unsigned multithread;			/* set by -M option */
 extern unsigned graphite_timestep;              /* set by -i option */
 extern unsigned graphite_archivedir;            /* set by -I option */
 extern unsigned graphite_encode;                /* set by -X option */
+extern unsigned graphite_cachesize;             /* set by -J option */
 
 struct http_params: public std::multimap <std::string, std::string> {
     std::string operator [] (const std::string &) const;
@@ -67,6 +68,10 @@ struct http_params: public std::multimap <std::string, std::string> {
 // main.cxx
 extern int
 mhd_notify_error (struct MHD_Connection *connection, int rc);
+extern void
+pmwebd_stats_add (const char *name, double value);
+extern void
+pmwebd_stats_set (const char *name, double value);
 
 // pmwebapi.cxx
 extern int
@@ -89,8 +94,11 @@ pmwebres_respond (struct MHD_Connection *connectio, const http_params &,
 extern int
 pmgraphite_respond (struct MHD_Connection *connection, const http_params &,
                     const std::vector <std::string> &url, const std::string& url0);
+extern void
+pmgraphite_deallocate_all (void);
 #else
 #define pmgraphite_respond(conn,params,url,url0) mhd_notify_error(conn, -EOPNOTSUPP)
+#define pmgraphite_deallocate_all() do { } while (0)
 #endif
 
 // util.cxx
@@ -103,6 +111,18 @@ extern int cursed_path_p (const std::string & blessed, const std::string & quest
 extern void json_quote (std::ostream & o, const std::string & value);
 extern struct MHD_Response *NOTMHD_compressible_response(struct MHD_Connection *connection,
                                                          const std::string& buf);
+/* A generator of a response body, one piece at a time.  next() appends
+   the next piece of output to o, and returns false once that was the
+   last piece. */
+struct NOTMHD_streamer {
+    virtual ~NOTMHD_streamer () {}
+    virtual bool next (std::ostream & o) = 0;
+};
+extern struct MHD_Response *NOTMHD_streaming_response(struct MHD_Connection *connection,
+                                                      NOTMHD_streamer *gen);
+extern void pmwebd_pool_start (unsigned nthreads);
+extern void pmwebd_pool_stop (void);
+extern void pmwebd_pool_run (void (*fn) (void *, unsigned), void *cls, unsigned njobs);
 
 
 // inlined right here
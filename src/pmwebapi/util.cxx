@@ -14,18 +14,15 @@
 
 #define _XOPEN_SOURCE 600
 
-#include "pmapi.h"
-#include "impl.h"
+#include "pmwebapi.h"
 
 #include <iostream>
 #include <sstream>
 #include <vector>
+#include <list>
 
 extern "C"
 {
-#include <sys/stat.h>
-#include <stdarg.h>
-#include <microhttpd.h>
 #ifdef HAVE_ZLIB
 #include <zlib.h>
 #endif
@@ -254,14 +251,9 @@ static void *compress_string(const std::string& input, size_t& output_length)
 
 
 
-/* Create and return MHD_Request with the given string buffer content.
-   Compress it if requested & possible.  Return NULL on error.  */
-struct MHD_Response *NOTMHD_compressible_response(struct MHD_Connection *connection,
-                                                  const std::string& buf)
+/* Did the client request gzip compression? */
+static bool NOTMHD_gzip_accepted_p(struct MHD_Connection *connection)
 {
-    struct MHD_Response* resp = NULL;
-
-    /* Did the client request compression? */
     const char *encodings = MHD_lookup_connection_value (connection,
                                                          MHD_HEADER_KIND,
                                                          MHD_HTTP_HEADER_ACCEPT_ENCODING);
@@ -274,7 +266,18 @@ struct MHD_Response *NOTMHD_compressible_response(struct MHD_Connection *connect
     (void) useragent;
     /* if (strstr (useragent, "Trident/") != NULL) encodings = ""; */ /* ?? disable on MSIE */
 
-    if (strstr (encodings, "gzip") != NULL) {
+    return (strstr (encodings, "gzip") != NULL);
+}
+
+
+/* Create and return MHD_Request with the given string buffer content.
+   Compress it if requested & possible.  Return NULL on error.  */
+struct MHD_Response *NOTMHD_compressible_response(struct MHD_Connection *connection,
+                                                  const std::string& buf)
+{
+    struct MHD_Response* resp = NULL;
+
+    if (NOTMHD_gzip_accepted_p (connection)) {
         size_t heap_buf_len;
         void *heap_buf = compress_string (buf, heap_buf_len);
         if (heap_buf != NULL) {
@@ -300,3 +303,306 @@ struct MHD_Response *NOTMHD_compressible_response(struct MHD_Connection *connect
 
     return resp;
 }
+
+
+
+/* State of one streaming response, owned by MHD from the time the
+   response is created until it calls NOTMHD_streaming_free.  */
+struct NOTMHD_stream {
+    NOTMHD_streamer *gen;
+    bool gen_done_p;		// gen->next() has returned false
+    string chunk;		// latest piece of uncompressed output
+    size_t chunk_used;		// ... of which this much has been consumed
+#if HAVE_ZLIB
+    bool gzip_p;
+    bool gzip_done_p;		// deflate() has returned Z_STREAM_END
+    z_stream zs;
+#endif
+};
+
+
+/* Ensure there is some unconsumed text in s->chunk, unless the generator
+   is exhausted.  Return false in the latter case.  */
+static bool NOTMHD_streaming_refill(NOTMHD_stream *s)
+{
+    while (s->chunk_used == s->chunk.size ()) {
+        if (s->gen_done_p)
+            return false;
+        ostringstream o;
+        s->gen_done_p = ! s->gen->next (o);
+        s->chunk = o.str ();
+        s->chunk_used = 0;
+    }
+    return true;
+}
+
+
+static ssize_t NOTMHD_streaming_read(void *cls, uint64_t /*pos*/, char *buf, size_t max)
+{
+    NOTMHD_stream *s = (NOTMHD_stream *) cls;
+
+    if (exit_p)
+        return MHD_CONTENT_READER_END_WITH_ERROR;
+
+#if HAVE_ZLIB
+    if (s->gzip_p) {
+        if (s->gzip_done_p)
+            return MHD_CONTENT_READER_END_OF_STREAM;
+
+        s->zs.next_out = (Bytef *) buf;
+        s->zs.avail_out = (uInt) max;
+        /* Keep feeding deflate until it fills buf or finishes; returning
+           0 bytes would only have MHD call us straight back. */
+        while (s->zs.avail_out > 0) {
+            bool more_p = NOTMHD_streaming_refill (s);
+            s->zs.next_in = (Bytef *) s->chunk.data () + s->chunk_used;
+            s->zs.avail_in = (uInt) (s->chunk.size () - s->chunk_used);
+            int rc = deflate (&s->zs, more_p ? Z_NO_FLUSH : Z_FINISH);
+            s->chunk_used = s->chunk.size () - s->zs.avail_in;
+            if (rc == Z_STREAM_END) {
+                s->gzip_done_p = true;
+                break;
+            }
+            if (rc != Z_OK && rc != Z_BUF_ERROR)
+                return MHD_CONTENT_READER_END_WITH_ERROR;
+        }
+        return (ssize_t) (max - s->zs.avail_out);
+    }
+#endif
+
+    if (! NOTMHD_streaming_refill (s))
+        return MHD_CONTENT_READER_END_OF_STREAM;
+
+    size_t n = s->chunk.size () - s->chunk_used;
+    if (n > max)
+        n = max;
+    memcpy (buf, s->chunk.data () + s->chunk_used, n);
+    s->chunk_used += n;
+    return (ssize_t) n;
+}
+
+
+static void NOTMHD_streaming_free(void *cls)
+{
+    NOTMHD_stream *s = (NOTMHD_stream *) cls;
+
+#if HAVE_ZLIB
+    if (s->gzip_p)
+        deflateEnd (&s->zs);
+#endif
+    delete s->gen;
+    delete s;
+}
+
+
+/* Create and return an MHD_Response whose body is produced piecewise by
+   the given generator, as MHD sends it out, and gzip-compressed on the
+   fly if requested & possible.  Only one chunk of output is held in
+   memory at a time, so arbitrarily large responses may be sent.  The
+   response takes ownership of gen.  Return NULL on error.  */
+struct MHD_Response *NOTMHD_streaming_response(struct MHD_Connection *connection,
+                                               NOTMHD_streamer *gen)
+{
+    struct MHD_Response* resp;
+    NOTMHD_stream *s = new NOTMHD_stream;
+    s->gen = gen;
+    s->gen_done_p = false;
+    s->chunk_used = 0;
+
+#if HAVE_ZLIB
+    s->gzip_p = false;
+    s->gzip_done_p = false;
+    if (NOTMHD_gzip_accepted_p (connection)) {
+        /* same settings as compress_string() */
+        s->zs.zalloc = (alloc_func) 0;
+        s->zs.zfree = (free_func) 0;
+        s->zs.opaque = (voidpf) 0;
+        int rc = deflateInit2 (&s->zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED,
+                               MAX_WBITS | 16 /*gzip*/,
+                               8 /*DEF_MEM_LEVEL*/, Z_DEFAULT_STRATEGY);
+        s->gzip_p = (rc == Z_OK);
+    }
+#endif
+
+    resp = MHD_create_response_from_callback (MHD_SIZE_UNKNOWN, 32 * 1024,
+                                              &NOTMHD_streaming_read, s,
+                                              &NOTMHD_streaming_free);
+    if (resp == NULL) {
+        NOTMHD_streaming_free (s);
+        return NULL;
+    }
+
+#if HAVE_ZLIB
+    if (s->gzip_p) {
+        int rc = MHD_add_response_header(resp, "Content-Encoding", "gzip");
+        if (rc != MHD_YES) {
+            /* s is gone along with resp; the caller has no way to retry */
+            MHD_destroy_response (resp);
+            return NULL;
+        }
+    }
+#else
+    (void) connection;
+#endif
+
+    return resp;
+}
+
+
+/* ------------------------------------------------------------------------ */
+
+
+/* A long-lived pool of worker threads, sized by -M, shared by everything
+   in pmwebd that can split its work into independent jobs (graphite
+   series fetches, archive enumeration).  A caller submits a batch of jobs
+   and helps run it until all of them are done.  Idle workers take jobs
+   from the pending batches in round-robin order, so one huge render does
+   not starve a concurrent small one. */
+
+struct pool_batch {
+    void (*fn) (void *, unsigned);
+    void *cls;
+    unsigned njobs;
+    unsigned next;      // next job number to hand out
+    unsigned done;      // jobs completed
+};
+
+#ifdef HAVE_PTHREAD_H
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t pool_work = PTHREAD_COND_INITIALIZER;  // new batch, or exit
+static pthread_cond_t pool_done = PTHREAD_COND_INITIALIZER;  // some batch finished
+static list <pool_batch *> pool_batches; // with jobs still to hand out
+static vector <pthread_t> pool_threads;
+static bool pool_exit_p;
+
+
+// Hand out the next job of the batch at the head of the queue, then rotate
+// that batch to the back.  Caller holds pool_lock.
+static pool_batch *
+pool_take (unsigned & job)
+{
+    if (pool_batches.empty ()) {
+        return NULL;
+    }
+    pool_batch *b = pool_batches.front ();
+    pool_batches.pop_front ();
+    job = b->next++;
+    if (b->next < b->njobs) {
+        pool_batches.push_back (b);
+    }
+    return b;
+}
+
+
+// Run one job, then account for it.  Caller holds pool_lock, which is
+// dropped for the duration of the job.
+static void
+pool_run_job (pool_batch *b, unsigned job)
+{
+    pthread_mutex_unlock (&pool_lock);
+    if (! exit_p) {
+        (*b->fn) (b->cls, job);
+    }
+    pthread_mutex_lock (&pool_lock);
+    if (++b->done == b->njobs) {
+        pthread_cond_broadcast (&pool_done);
+    }
+}
+
+
+static void *
+pool_thread_main (void *)
+{
+    pthread_mutex_lock (&pool_lock);
+    while (! pool_exit_p) {
+        unsigned job;
+        pool_batch *b = pool_take (job);
+        if (b == NULL) {
+            pthread_cond_wait (&pool_work, &pool_lock);
+            continue;
+        }
+        pool_run_job (b, job);
+    }
+    pthread_mutex_unlock (&pool_lock);
+    return 0;
+}
+#endif
+
+
+void
+pmwebd_pool_start (unsigned nthreads)
+{
+#ifdef HAVE_PTHREAD_H
+    for (unsigned i = 0; i < nthreads; i++) {
+        pthread_t x;
+        int rc = pthread_create (&x, NULL, &pool_thread_main, NULL);
+        if (rc == 0) {
+            pool_threads.push_back (x);
+        }
+    }
+    pmwebd_stats_set ("pool.threads", pool_threads.size ());
+#else
+    (void) nthreads;
+#endif
+}
+
+
+void
+pmwebd_pool_stop (void)
+{
+#ifdef HAVE_PTHREAD_H
+    pthread_mutex_lock (&pool_lock);
+    pool_exit_p = true;
+    pthread_cond_broadcast (&pool_work);
+    pthread_mutex_unlock (&pool_lock);
+
+    for (unsigned i = 0; i < pool_threads.size (); i++) {
+        (void) pthread_join (pool_threads[i], NULL);
+    }
+    pool_threads.clear ();
+#endif
+}
+
+
+/* Run fn(cls, 0) ... fn(cls, njobs-1), in parallel if the pool has any
+   threads, and return once all have completed.  Jobs are skipped once
+   exit_p is set. */
+void
+pmwebd_pool_run (void (*fn) (void *, unsigned), void *cls, unsigned njobs)
+{
+    if (njobs == 0) {
+        return;
+    }
+    pmwebd_stats_add ("pool.jobs", njobs);
+
+#ifdef HAVE_PTHREAD_H
+    pool_batch b;
+    b.fn = fn;
+    b.cls = cls;
+    b.njobs = njobs;
+    b.next = 0;
+    b.done = 0;
+
+    pthread_mutex_lock (&pool_lock);
+    if (njobs > 1 && ! pool_threads.empty ()) {
+        pool_batches.push_back (&b);
+        pthread_cond_broadcast (&pool_work);
+    }
+    // have the calling thread also have a go at its own batch
+    while (b.next < b.njobs) {
+        unsigned job = b.next++;
+        if (b.next == b.njobs) {
+            pool_batches.remove (&b);
+        }
+        pool_run_job (&b, job);
+    }
+    while (b.done < b.njobs) {
+        pthread_cond_wait (&pool_done, &pool_lock);
+    }
+    pthread_mutex_unlock (&pool_lock);
+#else
+    for (unsigned i = 0; i < njobs && ! exit_p; i++) {
+        (*fn) (cls, i);
+    }
+#endif
+}